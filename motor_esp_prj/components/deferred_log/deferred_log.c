@@ -0,0 +1,548 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <inttypes.h>
+#include <stdatomic.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_memory_utils.h"
+#include "esp_console.h"
+#include "argtable3/argtable3.h"
+
+#include "deferred_log.h"
+#include "sys_monitor.h"
+
+static const char *TAG = "deferred_log";
+
+#define LOG_RING_SLOTS 64  // power of two, head and tail run freely and wrap with uint32_t
+#define LOG_ARGS_MAX 8     // "I (time) tag: " takes two of them
+#define LOG_TEXT_MAX 32    // copies of %s arguments that live in RAM
+#define LOG_SPEC_MAX 16    // longest conversion spec, e.g. "%-08.3lx"
+#define LOG_LINE_MAX 256
+#define LOG_BENCH_CALLS 16
+#define LOG_ARG_TEXT (1ull << 32) // %s copied into the slot, the low bits are its offset in text
+
+typedef enum
+{
+    LOG_ARG_NONE = 0, // "%%"
+    LOG_ARG_INT,
+    LOG_ARG_LONG,
+    LOG_ARG_LLONG,
+    LOG_ARG_DOUBLE,
+    LOG_ARG_PTR,
+    LOG_ARG_STR,
+    LOG_ARG_BAD, // not captured, the message is printed in the caller
+} log_arg_t;
+
+typedef struct
+{
+    const char *start; // the '%'
+    const char *end;   // one past the conversion character
+    uint32_t stars;    // '*' width / precision, an int argument each, ahead of the value
+    log_arg_t type;
+} log_spec_t;
+
+typedef struct
+{
+    const char *fmt;
+    atomic_uchar ready; // written by the producer that reserved the slot, cleared by the printer
+    uint8_t nargs;
+    uint8_t text_len;
+    uint64_t args[LOG_ARGS_MAX];
+    char text[LOG_TEXT_MAX];
+} log_slot_t;
+
+// multi producer, single consumer: producers reserve a slot by CAS on head, the printer frees it by
+// moving tail, no lock is taken on the logging path
+static log_slot_t log_ring[LOG_RING_SLOTS];
+static atomic_uint log_head;
+static atomic_uint log_tail;
+static atomic_uint log_dropped;
+static atomic_bool log_sleeping; // set by the printer before it waits on an empty ring
+static volatile bool log_async = true;
+static vprintf_like_t log_vprintf_orig = vprintf;
+
+TaskHandle_t task_log_handle;
+#define task_log_stackdepth 1024 * 3
+static StackType_t task_log_stack[task_log_stackdepth];
+static StaticTask_t task_log_tcb;
+#define task_log_priority 1
+#define task_log_core 1 // console core, motion runs on the other one
+
+// next conversion at or after p, false when none is left
+static bool log_spec_next(const char *p, log_spec_t *spec)
+{
+    char length = 0;
+
+    p = strchr(p, '%');
+    if (p == NULL)
+    {
+        return false;
+    }
+    spec->start = p++;
+    spec->stars = 0;
+
+    while (*p && strchr("-+ #0", *p))
+    {
+        p++;
+    }
+    // width, then precision
+    for (int field = 0; field < 2; field++)
+    {
+        if (field == 1)
+        {
+            if (*p != '.')
+                break;
+            p++;
+        }
+        if (*p == '*')
+        {
+            spec->stars++;
+            p++;
+        }
+        while (*p >= '0' && *p <= '9')
+        {
+            p++;
+        }
+    }
+    while (*p && strchr("hlLqjzt", *p))
+    {
+        // h and hh promote to int, ll / q / j are 64-bit, z and t are 32-bit here
+        length = (*p == 'l' && length == 'l') || *p == 'q' || *p == 'j' ? 'q' : (*p == 'h' || *p == 'z' || *p == 't' ? length : *p);
+        p++;
+    }
+
+    switch (*p)
+    {
+    case '%':
+        spec->type = LOG_ARG_NONE;
+        break;
+    case 'd':
+    case 'i':
+    case 'u':
+    case 'x':
+    case 'X':
+    case 'o':
+    case 'c':
+        spec->type = length == 'q' ? LOG_ARG_LLONG : (length == 'l' ? LOG_ARG_LONG : LOG_ARG_INT);
+        break;
+    case 'f':
+    case 'F':
+    case 'e':
+    case 'E':
+    case 'g':
+    case 'G':
+    case 'a':
+    case 'A':
+        spec->type = length == 'L' ? LOG_ARG_BAD : LOG_ARG_DOUBLE;
+        break;
+    case 'p':
+        spec->type = LOG_ARG_PTR;
+        break;
+    case 's':
+        spec->type = length == 'l' ? LOG_ARG_BAD : LOG_ARG_STR;
+        break;
+    default:
+        spec->type = LOG_ARG_BAD;
+        break;
+    }
+    spec->end = *p ? p + 1 : p;
+    if (spec->end - spec->start > LOG_SPEC_MAX)
+    {
+        spec->type = LOG_ARG_BAD;
+    }
+    return true;
+}
+
+static int log_print(const char *fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    int ret = log_vprintf_orig(fmt, ap);
+    va_end(ap);
+    return ret;
+}
+
+// walk the format once and take the raw arguments, false when something can't be captured
+static bool log_capture(log_slot_t *rec, const char *fmt, va_list ap)
+{
+    log_spec_t spec;
+    const char *p = fmt;
+
+    rec->fmt = fmt;
+    rec->nargs = 0;
+    rec->text_len = 0;
+    while (log_spec_next(p, &spec))
+    {
+        p = spec.end;
+        if (spec.type == LOG_ARG_BAD || rec->nargs + spec.stars + (spec.type != LOG_ARG_NONE) > LOG_ARGS_MAX)
+        {
+            return false;
+        }
+        for (uint32_t i = 0; i < spec.stars; i++)
+        {
+            rec->args[rec->nargs++] = (int64_t)va_arg(ap, int);
+        }
+
+        uint64_t *arg = &rec->args[rec->nargs];
+        switch (spec.type)
+        {
+        case LOG_ARG_INT:
+            *arg = (int64_t)va_arg(ap, int);
+            break;
+        case LOG_ARG_LONG:
+            *arg = (int64_t)va_arg(ap, long);
+            break;
+        case LOG_ARG_LLONG:
+            *arg = (uint64_t)va_arg(ap, long long);
+            break;
+        case LOG_ARG_DOUBLE:
+        {
+            double value = va_arg(ap, double);
+            memcpy(arg, &value, sizeof(value));
+            break;
+        }
+        case LOG_ARG_PTR:
+            *arg = (uintptr_t)va_arg(ap, void *);
+            break;
+        case LOG_ARG_STR:
+        {
+            // strings in flash outlive the message, anything else may be gone by the time it prints
+            const char *str = va_arg(ap, const char *);
+            if (str == NULL || esp_ptr_in_drom(str))
+            {
+                *arg = (uintptr_t)str;
+            }
+            else if (rec->text_len >= LOG_TEXT_MAX)
+            {
+                *arg = (uintptr_t) "";
+            }
+            else
+            {
+                // truncated to what is left of the text area
+                size_t len = strnlen(str, LOG_TEXT_MAX - rec->text_len - 1);
+                memcpy(&rec->text[rec->text_len], str, len);
+                rec->text[rec->text_len + len] = '\0';
+                *arg = LOG_ARG_TEXT | rec->text_len;
+                rec->text_len += len + 1;
+            }
+            break;
+        }
+        default:
+            continue;
+        }
+        rec->nargs++;
+    }
+    return true;
+}
+
+static int log_vprintf(const char *fmt, va_list ap)
+{
+    log_slot_t rec;
+    va_list args;
+
+    // a format built at run time may not be there any more when the printer gets to it
+    if (!log_async || !esp_ptr_in_drom(fmt))
+    {
+        return log_vprintf_orig(fmt, ap);
+    }
+    va_copy(args, ap);
+    bool captured = log_capture(&rec, fmt, args);
+    va_end(args);
+    if (!captured)
+    {
+        return log_vprintf_orig(fmt, ap);
+    }
+
+    uint32_t tail;
+    uint32_t head = atomic_load_explicit(&log_head, memory_order_relaxed);
+    do
+    {
+        tail = atomic_load_explicit(&log_tail, memory_order_acquire);
+        if (head - tail >= LOG_RING_SLOTS)
+        {
+            atomic_fetch_add_explicit(&log_dropped, 1, memory_order_relaxed);
+            return 0;
+        }
+    } while (!atomic_compare_exchange_weak_explicit(&log_head, &head, head + 1, memory_order_acq_rel, memory_order_relaxed));
+
+    log_slot_t *slot = &log_ring[head % LOG_RING_SLOTS];
+    slot->fmt = rec.fmt;
+    slot->nargs = rec.nargs;
+    slot->text_len = rec.text_len;
+    memcpy(slot->args, rec.args, rec.nargs * sizeof(rec.args[0]));
+    memcpy(slot->text, rec.text, rec.text_len);
+    atomic_store_explicit(&slot->ready, 1, memory_order_release);
+
+    // head is published before the flag is read, a printer that missed the message has the flag set
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_exchange_explicit(&log_sleeping, false, memory_order_relaxed))
+    {
+        if (xPortInIsrContext())
+        {
+            vTaskNotifyGiveFromISR(task_log_handle, NULL);
+        }
+        else
+        {
+            xTaskNotifyGive(task_log_handle);
+        }
+    }
+    return 0;
+}
+
+// format a captured message one conversion at a time, with the argument types it was captured with
+static void log_format(const log_slot_t *slot, char *line, size_t size)
+{
+    char spec_buf[LOG_SPEC_MAX + 2 * 12];
+    const char *p = slot->fmt;
+    uint32_t arg = 0;
+    size_t len = 0;
+    log_spec_t spec;
+
+    line[0] = '\0';
+    for (;;)
+    {
+        bool more = log_spec_next(p, &spec);
+        const char *literal_end = more ? spec.start : p + strlen(p);
+        size_t literal = literal_end - p;
+        if (len + literal >= size)
+        {
+            literal = size - 1 - len;
+        }
+        memcpy(&line[len], p, literal);
+        len += literal;
+        line[len] = '\0';
+        if (!more)
+        {
+            break;
+        }
+        p = spec.end;
+
+        // stars are replaced by the widths they were captured with
+        size_t spec_len = 0;
+        for (const char *s = spec.start; s < spec.end; s++)
+        {
+            if (*s == '*')
+            {
+                spec_len += snprintf(&spec_buf[spec_len], sizeof(spec_buf) - spec_len, "%d", (int)slot->args[arg++]);
+            }
+            else
+            {
+                spec_buf[spec_len++] = *s;
+            }
+        }
+        spec_buf[spec_len] = '\0';
+
+        uint64_t value = spec.type == LOG_ARG_NONE ? 0 : slot->args[arg++];
+        char *out = &line[len];
+        size_t room = size - len;
+        int n = 0;
+        switch (spec.type)
+        {
+        case LOG_ARG_NONE:
+            n = snprintf(out, room, "%%");
+            break;
+        case LOG_ARG_INT:
+            n = snprintf(out, room, spec_buf, (int)value);
+            break;
+        case LOG_ARG_LONG:
+            n = snprintf(out, room, spec_buf, (long)value);
+            break;
+        case LOG_ARG_LLONG:
+            n = snprintf(out, room, spec_buf, (long long)value);
+            break;
+        case LOG_ARG_DOUBLE:
+        {
+            double d;
+            memcpy(&d, &value, sizeof(d));
+            n = snprintf(out, room, spec_buf, d);
+            break;
+        }
+        case LOG_ARG_PTR:
+            n = snprintf(out, room, spec_buf, (void *)(uintptr_t)value);
+            break;
+        case LOG_ARG_STR:
+        {
+            const char *str = value & LOG_ARG_TEXT ? &slot->text[(uint32_t)value] : (const char *)(uintptr_t)value;
+            n = snprintf(out, room, spec_buf, str);
+            break;
+        }
+        default:
+            break;
+        }
+        len += (n < 0) ? 0 : ((size_t)n >= room ? room - 1 : (size_t)n);
+    }
+}
+
+static void task_log_handler(void *Param)
+{
+    static char line[LOG_LINE_MAX];
+    uint32_t reported = 0;
+
+    for (;;)
+    {
+        uint32_t tail = atomic_load_explicit(&log_tail, memory_order_relaxed);
+        uint32_t head = atomic_load_explicit(&log_head, memory_order_acquire);
+        if (tail == head)
+        {
+            // say so before looking again, a producer either sees the flag or its message is seen here
+            atomic_store_explicit(&log_sleeping, true, memory_order_seq_cst);
+            if (atomic_load_explicit(&log_head, memory_order_seq_cst) == tail)
+            {
+                ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            }
+            atomic_store_explicit(&log_sleeping, false, memory_order_relaxed);
+            continue;
+        }
+
+        log_slot_t *slot = &log_ring[tail % LOG_RING_SLOTS];
+        if (!atomic_load_explicit(&slot->ready, memory_order_acquire))
+        {
+            // reserved but its producer hasn't finished copying, it doesn't notify again
+            ulTaskNotifyTake(pdTRUE, 1);
+            continue;
+        }
+        log_format(slot, line, sizeof(line));
+        atomic_store_explicit(&slot->ready, 0, memory_order_relaxed);
+        atomic_store_explicit(&log_tail, tail + 1, memory_order_release);
+
+        // the slot is free again before the slow part
+        log_print("%s", line);
+
+        uint32_t dropped = atomic_load_explicit(&log_dropped, memory_order_relaxed);
+        if (dropped != reported)
+        {
+            log_print("W (%" PRIu32 ") %s: %" PRIu32 " messages dropped\n", esp_log_timestamp(), TAG, dropped - reported);
+            reported = dropped;
+        }
+    }
+}
+
+uint32_t deferred_log_dropped(void)
+{
+    return atomic_load_explicit(&log_dropped, memory_order_relaxed);
+}
+
+void deferred_log_set_async(bool async)
+{
+    log_async = async;
+}
+
+void deferred_log_activate(void)
+{
+    task_log_handle = xTaskCreateStaticPinnedToCore(task_log_handler,
+                                                    "task_log_handler",
+                                                    task_log_stackdepth,
+                                                    NULL,
+                                                    task_log_priority,
+                                                    task_log_stack,
+                                                    &task_log_tcb,
+                                                    task_log_core);
+    sys_task_register(task_log_handle, task_log_stackdepth);
+
+    log_vprintf_orig = esp_log_set_vprintf(log_vprintf);
+    ESP_LOGI(TAG, "deferred logging, %d slots", LOG_RING_SLOTS);
+}
+
+/*************************************************/
+// command tools:
+
+static struct
+{
+    struct arg_str *mode;
+    struct arg_lit *bench;
+    struct arg_end *end;
+} log_args;
+
+// average and worst ESP_LOGI call time, in us
+static void log_bench(bool async, uint32_t *avg_us, uint32_t *max_us)
+{
+    int64_t total = 0;
+    int64_t worst = 0;
+
+    deferred_log_set_async(async);
+    for (int i = 0; i < LOG_BENCH_CALLS; i++)
+    {
+        int64_t start = esp_timer_get_time();
+        ESP_LOGI(TAG, "bench %d/%d %s", i + 1, LOG_BENCH_CALLS, async ? "async" : "sync");
+        int64_t spent = esp_timer_get_time() - start;
+        total += spent;
+        if (spent > worst)
+        {
+            worst = spent;
+        }
+    }
+    *avg_us = total / LOG_BENCH_CALLS;
+    *max_us = worst;
+}
+
+static int do_log_cmd(int argc, char **argv)
+{
+    int nerrors = arg_parse(argc, argv, (void **)&log_args);
+    if (nerrors != 0)
+    {
+        arg_print_errors(stderr, log_args.end, argv[0]);
+        return 0;
+    }
+
+    if (log_args.mode->count)
+    {
+        if (strcmp(log_args.mode->sval[0], "async") == 0)
+        {
+            deferred_log_set_async(true);
+        }
+        else if (strcmp(log_args.mode->sval[0], "sync") == 0)
+        {
+            deferred_log_set_async(false);
+        }
+        else
+        {
+            printf("mode is sync or async\n");
+            return 0;
+        }
+    }
+
+    if (log_args.bench->count)
+    {
+        bool async = log_async;
+        uint32_t sync_avg, sync_max, async_avg, async_max;
+
+        log_bench(false, &sync_avg, &sync_max);
+        log_bench(true, &async_avg, &async_max);
+        deferred_log_set_async(async);
+        // let the printer drain the async half before the table
+        vTaskDelay(pdMS_TO_TICKS(100));
+        printf("%-6s %8s %8s\n", "mode", "avg us", "max us");
+        printf("%-6s %8" PRIu32 " %8" PRIu32 "\n", "sync", sync_avg, sync_max);
+        printf("%-6s %8" PRIu32 " %8" PRIu32 "\n", "async", async_avg, async_max);
+        return 0;
+    }
+
+    uint32_t head = atomic_load(&log_head);
+    uint32_t tail = atomic_load(&log_tail);
+    printf("mode %s, ring %" PRIu32 "/%d, captured %" PRIu32 ", dropped %" PRIu32 "\n",
+           log_async ? "async" : "sync", head - tail, LOG_RING_SLOTS, head, deferred_log_dropped());
+    return 0;
+}
+
+static void register_log(void)
+{
+    log_args.mode = arg_str0("m", "mode", "<sync|async>", "Print in the caller, or defer to the log task");
+    log_args.bench = arg_lit0("b", "bench", "Time ESP_LOGI calls in both modes");
+    log_args.end = arg_end(2);
+    const esp_console_cmd_t log_cmd = {
+        .command = "log",
+        .help = "Deferred logging status, mode and benchmark",
+        .hint = NULL,
+        .func = &do_log_cmd,
+        .argtable = &log_args};
+    ESP_ERROR_CHECK(esp_console_cmd_register(&log_cmd));
+}
+
+void register_logtools(void)
+{
+    register_log();
+}
@@ -0,0 +1,16 @@
+#ifndef _DEFERRED_LOG_H_
+#define _DEFERRED_LOG_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// ESP_LOGx calls only capture the format pointer and raw arguments into a ring, a low priority
+// task on the console core formats and prints them
+void deferred_log_activate(void);
+// messages lost to a full ring since boot
+uint32_t deferred_log_dropped(void);
+// false: every call formats and prints in the caller again, e.g. to see logs right before a crash
+void deferred_log_set_async(bool async);
+void register_logtools(void);
+
+#endif
@@ -1,10 +1,13 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include "freertos/queue.h"
 #include "esp_log.h"
+#include "esp_attr.h"
 #include "driver/pulse_cnt.h"
 #include "driver/gpio.h"
-#include "stepper_app.h"
+#include "ec11_encoder.h"
+#include "idle_manager.h"
+#include "sys_monitor.h"
+#include "teach_replay.h"
 
 static const char *TAG = "ec11 encoder";
 
@@ -14,206 +17,247 @@ static const char *TAG = "ec11 encoder";
 #define EC11_GPIO_Y_B GPIO_NUM_13
 #define EC11_GPIO_Z_A GPIO_NUM_14
 #define EC11_GPIO_Z_B GPIO_NUM_17
+#define EC11_GPIO_FEED_A GPIO_NUM_1
+#define EC11_GPIO_FEED_B GPIO_NUM_2
 
 #define EC11_GLITCH_ns 1000
 
-#define EC11_COUNT_HIGH_LIMIT 100
-#define EC11_COUNT_LOW_LIMIT -100
-
-pcnt_unit_handle_t pcnt_uint_X = NULL;
-pcnt_unit_handle_t pcnt_uint_Y = NULL;
-pcnt_unit_handle_t pcnt_uint_Z = NULL;
-QueueHandle_t pcnt_X_watch_event_queue = NULL;
-QueueHandle_t pcnt_Y_watch_event_queue = NULL;
-QueueHandle_t pcnt_Z_watch_event_queue = NULL;
-extern QueueHandle_t step_X_queue;
-extern QueueHandle_t step_Y_queue;
-extern QueueHandle_t step_Z_queue;
-
-TaskHandle_t task_ec11_handle;
-#define task_ec11_stackdepth 1024 * 2
-#define task_ec11_priority 1
-
-// watch point X
-static bool ec11_pcnt_X_on_reach(pcnt_unit_handle_t unit, const pcnt_watch_event_data_t *edata, void *user_ctx)
+// the unit clears itself at either limit, the watch point ISR folds the limit into the 64-bit position
+#define EC11_COUNT_HIGH_LIMIT 10000
+#define EC11_COUNT_LOW_LIMIT -10000
+
+typedef struct
+{
+    pcnt_unit_handle_t unit;
+    gpio_num_t gpio_a;
+    gpio_num_t gpio_b;
+    teach_axis_t teach_axis; // TEACH_AXIS_MAX: not recorded
+    portMUX_TYPE lock;
+    int64_t accum;    // counts of finished hardware wraps, written by the ISR
+    int64_t position; // accum + live count, in quadrature counts
+    int64_t taken;    // counts handed to motion, axis knobs
+    int64_t detent;   // last detent handed to motion, the feed knob
+} ec11_knob_t;
+
+static ec11_knob_t ec11_knobs[EC11_KNOB_MAX] = {
+    [EC11_KNOB_X] = {
+        .gpio_a = EC11_GPIO_X_A,
+        .gpio_b = EC11_GPIO_X_B,
+        .teach_axis = TEACH_AXIS_X,
+        .lock = portMUX_INITIALIZER_UNLOCKED,
+    },
+    [EC11_KNOB_Y] = {
+        .gpio_a = EC11_GPIO_Y_A,
+        .gpio_b = EC11_GPIO_Y_B,
+        .teach_axis = TEACH_AXIS_Y,
+        .lock = portMUX_INITIALIZER_UNLOCKED,
+    },
+    [EC11_KNOB_Z] = {
+        .gpio_a = EC11_GPIO_Z_A,
+        .gpio_b = EC11_GPIO_Z_B,
+        .teach_axis = TEACH_AXIS_Z,
+        .lock = portMUX_INITIALIZER_UNLOCKED,
+    },
+#if EC11_FEED_KNOB
+    [EC11_KNOB_FEED] = {
+        .gpio_a = EC11_GPIO_FEED_A,
+        .gpio_b = EC11_GPIO_FEED_B,
+        .teach_axis = TEACH_AXIS_MAX, // a replay runs at whatever feed is set then
+        .lock = portMUX_INITIALIZER_UNLOCKED,
+    },
+#endif
+};
+
+// the task that takes the detents, see ec11_set_notify
+static TaskHandle_t ec11_notify_task = NULL;
+static uint32_t ec11_notify_bits = 0;
+
+// watch point at either limit, the counter has just been cleared by hardware
+static bool IRAM_ATTR ec11_pcnt_on_reach(pcnt_unit_handle_t unit, const pcnt_watch_event_data_t *edata, void *user_ctx)
 {
-    int watch_dat = edata->watch_point_value;
-    QueueHandle_t queue = (QueueHandle_t)user_ctx;
-    // send event data to pcnt_X_watch_event_queue, from this interrupt callback
-    xQueueSendFromISR(queue, &watch_dat, NULL);
-    return pdTRUE;
+    uint32_t isr_start = sys_isr_enter();
+    ec11_knob_t *knob = (ec11_knob_t *)user_ctx;
+    BaseType_t woken = pdFALSE;
+
+    portENTER_CRITICAL_ISR(&knob->lock);
+    knob->accum += edata->watch_point_value;
+    portEXIT_CRITICAL_ISR(&knob->lock);
+    if (ec11_notify_task)
+    {
+        xTaskNotifyFromISR(ec11_notify_task, ec11_notify_bits, eSetBits, &woken);
+    }
+    sys_isr_exit(SYS_ISR_PCNT_WATCH, isr_start);
+    return woken == pdTRUE;
 }
 
-// watch point Y
-static bool ec11_pcnt_Y_on_reach(pcnt_unit_handle_t unit, const pcnt_watch_event_data_t *edata, void *user_ctx)
+static int64_t ec11_read_position(ec11_knob_t *knob)
 {
-    int watch_dat = edata->watch_point_value;
-    QueueHandle_t queue = (QueueHandle_t)user_ctx;
-    // send event data to pcnt_X_watch_event_queue, from this interrupt callback
-    xQueueSendFromISR(queue, &watch_dat, NULL);
-    return pdTRUE;
+    int count;
+    int64_t position;
+
+    portENTER_CRITICAL(&knob->lock);
+    pcnt_unit_get_count(knob->unit, &count);
+    position = knob->accum + count;
+    portEXIT_CRITICAL(&knob->lock);
+
+    // a wrap whose interrupt is still pending reads as a jump of a whole limit, nothing real
+    // moves half a limit between two polls
+    if (position - knob->position < EC11_COUNT_LOW_LIMIT / 2)
+    {
+        position += EC11_COUNT_HIGH_LIMIT;
+    }
+    else if (position - knob->position > EC11_COUNT_HIGH_LIMIT / 2)
+    {
+        position += EC11_COUNT_LOW_LIMIT;
+    }
+
+    return position;
 }
 
-// watch point Z
-static bool ec11_pcnt_Z_on_reach(pcnt_unit_handle_t unit, const pcnt_watch_event_data_t *edata, void *user_ctx)
+// nearest detent, so a knob resting on a detent can't dither across a boundary
+static inline int64_t ec11_detent_of(int64_t position)
 {
-    int watch_dat = edata->watch_point_value;
-    QueueHandle_t queue = (QueueHandle_t)user_ctx;
-    // send event data to pcnt_X_watch_event_queue, from this interrupt callback
-    xQueueSendFromISR(queue, &watch_dat, NULL);
-    return pdTRUE;
+    int64_t shifted = position + EC11_COUNTS_PER_DETENT / 2;
+    int64_t detent = shifted / EC11_COUNTS_PER_DETENT;
+
+    if (shifted % EC11_COUNTS_PER_DETENT < 0)
+    {
+        detent--;
+    }
+    return detent;
 }
 
-static void task_ec11_handler(void *Param)
+int64_t ec11_get_position(ec11_knob_id_t knob)
 {
-    static int circute_count_X = 0, step_count_X = 0;
-    static int circute_count_Y = 0, step_count_Y = 0;
-    static int circute_count_Z = 0, step_count_Z = 0;
+    int64_t position;
 
-    static int step_sum_X = 0, step_sum_last_X = 0;
-    static int step_sum_Y = 0, step_sum_last_Y = 0;
-    static int step_sum_Z = 0, step_sum_last_Z = 0;
+    portENTER_CRITICAL(&ec11_knobs[knob].lock);
+    position = ec11_knobs[knob].position;
+    portEXIT_CRITICAL(&ec11_knobs[knob].lock);
 
-    static int event_count_X = 0;
-    static int event_count_Y = 0;
-    static int event_count_Z = 0;
+    return position;
+}
 
-    for (;;)
+void ec11_poll(void)
+{
+    for (int i = 0; i < EC11_KNOB_MAX; i++)
     {
-        // X channel
-        if (xQueueReceive(pcnt_X_watch_event_queue, &event_count_X, 0))
-        {
-            circute_count_X += event_count_X;
-        }
-        ESP_ERROR_CHECK(pcnt_unit_get_count(pcnt_uint_X, &step_count_X));
-        step_sum_X = circute_count_X + step_count_X;
-        if (step_sum_X != step_sum_last_X)
-        {
-            int step_sub_X = step_sum_X - step_sum_last_X;
-            xQueueSend(step_X_queue, &step_sub_X, 0);
-            step_sum_last_X = step_sum_X;
-        }
+        ec11_knob_t *knob = &ec11_knobs[i];
+        int64_t position = ec11_read_position(knob);
 
-        // Y channel
-        if (xQueueReceive(pcnt_Y_watch_event_queue, &event_count_Y, 0))
-        {
-            circute_count_Y += event_count_Y;
-        }
-        ESP_ERROR_CHECK(pcnt_unit_get_count(pcnt_uint_Y, &step_count_Y));
-        step_sum_Y = circute_count_Y + step_count_Y;
-        if (step_sum_Y != step_sum_last_Y)
-        {
-            int step_sub_Y = step_sum_Y - step_sum_last_Y;
-            xQueueSend(step_Y_queue, &step_sub_Y, 0);
-            step_sum_last_Y = step_sum_Y;
-        }
+        portENTER_CRITICAL(&knob->lock);
+        knob->position = position;
+        portEXIT_CRITICAL(&knob->lock);
+    }
+}
 
-        // Z channel
-        if (xQueueReceive(pcnt_Z_watch_event_queue, &event_count_Z, 0))
-        {
-            circute_count_Z += event_count_Z;
-        }
-        ESP_ERROR_CHECK(pcnt_unit_get_count(pcnt_uint_Z, &step_count_Z));
-        step_sum_Z = circute_count_Z + step_count_Z;
-        if (step_sum_Z != step_sum_last_Z)
+int ec11_take_counts(ec11_knob_id_t id)
+{
+    ec11_knob_t *knob = &ec11_knobs[id];
+
+    // every count goes to motion, a jog follows the knob between detents too
+    int step_sub = knob->position - knob->taken;
+    if (step_sub)
+    {
+        if (knob->teach_axis < TEACH_AXIS_MAX)
         {
-            int step_sub_Z = step_sum_Z - step_sum_last_Z;
-            xQueueSend(step_Z_queue, &step_sub_Z, 0);
-            step_sum_last_Z = step_sum_Z;
+            teach_record_step(knob->teach_axis, step_sub);
         }
-        vTaskDelay(10 / portTICK_PERIOD_MS);
+        knob->taken = knob->position;
+    }
+    return step_sub;
+}
+
+int ec11_take_detents(ec11_knob_id_t id)
+{
+    ec11_knob_t *knob = &ec11_knobs[id];
+
+    // whole detents only, the counts in between stay in the position
+    int64_t detent = ec11_detent_of(knob->position);
+    int step_sub = detent - knob->detent;
+    knob->detent = detent;
+    return step_sub;
+}
+
+// the glitch filter holds an APB lock, so the units are stopped to let the chip sleep
+static void ec11_idle_suspend(void *arg)
+{
+    for (int i = 0; i < EC11_KNOB_MAX; i++)
+    {
+        ESP_ERROR_CHECK(pcnt_unit_stop(ec11_knobs[i].unit));
+        ESP_ERROR_CHECK(pcnt_unit_disable(ec11_knobs[i].unit));
+    }
+}
+
+static void ec11_idle_resume(void *arg)
+{
+    for (int i = 0; i < EC11_KNOB_MAX; i++)
+    {
+        ESP_ERROR_CHECK(pcnt_unit_enable(ec11_knobs[i].unit));
+        ESP_ERROR_CHECK(pcnt_unit_start(ec11_knobs[i].unit));
     }
 }
 
 void ec11_activate(void)
 {
-    // ESP_LOGI(TAG, "install pcnt unit");
     pcnt_unit_config_t unit_config = {
         .high_limit = EC11_COUNT_HIGH_LIMIT,
         .low_limit = EC11_COUNT_LOW_LIMIT,
     };
-
-    ESP_ERROR_CHECK(pcnt_new_unit(&unit_config, &pcnt_uint_X));
-    ESP_ERROR_CHECK(pcnt_new_unit(&unit_config, &pcnt_uint_Y));
-    ESP_ERROR_CHECK(pcnt_new_unit(&unit_config, &pcnt_uint_Z));
-
-    // ESP_LOGI(TAG, "set glitch filter");
     pcnt_glitch_filter_config_t filter_config = {
         .max_glitch_ns = EC11_GLITCH_ns,
     };
-    ESP_ERROR_CHECK(pcnt_unit_set_glitch_filter(pcnt_uint_X, &filter_config));
-    ESP_ERROR_CHECK(pcnt_unit_set_glitch_filter(pcnt_uint_Y, &filter_config));
-    ESP_ERROR_CHECK(pcnt_unit_set_glitch_filter(pcnt_uint_Z, &filter_config));
-
-    // ESP_LOGI(TAG, "install pcnt channels");
-    pcnt_chan_config_t chan_X_config = {
-        .edge_gpio_num = EC11_GPIO_X_A,
-        .level_gpio_num = EC11_GPIO_X_B,
-    };
-    pcnt_chan_config_t chan_Y_config = {
-        .edge_gpio_num = EC11_GPIO_Y_A,
-        .level_gpio_num = EC11_GPIO_Y_B,
-    };
-    pcnt_chan_config_t chan_Z_config = {
-        .edge_gpio_num = EC11_GPIO_Z_A,
-        .level_gpio_num = EC11_GPIO_Z_B,
-    };
-    pcnt_channel_handle_t pcnt_chan_X = NULL;
-    pcnt_channel_handle_t pcnt_chan_Y = NULL;
-    pcnt_channel_handle_t pcnt_chan_Z = NULL;
-    ESP_ERROR_CHECK(pcnt_new_channel(pcnt_uint_X, &chan_X_config, &pcnt_chan_X));
-    ESP_ERROR_CHECK(pcnt_new_channel(pcnt_uint_Y, &chan_Y_config, &pcnt_chan_Y));
-    ESP_ERROR_CHECK(pcnt_new_channel(pcnt_uint_Z, &chan_Z_config, &pcnt_chan_Z));
-
-    // ESP_LOGI(TAG, "set edge and level actions for pcnt channels");
-    ESP_ERROR_CHECK(pcnt_channel_set_edge_action(pcnt_chan_X, PCNT_CHANNEL_EDGE_ACTION_DECREASE, PCNT_CHANNEL_EDGE_ACTION_INCREASE));
-    ESP_ERROR_CHECK(pcnt_channel_set_level_action(pcnt_chan_X, PCNT_CHANNEL_LEVEL_ACTION_HOLD, PCNT_CHANNEL_LEVEL_ACTION_INVERSE));
-    ESP_ERROR_CHECK(pcnt_channel_set_edge_action(pcnt_chan_Y, PCNT_CHANNEL_EDGE_ACTION_DECREASE, PCNT_CHANNEL_EDGE_ACTION_INCREASE));
-    ESP_ERROR_CHECK(pcnt_channel_set_level_action(pcnt_chan_Y, PCNT_CHANNEL_LEVEL_ACTION_HOLD, PCNT_CHANNEL_LEVEL_ACTION_INVERSE));
-    ESP_ERROR_CHECK(pcnt_channel_set_edge_action(pcnt_chan_Z, PCNT_CHANNEL_EDGE_ACTION_DECREASE, PCNT_CHANNEL_EDGE_ACTION_INCREASE));
-    ESP_ERROR_CHECK(pcnt_channel_set_level_action(pcnt_chan_Z, PCNT_CHANNEL_LEVEL_ACTION_HOLD, PCNT_CHANNEL_LEVEL_ACTION_INVERSE));
-
-    // ESP_LOGI(TAG, "add watch points and register callbacks");
-    ESP_ERROR_CHECK(pcnt_unit_add_watch_point(pcnt_uint_X, EC11_COUNT_HIGH_LIMIT));
-    ESP_ERROR_CHECK(pcnt_unit_add_watch_point(pcnt_uint_X, EC11_COUNT_LOW_LIMIT));
-    ESP_ERROR_CHECK(pcnt_unit_add_watch_point(pcnt_uint_Y, EC11_COUNT_HIGH_LIMIT));
-    ESP_ERROR_CHECK(pcnt_unit_add_watch_point(pcnt_uint_Y, EC11_COUNT_LOW_LIMIT));
-    ESP_ERROR_CHECK(pcnt_unit_add_watch_point(pcnt_uint_Z, EC11_COUNT_HIGH_LIMIT));
-    ESP_ERROR_CHECK(pcnt_unit_add_watch_point(pcnt_uint_Z, EC11_COUNT_LOW_LIMIT));
-
-    pcnt_event_callbacks_t cbs_X = {
-        .on_reach = ec11_pcnt_X_on_reach,
-    };
-    pcnt_event_callbacks_t cbs_Y = {
-        .on_reach = ec11_pcnt_Y_on_reach,
-    };
-    pcnt_event_callbacks_t cbs_Z = {
-        .on_reach = ec11_pcnt_Z_on_reach,
+    pcnt_event_callbacks_t cbs = {
+        .on_reach = ec11_pcnt_on_reach,
     };
 
-    pcnt_X_watch_event_queue = xQueueCreate(10, sizeof(int));
-    pcnt_Y_watch_event_queue = xQueueCreate(10, sizeof(int));
-    pcnt_Z_watch_event_queue = xQueueCreate(10, sizeof(int));
-    ESP_ERROR_CHECK(pcnt_unit_register_event_callbacks(pcnt_uint_X, &cbs_X, pcnt_X_watch_event_queue));
-    ESP_ERROR_CHECK(pcnt_unit_register_event_callbacks(pcnt_uint_Y, &cbs_Y, pcnt_Y_watch_event_queue));
-    ESP_ERROR_CHECK(pcnt_unit_register_event_callbacks(pcnt_uint_Z, &cbs_Z, pcnt_Z_watch_event_queue));
-
-    ESP_ERROR_CHECK(pcnt_unit_enable(pcnt_uint_X));
-    ESP_ERROR_CHECK(pcnt_unit_enable(pcnt_uint_Y));
-    ESP_ERROR_CHECK(pcnt_unit_enable(pcnt_uint_Z));
-    ESP_ERROR_CHECK(pcnt_unit_clear_count(pcnt_uint_X));
-    ESP_ERROR_CHECK(pcnt_unit_clear_count(pcnt_uint_Y));
-    ESP_ERROR_CHECK(pcnt_unit_clear_count(pcnt_uint_Z));
-    ESP_ERROR_CHECK(pcnt_unit_start(pcnt_uint_X));
-    ESP_ERROR_CHECK(pcnt_unit_start(pcnt_uint_Y));
-    ESP_ERROR_CHECK(pcnt_unit_start(pcnt_uint_Z));
-
-    ESP_LOGI(TAG, "enable XYZ pcnt unit");
-
-    xTaskCreate(task_ec11_handler,
-                "task_ec11_handler",
-                task_ec11_stackdepth,
-                NULL,
-                task_ec11_priority,
-                &task_ec11_handle);
-}
\ No newline at end of file
+    for (int i = 0; i < EC11_KNOB_MAX; i++)
+    {
+        ec11_knob_t *knob = &ec11_knobs[i];
+
+        ESP_ERROR_CHECK(pcnt_new_unit(&unit_config, &knob->unit));
+        ESP_ERROR_CHECK(pcnt_unit_set_glitch_filter(knob->unit, &filter_config));
+
+        // x4 decoding, each channel counts both edges of one phase with the other phase as direction
+        pcnt_chan_config_t chan_a_config = {
+            .edge_gpio_num = knob->gpio_a,
+            .level_gpio_num = knob->gpio_b,
+        };
+        pcnt_chan_config_t chan_b_config = {
+            .edge_gpio_num = knob->gpio_b,
+            .level_gpio_num = knob->gpio_a,
+        };
+        pcnt_channel_handle_t pcnt_chan_a = NULL;
+        pcnt_channel_handle_t pcnt_chan_b = NULL;
+        ESP_ERROR_CHECK(pcnt_new_channel(knob->unit, &chan_a_config, &pcnt_chan_a));
+        ESP_ERROR_CHECK(pcnt_new_channel(knob->unit, &chan_b_config, &pcnt_chan_b));
+        ESP_ERROR_CHECK(pcnt_channel_set_edge_action(pcnt_chan_a, PCNT_CHANNEL_EDGE_ACTION_DECREASE, PCNT_CHANNEL_EDGE_ACTION_INCREASE));
+        ESP_ERROR_CHECK(pcnt_channel_set_level_action(pcnt_chan_a, PCNT_CHANNEL_LEVEL_ACTION_KEEP, PCNT_CHANNEL_LEVEL_ACTION_INVERSE));
+        ESP_ERROR_CHECK(pcnt_channel_set_edge_action(pcnt_chan_b, PCNT_CHANNEL_EDGE_ACTION_INCREASE, PCNT_CHANNEL_EDGE_ACTION_DECREASE));
+        ESP_ERROR_CHECK(pcnt_channel_set_level_action(pcnt_chan_b, PCNT_CHANNEL_LEVEL_ACTION_KEEP, PCNT_CHANNEL_LEVEL_ACTION_INVERSE));
+
+        ESP_ERROR_CHECK(pcnt_unit_add_watch_point(knob->unit, EC11_COUNT_HIGH_LIMIT));
+        ESP_ERROR_CHECK(pcnt_unit_add_watch_point(knob->unit, EC11_COUNT_LOW_LIMIT));
+        ESP_ERROR_CHECK(pcnt_unit_register_event_callbacks(knob->unit, &cbs, knob));
+
+        ESP_ERROR_CHECK(pcnt_unit_enable(knob->unit));
+        ESP_ERROR_CHECK(pcnt_unit_clear_count(knob->unit));
+        ESP_ERROR_CHECK(pcnt_unit_start(knob->unit));
+    }
+
+    ESP_LOGI(TAG, "enable %s pcnt unit, x4 decoding", EC11_FEED_KNOB ? "XYZ and feed" : "XYZ");
+
+    idle_manager_register_hook(ec11_idle_suspend, ec11_idle_resume, NULL);
+}
+
+void ec11_set_notify(TaskHandle_t notify_task, uint32_t notify_bits)
+{
+    ec11_notify_bits = notify_bits;
+    ec11_notify_task = notify_task;
+    // every edge while awake, the first one while idle also wakes the chip
+    for (int i = 0; i < EC11_KNOB_MAX; i++)
+    {
+        idle_manager_add_wake_gpio(ec11_knobs[i].gpio_a, notify_task, notify_bits);
+        idle_manager_add_wake_gpio(ec11_knobs[i].gpio_b, notify_task, notify_bits);
+    }
+}
@@ -1,6 +1,37 @@
 #ifndef _EC11_ENCODER_H
 #define _EC11_ENCODER_H
 
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+// x4 quadrature: every edge of A and B counts, one detent is a full quadrature cycle
+#define EC11_COUNTS_PER_DETENT 4
+
+// a fourth knob for the feed override, it takes the pcnt unit a ledc step generator would count on
+#define EC11_FEED_KNOB 0
+
+typedef enum
+{
+    EC11_KNOB_X = 0,
+    EC11_KNOB_Y,
+    EC11_KNOB_Z,
+    EC11_KNOB_FEED, // only with EC11_FEED_KNOB
+} ec11_knob_id_t;
+
+#define EC11_KNOB_AXIS_MAX EC11_KNOB_FEED // the axis knobs come first, in axis order
+#define EC11_KNOB_MAX (EC11_KNOB_FEED + EC11_FEED_KNOB)
+
 void ec11_activate(void);
+// the knobs' edges and counter wraps set notify_bits of notify_task, which then polls
+void ec11_set_notify(TaskHandle_t notify_task, uint32_t notify_bits);
+// read the counters into the positions
+void ec11_poll(void);
+// counts turned since the last take as of the last poll, recorded for teach; the axis knobs
+int ec11_take_counts(ec11_knob_id_t knob);
+// whole detents turned since the last take as of the last poll, for steps of a setting; the feed knob
+int ec11_take_detents(ec11_knob_id_t knob);
+// accumulated position of a knob since boot, in quadrature counts
+int64_t ec11_get_position(ec11_knob_id_t knob);
 
-#endif
\ No newline at end of file
+#endif
@@ -4,6 +4,7 @@
 #include "esp_log.h"
 #include "driver/gpio.h"
 #include "driver/ledc.h"
+#include "sys_monitor.h"
 
 #define GPIO_SETP_X GPIO_NUM_36 // Define the output GPIO
 #define GPIO_DIR_X GPIO_NUM_35  // Define the output GPIO
@@ -18,8 +19,13 @@
 TaskHandle_t task_freq_test_handle;
 #define task_freq_test_stackdepth 1024 * 2
 #define task_freq_test_priority 1
+static StackType_t task_freq_test_stack[task_freq_test_stackdepth];
+static StaticTask_t task_freq_test_tcb;
 
+#define FREQ_TEST_QUEUE_LENGTH 10
 QueueHandle_t freq_test_X_queue = NULL;
+static uint8_t freq_test_X_queue_storage[FREQ_TEST_QUEUE_LENGTH * sizeof(int)];
+static StaticQueue_t freq_test_X_queue_buffer;
 
 static void task_freq_test_handler(void *Param)
 {
@@ -80,12 +86,14 @@ void freq_test_activate(void)
 
     ESP_ERROR_CHECK(ledc_channel_config(&ledc_channel));
 
-    freq_test_X_queue = xQueueCreate(10, sizeof(int));
+    freq_test_X_queue = xQueueCreateStatic(FREQ_TEST_QUEUE_LENGTH, sizeof(int), freq_test_X_queue_storage, &freq_test_X_queue_buffer);
 
-    xTaskCreate(task_freq_test_handler,
-                "task_freq_test_handler",
-                task_freq_test_stackdepth,
-                NULL,
-                task_freq_test_priority,
-                &task_freq_test_handle);
+    task_freq_test_handle = xTaskCreateStatic(task_freq_test_handler,
+                                              "task_freq_test_handler",
+                                              task_freq_test_stackdepth,
+                                              NULL,
+                                              task_freq_test_priority,
+                                              task_freq_test_stack,
+                                              &task_freq_test_tcb);
+    sys_task_register(task_freq_test_handle, task_freq_test_stackdepth);
 }
\ No newline at end of file
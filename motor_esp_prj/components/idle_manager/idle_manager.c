@@ -0,0 +1,395 @@
+#include <stdio.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "driver/gpio.h"
+#include "driver/uart.h"
+#include "esp_log.h"
+#include "esp_pm.h"
+#include "esp_sleep.h"
+#include "esp_timer.h"
+#include "esp_console.h"
+#include "argtable3/argtable3.h"
+#include "nvs_flash.h"
+#include "nvs.h"
+
+#include "idle_manager.h"
+#include "sys_monitor.h"
+
+static const char *TAG = "idle manager";
+
+#define IDLE_TIMEOUT_DEFAULT_ms 30000
+#define IDLE_HOOK_MAX 4
+#define IDLE_WAKE_GPIO_MAX 8
+#define IDLE_CPU_FREQ_MAX_MHz 240
+#define IDLE_CPU_FREQ_MIN_MHz 40
+#define IDLE_UART_WAKE_THRESHOLD 3 // rx edges to wake from light sleep, the first char is lost
+
+#define IDLE_NOTIFY_ENTER (1UL << 0)
+#define IDLE_NOTIFY_WAKE (1UL << 1)
+
+#define ESP_INTR_FLAG_DEFAULT 0
+
+typedef struct
+{
+    idle_hook_t suspend;
+    idle_hook_t resume;
+    void *arg;
+} idle_hook_entry_t;
+
+static idle_hook_entry_t idle_hooks[IDLE_HOOK_MAX];
+static int idle_hook_num = 0;
+
+static gpio_num_t wake_gpio[IDLE_WAKE_GPIO_MAX];
+static TaskHandle_t wake_notify_task[IDLE_WAKE_GPIO_MAX];
+static uint32_t wake_notify_bits[IDLE_WAKE_GPIO_MAX];
+static int wake_gpio_num = 0;
+
+static SemaphoreHandle_t idle_mutex = NULL;
+static esp_pm_lock_handle_t idle_pm_lock = NULL;
+static esp_timer_handle_t idle_timer = NULL;
+
+static volatile bool idle_state = false;
+static int motion_busy = 0;
+static uint32_t idle_timeout_ms = IDLE_TIMEOUT_DEFAULT_ms;
+
+// wake statistics
+static volatile int64_t wake_time_us = 0;
+static bool wake_pending_step = false;
+static uint32_t idle_enter_count = 0;
+static int64_t wake_ready_last_us = 0, wake_ready_max_us = 0;
+static int64_t wake_step_last_us = 0, wake_step_max_us = 0;
+
+TaskHandle_t task_idle_handle;
+#define task_idle_stackdepth 1024 * 2
+#define task_idle_priority 2
+
+extern nvs_handle_t motor_nvs_handle;
+
+static void IRAM_ATTR idle_wake_isr_handler(void *arg)
+{
+    int index = (intptr_t)arg;
+    BaseType_t woken = pdFALSE;
+
+    // awake, every edge of a wake pin is passed on to its task
+    if (!idle_state)
+    {
+        if (wake_notify_task[index])
+        {
+            xTaskNotifyFromISR(wake_notify_task[index], wake_notify_bits[index], eSetBits, &woken);
+        }
+        portYIELD_FROM_ISR(woken);
+        return;
+    }
+
+    // wake pins are level triggered while idle, mask them until the idle task re-arms them
+    for (int i = 0; i < wake_gpio_num; i++)
+    {
+        gpio_intr_disable(wake_gpio[i]);
+    }
+    if (wake_time_us == 0)
+    {
+        wake_time_us = esp_timer_get_time();
+    }
+    xTaskNotifyFromISR(task_idle_handle, IDLE_NOTIFY_WAKE, eSetBits, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
+static void idle_timer_callback(void *arg)
+{
+    xTaskNotify(task_idle_handle, IDLE_NOTIFY_ENTER, eSetBits);
+}
+
+static void idle_arm_timer(void)
+{
+    esp_timer_stop(idle_timer);
+    if (idle_timeout_ms)
+    {
+        ESP_ERROR_CHECK(esp_timer_start_once(idle_timer, (uint64_t)idle_timeout_ms * 1000));
+    }
+}
+
+// idle_mutex must be held
+static void idle_enter(void)
+{
+    if (idle_state || motion_busy)
+    {
+        return;
+    }
+
+    for (int i = 0; i < idle_hook_num; i++)
+    {
+        idle_hooks[i].suspend(idle_hooks[i].arg);
+    }
+
+    // idle before the pins turn level triggered, the isr must mask a level that is already there
+    wake_time_us = 0;
+    wake_pending_step = false;
+    idle_enter_count++;
+    idle_state = true;
+
+    // wake on the first level change of any knob pin
+    for (int i = 0; i < wake_gpio_num; i++)
+    {
+        int level = gpio_get_level(wake_gpio[i]);
+        ESP_ERROR_CHECK(gpio_wakeup_enable(wake_gpio[i], level ? GPIO_INTR_LOW_LEVEL : GPIO_INTR_HIGH_LEVEL));
+        gpio_intr_enable(wake_gpio[i]);
+    }
+
+    // drop the last lock, automatic light sleep takes over once every task blocks
+    ESP_ERROR_CHECK(esp_pm_lock_release(idle_pm_lock));
+}
+
+// idle_mutex must be held
+static void idle_resume(void)
+{
+    if (!idle_state)
+    {
+        return;
+    }
+
+    ESP_ERROR_CHECK(esp_pm_lock_acquire(idle_pm_lock));
+
+    for (int i = 0; i < wake_gpio_num; i++)
+    {
+        gpio_intr_disable(wake_gpio[i]);
+        gpio_wakeup_disable(wake_gpio[i]);
+    }
+
+    for (int i = idle_hook_num - 1; i >= 0; i--)
+    {
+        idle_hooks[i].resume(idle_hooks[i].arg);
+    }
+    idle_state = false;
+
+    // back to edges for the tasks
+    for (int i = 0; i < wake_gpio_num; i++)
+    {
+        gpio_set_intr_type(wake_gpio[i], GPIO_INTR_ANYEDGE);
+        gpio_intr_enable(wake_gpio[i]);
+    }
+
+    if (wake_time_us)
+    {
+        wake_ready_last_us = esp_timer_get_time() - wake_time_us;
+        if (wake_ready_last_us > wake_ready_max_us)
+            wake_ready_max_us = wake_ready_last_us;
+        wake_pending_step = true;
+    }
+
+    for (int i = 0; i < wake_gpio_num; i++)
+    {
+        if (wake_notify_task[i])
+        {
+            xTaskNotify(wake_notify_task[i], wake_notify_bits[i], eSetBits);
+        }
+    }
+}
+
+static void task_idle_handler(void *Param)
+{
+    uint32_t notify_bits = 0;
+
+    for (;;)
+    {
+        xTaskNotifyWait(0, UINT32_MAX, &notify_bits, portMAX_DELAY);
+
+        xSemaphoreTake(idle_mutex, portMAX_DELAY);
+        if (notify_bits & IDLE_NOTIFY_WAKE)
+        {
+            idle_resume();
+            if (!motion_busy)
+            {
+                idle_arm_timer();
+            }
+        }
+        else if (notify_bits & IDLE_NOTIFY_ENTER)
+        {
+            idle_enter();
+        }
+        xSemaphoreGive(idle_mutex);
+    }
+}
+
+void idle_manager_register_hook(idle_hook_t suspend, idle_hook_t resume, void *arg)
+{
+    if (idle_hook_num >= IDLE_HOOK_MAX)
+    {
+        ESP_LOGE(TAG, "too many idle hooks");
+        return;
+    }
+    xSemaphoreTake(idle_mutex, portMAX_DELAY);
+    idle_hooks[idle_hook_num].suspend = suspend;
+    idle_hooks[idle_hook_num].resume = resume;
+    idle_hooks[idle_hook_num].arg = arg;
+    idle_hook_num++;
+    xSemaphoreGive(idle_mutex);
+}
+
+void idle_manager_add_wake_gpio(gpio_num_t gpio, TaskHandle_t notify_task, uint32_t notify_bits)
+{
+    if (wake_gpio_num >= IDLE_WAKE_GPIO_MAX)
+    {
+        ESP_LOGE(TAG, "too many wake gpios");
+        return;
+    }
+    xSemaphoreTake(idle_mutex, portMAX_DELAY);
+    wake_gpio[wake_gpio_num] = gpio;
+    wake_notify_task[wake_gpio_num] = notify_task;
+    wake_notify_bits[wake_gpio_num] = notify_bits;
+    gpio_set_intr_type(gpio, GPIO_INTR_DISABLE);
+    ESP_ERROR_CHECK(gpio_isr_handler_add(gpio, idle_wake_isr_handler, (void *)(intptr_t)wake_gpio_num));
+    if (!idle_state)
+    {
+        gpio_set_intr_type(gpio, GPIO_INTR_ANYEDGE);
+        gpio_intr_enable(gpio);
+    }
+    wake_gpio_num++;
+    xSemaphoreGive(idle_mutex);
+}
+
+void idle_manager_motion_begin(void)
+{
+    xSemaphoreTake(idle_mutex, portMAX_DELAY);
+    motion_busy++;
+    esp_timer_stop(idle_timer);
+    idle_resume();
+    if (wake_pending_step)
+    {
+        // first move after a wake, the caller starts stepping right after this returns
+        wake_step_last_us = esp_timer_get_time() - wake_time_us;
+        if (wake_step_last_us > wake_step_max_us)
+            wake_step_max_us = wake_step_last_us;
+        wake_pending_step = false;
+    }
+    wake_time_us = 0;
+    xSemaphoreGive(idle_mutex);
+}
+
+void idle_manager_motion_end(void)
+{
+    xSemaphoreTake(idle_mutex, portMAX_DELAY);
+    if (motion_busy > 0)
+    {
+        motion_busy--;
+    }
+    if (motion_busy == 0)
+    {
+        idle_arm_timer();
+    }
+    xSemaphoreGive(idle_mutex);
+}
+
+bool idle_manager_is_idle(void)
+{
+    return idle_state;
+}
+
+void idle_manager_activate(void)
+{
+    idle_mutex = xSemaphoreCreateMutex();
+
+    if (nvs_get_u32(motor_nvs_handle, "idle_timeout", &idle_timeout_ms) == ESP_OK)
+        ESP_LOGI(TAG, "get idle_timeout = %lums from nvs", idle_timeout_ms);
+    else
+        ESP_LOGW(TAG, "cannot get idle_timeout from nvs, using default value: %lu", idle_timeout_ms);
+
+    esp_pm_config_esp32s3_t pm_config = {
+        .max_freq_mhz = IDLE_CPU_FREQ_MAX_MHz,
+        .min_freq_mhz = IDLE_CPU_FREQ_MIN_MHz,
+        .light_sleep_enable = true,
+    };
+    ESP_ERROR_CHECK(esp_pm_configure(&pm_config));
+
+    // held whenever the machine is not idle
+    ESP_ERROR_CHECK(esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "idle", &idle_pm_lock));
+    ESP_ERROR_CHECK(esp_pm_lock_acquire(idle_pm_lock));
+
+    // knob pins and the console keep the chip reachable from light sleep
+    ESP_ERROR_CHECK(esp_sleep_enable_gpio_wakeup());
+    ESP_ERROR_CHECK(uart_set_wakeup_threshold(CONFIG_ESP_CONSOLE_UART_NUM, IDLE_UART_WAKE_THRESHOLD));
+    ESP_ERROR_CHECK(esp_sleep_enable_uart_wakeup(CONFIG_ESP_CONSOLE_UART_NUM));
+
+    // gpio isr service may be installed first by another component
+    gpio_install_isr_service(ESP_INTR_FLAG_DEFAULT);
+
+    const esp_timer_create_args_t idle_timer_args = {
+        .callback = idle_timer_callback,
+        .name = "idle",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&idle_timer_args, &idle_timer));
+
+    xTaskCreate(task_idle_handler,
+                "task_idle_handler",
+                task_idle_stackdepth,
+                NULL,
+                task_idle_priority,
+                &task_idle_handle);
+    sys_task_register(task_idle_handle, task_idle_stackdepth);
+
+    xSemaphoreTake(idle_mutex, portMAX_DELAY);
+    idle_arm_timer();
+    xSemaphoreGive(idle_mutex);
+
+    ESP_LOGI(TAG, "idle timeout %lums", idle_timeout_ms);
+}
+
+/*************************************************/
+// command tools:
+
+static struct
+{
+    struct arg_int *timeout;
+    struct arg_end *end;
+} idle_args;
+
+static int do_idle_cmd(int argc, char **argv)
+{
+    int nerrors = arg_parse(argc, argv, (void **)&idle_args);
+    if (nerrors != 0)
+    {
+        arg_print_errors(stderr, idle_args.end, argv[0]);
+        return 0;
+    }
+
+    if (idle_args.timeout->count)
+    {
+        xSemaphoreTake(idle_mutex, portMAX_DELAY);
+        idle_timeout_ms = idle_args.timeout->ival[0];
+        if (!motion_busy)
+        {
+            idle_arm_timer();
+        }
+        xSemaphoreGive(idle_mutex);
+        ESP_LOGI(TAG, "idle timeout set successfully");
+        if (nvs_set_u32(motor_nvs_handle, "idle_timeout", idle_timeout_ms) == ESP_OK)
+        {
+            ESP_LOGI(TAG, "idle timeout saved");
+        }
+        else
+        {
+            ESP_LOGW(TAG, "cannot save idle timeout");
+        }
+    }
+
+    printf("state: %s, timeout: %lums%s\n", idle_state ? "idle" : "active", idle_timeout_ms, idle_timeout_ms ? "" : " (disabled)");
+    printf("idle entries: %lu\n", idle_enter_count);
+    printf("wake to ready: last %lldus, max %lldus\n", wake_ready_last_us, wake_ready_max_us);
+    printf("wake to first step: last %lldus, max %lldus\n", wake_step_last_us, wake_step_max_us);
+
+    return 0;
+}
+
+void register_idletools(void)
+{
+    idle_args.timeout = arg_int0("t", "timeout", "<ms>", "Idle time before releasing the drivers and sleeping, 0 disables");
+    idle_args.end = arg_end(2);
+    const esp_console_cmd_t idle_cmd = {
+        .command = "idle",
+        .help = "Show or config idle power management",
+        .hint = NULL,
+        .func = &do_idle_cmd,
+        .argtable = &idle_args};
+    ESP_ERROR_CHECK(esp_console_cmd_register(&idle_cmd));
+}
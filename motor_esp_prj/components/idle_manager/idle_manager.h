@@ -0,0 +1,20 @@
+#ifndef _IDLE_MANAGER_H_
+#define _IDLE_MANAGER_H_
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "driver/gpio.h"
+
+// suspend / resume hook of a peripheral owner, runs in task context with the idle lock held
+typedef void (*idle_hook_t)(void *arg);
+
+void idle_manager_activate(void);
+void idle_manager_register_hook(idle_hook_t suspend, idle_hook_t resume, void *arg);
+// a pin that wakes the chip from idle, while awake its edges set notify_bits of notify_task
+void idle_manager_add_wake_gpio(gpio_num_t gpio, TaskHandle_t notify_task, uint32_t notify_bits);
+void idle_manager_motion_begin(void);
+void idle_manager_motion_end(void);
+bool idle_manager_is_idle(void);
+void register_idletools(void);
+
+#endif
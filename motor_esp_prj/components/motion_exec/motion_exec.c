@@ -0,0 +1,244 @@
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_console.h"
+#include "argtable3/argtable3.h"
+
+#include "motion_exec.h"
+#include "ec11_encoder.h"
+#include "speed_switch.h"
+#include "stepper_app.h"
+#include "stepper_motor_encoder.h"
+#include "sys_monitor.h"
+
+static const char *TAG = "motion exec";
+
+#define MOTION_AXIS_MAX EC11_KNOB_AXIS_MAX // one knob per axis, in axis order
+#define MOTION_FEED_PER_DETENT 5      // percent, of the feed knob
+
+#define MOTION_NOTIFY_KNOB (1UL << 0)   // knob edge or counter wrap
+#define MOTION_NOTIFY_SPEED (1UL << 1)  // speed switch edge, or a refresh after idle
+#define MOTION_NOTIFY_JOG (1UL << 2)    // knob counts queued by teach replay
+#define MOTION_NOTIFY_DONE_X (1UL << 3) // last pulse of a started jog, one bit per axis from here
+#define MOTION_NOTIFY_DONE(axis) (MOTION_NOTIFY_DONE_X << (axis))
+
+#define MOTION_RETRY_ms 10 // an axis held by an arc or homing is tried again this often
+
+TaskHandle_t task_motion_exec_handle;
+#define task_motion_exec_stackdepth 1024 * 3 // the axis tasks' size, trim only from what mem measures under load
+static StackType_t task_motion_exec_stack[task_motion_exec_stackdepth];
+static StaticTask_t task_motion_exec_tcb;
+#define task_motion_exec_priority 5 // above every other app task, a wake goes straight to the pulses
+#define task_motion_exec_core 0     // motion core, the console and the journal run on the other one
+
+// wake statistics for the exec command, written by the executor only
+typedef struct
+{
+    uint32_t wakes;
+    uint32_t knob;
+    uint32_t speed;
+    uint32_t jog;
+    uint32_t done;
+    uint32_t moves;
+    uint32_t retries;
+    int64_t start_last_us; // knob wake to a jog's first transaction queued
+    int64_t start_max_us;
+    int64_t start_sum_us;
+    uint32_t start_count;
+    int64_t loop_max_us; // one pass over all axes
+} motion_stats_t;
+
+static motion_stats_t motion_stats;
+
+static bool IRAM_ATTR motion_on_jog_done(int axis, void *arg)
+{
+    BaseType_t woken = pdFALSE;
+
+    xTaskNotifyFromISR(task_motion_exec_handle, MOTION_NOTIFY_DONE(axis), eSetBits, &woken);
+    return woken == pdTRUE;
+}
+
+static void motion_on_jog_queued(void *arg)
+{
+    xTaskNotify(task_motion_exec_handle, MOTION_NOTIFY_JOG, eSetBits);
+}
+
+static void task_motion_exec(void *Param)
+{
+    int pending[MOTION_AXIS_MAX] = {0}; // counts taken but not started, their axis was held
+    int64_t speed_due_us = 0;           // switch sample after the contacts settled, 0 for none
+    TickType_t wait = portMAX_DELAY;
+
+    for (;;)
+    {
+        uint32_t bits = 0;
+        xTaskNotifyWait(0, UINT32_MAX, &bits, wait);
+        int64_t wake_us = esp_timer_get_time();
+        bool blocked = false;
+
+        motion_stats.wakes++;
+        motion_stats.knob += !!(bits & MOTION_NOTIFY_KNOB);
+        motion_stats.speed += !!(bits & MOTION_NOTIFY_SPEED);
+        motion_stats.jog += !!(bits & MOTION_NOTIFY_JOG);
+
+        // the first edge starts the filter time, the switch is read once at its end
+        if ((bits & MOTION_NOTIFY_SPEED) && !speed_due_us)
+        {
+            speed_due_us = wake_us + SPEED_SWITCH_FILTER_ms * 1000;
+        }
+        if (speed_due_us && wake_us >= speed_due_us)
+        {
+            speed_switch_sample();
+            speed_due_us = 0;
+        }
+
+        for (int axis = 0; axis < MOTION_AXIS_MAX; axis++)
+        {
+            if (bits & MOTION_NOTIFY_DONE(axis))
+            {
+                motion_stats.done++;
+                stepper_motor_jog_finish(axis);
+            }
+        }
+
+        // every pass reads the knobs, counts turned during a move wait there for its end
+        ec11_poll();
+#if EC11_FEED_KNOB
+        // the override applies to moves already running, never waits
+        int feed = ec11_take_detents(EC11_KNOB_FEED);
+        if (feed)
+        {
+            int percent = (int)stepper_feed_override_get() + feed * MOTION_FEED_PER_DETENT;
+            stepper_feed_override_set(percent < STEPPER_FEED_OVERRIDE_MIN ? STEPPER_FEED_OVERRIDE_MIN : percent);
+        }
+#endif
+        for (int axis = 0; axis < MOTION_AXIS_MAX; axis++)
+        {
+            if (stepper_motor_jog_busy(axis))
+            {
+                continue;
+            }
+            bool knob = false;
+            if (!pending[axis])
+            {
+                pending[axis] = ec11_take_counts(axis);
+                knob = pending[axis] != 0;
+            }
+            if (!pending[axis] && !stepper_motor_jog_receive(axis, &pending[axis]))
+            {
+                continue;
+            }
+            if (!stepper_motor_jog_start(axis, pending[axis]))
+            {
+                motion_stats.retries++;
+                blocked = true;
+                continue;
+            }
+            pending[axis] = 0;
+            motion_stats.moves++;
+            if (knob && (bits & MOTION_NOTIFY_KNOB))
+            {
+                motion_stats.start_last_us = esp_timer_get_time() - wake_us;
+                motion_stats.start_sum_us += motion_stats.start_last_us;
+                motion_stats.start_count++;
+                if (motion_stats.start_last_us > motion_stats.start_max_us)
+                {
+                    motion_stats.start_max_us = motion_stats.start_last_us;
+                }
+            }
+        }
+        if (esp_timer_get_time() - wake_us > motion_stats.loop_max_us)
+        {
+            motion_stats.loop_max_us = esp_timer_get_time() - wake_us;
+        }
+
+        // asleep until the next event, unless a held axis or the switch filter needs a look
+        wait = blocked ? pdMS_TO_TICKS(MOTION_RETRY_ms) : portMAX_DELAY;
+        if (speed_due_us)
+        {
+            int64_t due_us = speed_due_us - esp_timer_get_time();
+            TickType_t due = due_us > 0 ? pdMS_TO_TICKS((due_us + 999) / 1000) + 1 : 1;
+            wait = due < wait ? due : wait;
+        }
+    }
+}
+
+void motion_exec_activate(void)
+{
+    stepper_jog_callbacks_t jog_cbs = {
+        .on_done = motion_on_jog_done,
+        .on_queued = motion_on_jog_queued,
+        .arg = NULL,
+    };
+
+    task_motion_exec_handle = xTaskCreateStaticPinnedToCore(task_motion_exec,
+                                                            "task_motion_exec",
+                                                            task_motion_exec_stackdepth,
+                                                            NULL,
+                                                            task_motion_exec_priority,
+                                                            task_motion_exec_stack,
+                                                            &task_motion_exec_tcb,
+                                                            task_motion_exec_core);
+    sys_task_register(task_motion_exec_handle, task_motion_exec_stackdepth);
+    sys_heap_guard_task(task_motion_exec_handle);
+
+    stepper_motor_jog_register_callbacks(&jog_cbs);
+    speed_switch_set_notify(task_motion_exec_handle, MOTION_NOTIFY_SPEED);
+    ec11_set_notify(task_motion_exec_handle, MOTION_NOTIFY_KNOB);
+    // anything that happened before the bits were wired up
+    xTaskNotify(task_motion_exec_handle, MOTION_NOTIFY_KNOB | MOTION_NOTIFY_SPEED | MOTION_NOTIFY_JOG, eSetBits);
+
+    ESP_LOGI(TAG, "%d axes on core %d, priority %d", MOTION_AXIS_MAX, task_motion_exec_core, task_motion_exec_priority);
+}
+
+/*************************************************/
+// command tools:
+
+static struct
+{
+    struct arg_lit *clear;
+    struct arg_end *end;
+} exec_args;
+
+static int do_exec_cmd(int argc, char **argv)
+{
+    int nerrors = arg_parse(argc, argv, (void **)&exec_args);
+    if (nerrors != 0)
+    {
+        arg_print_errors(stderr, exec_args.end, argv[0]);
+        return 0;
+    }
+
+    // a snapshot, the executor may bump a counter while this copies
+    motion_stats_t stats = motion_stats;
+    printf("wakes: %" PRIu32 " (knob %" PRIu32 ", speed %" PRIu32 ", jog %" PRIu32 ", done %" PRIu32 ")\n",
+           stats.wakes, stats.knob, stats.speed, stats.jog, stats.done);
+    printf("jogs: %" PRIu32 ", retried on a held axis: %" PRIu32 "\n", stats.moves, stats.retries);
+    printf("knob wake to first transaction: last %lldus, avg %lldus, max %lldus\n", stats.start_last_us,
+           stats.start_count ? stats.start_sum_us / stats.start_count : 0, stats.start_max_us);
+    printf("longest pass: %lldus\n", stats.loop_max_us);
+
+    if (exec_args.clear->count)
+    {
+        memset(&motion_stats, 0, sizeof(motion_stats));
+    }
+    return 0;
+}
+
+void register_exectools(void)
+{
+    exec_args.clear = arg_lit0("c", "clear", "Clear the statistics after printing them");
+    exec_args.end = arg_end(2);
+    const esp_console_cmd_t exec_cmd = {
+        .command = "exec",
+        .help = "Show motion executor wakes and knob to pulse latency, context switches are in top",
+        .hint = NULL,
+        .func = &do_exec_cmd,
+        .argtable = &exec_args};
+    ESP_ERROR_CHECK(esp_console_cmd_register(&exec_cmd));
+}
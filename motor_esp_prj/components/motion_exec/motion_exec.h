@@ -0,0 +1,9 @@
+#ifndef _MOTION_EXEC_H_
+#define _MOTION_EXEC_H_
+
+// one task steps every jog: knobs, speed switch and the step generators' done interrupts only set
+// its notification bits, it then runs all axes in order, X first, and never waits on one of them
+void motion_exec_activate(void);
+void register_exectools(void);
+
+#endif
@@ -0,0 +1,330 @@
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_partition.h"
+#include "esp_console.h"
+#include "argtable3/argtable3.h"
+
+#include "pos_journal.h"
+#include "sys_monitor.h"
+
+static const char *TAG = "pos_journal";
+
+#define JOURNAL_PARTITION "journal"
+#define JOURNAL_SUBTYPE 0x40      // custom data subtype, see partitions_table.csv
+#define JOURNAL_SETTLE_ms 500     // no move and no position change for this long before a record
+#define JOURNAL_INTERVAL_ms 2000  // at least this long between records, bounds the flash wear
+
+static const esp_partition_t *journal_part;
+static pos_journal_t journal;
+static bool journal_ready;
+static SemaphoreHandle_t journal_mutex; // journal and its flash, appends may erase for tens of ms
+static StaticSemaphore_t journal_mutex_buffer;
+
+// restored at boot
+static pos_journal_state_t journal_restored;
+static bool journal_found;
+static bool journal_settled = true;
+static int64_t journal_restore_us;
+
+// latest positions from the motion side, written by the journal task
+static portMUX_TYPE journal_lock = portMUX_INITIALIZER_UNLOCKED;
+static pos_journal_state_t journal_pending;
+static bool journal_dirty;
+static uint32_t journal_moving; // moves running
+static bool journal_appending;  // a record going to flash, with maybe an erase, moves wait for it
+static TickType_t journal_change_tick;
+
+TaskHandle_t task_journal_handle;
+#define task_journal_stackdepth 1024 * 3
+static StackType_t task_journal_stack[task_journal_stackdepth];
+static StaticTask_t task_journal_tcb;
+#define task_journal_priority 2
+#define task_journal_core 1 // console core, motion runs on the other one
+
+static esp_err_t journal_flash_read(void *ctx, size_t offset, void *buf, size_t len)
+{
+    return esp_partition_read(ctx, offset, buf, len);
+}
+
+static esp_err_t journal_flash_write(void *ctx, size_t offset, const void *buf, size_t len)
+{
+    return esp_partition_write(ctx, offset, buf, len);
+}
+
+static esp_err_t journal_flash_erase(void *ctx, size_t offset, size_t len)
+{
+    return esp_partition_erase_range(ctx, offset, len);
+}
+
+// with the mutex held, the journal task calls it as a move starts, and every holder before giving
+// the mutex back so a move that started meanwhile gets its mark
+static void journal_mark_moving(void)
+{
+    bool moving;
+
+    portENTER_CRITICAL(&journal_lock);
+    moving = journal_moving > 0;
+    portEXIT_CRITICAL(&journal_lock);
+    if (moving && !journal.latest_moving)
+    {
+        ESP_ERROR_CHECK_WITHOUT_ABORT(pos_journal_mark_moving(&journal));
+    }
+}
+
+static void task_journal_handler(void *Param)
+{
+    TickType_t last_write = xTaskGetTickCount() - pdMS_TO_TICKS(JOURNAL_INTERVAL_ms);
+    TickType_t wait = portMAX_DELAY;
+
+    for (;;)
+    {
+        ulTaskNotifyTake(pdTRUE, wait);
+
+        pos_journal_state_t state;
+        bool dirty, moving;
+        TickType_t change;
+        portENTER_CRITICAL(&journal_lock);
+        state = journal_pending;
+        dirty = journal_dirty;
+        moving = journal_moving > 0;
+        change = journal_change_tick;
+        portEXIT_CRITICAL(&journal_lock);
+
+        // the end of the next move notifies again
+        wait = portMAX_DELAY;
+        if (moving)
+        {
+            // the move notified as it started, its steps go out meanwhile
+            xSemaphoreTake(journal_mutex, portMAX_DELAY);
+            journal_mark_moving();
+            xSemaphoreGive(journal_mutex);
+            continue;
+        }
+        if (!dirty)
+        {
+            continue;
+        }
+        TickType_t since_change = xTaskGetTickCount() - change;
+        TickType_t since_write = xTaskGetTickCount() - last_write;
+        TickType_t settle = pdMS_TO_TICKS(JOURNAL_SETTLE_ms);
+        TickType_t interval = pdMS_TO_TICKS(JOURNAL_INTERVAL_ms);
+        if (since_change < settle || since_write < interval)
+        {
+            wait = since_change < settle ? settle - since_change : 0;
+            if (since_write < interval && interval - since_write > wait)
+            {
+                wait = interval - since_write;
+            }
+            continue;
+        }
+
+        xSemaphoreTake(journal_mutex, portMAX_DELAY);
+        // a move may have started since, the record would already be stale
+        portENTER_CRITICAL(&journal_lock);
+        bool changed = journal_moving > 0 || journal_change_tick != change;
+        if (!changed)
+        {
+            journal_dirty = false;
+            journal_appending = true;
+        }
+        portEXIT_CRITICAL(&journal_lock);
+        if (!changed)
+        {
+            ESP_ERROR_CHECK_WITHOUT_ABORT(pos_journal_append(&journal, &state));
+            last_write = xTaskGetTickCount();
+            portENTER_CRITICAL(&journal_lock);
+            journal_appending = false;
+            portEXIT_CRITICAL(&journal_lock);
+        }
+        journal_mark_moving();
+        xSemaphoreGive(journal_mutex);
+    }
+}
+
+void pos_journal_activate(void)
+{
+    journal_mutex = xSemaphoreCreateMutexStatic(&journal_mutex_buffer);
+
+    journal_part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, JOURNAL_SUBTYPE, JOURNAL_PARTITION);
+    if (journal_part == NULL)
+    {
+        ESP_LOGW(TAG, "no \"%s\" partition, positions are not kept over a reset", JOURNAL_PARTITION);
+        return;
+    }
+
+    pos_journal_flash_t flash = {
+        .read = journal_flash_read,
+        .write = journal_flash_write,
+        .erase = journal_flash_erase,
+        .ctx = (void *)journal_part,
+        .size = journal_part->size,
+    };
+    int64_t start_us = esp_timer_get_time();
+    esp_err_t err = pos_journal_open(&journal, &flash, &journal_restored, &journal_found, &journal_settled);
+    journal_restore_us = esp_timer_get_time() - start_us;
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "cannot open the journal: %s", esp_err_to_name(err));
+        return;
+    }
+    journal_pending = journal_restored;
+    journal_ready = true;
+
+    if (!journal_found)
+    {
+        ESP_LOGW(TAG, "journal is empty, positions start at 0");
+    }
+    else
+    {
+        ESP_LOGI(TAG, "restored record %lu in %lldus, %lu slots scanned, %lu torn", journal.seq, journal_restore_us,
+                 journal.stats.scanned, journal.stats.torn);
+    }
+
+    task_journal_handle = xTaskCreateStaticPinnedToCore(task_journal_handler,
+                                                        "task_journal_handler",
+                                                        task_journal_stackdepth,
+                                                        NULL,
+                                                        task_journal_priority,
+                                                        task_journal_stack,
+                                                        &task_journal_tcb,
+                                                        task_journal_core);
+    sys_task_register(task_journal_handle, task_journal_stackdepth);
+}
+
+bool pos_journal_restore(pos_journal_state_t *state, bool *settled)
+{
+    *state = journal_restored;
+    *settled = journal_settled;
+    return journal_found;
+}
+
+bool pos_journal_motion_try_begin(void)
+{
+    bool first;
+
+    portENTER_CRITICAL(&journal_lock);
+    if (journal_appending)
+    {
+        portEXIT_CRITICAL(&journal_lock);
+        return false;
+    }
+    first = journal_moving++ == 0;
+    portEXIT_CRITICAL(&journal_lock);
+
+    // the journal task writes the mark, the motion side never waits for the flash
+    if (first && journal_ready)
+    {
+        xTaskNotifyGive(task_journal_handle);
+    }
+    return true;
+}
+
+void pos_journal_motion_begin(void)
+{
+    while (!pos_journal_motion_try_begin())
+    {
+        vTaskDelay(1);
+    }
+}
+
+void pos_journal_motion_end(void)
+{
+    portENTER_CRITICAL(&journal_lock);
+    if (journal_moving > 0)
+    {
+        journal_moving--;
+    }
+    journal_change_tick = xTaskGetTickCount();
+    portEXIT_CRITICAL(&journal_lock);
+    if (journal_ready)
+    {
+        xTaskNotifyGive(task_journal_handle);
+    }
+}
+
+void pos_journal_note(const pos_journal_state_t *state)
+{
+    portENTER_CRITICAL(&journal_lock);
+    journal_pending = *state;
+    journal_dirty = true;
+    journal_change_tick = xTaskGetTickCount();
+    portEXIT_CRITICAL(&journal_lock);
+    if (journal_ready)
+    {
+        xTaskNotifyGive(task_journal_handle);
+    }
+}
+
+/*************************************************/
+// command tools:
+
+static int do_journal_cmd(int argc, char **argv)
+{
+    if (!journal_ready)
+    {
+        printf("no journal\n");
+        return 0;
+    }
+
+    pos_journal_stats_t stats;
+    uint32_t seq, slot, slots;
+    bool moving;
+    xSemaphoreTake(journal_mutex, portMAX_DELAY);
+    stats = journal.stats;
+    seq = journal.seq;
+    slot = journal.latest_slot;
+    slots = journal.slots;
+    moving = journal.latest_moving;
+    journal_mark_moving();
+    xSemaphoreGive(journal_mutex);
+
+    pos_journal_state_t pending;
+    bool dirty;
+    portENTER_CRITICAL(&journal_lock);
+    pending = journal_pending;
+    dirty = journal_dirty;
+    portEXIT_CRITICAL(&journal_lock);
+
+    printf("partition \"%s\" at 0x%lx, %luKB, %lu slots of %dB\n", journal_part->label, journal_part->address,
+           journal_part->size / 1024, slots, POS_JOURNAL_RECORD_SIZE);
+    printf("restore: %s%s, %lld us, %lu slots scanned, %lu torn\n", journal_found ? "found" : "empty",
+           journal_found && !journal_settled ? " (power lost while moving)" : "", journal_restore_us,
+           stats.scanned, stats.torn);
+    printf("latest: record %lu in slot %lu, %s\n", seq, slot, moving ? "moving" : "settled");
+    printf("pending: %s, x %" PRId64 " y %" PRId64 " z %" PRId64 " homed 0x%x\n", dirty ? "yes" : "no", pending.pos[0], pending.pos[1],
+           pending.pos[2], pending.homed);
+
+    uint64_t flash_bytes = stats.bytes_programmed + (uint64_t)stats.erases * POS_JOURNAL_SECTOR_SIZE;
+    uint64_t payload_bytes = (uint64_t)stats.records * POS_JOURNAL_PAYLOAD_SIZE;
+    printf("since boot: %lu records, %lu marks, %lu erases, %lu slots skipped\n", stats.records, stats.marks,
+           stats.erases, stats.skipped);
+    if (payload_bytes)
+    {
+        // erased bytes count as written, every byte of a sector wears with an erase
+        printf("write amplification: %" PRIu64 "B to flash for %" PRIu64 "B of positions, %" PRIu64 ".%02" PRIu64 "x\n",
+               flash_bytes, payload_bytes, flash_bytes / payload_bytes, flash_bytes * 100 / payload_bytes % 100);
+    }
+    return 0;
+}
+
+static void register_journal(void)
+{
+    const esp_console_cmd_t journal_cmd = {
+        .command = "journal",
+        .help = "Position journal: restore, latest record, write amplification",
+        .hint = NULL,
+        .func = &do_journal_cmd,
+    };
+    ESP_ERROR_CHECK(esp_console_cmd_register(&journal_cmd));
+}
+
+void register_journaltools(void)
+{
+    register_journal();
+}
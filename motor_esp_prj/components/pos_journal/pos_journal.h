@@ -0,0 +1,23 @@
+#ifndef _POS_JOURNAL_H_
+#define _POS_JOURNAL_H_
+
+#include <stdbool.h>
+#include "pos_journal_log.h"
+
+// axis positions survive a reset: a record is appended to the "journal" partition once motion has
+// settled, at most one per JOURNAL_INTERVAL_ms, the last one is restored at boot in a single scan
+void pos_journal_activate(void);
+// state restored at boot, false when the journal was empty; settled is false when the power went
+// while an axis was moving, the positions are then only where the last move started
+bool pos_journal_restore(pos_journal_state_t *state, bool *settled);
+// around every move, the journal task marks the record moving as the first one starts; no move
+// starts while a record is appended, which may erase a sector: begin waits for it, try_begin is
+// false instead and the move is tried again later
+void pos_journal_motion_begin(void);
+bool pos_journal_motion_try_begin(void);
+void pos_journal_motion_end(void);
+// positions changed, written once motion has settled
+void pos_journal_note(const pos_journal_state_t *state);
+void register_journaltools(void);
+
+#endif
@@ -0,0 +1,220 @@
+#include <string.h>
+#include "pos_journal_log.h"
+
+#define POS_JOURNAL_MAGIC 0x4a51 // "QJ", "PJ" records held 32-bit positions
+#define POS_JOURNAL_SETTLED 0xff
+#define POS_JOURNAL_MOVING 0x00
+
+// on flash, little endian, the crc goes last so a torn append always breaks it
+typedef struct {
+    uint16_t magic;
+    uint8_t homed;
+    uint8_t moving; // cleared in place, not covered by the crc
+    uint32_t seq;
+    int64_t pos[POS_JOURNAL_AXES];
+    uint32_t spare; // written 0, keeps the record a multiple of the positions' alignment
+    uint32_t crc;
+} pos_journal_record_t;
+
+_Static_assert(sizeof(pos_journal_record_t) == POS_JOURNAL_RECORD_SIZE, "journal record size");
+
+static uint32_t pos_journal_crc32(const uint8_t *data, size_t len)
+{
+    uint32_t crc = 0xffffffff;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+        }
+    }
+    return ~crc;
+}
+
+static uint32_t pos_journal_record_crc(const pos_journal_record_t *record)
+{
+    pos_journal_record_t copy = *record;
+
+    copy.moving = POS_JOURNAL_SETTLED;
+    return pos_journal_crc32((const uint8_t *)&copy, offsetof(pos_journal_record_t, crc));
+}
+
+static bool pos_journal_record_empty(const pos_journal_record_t *record)
+{
+    const uint8_t *bytes = (const uint8_t *)record;
+
+    for (size_t i = 0; i < sizeof(*record); i++)
+    {
+        if (bytes[i] != 0xff)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool pos_journal_record_valid(const pos_journal_record_t *record)
+{
+    return record->magic == POS_JOURNAL_MAGIC && record->crc == pos_journal_record_crc(record);
+}
+
+static size_t pos_journal_slot_offset(uint32_t slot)
+{
+    return slot / POS_JOURNAL_SECTOR_RECORDS * POS_JOURNAL_SECTOR_SIZE + slot % POS_JOURNAL_SECTOR_RECORDS * POS_JOURNAL_RECORD_SIZE;
+}
+
+esp_err_t pos_journal_open(pos_journal_t *journal, const pos_journal_flash_t *flash, pos_journal_state_t *state,
+                           bool *ret_found, bool *ret_settled)
+{
+    static pos_journal_record_t scan[POS_JOURNAL_SCAN_RECORDS];
+    pos_journal_record_t latest = {0};
+    uint32_t next_empty = UINT32_MAX; // first empty slot behind the latest record, in its sector
+
+    if (flash->size % POS_JOURNAL_SECTOR_SIZE || flash->size < 2 * POS_JOURNAL_SECTOR_SIZE)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(journal, 0, sizeof(*journal));
+    journal->flash = *flash;
+    journal->slots = flash->size / POS_JOURNAL_SECTOR_SIZE * POS_JOURNAL_SECTOR_RECORDS;
+    journal->latest_slot = UINT32_MAX;
+
+    // a single pass, a scan block never crosses a sector
+    for (uint32_t slot = 0; slot < journal->slots; slot += POS_JOURNAL_SCAN_RECORDS)
+    {
+        uint32_t in_sector = POS_JOURNAL_SECTOR_RECORDS - slot % POS_JOURNAL_SECTOR_RECORDS;
+        uint32_t count = in_sector < POS_JOURNAL_SCAN_RECORDS ? in_sector : POS_JOURNAL_SCAN_RECORDS;
+        esp_err_t err = flash->read(flash->ctx, pos_journal_slot_offset(slot), scan, count * POS_JOURNAL_RECORD_SIZE);
+        if (err != ESP_OK)
+        {
+            return err;
+        }
+        for (uint32_t i = 0; i < count; i++)
+        {
+            uint32_t at = slot + i;
+            journal->stats.scanned++;
+            if (pos_journal_record_empty(&scan[i]))
+            {
+                if (next_empty == UINT32_MAX && journal->latest_slot != UINT32_MAX &&
+                    at / POS_JOURNAL_SECTOR_RECORDS == journal->latest_slot / POS_JOURNAL_SECTOR_RECORDS)
+                {
+                    next_empty = at;
+                }
+            }
+            else if (!pos_journal_record_valid(&scan[i]))
+            {
+                journal->stats.torn++;
+            }
+            else if (journal->latest_slot == UINT32_MAX || (int32_t)(scan[i].seq - latest.seq) > 0)
+            {
+                latest = scan[i];
+                journal->latest_slot = at;
+                next_empty = UINT32_MAX;
+            }
+        }
+        // the loop steps by whole scan blocks, a short one at the end of a sector realigns
+        slot -= POS_JOURNAL_SCAN_RECORDS - count;
+    }
+
+    memset(state, 0, sizeof(*state));
+    *ret_found = journal->latest_slot != UINT32_MAX;
+    *ret_settled = true;
+    if (*ret_found)
+    {
+        memcpy(state->pos, latest.pos, sizeof(state->pos));
+        state->homed = latest.homed;
+        journal->seq = latest.seq;
+        journal->latest_moving = latest.moving != POS_JOURNAL_SETTLED;
+        *ret_settled = !journal->latest_moving;
+        // behind the latest in its sector, or the start of the next one, which gets erased first
+        if (next_empty != UINT32_MAX)
+        {
+            journal->next_slot = next_empty;
+        }
+        else
+        {
+            journal->next_slot = (journal->latest_slot / POS_JOURNAL_SECTOR_RECORDS + 1) * POS_JOURNAL_SECTOR_RECORDS % journal->slots;
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t pos_journal_append(pos_journal_t *journal, const pos_journal_state_t *state)
+{
+    const pos_journal_flash_t *flash = &journal->flash;
+    pos_journal_record_t record = {
+        .magic = POS_JOURNAL_MAGIC,
+        .homed = state->homed,
+        .moving = POS_JOURNAL_SETTLED,
+        .seq = journal->seq + 1,
+    };
+    pos_journal_record_t slot_now;
+    esp_err_t err;
+
+    memcpy(record.pos, state->pos, sizeof(record.pos));
+    record.crc = pos_journal_record_crc(&record);
+
+    for (;;)
+    {
+        uint32_t slot = journal->next_slot;
+        size_t offset = pos_journal_slot_offset(slot);
+
+        // entering a sector, it holds the oldest records of the ring
+        if (slot % POS_JOURNAL_SECTOR_RECORDS == 0)
+        {
+            err = flash->erase(flash->ctx, offset, POS_JOURNAL_SECTOR_SIZE);
+            if (err != ESP_OK)
+            {
+                return err;
+            }
+            journal->stats.erases++;
+        }
+        journal->next_slot = (slot + 1) % journal->slots;
+
+        // a torn append before a power loss leaves a slot that can't be written again
+        err = flash->read(flash->ctx, offset, &slot_now, sizeof(slot_now));
+        if (err != ESP_OK)
+        {
+            return err;
+        }
+        if (!pos_journal_record_empty(&slot_now))
+        {
+            journal->stats.skipped++;
+            continue;
+        }
+
+        err = flash->write(flash->ctx, offset, &record, sizeof(record));
+        if (err != ESP_OK)
+        {
+            return err;
+        }
+        journal->stats.records++;
+        journal->stats.bytes_programmed += sizeof(record);
+        journal->latest_slot = slot;
+        journal->latest_moving = false;
+        journal->seq = record.seq;
+        return ESP_OK;
+    }
+}
+
+esp_err_t pos_journal_mark_moving(pos_journal_t *journal)
+{
+    uint8_t moving = POS_JOURNAL_MOVING; // in RAM, the flash driver can't program from flash
+
+    if (journal->latest_slot == UINT32_MAX || journal->latest_moving)
+    {
+        return ESP_OK;
+    }
+    size_t offset = pos_journal_slot_offset(journal->latest_slot) + offsetof(pos_journal_record_t, moving);
+    esp_err_t err = journal->flash.write(journal->flash.ctx, offset, &moving, sizeof(moving));
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+    journal->latest_moving = true;
+    journal->stats.marks++;
+    journal->stats.bytes_programmed += sizeof(moving);
+    return ESP_OK;
+}
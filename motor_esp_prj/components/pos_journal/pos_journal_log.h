@@ -0,0 +1,96 @@
+#ifndef _POS_JOURNAL_LOG_H
+#define _POS_JOURNAL_LOG_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define POS_JOURNAL_AXES 3
+#define POS_JOURNAL_SECTOR_SIZE 4096 // erase unit
+#define POS_JOURNAL_RECORD_SIZE 40
+#define POS_JOURNAL_SECTOR_RECORDS (POS_JOURNAL_SECTOR_SIZE / POS_JOURNAL_RECORD_SIZE)
+#define POS_JOURNAL_PAYLOAD_SIZE (POS_JOURNAL_AXES * 8 + 1) // positions and homed flags, for the write amplification
+#define POS_JOURNAL_SCAN_RECORDS 32  // records read per flash access by the restore scan
+
+/**
+ * @brief Flash region of the journal, NOR semantics: a write can only clear bits, an erase sets a
+ *        whole sector back to 0xff
+ */
+typedef struct {
+    esp_err_t (*read)(void *ctx, size_t offset, void *buf, size_t len);
+    esp_err_t (*write)(void *ctx, size_t offset, const void *buf, size_t len);
+    esp_err_t (*erase)(void *ctx, size_t offset, size_t len);
+    void *ctx;
+    size_t size; // a whole number of sectors, at least two
+} pos_journal_flash_t;
+
+/**
+ * @brief What the journal keeps, positions in steps
+ */
+typedef struct {
+    int64_t pos[POS_JOURNAL_AXES];
+    uint8_t homed; // bit per axis
+} pos_journal_state_t;
+
+typedef struct {
+    uint32_t records;          // appended since open
+    uint32_t marks;            // records marked moving since open
+    uint32_t erases;           // sectors erased since open
+    uint64_t bytes_programmed; // records and marks
+    uint32_t scanned;          // slots read by the restore scan
+    uint32_t torn;             // slots the scan found neither empty nor valid
+    uint32_t skipped;          // slots left out by appends since they weren't erased
+} pos_journal_stats_t;
+
+/**
+ * @brief Log structured position journal
+ *
+ * Records are appended one after another around a ring of sectors, a sector is erased when the
+ * ring enters it again, so every sector wears the same. A record carries a sequence number and a
+ * crc, a torn append fails its crc and the one before it stays the latest. Starting a move clears
+ * the moving byte of the latest record in place (outside the crc), a power loss while moving is
+ * seen at restore without a record per move.
+ */
+typedef struct {
+    pos_journal_flash_t flash;
+    uint32_t slots;
+    uint32_t next_slot;   // where the next append goes
+    uint32_t latest_slot; // UINT32_MAX while empty
+    uint32_t seq;
+    bool latest_moving;
+    pos_journal_stats_t stats;
+} pos_journal_t;
+
+/**
+ * @brief Scan the region once and find the latest record
+ *
+ * @param[out] state Latest state, zero when the journal is empty
+ * @param[out] ret_found A record was found
+ * @param[out] ret_settled The latest record wasn't marked moving
+ * @return
+ *      - ESP_ERR_INVALID_ARG for a region that isn't whole sectors, or fewer than two
+ *      - ESP_OK, also for an empty journal
+ */
+esp_err_t pos_journal_open(pos_journal_t *journal, const pos_journal_flash_t *flash, pos_journal_state_t *state,
+                           bool *ret_found, bool *ret_settled);
+
+/**
+ * @brief Append a settled state
+ */
+esp_err_t pos_journal_append(pos_journal_t *journal, const pos_journal_state_t *state);
+
+/**
+ * @brief Mark the latest record moving, once per move of a settled journal
+ */
+esp_err_t pos_journal_mark_moving(pos_journal_t *journal);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -24,56 +24,70 @@
 // static const char *TAG = "speed_switch";
 
 SemaphoreHandle_t motor_speed_semphr = NULL;
+static StaticSemaphore_t motor_speed_semphr_buffer;
 uint32_t motor_speed = 1;
 
-TaskHandle_t task_speed_switch_handle;
-#define task_speed_switch_stackdepth 1024 * 2
-#define task_speed_switch_priority 1
+// the task that samples the switch, see speed_switch_set_notify
+static TaskHandle_t speed_switch_notify_task = NULL;
+static uint32_t speed_switch_notify_bits = 0;
 
-static void task_speed_switch(void *arg)
+void speed_switch_sample(void)
 {
     static int gpio_speed_level = 2;
 
-    for (;;)
+    gpio_speed_level = gpio_get_level(GPIO_SPEED_1);
+    gpio_speed_level = (gpio_speed_level << 1) + gpio_get_level(GPIO_SPEED_2);
+    //ESP_LOGI(TAG, "switch value : %d", gpio_speed_level);
+
+    gpio_set_level(GPIO_LED_SPEED_1, GPIO_LED_LEVEL_OFF);
+    gpio_set_level(GPIO_LED_SPEED_10, GPIO_LED_LEVEL_OFF);
+    gpio_set_level(GPIO_LED_SPEED_100, GPIO_LED_LEVEL_OFF);
+
+    xSemaphoreTake(motor_speed_semphr, portMAX_DELAY);
+    switch (gpio_speed_level)
     {
-        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
-        vTaskDelay(20 / portTICK_PERIOD_MS);       // 20ms soft filter
-
-        gpio_speed_level = gpio_get_level(GPIO_SPEED_1);
-        gpio_speed_level = (gpio_speed_level << 1) + gpio_get_level(GPIO_SPEED_2);
-        //ESP_LOGI(TAG, "switch value : %d", gpio_speed_level);
-
-        gpio_set_level(GPIO_LED_SPEED_1, GPIO_LED_LEVEL_OFF);
-        gpio_set_level(GPIO_LED_SPEED_10, GPIO_LED_LEVEL_OFF);
-        gpio_set_level(GPIO_LED_SPEED_100, GPIO_LED_LEVEL_OFF);
-
-        xSemaphoreTake(motor_speed_semphr, portMAX_DELAY);
-        switch (gpio_speed_level)
-        {
-        case 1:
-            gpio_set_level(GPIO_LED_SPEED_1, GPIO_LED_LEVEL_ON);
-            motor_speed = 1;
-            break;
-        case 3:
-            gpio_set_level(GPIO_LED_SPEED_10, GPIO_LED_LEVEL_ON);
-            motor_speed = 10;
-            break;
-        case 2:
-            gpio_set_level(GPIO_LED_SPEED_100, GPIO_LED_LEVEL_ON);
-            motor_speed = 100;
-            break;
-        default:
-            break;
-        }
-        xSemaphoreGive(motor_speed_semphr);
-
-        xTaskNotifyStateClear(xTaskGetCurrentTaskHandle());
+    case 1:
+        gpio_set_level(GPIO_LED_SPEED_1, GPIO_LED_LEVEL_ON);
+        motor_speed = 1;
+        break;
+    case 3:
+        gpio_set_level(GPIO_LED_SPEED_10, GPIO_LED_LEVEL_ON);
+        motor_speed = 10;
+        break;
+    case 2:
+        gpio_set_level(GPIO_LED_SPEED_100, GPIO_LED_LEVEL_ON);
+        motor_speed = 100;
+        break;
+    default:
+        break;
     }
+    xSemaphoreGive(motor_speed_semphr);
 }
 
 static void IRAM_ATTR gpio_isr_handler(void *arg)
 {
-    vTaskNotifyGiveFromISR(task_speed_switch_handle, NULL);
+    BaseType_t woken = pdFALSE;
+
+    if (speed_switch_notify_task)
+    {
+        xTaskNotifyFromISR(speed_switch_notify_task, speed_switch_notify_bits, eSetBits, &woken);
+    }
+    portYIELD_FROM_ISR(woken);
+}
+
+// edges are missed in light sleep, sample the switch again
+void speed_switch_refresh(void)
+{
+    if (speed_switch_notify_task)
+    {
+        xTaskNotify(speed_switch_notify_task, speed_switch_notify_bits, eSetBits);
+    }
+}
+
+void speed_switch_set_notify(TaskHandle_t notify_task, uint32_t notify_bits)
+{
+    speed_switch_notify_bits = notify_bits;
+    speed_switch_notify_task = notify_task;
 }
 
 void speed_switch_activate(void)
@@ -103,14 +117,7 @@ void speed_switch_activate(void)
     gpio_set_level(GPIO_LED_SPEED_10, GPIO_LED_LEVEL_OFF);
     gpio_set_level(GPIO_LED_SPEED_100, GPIO_LED_LEVEL_OFF);
 
-    xTaskCreate(task_speed_switch,
-                "task_speed_switch",
-                task_speed_switch_stackdepth,
-                NULL,
-                task_speed_switch_priority,
-                &task_speed_switch_handle);
-
-    motor_speed_semphr = xSemaphoreCreateBinary();
+    motor_speed_semphr = xSemaphoreCreateBinaryStatic(&motor_speed_semphr_buffer);
     xSemaphoreGive(motor_speed_semphr);
-    xTaskNotifyGive(task_speed_switch_handle);
+    speed_switch_sample();
 }
\ No newline at end of file
@@ -1,6 +1,18 @@
 #ifndef _SPEED_SWITCH_H
 #define _SPEED_SWITCH_H
 
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+// switch contacts settle this long after an edge before they are sampled
+#define SPEED_SWITCH_FILTER_ms 20
+
 void speed_switch_activate(void);
+// the switch's edges and refreshes set notify_bits of notify_task, which samples after the filter time
+void speed_switch_set_notify(TaskHandle_t notify_task, uint32_t notify_bits);
+void speed_switch_refresh(void);
+// read the switch into motor_speed and the leds
+void speed_switch_sample(void);
 
 #endif
\ No newline at end of file
@@ -5,18 +5,35 @@
 #include "driver/rmt_tx.h"
 #include "driver/gpio.h"
 #include "esp_log.h"
+#include "esp_rom_sys.h"
+#include "esp_timer.h"
 #include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
 #include "esp_system.h"
 #include "esp_console.h"
 #include "argtable3/argtable3.h"
 #include "nvs_flash.h"
 #include "nvs.h"
+#include "esp_partition.h"
 
 #include "user_console.h"
 #include "stepper_motor_encoder.h"
+#include "stepper_move.h"
+#include "stepper_shaper.h"
+#include "stepper_arc.h"
+#include "stepper_gen.h"
+#include "stepper_home.h"
+#include "stepper_gear.h"
+#include "stepper_ramp.h"
+#include "stepper_lash.h"
 #include "stepper_app.h"
 #include "speed_switch.h"
 #include "user_nvs.h"
+#include "idle_manager.h"
+#include "pos_journal.h"
+#include "sys_monitor.h"
 
 static const char *TAG = "stepper motor";
 
@@ -27,49 +44,270 @@ static const char *TAG = "stepper motor";
 #define STEP_MOTOR_GPIO_STEP_Y GPIO_NUM_34
 #define STEP_MOTOR_GPIO_DIR_Z GPIO_NUM_48
 #define STEP_MOTOR_GPIO_STEP_Z GPIO_NUM_47
+// shared driver enable, leave undefined while the drivers are hard wired enabled
+// #define STEP_MOTOR_GPIO_EN GPIO_NUM_38
+#define STEP_MOTOR_EN_LEVEL_ON 0
+#define STEP_MOTOR_EN_LEVEL_OFF 1
+#define STEP_MOTOR_EN_WAKE_us 1000 // driver charge pump / hold current settle time
+
+// limit switches for homing, normally closed to GND with the pull-up, a broken wire reads as tripped
+#define STEP_LIMIT_GPIO_X GPIO_NUM_4
+#define STEP_LIMIT_GPIO_Y GPIO_NUM_5
+#define STEP_LIMIT_GPIO_Z GPIO_NUM_15
+#define STEP_LIMIT_LEVEL_ACTIVE 1
+#define STEP_LIMIT_DEBOUNCE_us 2000 // a level counts once the input has been quiet this long
+#define STEP_LIMIT_SETTLE_TRIES 10  // a switch still chattering after this many debounce times is read as is
+
+// homing cycle, the same for every axis
+#define STEP_HOME_DIR (-1)         // the switches sit at the counterclockwise end
+#define STEP_HOME_SEEK_HZ 6000
+#define STEP_HOME_LOCATE_HZ 400
+#define STEP_HOME_TRAVEL_MAX 200000 // longest fast move without a switch change
+#define STEP_HOME_SLOW_STEPS 40     // slow approach zone before the switch
+#define STEP_HOME_POS 0             // position of an axis on its switch
 
 #define FREQ_DEFAULT_x1 3000
 #define FREQ_DEFAULT_x10 15000
 #define FREQ_DEFAULT_x100 18000
-#define STEP_BASIC_DEFAULT 64
+#define STEP_BASIC_DEFAULT 64 // steps per half detent at x1, a knob count moves half of it
 
 #define STEP_MOTOR_SPIN_DIR_CLOCKWISE 0
 #define STEP_MOTOR_SPIN_DIR_COUNTERCLOCKWISE !STEP_MOTOR_SPIN_DIR_CLOCKWISE
-#define STEP_MOTOR_RESOLUTION_HZ 1000000 // 1MHz resolution
+#define STEP_MOTOR_RESOLUTION_HZ 1000000 // 1MHz resolution, looped mode
+// 1: exact-average step rate, each move streamed by the dither encoder at a resolution picked from the speed range,
+//    refilled from the RMT isr, which keeps running through flash writes (CONFIG_RMT_ISR_IRAM_SAFE, encoders in iram)
+// 0: identical symbols at STEP_MOTOR_RESOLUTION_HZ, hardware looped
+#define STEP_MOTOR_DITHER 1
+
+// step pulse backend of each axis, STEPPER_GEN_RMT / LEDC / MCPWM
+// arcs need RMT on both of their axes, LEDC takes the PCNT unit left over by the knobs (one axis at most)
+#define STEP_MOTOR_GEN_X STEPPER_GEN_RMT
+#define STEP_MOTOR_GEN_Y STEPPER_GEN_RMT
+#define STEP_MOTOR_GEN_Z STEPPER_GEN_RMT
 
 static uint32_t freq_x1 = FREQ_DEFAULT_x1,
                 freq_x10 = FREQ_DEFAULT_x10,
                 freq_x100 = FREQ_DEFAULT_x100;
 static uint32_t step_basic = STEP_BASIC_DEFAULT;
 
+// STEP and DIR timing, the driver's datasheet minimums (DRV8825 here), per axis from nvs, see the pulse command
+// PULSE_FIXED 1: one symbol per step, a fixed high pulse and the rest of the period low, 0: 50% duty
+#define STEP_PULSE_DEFAULT_HIGH_ns 1900
+#define STEP_PULSE_DEFAULT_LOW_ns 1900
+#define STEP_PULSE_DEFAULT_DIR_ns 650
+#define STEP_PULSE_DEFAULT_FIXED 0
+#define STEP_PULSE_NS_MAX 100000 // 100us, longer than any driver asks for
+
+// backlash, per axis from nvs, see the lash command
+#define STEP_LASH_DEFAULT_STEPS 0
+#define STEP_LASH_DEFAULT_HZ 1000
+
+// acceleration ramps, made by tools/ramp_gen and flashed into their own partition,
+// the ones at an axis resolution are copied to internal ram, the generator isr never reads flash
+#define STEP_RAMP_PARTITION "ramp"
+#define STEP_RAMP_SUBTYPE 0x41 // custom data subtype, see partitions_table.csv
+#define STEP_RAMP_RAM_SIZE 0x4000
+static const esp_partition_t *step_ramp_part;
+static const void *step_ramp_image;
+static uint32_t step_ramp_ram[STEP_RAMP_RAM_SIZE / sizeof(uint32_t)];
+
+// input shaping, per axis, tuned to the ringing mode of that axis
+#define SHAPE_DEFAULT_TYPE STEPPER_SHAPER_NONE
+#define SHAPE_DEFAULT_FREQ_mHz 40000 // 40Hz
+#define SHAPE_DEFAULT_DAMPING_pm 50  // 0.05
+
+typedef enum {
+    STEP_AXIS_X = 0,
+    STEP_AXIS_Y,
+    STEP_AXIS_Z,
+    STEP_AXIS_MAX,
+} step_axis_t;
+
+typedef struct
+{
+    const char *name;
+    uint32_t type;
+    uint32_t freq_mhz;   // natural frequency, in mHz
+    uint32_t damping_pm; // damping ratio, in 1/1000
+    stepper_shaper_t shaper;
+} step_shape_t;
+
+static step_shape_t step_shapes[STEP_AXIS_MAX] = {
+    [STEP_AXIS_X] = {.name = "X"},
+    [STEP_AXIS_Y] = {.name = "Y"},
+    [STEP_AXIS_Z] = {.name = "Z"},
+};
+static portMUX_TYPE step_shape_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// step timing and channel resolution of each axis, both fixed at boot
+static stepper_pulse_t step_axis_pulse[STEP_AXIS_MAX];
+static uint32_t step_axis_resolution_hz[STEP_AXIS_MAX];
+
 // rmt channel
 rmt_channel_handle_t motor_chan_X = NULL;
 rmt_channel_handle_t motor_chan_Y = NULL;
 rmt_channel_handle_t motor_chan_Z = NULL;
 
-// rmt message queue
-QueueHandle_t step_X_queue = NULL;
-QueueHandle_t step_Y_queue = NULL;
-QueueHandle_t step_Z_queue = NULL;
+// jog queues, knob counts sent by teach replay and taken by the motion executor
+#define STEP_QUEUE_LENGTH 2
+static QueueHandle_t step_X_queue = NULL;
+static QueueHandle_t step_Y_queue = NULL;
+static QueueHandle_t step_Z_queue = NULL;
+static uint8_t step_X_queue_storage[STEP_QUEUE_LENGTH * sizeof(int)];
+static uint8_t step_Y_queue_storage[STEP_QUEUE_LENGTH * sizeof(int)];
+static uint8_t step_Z_queue_storage[STEP_QUEUE_LENGTH * sizeof(int)];
+static StaticQueue_t step_X_queue_buffer;
+static StaticQueue_t step_Y_queue_buffer;
+static StaticQueue_t step_Z_queue_buffer;
+
+// stepper motor encoder, one per channel since an encoder keeps per transaction state
+rmt_encoder_handle_t uniform_motor_encoder_X = NULL;
+rmt_encoder_handle_t uniform_motor_encoder_Y = NULL;
+rmt_encoder_handle_t uniform_motor_encoder_Z = NULL;
+static rmt_encoder_handle_t arc_motor_encoder[STEP_AXIS_MAX];
+static rmt_encoder_handle_t gear_motor_encoder[STEP_AXIS_MAX];
+
+// step pulse generators, jog moves go through these whatever the backend
+static const stepper_gen_backend_t step_axis_backend[STEP_AXIS_MAX] = {STEP_MOTOR_GEN_X, STEP_MOTOR_GEN_Y, STEP_MOTOR_GEN_Z};
+static stepper_gen_handle_t step_axis_gen[STEP_AXIS_MAX];
+
+// a channel is driven by the motion executor, the arc task or homing, one at a time
+static SemaphoreHandle_t step_axis_mutex[STEP_AXIS_MAX];
+static StaticSemaphore_t step_axis_mutex_buffer[STEP_AXIS_MAX];
 
-// stepper motor encoder
-rmt_encoder_handle_t uniform_motor_encoder = NULL;
+static rmt_channel_handle_t *const step_axis_chan[STEP_AXIS_MAX] = {&motor_chan_X, &motor_chan_Y, &motor_chan_Z};
+static rmt_encoder_handle_t *const step_axis_encoder[STEP_AXIS_MAX] = {&uniform_motor_encoder_X, &uniform_motor_encoder_Y, &uniform_motor_encoder_Z};
+static const gpio_num_t step_axis_step_gpio[STEP_AXIS_MAX] = {STEP_MOTOR_GPIO_STEP_X, STEP_MOTOR_GPIO_STEP_Y, STEP_MOTOR_GPIO_STEP_Z};
+static const gpio_num_t step_axis_dir_gpio[STEP_AXIS_MAX] = {STEP_MOTOR_GPIO_DIR_X, STEP_MOTOR_GPIO_DIR_Y, STEP_MOTOR_GPIO_DIR_Z};
+static volatile int8_t step_axis_dir[STEP_AXIS_MAX] = {1, 1, 1}; // last DIR set, +1 clockwise
 
-rmt_transmit_config_t tx_config = {
-    .loop_count = 0,
+// backlash of each axis, the side of the slack follows every DIR set, whoever moves the axis
+static stepper_lash_t step_axis_lash[STEP_AXIS_MAX];
+static portMUX_TYPE step_lash_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// electronic gearing, a slave axis follows the jog moves of its master at a fixed ratio
+typedef struct
+{
+    bool on;
+    step_axis_t master;
+    bool knob; // only the master's knob drives the slave, the master axis stays
+    stepper_gear_t gear;
+} step_gear_link_t;
+
+static step_gear_link_t step_gear_links[STEP_AXIS_MAX];
+static portMUX_TYPE step_gear_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// axis positions in steps, clockwise positive, known once the axis is homed
+static int64_t step_axis_pos[STEP_AXIS_MAX];
+static bool step_axis_homed[STEP_AXIS_MAX];
+static portMUX_TYPE step_pos_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// limit input of an axis, the isr latches where in the running move the switch tripped
+typedef struct
+{
+    gpio_num_t gpio;
+    // the move in progress, set before it starts
+    stepper_gen_handle_t gen;
+    uint32_t start_steps; // generator count at the start
+    bool counted;         // the generator counts, otherwise the steps are told from the time
+    int64_t start_us;
+    uint32_t freq_hz;
+    // written by the isr
+    int64_t edge_us; // last edge, for the debounce
+    uint32_t trip_steps;
+    bool tripped;
+} step_limit_t;
+
+static step_limit_t step_limits[STEP_AXIS_MAX] = {
+    [STEP_AXIS_X] = {.gpio = STEP_LIMIT_GPIO_X},
+    [STEP_AXIS_Y] = {.gpio = STEP_LIMIT_GPIO_Y},
+    [STEP_AXIS_Z] = {.gpio = STEP_LIMIT_GPIO_Z},
 };
+static portMUX_TYPE step_limit_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// arcs across two axes
+typedef struct
+{
+    step_axis_t axis_a;
+    step_axis_t axis_b;
+    stepper_arc_t arc;
+    uint32_t feed_hz; // path speed, in steps per second
+    int64_t end_a;    // end point relative to the start, for the axis positions
+    int64_t end_b;
+} step_arc_cmd_t;
+
+#define STEP_ARC_QUEUE_LENGTH 1
+static QueueHandle_t step_arc_queue = NULL;
+static uint8_t step_arc_queue_storage[STEP_ARC_QUEUE_LENGTH * sizeof(step_arc_cmd_t)];
+static StaticQueue_t step_arc_queue_buffer;
+
+// homing, axes one after another in the order given
+typedef struct
+{
+    step_axis_t axes[STEP_AXIS_MAX];
+    uint32_t num_axes;
+    uint32_t seek_hz;
+    uint32_t locate_hz;
+} step_home_cmd_t;
+
+#define STEP_HOME_QUEUE_LENGTH 1
+static QueueHandle_t step_home_queue = NULL;
+static uint8_t step_home_queue_storage[STEP_HOME_QUEUE_LENGTH * sizeof(step_home_cmd_t)];
+static StaticQueue_t step_home_queue_buffer;
+
+// a jog started by the motion executor, its axes stay taken until stepper_motor_jog_finish
+typedef struct
+{
+    bool busy;
+    int64_t steps; // signed, added to the position once the last pulse is out
+    // telemetry: the generator's count when the jog was queued, live until its steps are booked
+    bool live;
+    uint32_t base;
+    uint32_t take_up; // backlash steps ahead of the jog, counted by the generator but not travelled
+    int half;         // -1 ~ 1, the half step of an odd count * step_basic * speed not moved yet
+    bool group[STEP_AXIS_MAX]; // the axes taken for it, the slaves of a geared jog too
+} step_jog_t;
+
+// a geared jog or one on a pwm backend, run by the jog task to its end: those block while they step
+typedef struct
+{
+    int dir;
+    uint32_t freq_hz;
+    uint64_t steps;
+    bool geared;
+    bool master_moves;
+    step_gear_link_t links[STEP_AXIS_MAX];
+    stepper_segment_t segments[STEPPER_GEN_SEGMENT_MAX]; // a geared jog's take-up only
+    uint32_t num_segments;
+} step_jog_run_t;
+
+static QueueHandle_t *const step_axis_queue[STEP_AXIS_MAX] = {&step_X_queue, &step_Y_queue, &step_Z_queue};
+static step_jog_t step_jogs[STEP_AXIS_MAX];
+static stepper_jog_callbacks_t step_jog_cbs;
 
-TaskHandle_t task_stepper_motor_X_handle;
-#define task_stepper_motor_X_stackdepth 1024 * 3
-#define task_stepper_motor_X_priority 1
+// one run per axis at most, its jog stays busy until finished
+static step_jog_run_t step_jog_runs[STEP_AXIS_MAX];
+static QueueHandle_t step_jog_run_queue = NULL;
+static uint8_t step_jog_run_queue_storage[STEP_AXIS_MAX * sizeof(int)];
+static StaticQueue_t step_jog_run_queue_buffer;
 
-TaskHandle_t task_stepper_motor_Y_handle;
-#define task_stepper_motor_Y_stackdepth 1024 * 3
-#define task_stepper_motor_Y_priority 1
+TaskHandle_t task_stepper_jog_handle;
+#define task_stepper_jog_stackdepth 1024 * 3
+static StackType_t task_stepper_jog_stack[task_stepper_jog_stackdepth];
+static StaticTask_t task_stepper_jog_tcb;
+#define task_stepper_jog_priority 4 // under the motion executor, which keeps stepping the other axes
 
-TaskHandle_t task_stepper_motor_Z_handle;
-#define task_stepper_motor_Z_stackdepth 1024 * 3
-#define task_stepper_motor_Z_priority 1
+TaskHandle_t task_stepper_arc_handle;
+#define task_stepper_arc_stackdepth 1024 * 3
+static StackType_t task_stepper_arc_stack[task_stepper_arc_stackdepth];
+static StaticTask_t task_stepper_arc_tcb;
+#define task_stepper_arc_priority 1
+
+TaskHandle_t task_stepper_home_handle;
+#define task_stepper_home_stackdepth 1024 * 3
+static StackType_t task_stepper_home_stack[task_stepper_home_stackdepth];
+static StaticTask_t task_stepper_home_tcb;
+#define task_stepper_home_priority 1
 
 // speed_switch control
 extern SemaphoreHandle_t motor_speed_semphr;
@@ -100,287 +338,1952 @@ static uint32_t get_current_motor_speed(void)
     return freq_run;
 }
 
-static void task_stepper_motor_X_handler(void *Param)
+static void stepper_shape_get(step_axis_t axis, stepper_shaper_t *shaper)
+{
+    portENTER_CRITICAL(&step_shape_lock);
+    *shaper = step_shapes[axis].shaper;
+    portEXIT_CRITICAL(&step_shape_lock);
+}
+
+// hand the positions to the journal, it writes them once motion has settled
+static void stepper_pos_journal(void)
 {
-    static int step_rev_X = 0;
-    static uint32_t freq_run = 0;
+    pos_journal_state_t state = {0};
 
-    for (;;)
+    portENTER_CRITICAL(&step_pos_lock);
+    for (int i = 0; i < STEP_AXIS_MAX; i++)
     {
-        // get speed changed by switch(3x)
-        if (xQueueReceive(step_X_queue, &step_rev_X, portMAX_DELAY))
-        {
-            if (step_rev_X > 0)
-            {
-                gpio_set_level(STEP_MOTOR_GPIO_DIR_X, STEP_MOTOR_SPIN_DIR_CLOCKWISE);
-            }
-            else if (step_rev_X < 0)
-            {
-                gpio_set_level(STEP_MOTOR_GPIO_DIR_X, STEP_MOTOR_SPIN_DIR_COUNTERCLOCKWISE);
-                step_rev_X *= (-1);
-            }
+        state.pos[i] = step_axis_pos[i];
+        state.homed |= step_axis_homed[i] << i;
+    }
+    portEXIT_CRITICAL(&step_pos_lock);
+    pos_journal_note(&state);
+}
 
-            freq_run = get_current_motor_speed();
-            tx_config.loop_count = step_rev_X * step_basic * motor_speed;
+// positions from the journal, an axis that was moving when the power went is no longer homed
+static void stepper_pos_restore(void)
+{
+    pos_journal_state_t state;
+    bool settled;
 
-            ESP_ERROR_CHECK(rmt_transmit(motor_chan_X, uniform_motor_encoder, &freq_run, sizeof(freq_run), &tx_config));
-            ESP_ERROR_CHECK(rmt_tx_wait_all_done(motor_chan_X, -1));
-        }
+    if (!pos_journal_restore(&state, &settled))
+    {
+        return;
+    }
+    for (int i = 0; i < STEP_AXIS_MAX; i++)
+    {
+        step_axis_pos[i] = state.pos[i];
+        step_axis_homed[i] = settled && (state.homed & (1 << i));
+        ESP_LOGI(TAG, "axis %s at %" PRId64 "%s", step_shapes[i].name, state.pos[i], step_axis_homed[i] ? ", homed" : "");
+    }
+    if (!settled)
+    {
+        ESP_LOGW(TAG, "power was lost while moving, positions are where the last move started, home again");
     }
 }
 
-static void task_stepper_motor_Y_handler(void *Param)
+// DIR of the next move, a reversal owes the backlash: its take-up segment goes to take_up, NULL
+// for a move that has no way to put it out; returns the segments written, 0 or 1
+static uint32_t stepper_set_dir(step_axis_t axis, int dir, stepper_segment_t *take_up)
 {
-    static int step_rev_Y = 0;
-    static uint32_t freq_run = 0;
+    gpio_set_level(step_axis_dir_gpio[axis], dir > 0 ? STEP_MOTOR_SPIN_DIR_CLOCKWISE : STEP_MOTOR_SPIN_DIR_COUNTERCLOCKWISE);
+    step_axis_dir[axis] = dir > 0 ? 1 : -1;
+    portENTER_CRITICAL(&step_lash_lock);
+    uint32_t num = stepper_lash_dir(&step_axis_lash[axis], dir, take_up);
+    portEXIT_CRITICAL(&step_lash_lock);
+    return num;
+}
 
-    for (;;)
+// a take-up on its own, ahead of a synced move (arc run, geared move) that has no place for it; the
+// other axes of the move stand still meanwhile
+static void stepper_take_up_run(step_axis_t axis, const stepper_segment_t *take_up)
+{
+    // a plain exact segment, the generator only puts a take-up segment out ahead of a move
+    stepper_segment_t segment = *take_up;
+    segment.take_up = false;
+    ESP_ERROR_CHECK_WITHOUT_ABORT(stepper_gen_run(step_axis_gen[axis], &segment, 1));
+}
+
+static void stepper_pos_add(step_axis_t axis, int64_t steps)
+{
+    portENTER_CRITICAL(&step_pos_lock);
+    step_axis_pos[axis] += steps;
+    portEXIT_CRITICAL(&step_pos_lock);
+    stepper_pos_journal();
+}
+
+// shape a move behind the segments already there, its backlash take-up, returns them all
+static uint32_t stepper_shape_move(step_axis_t axis, uint32_t freq_hz, uint64_t steps, stepper_segment_t *segments, uint32_t num_segments)
+{
+    stepper_shaper_t shaper;
+
+    stepper_shape_get(axis, &shaper);
+    return num_segments + stepper_shaper_apply(&shaper, freq_hz, steps, &segments[num_segments]);
+}
+
+// send a move through the step generator of its axis
+static void stepper_motor_run(step_axis_t axis, const stepper_segment_t *segments, uint32_t num_segments)
+{
+    idle_manager_motion_begin();
+    pos_journal_motion_begin();
+    ESP_ERROR_CHECK_WITHOUT_ABORT(stepper_gen_run(step_axis_gen[axis], segments, num_segments));
+    idle_manager_motion_end();
+    pos_journal_motion_end();
+}
+
+// a geared move: master and slaves get the same shaped move through their gear encoders, synced;
+// the master's take-up (NULL for none) and the slaves' reversals go out first, one axis at a time
+static void stepper_gear_run(step_axis_t master, int dir, uint32_t freq_hz, uint64_t steps,
+                             const step_gear_link_t *links, bool master_moves, const stepper_segment_t *take_up)
+{
+    // payloads are read when the transaction starts, keep them alive until all done
+    static stepper_motor_gear_payload_t payloads[STEP_AXIS_MAX];
+    rmt_channel_handle_t chans[STEP_AXIS_MAX];
+    step_axis_t chan_axes[STEP_AXIS_MAX];
+    uint32_t num_chans = 0;
+    stepper_shaper_t shaper;
+    stepper_motor_gear_payload_t move = {
+        .dir = dir,
+    };
+    rmt_transmit_config_t tx_config = {
+        .loop_count = 0,
+    };
+    rmt_sync_manager_handle_t synchro = NULL;
+    stepper_segment_t take_ups[STEP_AXIS_MAX];
+    bool taking_up[STEP_AXIS_MAX] = {false};
+
+    if (take_up)
     {
-        // get speed changed by switch(3x)
-        if (xQueueReceive(step_Y_queue, &step_rev_Y, portMAX_DELAY))
+        take_ups[master] = *take_up;
+        taking_up[master] = true;
+    }
+    stepper_shape_get(master, &shaper);
+    move.num_segments = stepper_shaper_apply(&shaper, freq_hz, steps, move.segments);
+    // the master is cut as finely as its finest slave, so a 1:1 slave pulses with it
+    stepper_gear_init(&move.gear, 1, 1);
+    for (int i = 0; i < STEP_AXIS_MAX; i++)
+    {
+        if (links[i].on && links[i].master == master && links[i].gear.split > move.gear.split)
         {
-            if (step_rev_Y > 0)
-            {
-                gpio_set_level(STEP_MOTOR_GPIO_DIR_Y, STEP_MOTOR_SPIN_DIR_CLOCKWISE);
-            }
-            else if (step_rev_Y < 0)
-            {
-                gpio_set_level(STEP_MOTOR_GPIO_DIR_Y, STEP_MOTOR_SPIN_DIR_COUNTERCLOCKWISE);
-                step_rev_Y *= (-1);
-            }
+            move.gear.split = links[i].gear.split;
+        }
+    }
+    for (int i = 0; i < STEP_AXIS_MAX; i++)
+    {
+        bool slave = links[i].on && links[i].master == master;
+        if (i == master ? !master_moves : !slave)
+        {
+            continue;
+        }
+        payloads[i] = move;
+        payloads[i].axis = slave;
+        if (slave)
+        {
+            payloads[i].gear = links[i].gear;
+            int slave_dir = links[i].gear.num < 0 ? -dir : dir;
+            taking_up[i] = stepper_set_dir(i, slave_dir, &take_ups[i]) != 0;
+        }
+        chans[num_chans] = *step_axis_chan[i];
+        chan_axes[num_chans++] = i;
+    }
 
-            freq_run = get_current_motor_speed();
-            tx_config.loop_count = step_rev_Y * step_basic * motor_speed;
+    idle_manager_motion_begin();
+    pos_journal_motion_begin();
+    for (int i = 0; i < STEP_AXIS_MAX; i++)
+    {
+        if (taking_up[i])
+        {
+            stepper_take_up_run(i, &take_ups[i]);
+        }
+    }
+    if (num_chans > 1)
+    {
+        // a synced channel waits for the rest of its group, the group only lives as long as the move
+        rmt_sync_manager_config_t synchro_config = {
+            .tx_channel_array = chans,
+            .array_size = num_chans,
+        };
+        ESP_ERROR_CHECK(rmt_new_sync_manager(&synchro_config, &synchro));
+    }
+    for (uint32_t i = 0; i < num_chans; i++)
+    {
+        ESP_ERROR_CHECK(rmt_transmit(chans[i], gear_motor_encoder[chan_axes[i]], &payloads[chan_axes[i]], sizeof(payloads[0]), &tx_config));
+    }
+    for (uint32_t i = 0; i < num_chans; i++)
+    {
+        ESP_ERROR_CHECK(rmt_tx_wait_all_done(chans[i], -1));
+    }
+    if (synchro)
+    {
+        ESP_ERROR_CHECK(rmt_del_sync_manager(synchro));
+    }
+    idle_manager_motion_end();
+    pos_journal_motion_end();
 
-            ESP_ERROR_CHECK(rmt_transmit(motor_chan_Y, uniform_motor_encoder, &freq_run, sizeof(freq_run), &tx_config));
-            ESP_ERROR_CHECK(rmt_tx_wait_all_done(motor_chan_Y, -1));
+    if (master_moves)
+    {
+        stepper_pos_add(master, dir * (int64_t)steps);
+    }
+    for (int i = 0; i < STEP_AXIS_MAX; i++)
+    {
+        if (!links[i].on || links[i].master != master)
+        {
+            continue;
+        }
+        // same steps the encoder made, the remainder carries to the next move unless the link changed meanwhile
+        stepper_gear_t gear = links[i].gear;
+        stepper_pos_add(i, stepper_gear_follow(&gear, dir * (int64_t)steps));
+        portENTER_CRITICAL(&step_gear_lock);
+        step_gear_link_t *link = &step_gear_links[i];
+        if (link->on && link->master == master && link->gear.num == gear.num && link->gear.den == gear.den)
+        {
+            link->gear.acc = gear.acc;
         }
+        portEXIT_CRITICAL(&step_gear_lock);
     }
 }
 
-static void task_stepper_motor_Z_handler(void *Param)
+// the axes a jog of this one moves, its slaves follow
+static bool stepper_jog_group(step_axis_t axis, step_gear_link_t *links, bool *group, bool *master_moves)
 {
-    static int step_rev_Z = 0;
-    static uint32_t freq_run = 0;
+    bool geared = false;
 
-    for (;;)
+    *master_moves = true;
+    portENTER_CRITICAL(&step_gear_lock);
+    memcpy(links, step_gear_links, sizeof(step_gear_links));
+    portEXIT_CRITICAL(&step_gear_lock);
+    for (int i = 0; i < STEP_AXIS_MAX; i++)
     {
-        // get speed changed by switch(3x)
-        if (xQueueReceive(step_Z_queue, &step_rev_Z, portMAX_DELAY))
+        group[i] = false;
+        if (links[i].on && links[i].master == axis)
         {
-            if (step_rev_Z > 0)
-            {
-                gpio_set_level(STEP_MOTOR_GPIO_DIR_Z, STEP_MOTOR_SPIN_DIR_CLOCKWISE);
-            }
-            else if (step_rev_Z < 0)
+            // every slave of a master is set to the same mode
+            group[i] = geared = true;
+            *master_moves = !links[i].knob;
+        }
+    }
+    group[axis] = *master_moves;
+    return geared;
+}
+
+// the executor never waits for an axis, a group it can't take whole now is tried again later
+static bool stepper_jog_take(const bool *group)
+{
+    // lower axis first, like arcs
+    for (int i = 0; i < STEP_AXIS_MAX; i++)
+    {
+        if (group[i] && xSemaphoreTake(step_axis_mutex[i], 0) != pdTRUE)
+        {
+            for (int j = i - 1; j >= 0; j--)
             {
-                gpio_set_level(STEP_MOTOR_GPIO_DIR_Z, STEP_MOTOR_SPIN_DIR_COUNTERCLOCKWISE);
-                step_rev_Z *= (-1);
+                if (group[j])
+                {
+                    xSemaphoreGive(step_axis_mutex[j]);
+                }
             }
-
-            freq_run = get_current_motor_speed();
-            tx_config.loop_count = step_rev_Z * step_basic * motor_speed;
-
-            ESP_ERROR_CHECK(rmt_transmit(motor_chan_Z, uniform_motor_encoder, &freq_run, sizeof(freq_run), &tx_config));
-            ESP_ERROR_CHECK(rmt_tx_wait_all_done(motor_chan_Z, -1));
+            return false;
         }
     }
+    return true;
 }
 
-void stepper_motor_activate(void)
+static void stepper_jog_give(const bool *group)
 {
-    // DIR gpio
-    gpio_config_t stepper_dir_io = {
-        .intr_type = GPIO_INTR_DISABLE,
-        .mode = GPIO_MODE_OUTPUT,
-        .pin_bit_mask = ((1ULL << STEP_MOTOR_GPIO_DIR_X) | (1ULL << STEP_MOTOR_GPIO_DIR_Y) | (1ULL << STEP_MOTOR_GPIO_DIR_Z)),
-        .pull_down_en = 0,
-        .pull_up_en = 1,
-    };
-    gpio_config(&stepper_dir_io);
-
-    //
-    rmt_tx_channel_config_t tx_chan_X_config = {
-        .clk_src = RMT_CLK_SRC_DEFAULT, // select clock source
-        .gpio_num = STEP_MOTOR_GPIO_STEP_X,
-        .mem_block_symbols = 48,
-        .resolution_hz = STEP_MOTOR_RESOLUTION_HZ,
-        .trans_queue_depth = 5, // set the number of transactions that can be pending in the background
-    };
-    rmt_tx_channel_config_t tx_chan_Y_config = {
-        .clk_src = RMT_CLK_SRC_DEFAULT, // select clock source
-        .gpio_num = STEP_MOTOR_GPIO_STEP_Y,
-        .mem_block_symbols = 48,
-        .resolution_hz = STEP_MOTOR_RESOLUTION_HZ,
-        .trans_queue_depth = 5, // set the number of transactions that can be pending in the background
-    };
-    rmt_tx_channel_config_t tx_chan_Z_config = {
-        .clk_src = RMT_CLK_SRC_DEFAULT, // select clock source
-        .gpio_num = STEP_MOTOR_GPIO_STEP_Z,
-        .mem_block_symbols = 48,
-        .resolution_hz = STEP_MOTOR_RESOLUTION_HZ,
-        .trans_queue_depth = 5, // set the number of transactions that can be pending in the background
-    };
-    ESP_ERROR_CHECK(rmt_new_tx_channel(&tx_chan_X_config, &motor_chan_X));
-    ESP_ERROR_CHECK(rmt_new_tx_channel(&tx_chan_Y_config, &motor_chan_Y));
-    ESP_ERROR_CHECK(rmt_new_tx_channel(&tx_chan_Z_config, &motor_chan_Z));
-
-    stepper_motor_uniform_encoder_config_t uniform_encoder_config = {
-        .resolution = STEP_MOTOR_RESOLUTION_HZ,
-    };
-    ESP_ERROR_CHECK(rmt_new_stepper_motor_uniform_encoder(&uniform_encoder_config, &uniform_motor_encoder));
-
-    ESP_ERROR_CHECK(rmt_enable(motor_chan_X));
-    ESP_ERROR_CHECK(rmt_enable(motor_chan_Y));
-    ESP_ERROR_CHECK(rmt_enable(motor_chan_Z));
-
-    step_X_queue = xQueueCreate(2, sizeof(int));
-    step_Y_queue = xQueueCreate(2, sizeof(int));
-    step_Z_queue = xQueueCreate(2, sizeof(int));
-    xTaskCreate(task_stepper_motor_X_handler,
-                "task_stepper_motor_X_handler",
-                task_stepper_motor_X_stackdepth,
-                NULL,
-                task_stepper_motor_X_priority,
-                &task_stepper_motor_X_handle);
-
-    xTaskCreate(task_stepper_motor_Y_handler,
-                "task_stepper_motor_Y_handler",
-                task_stepper_motor_Y_stackdepth,
-                NULL,
-                task_stepper_motor_Y_priority,
-                &task_stepper_motor_Y_handle);
-
-    xTaskCreate(task_stepper_motor_Z_handler,
-                "task_stepper_motor_Z_handler",
-                task_stepper_motor_Z_stackdepth,
-                NULL,
-                task_stepper_motor_Z_priority,
-                &task_stepper_motor_Z_handle);
-
-    // freq x1
-    if (nvs_get_u32(motor_nvs_handle, "freq_set_x1", &freq_x1) == ESP_OK)
-        ESP_LOGI(TAG, "get freq_set_x1 = %luHz from nvs", freq_x1);
-    else
-        ESP_LOGW(TAG, "cannot get freq_set_x1 from nvs, using default value: %lu", freq_x1);
+    for (int i = STEP_AXIS_MAX - 1; i >= 0; i--)
+    {
+        if (group[i])
+        {
+            xSemaphoreGive(step_axis_mutex[i]);
+        }
+    }
+}
 
-    // freq x10
-    if (nvs_get_u32(motor_nvs_handle, "freq_set_x10", &freq_x10) == ESP_OK)
-        ESP_LOGI(TAG, "get freq_set_x10 = %luHz from nvs", freq_x10);
-    else
-        ESP_LOGW(TAG, "cannot get freq_set_x10 from nvs, using default value: %lu", freq_x10);
+// from the step generator's done isr
+static bool IRAM_ATTR stepper_jog_on_done(stepper_gen_t *gen, void *user_ctx)
+{
+    return step_jog_cbs.on_done ? step_jog_cbs.on_done((int)(intptr_t)user_ctx, step_jog_cbs.arg) : false;
+}
 
-    // freq x100
-    if (nvs_get_u32(motor_nvs_handle, "freq_set_x100", &freq_x100) == ESP_OK)
-        ESP_LOGI(TAG, "get freq_set_x100 = %luHz from nvs", freq_x100);
-    else
-        ESP_LOGW(TAG, "cannot get freq_set_x100 from nvs, using default value: %lu", freq_x100);
+void stepper_motor_jog_register_callbacks(const stepper_jog_callbacks_t *cbs)
+{
+    step_jog_cbs = *cbs;
+}
 
-    // basic step
-    if (nvs_get_u32(motor_nvs_handle, "step_basic_set", &step_basic) == ESP_OK)
-        ESP_LOGI(TAG, "get step_basic_set = %lu from nvs", step_basic);
-    else
-        ESP_LOGW(TAG, "cannot get step_basic_set from nvs, using default value: %lu", step_basic);
+bool stepper_motor_jog_send(int axis, int counts, TickType_t wait)
+{
+    if (xQueueSend(*step_axis_queue[axis], &counts, wait) != pdTRUE)
+    {
+        return false;
+    }
+    if (step_jog_cbs.on_queued)
+    {
+        step_jog_cbs.on_queued(step_jog_cbs.arg);
+    }
+    return true;
 }
 
-/*************************************************/
-// command tools:
+bool stepper_motor_jog_receive(int axis, int *counts)
+{
+    return xQueueReceive(*step_axis_queue[axis], counts, 0) == pdTRUE;
+}
 
-static struct
+bool stepper_motor_jog_busy(int axis)
 {
-    struct arg_int *freq_set_x1;
-    struct arg_int *freq_set_x10;
-    struct arg_int *freq_set_x100;
-    struct arg_int *step_basic_set;
-    struct arg_end *end;
-} motor_set_args;
+    return step_jogs[axis].busy;
+}
 
-static int do_motor_set_cmd(int argc, char **argv)
+bool stepper_motor_jog_start(int axis, int counts)
 {
-    int nerrors = arg_parse(argc, argv, (void **)&motor_set_args);
-    if (nerrors != 0)
+    step_gear_link_t links[STEP_AXIS_MAX];
+    bool group[STEP_AXIS_MAX];
+    bool master_moves;
+    step_jog_t *jog = &step_jogs[axis];
+
+    if (jog->busy)
     {
-        arg_print_errors(stderr, motor_set_args.end, argv[0]);
-        return 0;
+        return false;
+    }
+    // a count moves half of step_basic * speed, a detent's 4 as far as the two counts of x2 decoding
+    int64_t halves = (int64_t)counts * step_basic * motor_speed + jog->half;
+    int64_t move = halves / 2;
+    if (move == 0)
+    {
+        // less than a step, a count of an odd step_basic at x1: the half waits for the next count
+        jog->half = (int)halves;
+        return true;
+    }
+    bool geared = stepper_jog_group(axis, links, group, &master_moves);
+    if (!stepper_jog_take(group))
+    {
+        return false;
+    }
+    // not while a journal record is appended, it may be erasing a sector: held and tried again
+    if (!pos_journal_motion_try_begin())
+    {
+        stepper_jog_give(group);
+        return false;
     }
+    jog->half = (int)(halves - move * 2);
 
-    // args
-    if (motor_set_args.freq_set_x1->count)
+    int dir = move < 0 ? -1 : 1;
+    stepper_segment_t segments[STEPPER_GEN_SEGMENT_MAX];
+    // a reversal's take-up leads the move, a geared move puts it out on its own first; a master that
+    // stays keeps its DIR and its slack where they are
+    uint32_t num_take_up = master_moves ? stepper_set_dir(axis, dir, &segments[0]) : 0;
+    uint32_t take_up = num_take_up ? (uint32_t)segments[0].steps : 0;
+    uint32_t freq_hz = get_current_motor_speed();
+    uint64_t steps = (uint64_t)(dir * move);
+
+    memcpy(jog->group, group, sizeof(jog->group));
+
+    // geared moves sync several channels and the pwm backends count their own pulses, both block until
+    // their last step: the jog task runs those and ends them in on_done like the rest
+    if (geared || !stepper_gen_can_start(step_axis_gen[axis]))
     {
-        freq_x1 = motor_set_args.freq_set_x1->ival[0];
-        ESP_LOGI(TAG, "freq(x1) set successfully");
-        if (nvs_set_u32(motor_nvs_handle, "freq_set_x1", freq_x1) == ESP_OK)
-        {
-            ESP_LOGI(TAG, "freq(x1) saved");
-        }
-        else
+        step_jog_run_t *run = &step_jog_runs[axis];
+        run->dir = dir;
+        run->freq_hz = freq_hz;
+        run->steps = steps;
+        run->geared = geared;
+        run->master_moves = master_moves;
+        memcpy(run->links, links, sizeof(run->links));
+        if (num_take_up)
         {
-            ESP_LOGW(TAG, "cannot save freq(x1)");
+            run->segments[0] = segments[0];
         }
+        run->num_segments = geared ? num_take_up : stepper_shape_move(axis, freq_hz, steps, run->segments, num_take_up);
+        jog->busy = true;
+        // a geared move books its axes itself, slaves included
+        jog->steps = geared ? 0 : dir * (int64_t)steps;
+        idle_manager_motion_begin();
+        xQueueSend(step_jog_run_queue, &axis, portMAX_DELAY); // room for every axis
+        return true;
     }
 
-    if (motor_set_args.freq_set_x10->count)
+    uint32_t num_segments = stepper_shape_move(axis, freq_hz, steps, segments, num_take_up);
+
+    stepper_gen_count_t count;
+    stepper_gen_count(step_axis_gen[axis], &count);
+    jog->busy = true;
+    portENTER_CRITICAL(&step_pos_lock);
+    jog->steps = dir * (int64_t)steps;
+    jog->base = count.steps;
+    jog->take_up = take_up;
+    jog->live = true;
+    portEXIT_CRITICAL(&step_pos_lock);
+    idle_manager_motion_begin();
+    if (ESP_ERROR_CHECK_WITHOUT_ABORT(stepper_gen_start(step_axis_gen[axis], segments, num_segments)) != ESP_OK)
     {
-        freq_x10 = motor_set_args.freq_set_x10->ival[0];
-        ESP_LOGI(TAG, "freq(x10) set successfully");
-        if (nvs_set_u32(motor_nvs_handle, "freq_set_x10", freq_x10) == ESP_OK)
-        {
-            ESP_LOGI(TAG, "freq(x10) saved");
-        }
-        else
-        {
-            ESP_LOGW(TAG, "cannot save freq(x10)");
-        }
+        jog->steps = 0;
+        stepper_motor_jog_finish(axis);
     }
+    return true;
+}
 
-    if (motor_set_args.freq_set_x100->count)
+void stepper_motor_jog_finish(int axis)
+{
+    step_jog_t *jog = &step_jogs[axis];
+
+    if (!jog->busy)
     {
-        freq_x100 = motor_set_args.freq_set_x100->ival[0];
-        ESP_LOGI(TAG, "freq(x100) set successfully");
-        if (nvs_set_u32(motor_nvs_handle, "freq_set_x100", freq_x100) == ESP_OK)
+        return;
+    }
+    idle_manager_motion_end();
+    pos_journal_motion_end();
+    // booked and taken off the live count at once, telemetry never sees the steps twice
+    portENTER_CRITICAL(&step_pos_lock);
+    step_axis_pos[axis] += jog->steps;
+    jog->live = false;
+    portEXIT_CRITICAL(&step_pos_lock);
+    stepper_pos_journal();
+    jog->busy = false;
+    stepper_jog_give(jog->group);
+}
+
+static void task_stepper_jog_handler(void *Param)
+{
+    int axis;
+
+    for (;;)
+    {
+        xQueueReceive(step_jog_run_queue, &axis, portMAX_DELAY);
+        step_jog_run_t *run = &step_jog_runs[axis];
+        if (run->geared)
         {
-            ESP_LOGI(TAG, "freq(x100) saved");
+            stepper_gear_run(axis, run->dir, run->freq_hz, run->steps, run->links, run->master_moves,
+                             run->num_segments ? &run->segments[0] : NULL);
         }
         else
         {
-            ESP_LOGW(TAG, "cannot save freq(x100)");
+            stepper_motor_run(axis, run->segments, run->num_segments);
+        }
+        // the isr's callback, safe from a task as well
+        if (step_jog_cbs.on_done && step_jog_cbs.on_done(axis, step_jog_cbs.arg))
+        {
+            taskYIELD();
         }
     }
+}
 
-    if (motor_set_args.step_basic_set->count)
+void stepper_motor_sample(int axis, stepper_axis_sample_t *sample)
+{
+    step_jog_t *jog = &step_jogs[axis];
+    stepper_gen_count_t count;
+
+    stepper_gen_count(step_axis_gen[axis], &count);
+    portENTER_CRITICAL(&step_pos_lock);
+    sample->pos = step_axis_pos[axis];
+    if (jog->live)
     {
-        step_basic = motor_set_args.step_basic_set->ival[0];
-        ESP_LOGI(TAG, "step basic set successfully");
-        if (nvs_set_u32(motor_nvs_handle, "step_basic_set", step_basic) == ESP_OK)
+        uint64_t total = jog->steps < 0 ? -jog->steps : jog->steps;
+        uint64_t out = (uint32_t)(count.steps - jog->base);
+        // the take-up goes out first, the nut stays put through it
+        out = out > jog->take_up ? out - jog->take_up : 0;
+        out = out < total ? out : total;
+        sample->pos += jog->steps < 0 ? -(int64_t)out : (int64_t)out;
+    }
+    portEXIT_CRITICAL(&step_pos_lock);
+    sample->freq_hz = step_axis_dir[axis] * (int32_t)count.freq_hz;
+    sample->queued = uxQueueMessagesWaiting(*step_axis_queue[axis]);
+    sample->pending = count.pending;
+}
+
+static bool stepper_shape_update(step_shape_t *shape, uint32_t type, uint32_t freq_mhz, uint32_t damping_pm)
+{
+    stepper_shaper_t shaper;
+
+    if (!stepper_shaper_init(&shaper, type, freq_mhz / 1000.0f, damping_pm / 1000.0f))
+    {
+        return false;
+    }
+    portENTER_CRITICAL(&step_shape_lock);
+    shape->type = type;
+    shape->freq_mhz = freq_mhz;
+    shape->damping_pm = damping_pm;
+    shape->shaper = shaper;
+    portEXIT_CRITICAL(&step_shape_lock);
+    return true;
+}
+
+static void stepper_shape_load(void)
+{
+    char key[NVS_KEY_NAME_MAX_SIZE];
+
+    for (int i = 0; i < STEP_AXIS_MAX; i++)
+    {
+        step_shape_t *shape = &step_shapes[i];
+        uint32_t type = SHAPE_DEFAULT_TYPE;
+        uint32_t freq_mhz = SHAPE_DEFAULT_FREQ_mHz;
+        uint32_t damping_pm = SHAPE_DEFAULT_DAMPING_pm;
+
+        snprintf(key, sizeof(key), "shape_%s_type", shape->name);
+        nvs_get_u32(motor_nvs_handle, key, &type);
+        snprintf(key, sizeof(key), "shape_%s_freq", shape->name);
+        nvs_get_u32(motor_nvs_handle, key, &freq_mhz);
+        snprintf(key, sizeof(key), "shape_%s_damp", shape->name);
+        nvs_get_u32(motor_nvs_handle, key, &damping_pm);
+
+        if (stepper_shape_update(shape, type, freq_mhz, damping_pm))
         {
-            ESP_LOGI(TAG, "step basic saved");
+            ESP_LOGI(TAG, "axis %s shaper %s, %lu.%03luHz, damping 0.%03lu", shape->name,
+                     stepper_shaper_name(type), freq_mhz / 1000, freq_mhz % 1000, damping_pm);
         }
         else
         {
-            ESP_LOGW(TAG, "cannot save step basic");
+            ESP_LOGW(TAG, "invalid axis %s shaper from nvs, using default value: none", shape->name);
+            stepper_shape_update(shape, STEPPER_SHAPER_NONE, SHAPE_DEFAULT_FREQ_mHz, SHAPE_DEFAULT_DAMPING_pm);
         }
     }
+}
+
+static bool stepper_pulse_valid(const stepper_pulse_t *pulse)
+{
+    return pulse->high_ns <= STEP_PULSE_NS_MAX && pulse->low_ns <= STEP_PULSE_NS_MAX && pulse->dir_setup_ns <= STEP_PULSE_NS_MAX;
+}
+
+static void stepper_pulse_load(void)
+{
+    char key[NVS_KEY_NAME_MAX_SIZE];
+
+    for (int i = 0; i < STEP_AXIS_MAX; i++)
+    {
+        stepper_pulse_t *pulse = &step_axis_pulse[i];
+        uint32_t fixed = STEP_PULSE_DEFAULT_FIXED;
+
+        pulse->high_ns = STEP_PULSE_DEFAULT_HIGH_ns;
+        pulse->low_ns = STEP_PULSE_DEFAULT_LOW_ns;
+        pulse->dir_setup_ns = STEP_PULSE_DEFAULT_DIR_ns;
+        snprintf(key, sizeof(key), "pulse_%s_high", step_shapes[i].name);
+        nvs_get_u32(motor_nvs_handle, key, &pulse->high_ns);
+        snprintf(key, sizeof(key), "pulse_%s_low", step_shapes[i].name);
+        nvs_get_u32(motor_nvs_handle, key, &pulse->low_ns);
+        snprintf(key, sizeof(key), "pulse_%s_dir", step_shapes[i].name);
+        nvs_get_u32(motor_nvs_handle, key, &pulse->dir_setup_ns);
+        snprintf(key, sizeof(key), "pulse_%s_fix", step_shapes[i].name);
+        nvs_get_u32(motor_nvs_handle, key, &fixed);
+        pulse->fixed = fixed != 0;
+
+        if (!stepper_pulse_valid(pulse))
+        {
+            ESP_LOGW(TAG, "invalid axis %s pulse timing from nvs, using default values", step_shapes[i].name);
+            *pulse = (stepper_pulse_t){STEP_PULSE_DEFAULT_HIGH_ns, STEP_PULSE_DEFAULT_LOW_ns, STEP_PULSE_DEFAULT_DIR_ns, STEP_PULSE_DEFAULT_FIXED};
+        }
+    }
+}
+
+static void stepper_lash_load(void)
+{
+    char key[NVS_KEY_NAME_MAX_SIZE];
+
+    for (int i = 0; i < STEP_AXIS_MAX; i++)
+    {
+        uint32_t steps = STEP_LASH_DEFAULT_STEPS;
+        uint32_t freq_hz = STEP_LASH_DEFAULT_HZ;
+
+        snprintf(key, sizeof(key), "lash_%s_steps", step_shapes[i].name);
+        nvs_get_u32(motor_nvs_handle, key, &steps);
+        snprintf(key, sizeof(key), "lash_%s_hz", step_shapes[i].name);
+        nvs_get_u32(motor_nvs_handle, key, &freq_hz);
+
+        if (!stepper_lash_set(&step_axis_lash[i], steps, freq_hz))
+        {
+            ESP_LOGW(TAG, "invalid axis %s backlash from nvs, using default value: none", step_shapes[i].name);
+            stepper_lash_set(&step_axis_lash[i], STEP_LASH_DEFAULT_STEPS, STEP_LASH_DEFAULT_HZ);
+        }
+        else if (steps)
+        {
+            ESP_LOGI(TAG, "axis %s backlash %lu steps, taken up at %luHz", step_shapes[i].name, steps, freq_hz);
+        }
+    }
+}
+
+// map the ramp partition just long enough to copy the ramps the axes can use into ram
+static void stepper_ramp_load(void)
+{
+    const void *image;
+    esp_partition_mmap_handle_t mmap;
+
+    step_ramp_part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, STEP_RAMP_SUBTYPE, STEP_RAMP_PARTITION);
+    if (!step_ramp_part)
+    {
+        ESP_LOGW(TAG, "no \"%s\" partition, moves start at full rate", STEP_RAMP_PARTITION);
+        return;
+    }
+    if (esp_partition_mmap(step_ramp_part, 0, step_ramp_part->size, ESP_PARTITION_MMAP_DATA, &image, &mmap) != ESP_OK)
+    {
+        ESP_LOGW(TAG, "cannot map the ramp partition, moves start at full rate");
+        return;
+    }
+    if (!stepper_ramp_check(image, step_ramp_part->size))
+    {
+        ESP_LOGW(TAG, "no valid ramp image in the partition, flash one made by tools/ramp_gen");
+        esp_partition_munmap(mmap);
+        return;
+    }
+    uint32_t num_mapped = ((const stepper_ramp_header_t *)image)->num_entries;
+    uint32_t num_usable = 0;
+    for (uint32_t i = 0; i < num_mapped; i++)
+    {
+        for (int axis = 0; axis < STEP_AXIS_MAX; axis++)
+        {
+            if (stepper_ramp_entries(image)[i].resolution == step_axis_resolution_hz[axis])
+            {
+                num_usable++;
+                break;
+            }
+        }
+    }
+    size_t size = stepper_ramp_copy(step_ramp_ram, sizeof(step_ramp_ram), image, step_axis_resolution_hz, STEP_AXIS_MAX);
+    esp_partition_munmap(mmap);
+    if (size == 0)
+    {
+        ESP_LOGW(TAG, "none of the %lu ramps fit an axis resolution in %uB of ram, moves start at full rate",
+                 num_mapped, STEP_RAMP_RAM_SIZE);
+        return;
+    }
+    step_ramp_image = step_ramp_ram;
+
+    const stepper_ramp_header_t *header = step_ramp_image;
+    ESP_LOGI(TAG, "%u of %lu ramps copied to ram, %luB", header->num_entries, num_mapped, header->size);
+    if (header->num_entries < num_usable)
+    {
+        ESP_LOGW(TAG, "%lu ramps at an axis resolution left out, over %uB", num_usable - header->num_entries, STEP_RAMP_RAM_SIZE);
+    }
+    for (int axis = 0; axis < STEP_AXIS_MAX; axis++)
+    {
+        uint32_t usable = 0;
+        for (uint32_t i = 0; i < header->num_entries; i++)
+        {
+            usable += stepper_ramp_entries(step_ramp_image)[i].resolution == step_axis_resolution_hz[axis];
+        }
+        ESP_LOGI(TAG, "axis %s: %lu of them at its %luHz resolution", step_shapes[axis].name, usable, step_axis_resolution_hz[axis]);
+    }
+}
+
+// an arc is sent one direction run at a time, DIR pins switch between runs while both channels are stopped
+static void task_stepper_arc_handler(void *Param)
+{
+    static step_arc_cmd_t cmd;
+    // payloads are read when the transaction starts, keep them alive until all done
+    static stepper_motor_arc_payload_t payload_a;
+    static stepper_motor_arc_payload_t payload_b;
+    int dir_a, dir_b;
+
+    for (;;)
+    {
+        if (xQueueReceive(step_arc_queue, &cmd, portMAX_DELAY))
+        {
+            // lower axis first, so two arcs sharing an axis can't deadlock
+            step_axis_t first = cmd.axis_a < cmd.axis_b ? cmd.axis_a : cmd.axis_b;
+            step_axis_t second = cmd.axis_a < cmd.axis_b ? cmd.axis_b : cmd.axis_a;
+            xSemaphoreTake(step_axis_mutex[first], portMAX_DELAY);
+            xSemaphoreTake(step_axis_mutex[second], portMAX_DELAY);
+
+            rmt_channel_handle_t chan_a = *step_axis_chan[cmd.axis_a];
+            rmt_channel_handle_t chan_b = *step_axis_chan[cmd.axis_b];
+            rmt_channel_handle_t chans[2] = {chan_a, chan_b};
+            rmt_sync_manager_config_t synchro_config = {
+                .tx_channel_array = chans,
+                .array_size = 2,
+            };
+            rmt_sync_manager_handle_t synchro = NULL;
+            rmt_transmit_config_t tx_config = {
+                .loop_count = 0,
+            };
+
+            idle_manager_motion_begin();
+            pos_journal_motion_begin();
+            // a synced channel waits for the rest of its group, the group only lives as long as the arc
+            ESP_ERROR_CHECK(rmt_new_sync_manager(&synchro_config, &synchro));
+            for (;;)
+            {
+                payload_a.arc = cmd.arc;
+                payload_a.steps = stepper_arc_run(&cmd.arc, &dir_a, &dir_b);
+                if (payload_a.steps == 0)
+                {
+                    break;
+                }
+                payload_a.feed_hz = cmd.feed_hz;
+                payload_a.axis = 0;
+                payload_b = payload_a;
+                payload_b.axis = 1;
+
+                // a reversing axis takes its slack up on its own channel, out of the sync group, so
+                // the arc run that follows moves the nut the whole way
+                stepper_segment_t take_up_a;
+                stepper_segment_t take_up_b;
+                bool lash_a = dir_a && stepper_set_dir(cmd.axis_a, dir_a, &take_up_a);
+                bool lash_b = dir_b && stepper_set_dir(cmd.axis_b, dir_b, &take_up_b);
+                if (lash_a || lash_b)
+                {
+                    ESP_ERROR_CHECK(rmt_del_sync_manager(synchro));
+                    if (lash_a)
+                    {
+                        stepper_take_up_run(cmd.axis_a, &take_up_a);
+                    }
+                    if (lash_b)
+                    {
+                        stepper_take_up_run(cmd.axis_b, &take_up_b);
+                    }
+                    ESP_ERROR_CHECK(rmt_new_sync_manager(&synchro_config, &synchro));
+                }
+                ESP_ERROR_CHECK(rmt_sync_reset(synchro));
+                ESP_ERROR_CHECK(rmt_transmit(chan_a, arc_motor_encoder[cmd.axis_a], &payload_a, sizeof(payload_a), &tx_config));
+                ESP_ERROR_CHECK(rmt_transmit(chan_b, arc_motor_encoder[cmd.axis_b], &payload_b, sizeof(payload_b), &tx_config));
+                ESP_ERROR_CHECK(rmt_tx_wait_all_done(chan_a, -1));
+                ESP_ERROR_CHECK(rmt_tx_wait_all_done(chan_b, -1));
+            }
+            ESP_ERROR_CHECK(rmt_del_sync_manager(synchro));
+            idle_manager_motion_end();
+            pos_journal_motion_end();
+            stepper_pos_add(cmd.axis_a, cmd.end_a);
+            stepper_pos_add(cmd.axis_b, cmd.end_b);
+
+            xSemaphoreGive(step_axis_mutex[second]);
+            xSemaphoreGive(step_axis_mutex[first]);
+        }
+    }
+}
+
+static void IRAM_ATTR step_limit_isr_handler(void *arg)
+{
+    uint32_t isr_start = sys_isr_enter();
+    step_limit_t *limit = (step_limit_t *)arg;
+    int64_t now = esp_timer_get_time();
+    stepper_gen_count_t count;
+
+    portENTER_CRITICAL_ISR(&step_limit_lock);
+    // the first edge to active latches, bounces come within the debounce time and don't move it,
+    // an edge after a quiet input means the first one was a glitch
+    if (gpio_get_level(limit->gpio) == STEP_LIMIT_LEVEL_ACTIVE &&
+        (!limit->tripped || now - limit->edge_us >= STEP_LIMIT_DEBOUNCE_us))
+    {
+        if (limit->counted && stepper_gen_count(limit->gen, &count))
+        {
+            // the steps out on the pin, whatever the start latency and DIR setup
+            limit->trip_steps = count.steps - limit->start_steps;
+        }
+        else
+        {
+            // step pulses end their periods, a pulse is out half a period before its period ends
+            uint64_t elapsed_us = now > limit->start_us ? now - limit->start_us : 0;
+            limit->trip_steps = (elapsed_us * limit->freq_hz + 500000) / 1000000;
+        }
+        limit->tripped = true;
+    }
+    limit->edge_us = now;
+    portEXIT_CRITICAL_ISR(&step_limit_lock);
+
+    sys_isr_exit(SYS_ISR_LIMIT_LATCH, isr_start);
+}
+
+// right before the move starts, the generator is idle
+static void step_limit_arm(step_limit_t *limit, stepper_gen_handle_t gen, uint32_t freq_hz)
+{
+    stepper_gen_count_t count;
+    bool counted = stepper_gen_count(gen, &count);
+
+    portENTER_CRITICAL(&step_limit_lock);
+    limit->gen = gen;
+    limit->start_steps = count.steps;
+    limit->counted = counted;
+    limit->freq_hz = freq_hz;
+    limit->tripped = false;
+    limit->start_us = esp_timer_get_time();
+    portEXIT_CRITICAL(&step_limit_lock);
+}
+
+// level that has held for STEP_LIMIT_DEBOUNCE_us, waits out a bounce in progress
+static bool step_limit_active(step_limit_t *limit)
+{
+    for (int i = 0; i < STEP_LIMIT_SETTLE_TRIES; i++)
+    {
+        portENTER_CRITICAL(&step_limit_lock);
+        int64_t quiet_us = esp_timer_get_time() - limit->edge_us;
+        portEXIT_CRITICAL(&step_limit_lock);
+        if (quiet_us >= STEP_LIMIT_DEBOUNCE_us)
+        {
+            break;
+        }
+        esp_rom_delay_us(STEP_LIMIT_DEBOUNCE_us - quiet_us);
+    }
+    return gpio_get_level(limit->gpio) == STEP_LIMIT_LEVEL_ACTIVE;
+}
+
+static void step_limit_read(step_limit_t *limit, stepper_home_latch_t *latch)
+{
+    latch->active = step_limit_active(limit);
+    portENTER_CRITICAL(&step_limit_lock);
+    latch->tripped = limit->tripped;
+    latch->trip_steps = limit->trip_steps;
+    portEXIT_CRITICAL(&step_limit_lock);
+}
+
+// the caller holds the axis, moves are unshaped so a generator without a count can be timed instead
+static bool stepper_home_axis(step_axis_t axis, const stepper_home_config_t *config)
+{
+    step_limit_t *limit = &step_limits[axis];
+    stepper_home_t home;
+    stepper_home_move_t move;
+    stepper_home_latch_t latch;
+    int64_t start_us = esp_timer_get_time();
+
+    if (!stepper_home_init(&home, config, step_limit_active(limit)))
+    {
+        return false;
+    }
+
+    portENTER_CRITICAL(&step_pos_lock);
+    step_axis_homed[axis] = false;
+    portEXIT_CRITICAL(&step_pos_lock);
+
+    idle_manager_motion_begin();
+    pos_journal_motion_begin();
+    while (stepper_home_next(&home, &move))
+    {
+        stepper_segment_t segment = {
+            .freq_hz = move.freq_hz,
+            .steps = move.steps,
+            .exact = true, // the locate rate sets the repeatability, whatever the feed
+        };
+        stepper_set_dir(axis, move.dir, NULL);
+        step_limit_arm(limit, step_axis_gen[axis], move.freq_hz);
+        if (stepper_gen_run(step_axis_gen[axis], &segment, 1) != ESP_OK)
+        {
+            ESP_LOGE(TAG, "axis %s homing stopped, %luHz is out of the generator's range", step_shapes[axis].name, move.freq_hz);
+            break;
+        }
+        step_limit_read(limit, &latch);
+        stepper_home_report(&home, &latch);
+    }
+    idle_manager_motion_end();
+    pos_journal_motion_end();
+
+    if (home.phase != STEPPER_HOME_DONE)
+    {
+        ESP_LOGE(TAG, "axis %s homing failed in %s, %lld steps from the start", step_shapes[axis].name,
+                 stepper_home_phase_name(home.phase), home.pos);
+        // still counted, the journal keeps where the axis stopped
+        stepper_pos_add(axis, home.pos);
+        return false;
+    }
+
+    portENTER_CRITICAL(&step_pos_lock);
+    step_axis_pos[axis] = STEP_HOME_POS;
+    step_axis_homed[axis] = true;
+    portEXIT_CRITICAL(&step_pos_lock);
+    stepper_pos_journal();
+    ESP_LOGI(TAG, "axis %s homed in %lldms, switch %lld steps from the start, seek latch off by %lld",
+             step_shapes[axis].name, (esp_timer_get_time() - start_us) / 1000, home.found,
+             (home.found - home.ref) * config->dir);
+    return true;
+}
+
+static void task_stepper_home_handler(void *Param)
+{
+    static step_home_cmd_t cmd;
+
+    for (;;)
+    {
+        if (xQueueReceive(step_home_queue, &cmd, portMAX_DELAY))
+        {
+            stepper_home_config_t config = {
+                .dir = STEP_HOME_DIR,
+                .seek_hz = cmd.seek_hz,
+                .locate_hz = cmd.locate_hz,
+                .travel_max = STEP_HOME_TRAVEL_MAX,
+                .slow_steps = STEP_HOME_SLOW_STEPS,
+            };
+            for (uint32_t i = 0; i < cmd.num_axes; i++)
+            {
+                xSemaphoreTake(step_axis_mutex[cmd.axes[i]], portMAX_DELAY);
+                bool homed = stepper_home_axis(cmd.axes[i], &config);
+                xSemaphoreGive(step_axis_mutex[cmd.axes[i]]);
+                // later axes may rely on this one being clear, e.g. Z up before XY
+                if (!homed)
+                {
+                    break;
+                }
+            }
+        }
+    }
+}
+
+// idle: release hold current and the step generators' APB locks
+static void stepper_motor_idle_suspend(void *arg)
+{
+#ifdef STEP_MOTOR_GPIO_EN
+    gpio_set_level(STEP_MOTOR_GPIO_EN, STEP_MOTOR_EN_LEVEL_OFF);
+#endif
+    for (int i = 0; i < STEP_AXIS_MAX; i++)
+    {
+        ESP_ERROR_CHECK(stepper_gen_disable(step_axis_gen[i]));
+    }
+}
+
+static void stepper_motor_idle_resume(void *arg)
+{
+    for (int i = 0; i < STEP_AXIS_MAX; i++)
+    {
+        ESP_ERROR_CHECK(stepper_gen_enable(step_axis_gen[i]));
+    }
+#ifdef STEP_MOTOR_GPIO_EN
+    gpio_set_level(STEP_MOTOR_GPIO_EN, STEP_MOTOR_EN_LEVEL_ON);
+    esp_rom_delay_us(STEP_MOTOR_EN_WAKE_us);
+#endif
+    speed_switch_refresh();
+}
+
+void stepper_motor_activate(void)
+{
+    // DIR gpio
+    gpio_config_t stepper_dir_io = {
+        .intr_type = GPIO_INTR_DISABLE,
+        .mode = GPIO_MODE_OUTPUT,
+        .pin_bit_mask = ((1ULL << STEP_MOTOR_GPIO_DIR_X) | (1ULL << STEP_MOTOR_GPIO_DIR_Y) | (1ULL << STEP_MOTOR_GPIO_DIR_Z)),
+        .pull_down_en = 0,
+        .pull_up_en = 1,
+    };
+    gpio_config(&stepper_dir_io);
+
+#ifdef STEP_MOTOR_GPIO_EN
+    gpio_config_t stepper_en_io = {
+        .intr_type = GPIO_INTR_DISABLE,
+        .mode = GPIO_MODE_OUTPUT,
+        .pin_bit_mask = (1ULL << STEP_MOTOR_GPIO_EN),
+        .pull_down_en = 0,
+        .pull_up_en = 1,
+    };
+    gpio_config(&stepper_en_io);
+    gpio_set_level(STEP_MOTOR_GPIO_EN, STEP_MOTOR_EN_LEVEL_ON);
+#endif
+
+    // freq x1
+    if (nvs_get_u32(motor_nvs_handle, "freq_set_x1", &freq_x1) == ESP_OK)
+        ESP_LOGI(TAG, "get freq_set_x1 = %luHz from nvs", freq_x1);
+    else
+        ESP_LOGW(TAG, "cannot get freq_set_x1 from nvs, using default value: %lu", freq_x1);
+
+    // freq x10
+    if (nvs_get_u32(motor_nvs_handle, "freq_set_x10", &freq_x10) == ESP_OK)
+        ESP_LOGI(TAG, "get freq_set_x10 = %luHz from nvs", freq_x10);
+    else
+        ESP_LOGW(TAG, "cannot get freq_set_x10 from nvs, using default value: %lu", freq_x10);
+
+    // freq x100
+    if (nvs_get_u32(motor_nvs_handle, "freq_set_x100", &freq_x100) == ESP_OK)
+        ESP_LOGI(TAG, "get freq_set_x100 = %luHz from nvs", freq_x100);
+    else
+        ESP_LOGW(TAG, "cannot get freq_set_x100 from nvs, using default value: %lu", freq_x100);
+
+    // basic step
+    if (nvs_get_u32(motor_nvs_handle, "step_basic_set", &step_basic) == ESP_OK)
+        ESP_LOGI(TAG, "get step_basic_set = %lu from nvs", step_basic);
+    else
+        ESP_LOGW(TAG, "cannot get step_basic_set from nvs, using default value: %lu", step_basic);
+
+    stepper_shape_load();
+    stepper_pulse_load();
+    stepper_lash_load();
+    stepper_pos_restore();
+
+    uint32_t freq_min = freq_x1;
+    if (freq_x10 < freq_min)
+        freq_min = freq_x10;
+    if (freq_x100 < freq_min)
+        freq_min = freq_x100;
+    for (int i = 0; i < STEP_AXIS_MAX; i++)
+    {
+        // a fixed pulse changes the longest period one symbol holds, so the resolution is the axis' own
+#if STEP_MOTOR_DITHER
+        step_axis_resolution_hz[i] = stepper_pick_pulse_resolution(freq_min, &step_axis_pulse[i]);
+#else
+        step_axis_resolution_hz[i] = STEP_MOTOR_RESOLUTION_HZ;
+#endif
+        ESP_LOGI(TAG, "axis %s: %s step pulses, resolution %luHz for speeds from %luHz, up to %luHz", step_shapes[i].name,
+                 step_axis_pulse[i].fixed ? "fixed" : "50%", step_axis_resolution_hz[i], freq_min,
+                 stepper_pulse_max_hz(&step_axis_pulse[i], step_axis_resolution_hz[i]));
+    }
+    stepper_ramp_load();
+
+    for (int i = 0; i < STEP_AXIS_MAX; i++)
+    {
+        step_axis_mutex[i] = xSemaphoreCreateMutexStatic(&step_axis_mutex_buffer[i]);
+        stepper_motor_uniform_encoder_config_t uniform_encoder_config = {
+            .resolution = step_axis_resolution_hz[i],
+            .pulse = step_axis_pulse[i],
+            .flags.dither = STEP_MOTOR_DITHER,
+        };
+        stepper_motor_arc_encoder_config_t arc_encoder_config = {
+            .resolution = step_axis_resolution_hz[i],
+        };
+        stepper_motor_gear_encoder_config_t gear_encoder_config = {
+            .resolution = step_axis_resolution_hz[i],
+        };
+
+        switch (step_axis_backend[i])
+        {
+        case STEPPER_GEN_RMT:
+        {
+            rmt_tx_channel_config_t tx_chan_config = {
+                .clk_src = RMT_CLK_SRC_DEFAULT, // select clock source
+                .gpio_num = step_axis_step_gpio[i],
+                .mem_block_symbols = 48,
+                .resolution_hz = step_axis_resolution_hz[i],
+                .trans_queue_depth = STEPPER_GEN_RMT_QUEUE_DEPTH, // a whole jog is queued at once, see stepper_motor_jog_start
+            };
+            ESP_ERROR_CHECK(rmt_new_tx_channel(&tx_chan_config, step_axis_chan[i]));
+            ESP_ERROR_CHECK(rmt_new_stepper_motor_uniform_encoder(&uniform_encoder_config, step_axis_encoder[i]));
+            ESP_ERROR_CHECK(rmt_new_stepper_motor_arc_encoder(&arc_encoder_config, &arc_motor_encoder[i]));
+            ESP_ERROR_CHECK(rmt_new_stepper_motor_gear_encoder(&gear_encoder_config, &gear_motor_encoder[i]));
+            stepper_rmt_gen_config_t gen_config = {
+                .chan = *step_axis_chan[i],
+                .encoder = *step_axis_encoder[i],
+                .ramps = step_ramp_image,
+                .resolution = step_axis_resolution_hz[i],
+                .on_done = stepper_jog_on_done,
+                .user_ctx = (void *)(intptr_t)i,
+                .flags.dither = STEP_MOTOR_DITHER,
+            };
+            ESP_ERROR_CHECK(stepper_new_rmt_gen(&gen_config, &step_axis_gen[i]));
+            break;
+        }
+        case STEPPER_GEN_LEDC:
+        {
+            // LEDC timer and channel numbered after the axis
+            stepper_ledc_gen_config_t gen_config = {
+                .gpio_num = step_axis_step_gpio[i],
+                .timer_num = i,
+                .channel = i,
+            };
+            ESP_ERROR_CHECK(stepper_new_ledc_gen(&gen_config, &step_axis_gen[i]));
+            break;
+        }
+        case STEPPER_GEN_MCPWM:
+        {
+            stepper_mcpwm_gen_config_t gen_config = {
+                .gpio_num = step_axis_step_gpio[i],
+                .group_id = 0,
+            };
+            ESP_ERROR_CHECK(stepper_new_mcpwm_gen(&gen_config, &step_axis_gen[i]));
+            break;
+        }
+        default:
+            ESP_ERROR_CHECK(ESP_ERR_INVALID_ARG);
+            break;
+        }
+        ESP_ERROR_CHECK(stepper_gen_enable(step_axis_gen[i]));
+        ESP_LOGI(TAG, "axis %s steps from %s", step_shapes[i].name, step_axis_gen[i]->name);
+    }
+
+    idle_manager_register_hook(stepper_motor_idle_suspend, stepper_motor_idle_resume, NULL);
+
+    step_X_queue = xQueueCreateStatic(STEP_QUEUE_LENGTH, sizeof(int), step_X_queue_storage, &step_X_queue_buffer);
+    step_Y_queue = xQueueCreateStatic(STEP_QUEUE_LENGTH, sizeof(int), step_Y_queue_storage, &step_Y_queue_buffer);
+    step_Z_queue = xQueueCreateStatic(STEP_QUEUE_LENGTH, sizeof(int), step_Z_queue_storage, &step_Z_queue_buffer);
+
+    step_jog_run_queue = xQueueCreateStatic(STEP_AXIS_MAX, sizeof(int), step_jog_run_queue_storage, &step_jog_run_queue_buffer);
+    task_stepper_jog_handle = xTaskCreateStatic(task_stepper_jog_handler,
+                                                "task_stepper_jog_handler",
+                                                task_stepper_jog_stackdepth,
+                                                NULL,
+                                                task_stepper_jog_priority,
+                                                task_stepper_jog_stack,
+                                                &task_stepper_jog_tcb);
+    sys_task_register(task_stepper_jog_handle, task_stepper_jog_stackdepth);
+    sys_heap_guard_task(task_stepper_jog_handle);
+
+    step_arc_queue = xQueueCreateStatic(STEP_ARC_QUEUE_LENGTH, sizeof(step_arc_cmd_t), step_arc_queue_storage, &step_arc_queue_buffer);
+    task_stepper_arc_handle = xTaskCreateStatic(task_stepper_arc_handler,
+                                                "task_stepper_arc_handler",
+                                                task_stepper_arc_stackdepth,
+                                                NULL,
+                                                task_stepper_arc_priority,
+                                                task_stepper_arc_stack,
+                                                &task_stepper_arc_tcb);
+    sys_task_register(task_stepper_arc_handle, task_stepper_arc_stackdepth);
+    sys_heap_guard_task(task_stepper_arc_handle);
+
+    // limit inputs, both edges so the isr sees bounces and releases for the debounce
+    gpio_config_t limit_io = {
+        .intr_type = GPIO_INTR_ANYEDGE,
+        .mode = GPIO_MODE_INPUT,
+        .pin_bit_mask = ((1ULL << STEP_LIMIT_GPIO_X) | (1ULL << STEP_LIMIT_GPIO_Y) | (1ULL << STEP_LIMIT_GPIO_Z)),
+        .pull_down_en = 0,
+        .pull_up_en = 1,
+    };
+    gpio_config(&limit_io);
+    gpio_install_isr_service(0);
+    for (int i = 0; i < STEP_AXIS_MAX; i++)
+    {
+        ESP_ERROR_CHECK(gpio_isr_handler_add(step_limits[i].gpio, step_limit_isr_handler, &step_limits[i]));
+    }
+
+    step_home_queue = xQueueCreateStatic(STEP_HOME_QUEUE_LENGTH, sizeof(step_home_cmd_t), step_home_queue_storage, &step_home_queue_buffer);
+    task_stepper_home_handle = xTaskCreateStatic(task_stepper_home_handler,
+                                                 "task_stepper_home_handler",
+                                                 task_stepper_home_stackdepth,
+                                                 NULL,
+                                                 task_stepper_home_priority,
+                                                 task_stepper_home_stack,
+                                                 &task_stepper_home_tcb);
+    sys_task_register(task_stepper_home_handle, task_stepper_home_stackdepth);
+    sys_heap_guard_task(task_stepper_home_handle);
+}
+
+/*************************************************/
+// command tools:
+
+// a speed above what the step timing of an axis allows runs at that axis' limit
+static void stepper_pulse_check_speed(uint32_t freq_hz)
+{
+    for (int i = 0; i < STEP_AXIS_MAX; i++)
+    {
+        uint32_t max_hz = stepper_pulse_max_hz(&step_axis_pulse[i], step_axis_resolution_hz[i]);
+        if (freq_hz > max_hz)
+        {
+            ESP_LOGW(TAG, "axis %s steps at %luHz at most with its pulse timing", step_shapes[i].name, max_hz);
+        }
+    }
+}
+
+static struct
+{
+    struct arg_int *freq_set_x1;
+    struct arg_int *freq_set_x10;
+    struct arg_int *freq_set_x100;
+    struct arg_int *step_basic_set;
+    struct arg_end *end;
+} motor_set_args;
+
+static int do_motor_set_cmd(int argc, char **argv)
+{
+    int nerrors = arg_parse(argc, argv, (void **)&motor_set_args);
+    if (nerrors != 0)
+    {
+        arg_print_errors(stderr, motor_set_args.end, argv[0]);
+        return 0;
+    }
+
+    // args
+    if (motor_set_args.freq_set_x1->count)
+    {
+        freq_x1 = motor_set_args.freq_set_x1->ival[0];
+        ESP_LOGI(TAG, "freq(x1) set successfully");
+        stepper_pulse_check_speed(freq_x1);
+        if (nvs_set_u32(motor_nvs_handle, "freq_set_x1", freq_x1) == ESP_OK)
+        {
+            ESP_LOGI(TAG, "freq(x1) saved");
+        }
+        else
+        {
+            ESP_LOGW(TAG, "cannot save freq(x1)");
+        }
+    }
+
+    if (motor_set_args.freq_set_x10->count)
+    {
+        freq_x10 = motor_set_args.freq_set_x10->ival[0];
+        ESP_LOGI(TAG, "freq(x10) set successfully");
+        stepper_pulse_check_speed(freq_x10);
+        if (nvs_set_u32(motor_nvs_handle, "freq_set_x10", freq_x10) == ESP_OK)
+        {
+            ESP_LOGI(TAG, "freq(x10) saved");
+        }
+        else
+        {
+            ESP_LOGW(TAG, "cannot save freq(x10)");
+        }
+    }
+
+    if (motor_set_args.freq_set_x100->count)
+    {
+        freq_x100 = motor_set_args.freq_set_x100->ival[0];
+        ESP_LOGI(TAG, "freq(x100) set successfully");
+        stepper_pulse_check_speed(freq_x100);
+        if (nvs_set_u32(motor_nvs_handle, "freq_set_x100", freq_x100) == ESP_OK)
+        {
+            ESP_LOGI(TAG, "freq(x100) saved");
+        }
+        else
+        {
+            ESP_LOGW(TAG, "cannot save freq(x100)");
+        }
+    }
+
+    if (motor_set_args.step_basic_set->count)
+    {
+        step_basic = motor_set_args.step_basic_set->ival[0];
+        ESP_LOGI(TAG, "step basic set successfully");
+        if (nvs_set_u32(motor_nvs_handle, "step_basic_set", step_basic) == ESP_OK)
+        {
+            ESP_LOGI(TAG, "step basic saved");
+        }
+        else
+        {
+            ESP_LOGW(TAG, "cannot save step basic");
+        }
+    }
+
+    return 0;
+}
+
+static void register_motor_set(void)
+{
+    motor_set_args.freq_set_x1 = arg_int0(NULL, "fx1", "<Hz>", "Set the frequency of speed x1 (500 ~ 60000 Hz)");
+    motor_set_args.freq_set_x10 = arg_int0(NULL, "fx10", "<Hz>", "Set the frequency of speed x10 (500 ~ 60000 Hz)");
+    motor_set_args.freq_set_x100 = arg_int0(NULL, "fx100", "<Hz>", "Set the frequency of speed x100 (500 ~ 60000 Hz)");
+    motor_set_args.step_basic_set = arg_int0(NULL, "step", "<number>", "Set the steps per half knob detent at speed x1, a detent moves twice this");
+    motor_set_args.end = arg_end(2);
+    const esp_console_cmd_t motor_set_cmd = {
+        .command = "set",
+        .help = "Config 42_motor",
+        .hint = NULL,
+        .func = &do_motor_set_cmd,
+        .argtable = &motor_set_args};
+    ESP_ERROR_CHECK(esp_console_cmd_register(&motor_set_cmd));
+}
+
+static struct
+{
+    struct arg_str *axis;
+    struct arg_str *type;
+    struct arg_dbl *freq;
+    struct arg_dbl *damping;
+    struct arg_end *end;
+} motor_shape_args;
+
+static int do_motor_shape_cmd(int argc, char **argv)
+{
+    char key[NVS_KEY_NAME_MAX_SIZE];
+
+    int nerrors = arg_parse(argc, argv, (void **)&motor_shape_args);
+    if (nerrors != 0)
+    {
+        arg_print_errors(stderr, motor_shape_args.end, argv[0]);
+        return 0;
+    }
+
+    if (motor_shape_args.axis->count == 0)
+    {
+        for (int i = 0; i < STEP_AXIS_MAX; i++)
+        {
+            step_shape_t *shape = &step_shapes[i];
+            printf("%s: %-4s %lu.%03luHz damping 0.%03lu\n", shape->name, stepper_shaper_name(shape->type),
+                   shape->freq_mhz / 1000, shape->freq_mhz % 1000, shape->damping_pm);
+        }
+        return 0;
+    }
+
+    step_shape_t *shape = NULL;
+    for (int i = 0; i < STEP_AXIS_MAX; i++)
+    {
+        if (strcasecmp(motor_shape_args.axis->sval[0], step_shapes[i].name) == 0)
+        {
+            shape = &step_shapes[i];
+        }
+    }
+    if (shape == NULL)
+    {
+        ESP_LOGW(TAG, "unknown axis %s", motor_shape_args.axis->sval[0]);
+        return 0;
+    }
+
+    uint32_t type = shape->type;
+    uint32_t freq_mhz = shape->freq_mhz;
+    uint32_t damping_pm = shape->damping_pm;
+    if (motor_shape_args.type->count)
+    {
+        for (type = 0; type < STEPPER_SHAPER_TYPE_MAX; type++)
+        {
+            if (strcasecmp(motor_shape_args.type->sval[0], stepper_shaper_name(type)) == 0)
+                break;
+        }
+    }
+    if (motor_shape_args.freq->count)
+    {
+        freq_mhz = motor_shape_args.freq->dval[0] > 0 ? (uint32_t)(motor_shape_args.freq->dval[0] * 1000 + 0.5) : 0;
+    }
+    if (motor_shape_args.damping->count)
+    {
+        damping_pm = motor_shape_args.damping->dval[0] >= 0 ? (uint32_t)(motor_shape_args.damping->dval[0] * 1000 + 0.5) : UINT32_MAX;
+    }
+
+    if (!stepper_shape_update(shape, type, freq_mhz, damping_pm))
+    {
+        ESP_LOGW(TAG, "invalid shaper, type none|zv|zvd|ei, damping 0 ~ 0.999 (ei 0 ~ 0.3)");
+        return 0;
+    }
+    ESP_LOGI(TAG, "axis %s shaper set successfully", shape->name);
+
+    snprintf(key, sizeof(key), "shape_%s_type", shape->name);
+    esp_err_t err = nvs_set_u32(motor_nvs_handle, key, type);
+    snprintf(key, sizeof(key), "shape_%s_freq", shape->name);
+    err |= nvs_set_u32(motor_nvs_handle, key, freq_mhz);
+    snprintf(key, sizeof(key), "shape_%s_damp", shape->name);
+    err |= nvs_set_u32(motor_nvs_handle, key, damping_pm);
+    if (err == ESP_OK)
+    {
+        ESP_LOGI(TAG, "axis %s shaper saved", shape->name);
+    }
+    else
+    {
+        ESP_LOGW(TAG, "cannot save axis %s shaper", shape->name);
+    }
+
+    return 0;
+}
+
+static void register_motor_shape(void)
+{
+    motor_shape_args.axis = arg_str0("a", "axis", "<X|Y|Z>", "Axis to shape, print all axes if omitted");
+    motor_shape_args.type = arg_str0("t", "type", "<none|zv|zvd|ei>", "Shaper type");
+    motor_shape_args.freq = arg_dbl0("f", "freq", "<Hz>", "Natural frequency of the ringing");
+    motor_shape_args.damping = arg_dbl0("d", "damping", "<ratio>", "Damping ratio of the ringing (0 ~ 0.999)");
+    motor_shape_args.end = arg_end(4);
+    const esp_console_cmd_t motor_shape_cmd = {
+        .command = "shape",
+        .help = "Input shaping of the step rate, per axis",
+        .hint = NULL,
+        .func = &do_motor_shape_cmd,
+        .argtable = &motor_shape_args};
+    ESP_ERROR_CHECK(esp_console_cmd_register(&motor_shape_cmd));
+}
+
+static int step_axis_of(char name)
+{
+    for (int i = 0; i < STEP_AXIS_MAX; i++)
+    {
+        if ((name & ~0x20) == step_shapes[i].name[0])
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static struct
+{
+    struct arg_str *axis;
+    struct arg_int *high;
+    struct arg_int *low;
+    struct arg_int *dir;
+    struct arg_lit *fixed;
+    struct arg_lit *half;
+    struct arg_end *end;
+} motor_pulse_args;
+
+static int do_motor_pulse_cmd(int argc, char **argv)
+{
+    char key[NVS_KEY_NAME_MAX_SIZE];
+
+    int nerrors = arg_parse(argc, argv, (void **)&motor_pulse_args);
+    if (nerrors != 0)
+    {
+        arg_print_errors(stderr, motor_pulse_args.end, argv[0]);
+        return 0;
+    }
+
+    if (motor_pulse_args.axis->count == 0)
+    {
+        for (int i = 0; i < STEP_AXIS_MAX; i++)
+        {
+            const stepper_pulse_t *pulse = &step_axis_pulse[i];
+            stepper_pulse_ticks_t ticks;
+            stepper_pulse_ticks(pulse, step_axis_resolution_hz[i], &ticks);
+            printf("%s: %-5s high %luns low %luns dir %luns, %luHz resolution, period %lu ticks min, up to %luHz\n",
+                   step_shapes[i].name, pulse->fixed ? "fixed" : "50%", pulse->high_ns, pulse->low_ns, pulse->dir_setup_ns,
+                   step_axis_resolution_hz[i], ticks.period_min, stepper_pulse_max_hz(pulse, step_axis_resolution_hz[i]));
+        }
+        return 0;
+    }
+
+    int axis = strlen(motor_pulse_args.axis->sval[0]) == 1 ? step_axis_of(motor_pulse_args.axis->sval[0][0]) : -1;
+    if (axis < 0)
+    {
+        ESP_LOGW(TAG, "unknown axis %s", motor_pulse_args.axis->sval[0]);
+        return 0;
+    }
+    if (motor_pulse_args.fixed->count && motor_pulse_args.half->count)
+    {
+        ESP_LOGW(TAG, "give either --fixed or --half");
+        return 0;
+    }
+
+    stepper_pulse_t pulse = step_axis_pulse[axis];
+    if (motor_pulse_args.high->count)
+    {
+        pulse.high_ns = motor_pulse_args.high->ival[0] >= 0 ? motor_pulse_args.high->ival[0] : UINT32_MAX;
+    }
+    if (motor_pulse_args.low->count)
+    {
+        pulse.low_ns = motor_pulse_args.low->ival[0] >= 0 ? motor_pulse_args.low->ival[0] : UINT32_MAX;
+    }
+    if (motor_pulse_args.dir->count)
+    {
+        pulse.dir_setup_ns = motor_pulse_args.dir->ival[0] >= 0 ? motor_pulse_args.dir->ival[0] : UINT32_MAX;
+    }
+    if (motor_pulse_args.fixed->count || motor_pulse_args.half->count)
+    {
+        pulse.fixed = motor_pulse_args.fixed->count != 0;
+    }
+    if (!stepper_pulse_valid(&pulse))
+    {
+        ESP_LOGW(TAG, "invalid pulse timing, 0 ~ %d ns", STEP_PULSE_NS_MAX);
+        return 0;
+    }
+
+    // the encoders and the channel resolution are set up at boot
+    snprintf(key, sizeof(key), "pulse_%s_high", step_shapes[axis].name);
+    esp_err_t err = nvs_set_u32(motor_nvs_handle, key, pulse.high_ns);
+    snprintf(key, sizeof(key), "pulse_%s_low", step_shapes[axis].name);
+    err |= nvs_set_u32(motor_nvs_handle, key, pulse.low_ns);
+    snprintf(key, sizeof(key), "pulse_%s_dir", step_shapes[axis].name);
+    err |= nvs_set_u32(motor_nvs_handle, key, pulse.dir_setup_ns);
+    snprintf(key, sizeof(key), "pulse_%s_fix", step_shapes[axis].name);
+    err |= nvs_set_u32(motor_nvs_handle, key, pulse.fixed);
+    if (err == ESP_OK)
+    {
+        ESP_LOGI(TAG, "axis %s pulse timing saved, it takes effect after a restart", step_shapes[axis].name);
+    }
+    else
+    {
+        ESP_LOGW(TAG, "cannot save axis %s pulse timing", step_shapes[axis].name);
+    }
 
     return 0;
 }
 
-static void register_motor_set(void)
+static void register_motor_pulse(void)
 {
-    motor_set_args.freq_set_x1 = arg_int0(NULL, "fx1", "<Hz>", "Set the frequency of speed x1 (500 ~ 60000 Hz)");
-    motor_set_args.freq_set_x10 = arg_int0(NULL, "fx10", "<Hz>", "Set the frequency of speed x10 (500 ~ 60000 Hz)");
-    motor_set_args.freq_set_x100 = arg_int0(NULL, "fx100", "<Hz>", "Set the frequency of speed x100 (500 ~ 60000 Hz)");
-    motor_set_args.step_basic_set = arg_int0(NULL, "step", "<number>", "Set the basic step number of speed x1");
-    motor_set_args.end = arg_end(2);
-    const esp_console_cmd_t motor_set_cmd = {
-        .command = "set",
-        .help = "Config 42_motor",
+    motor_pulse_args.axis = arg_str0("a", "axis", "<X|Y|Z>", "Axis to set, print all axes if omitted");
+    motor_pulse_args.high = arg_int0(NULL, "high", "<ns>", "Shortest STEP high time of the driver");
+    motor_pulse_args.low = arg_int0(NULL, "low", "<ns>", "Shortest STEP low time of the driver");
+    motor_pulse_args.dir = arg_int0(NULL, "dir", "<ns>", "DIR setup time before the next STEP rising edge");
+    motor_pulse_args.fixed = arg_lit0(NULL, "fixed", "One symbol per step, a fixed high pulse and the rest of the period low");
+    motor_pulse_args.half = arg_lit0(NULL, "half", "50% duty steps");
+    motor_pulse_args.end = arg_end(6);
+    const esp_console_cmd_t motor_pulse_cmd = {
+        .command = "pulse",
+        .help = "STEP and DIR timing of the drivers, per axis, used from the next boot",
         .hint = NULL,
-        .func = &do_motor_set_cmd,
-        .argtable = &motor_set_args};
-    ESP_ERROR_CHECK(esp_console_cmd_register(&motor_set_cmd));
+        .func = &do_motor_pulse_cmd,
+        .argtable = &motor_pulse_args};
+    ESP_ERROR_CHECK(esp_console_cmd_register(&motor_pulse_cmd));
+}
+
+static struct
+{
+    struct arg_str *axis;
+    struct arg_int *steps;
+    struct arg_int *freq;
+    struct arg_end *end;
+} motor_lash_args;
+
+static int do_motor_lash_cmd(int argc, char **argv)
+{
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    stepper_lash_t lash;
+
+    int nerrors = arg_parse(argc, argv, (void **)&motor_lash_args);
+    if (nerrors != 0)
+    {
+        arg_print_errors(stderr, motor_lash_args.end, argv[0]);
+        return 0;
+    }
+
+    if (motor_lash_args.axis->count == 0)
+    {
+        for (int i = 0; i < STEP_AXIS_MAX; i++)
+        {
+            portENTER_CRITICAL(&step_lash_lock);
+            lash = step_axis_lash[i];
+            portEXIT_CRITICAL(&step_lash_lock);
+            printf("%s: %lu steps, taken up at %luHz, slack %s\n", step_shapes[i].name, lash.steps, lash.freq_hz,
+                   lash.side > 0 ? "taken up clockwise" : lash.side < 0 ? "taken up counterclockwise" : "unknown until the axis moves");
+        }
+        return 0;
+    }
+
+    int axis = strlen(motor_lash_args.axis->sval[0]) == 1 ? step_axis_of(motor_lash_args.axis->sval[0][0]) : -1;
+    if (axis < 0)
+    {
+        ESP_LOGW(TAG, "unknown axis %s", motor_lash_args.axis->sval[0]);
+        return 0;
+    }
+
+    // the next reversal takes it up, a move already queued keeps what it got
+    portENTER_CRITICAL(&step_lash_lock);
+    lash = step_axis_lash[axis];
+    uint32_t steps = motor_lash_args.steps->count ? (motor_lash_args.steps->ival[0] >= 0 ? motor_lash_args.steps->ival[0] : UINT32_MAX) : lash.steps;
+    uint32_t freq_hz = motor_lash_args.freq->count ? (motor_lash_args.freq->ival[0] >= 0 ? motor_lash_args.freq->ival[0] : 0) : lash.freq_hz;
+    bool valid = stepper_lash_set(&step_axis_lash[axis], steps, freq_hz);
+    portEXIT_CRITICAL(&step_lash_lock);
+    if (!valid)
+    {
+        ESP_LOGW(TAG, "invalid backlash, 0 ~ %d steps taken up at %d ~ %dHz", STEPPER_LASH_STEPS_MAX, STEPPER_LASH_FREQ_MIN,
+                 STEPPER_LASH_FREQ_MAX);
+        return 0;
+    }
+    ESP_LOGI(TAG, "axis %s backlash set successfully", step_shapes[axis].name);
+
+    snprintf(key, sizeof(key), "lash_%s_steps", step_shapes[axis].name);
+    esp_err_t err = nvs_set_u32(motor_nvs_handle, key, steps);
+    snprintf(key, sizeof(key), "lash_%s_hz", step_shapes[axis].name);
+    err |= nvs_set_u32(motor_nvs_handle, key, freq_hz);
+    if (err == ESP_OK)
+    {
+        ESP_LOGI(TAG, "axis %s backlash saved", step_shapes[axis].name);
+    }
+    else
+    {
+        ESP_LOGW(TAG, "cannot save axis %s backlash", step_shapes[axis].name);
+    }
+
+    return 0;
+}
+
+static void register_motor_lash(void)
+{
+    motor_lash_args.axis = arg_str0("a", "axis", "<X|Y|Z>", "Axis to set, print all axes if omitted");
+    motor_lash_args.steps = arg_int0("s", "steps", "<steps>", "Slack taken up ahead of a reversing jog, 0 for none");
+    motor_lash_args.freq = arg_int0("f", "freq", "<Hz>", "Take-up rate, one the motor starts at without a ramp");
+    motor_lash_args.end = arg_end(4);
+    const esp_console_cmd_t motor_lash_cmd = {
+        .command = "lash",
+        .help = "Backlash compensation of knob jogs, per axis, the take-up steps are not in the position",
+        .hint = NULL,
+        .func = &do_motor_lash_cmd,
+        .argtable = &motor_lash_args};
+    ESP_ERROR_CHECK(esp_console_cmd_register(&motor_lash_cmd));
+}
+
+static struct
+{
+    struct arg_str *plane;
+    struct arg_int *end_a;
+    struct arg_int *end_b;
+    struct arg_int *center_a;
+    struct arg_int *center_b;
+    struct arg_int *radius;
+    struct arg_lit *cw;
+    struct arg_int *feed;
+    struct arg_end *end;
+} motor_arc_args;
+
+static int do_motor_arc_cmd(int argc, char **argv)
+{
+    static step_arc_cmd_t cmd;
+
+    int nerrors = arg_parse(argc, argv, (void **)&motor_arc_args);
+    if (nerrors != 0)
+    {
+        arg_print_errors(stderr, motor_arc_args.end, argv[0]);
+        return 0;
+    }
+
+    const char *plane = motor_arc_args.plane->sval[0];
+    int axis_a = strlen(plane) == 2 ? step_axis_of(plane[0]) : -1;
+    int axis_b = strlen(plane) == 2 ? step_axis_of(plane[1]) : -1;
+    if (axis_a < 0 || axis_b < 0 || axis_a == axis_b)
+    {
+        ESP_LOGW(TAG, "plane must be two different axes of XYZ");
+        return 0;
+    }
+    if (step_axis_backend[axis_a] != STEPPER_GEN_RMT || step_axis_backend[axis_b] != STEPPER_GEN_RMT)
+    {
+        ESP_LOGW(TAG, "arcs need rmt step generators on both axes");
+        return 0;
+    }
+    // both trains count the same slots
+    if (step_axis_resolution_hz[axis_a] != step_axis_resolution_hz[axis_b])
+    {
+        ESP_LOGW(TAG, "arcs need the same channel resolution on both axes, see pulse");
+        return 0;
+    }
+
+    bool has_center = motor_arc_args.center_a->count || motor_arc_args.center_b->count;
+    if (has_center == (motor_arc_args.radius->count != 0))
+    {
+        ESP_LOGW(TAG, "give either the center (-i, -j) or the radius (-r)");
+        return 0;
+    }
+
+    bool cw = motor_arc_args.cw->count != 0;
+    int64_t end_a = motor_arc_args.end_a->ival[0];
+    int64_t end_b = motor_arc_args.end_b->ival[0];
+    bool valid;
+    if (has_center)
+    {
+        int64_t center_a = motor_arc_args.center_a->count ? motor_arc_args.center_a->ival[0] : 0;
+        int64_t center_b = motor_arc_args.center_b->count ? motor_arc_args.center_b->ival[0] : 0;
+        valid = stepper_arc_init_center(&cmd.arc, end_a, end_b, center_a, center_b, cw);
+    }
+    else
+    {
+        valid = stepper_arc_init_radius(&cmd.arc, end_a, end_b, motor_arc_args.radius->ival[0], cw);
+    }
+    if (!valid)
+    {
+        ESP_LOGW(TAG, "no such arc, the end must lie on the circle (within %d steps) and offsets within %d steps",
+                 STEPPER_ARC_RADIUS_TOL, STEPPER_ARC_COORD_MAX);
+        return 0;
+    }
+
+    cmd.axis_a = axis_a;
+    cmd.axis_b = axis_b;
+    cmd.end_a = end_a;
+    cmd.end_b = end_b;
+    cmd.feed_hz = motor_arc_args.feed->count ? motor_arc_args.feed->ival[0] : get_current_motor_speed();
+    if (cmd.feed_hz == 0 || cmd.feed_hz > step_axis_resolution_hz[axis_a] / 4)
+    {
+        ESP_LOGW(TAG, "feed out of range (1 ~ %lu Hz)", step_axis_resolution_hz[axis_a] / 4);
+        return 0;
+    }
+
+    if (xQueueSend(step_arc_queue, &cmd, 0) != pdTRUE)
+    {
+        ESP_LOGW(TAG, "an arc is already pending");
+    }
+    return 0;
+}
+
+static void register_motor_arc(void)
+{
+    motor_arc_args.plane = arg_str1(NULL, NULL, "<AB>", "Plane, two of XYZ, e.g. XY");
+    motor_arc_args.end_a = arg_int1(NULL, NULL, "<a>", "End on the first axis, steps from here");
+    motor_arc_args.end_b = arg_int1(NULL, NULL, "<b>", "End on the second axis, steps from here");
+    motor_arc_args.center_a = arg_int0("i", NULL, "<steps>", "Center on the first axis, from here");
+    motor_arc_args.center_b = arg_int0("j", NULL, "<steps>", "Center on the second axis, from here");
+    motor_arc_args.radius = arg_int0("r", NULL, "<steps>", "Radius instead of the center, negative for more than a half turn");
+    motor_arc_args.cw = arg_lit0("c", "cw", "Clockwise from the first axis to the second (default counterclockwise)");
+    motor_arc_args.feed = arg_int0("f", "feed", "<Hz>", "Path speed in steps per second (default the current speed)");
+    motor_arc_args.end = arg_end(4);
+    const esp_console_cmd_t motor_arc_cmd = {
+        .command = "arc",
+        .help = "Trace an arc across two axes, end == start with a center is a full circle",
+        .hint = NULL,
+        .func = &do_motor_arc_cmd,
+        .argtable = &motor_arc_args};
+    ESP_ERROR_CHECK(esp_console_cmd_register(&motor_arc_cmd));
+}
+
+static struct
+{
+    struct arg_str *axes;
+    struct arg_int *seek;
+    struct arg_int *locate;
+    struct arg_end *end;
+} motor_home_args;
+
+static int do_motor_home_cmd(int argc, char **argv)
+{
+    static step_home_cmd_t cmd;
+
+    int nerrors = arg_parse(argc, argv, (void **)&motor_home_args);
+    if (nerrors != 0)
+    {
+        arg_print_errors(stderr, motor_home_args.end, argv[0]);
+        return 0;
+    }
+
+    if (motor_home_args.axes->count == 0)
+    {
+        for (int i = 0; i < STEP_AXIS_MAX; i++)
+        {
+            portENTER_CRITICAL(&step_pos_lock);
+            int64_t pos = step_axis_pos[i];
+            bool homed = step_axis_homed[i];
+            portEXIT_CRITICAL(&step_pos_lock);
+            printf("%s: %10lld %s, limit %s\n", step_shapes[i].name, pos, homed ? "homed" : "not homed",
+                   gpio_get_level(step_limits[i].gpio) == STEP_LIMIT_LEVEL_ACTIVE ? "active" : "clear");
+        }
+        return 0;
+    }
+
+    const char *axes = motor_home_args.axes->sval[0];
+    cmd.num_axes = 0;
+    for (const char *c = axes; *c; c++)
+    {
+        int axis = step_axis_of(*c);
+        if (axis < 0 || cmd.num_axes == STEP_AXIS_MAX)
+        {
+            ESP_LOGW(TAG, "axes must be up to three of XYZ, in homing order, e.g. ZXY");
+            return 0;
+        }
+        cmd.axes[cmd.num_axes++] = axis;
+    }
+    cmd.seek_hz = motor_home_args.seek->count ? motor_home_args.seek->ival[0] : STEP_HOME_SEEK_HZ;
+    cmd.locate_hz = motor_home_args.locate->count ? motor_home_args.locate->ival[0] : STEP_HOME_LOCATE_HZ;
+    if (cmd.seek_hz == 0 || cmd.locate_hz == 0 || cmd.locate_hz > cmd.seek_hz)
+    {
+        ESP_LOGW(TAG, "rates must be above 0Hz, the slow one no faster than the seek");
+        return 0;
+    }
+
+    if (xQueueSend(step_home_queue, &cmd, 0) != pdTRUE)
+    {
+        ESP_LOGW(TAG, "homing is already pending");
+    }
+    return 0;
+}
+
+static void register_motor_home(void)
+{
+    motor_home_args.axes = arg_str0(NULL, NULL, "<axes>", "Axes to home in order, e.g. ZXY, print the positions if omitted");
+    motor_home_args.seek = arg_int0("s", "seek", "<Hz>", "Fast seek rate (default 6000Hz)");
+    motor_home_args.locate = arg_int0("l", "locate", "<Hz>", "Slow approach rate (default 400Hz)");
+    motor_home_args.end = arg_end(3);
+    const esp_console_cmd_t motor_home_cmd = {
+        .command = "home",
+        .help = "Home axes on their limit switches: fast seek, back off, slow approach",
+        .hint = NULL,
+        .func = &do_motor_home_cmd,
+        .argtable = &motor_home_args};
+    ESP_ERROR_CHECK(esp_console_cmd_register(&motor_home_cmd));
+}
+
+static struct
+{
+    struct arg_str *slave;
+    struct arg_str *master;
+    struct arg_str *ratio;
+    struct arg_lit *knob;
+    struct arg_lit *off;
+    struct arg_end *end;
+} motor_gear_args;
+
+static void stepper_gear_print(void)
+{
+    step_gear_link_t links[STEP_AXIS_MAX];
+
+    portENTER_CRITICAL(&step_gear_lock);
+    memcpy(links, step_gear_links, sizeof(links));
+    portEXIT_CRITICAL(&step_gear_lock);
+    for (int i = 0; i < STEP_AXIS_MAX; i++)
+    {
+        if (links[i].on)
+        {
+            printf("%s follows %s%s at %ld/%lu\n", step_shapes[i].name, step_shapes[links[i].master].name,
+                   links[i].knob ? "'s knob" : "", links[i].gear.num, links[i].gear.den);
+        }
+        else
+        {
+            printf("%s: own knob only\n", step_shapes[i].name);
+        }
+    }
+}
+
+static int do_motor_gear_cmd(int argc, char **argv)
+{
+    int nerrors = arg_parse(argc, argv, (void **)&motor_gear_args);
+    if (nerrors != 0)
+    {
+        arg_print_errors(stderr, motor_gear_args.end, argv[0]);
+        return 0;
+    }
+
+    if (motor_gear_args.slave->count == 0)
+    {
+        stepper_gear_print();
+        return 0;
+    }
+    const char *slave_name = motor_gear_args.slave->sval[0];
+    int slave = strlen(slave_name) == 1 ? step_axis_of(slave_name[0]) : -1;
+    if (slave < 0)
+    {
+        ESP_LOGW(TAG, "slave is one of XYZ");
+        return 0;
+    }
+    if (motor_gear_args.off->count)
+    {
+        portENTER_CRITICAL(&step_gear_lock);
+        step_gear_links[slave].on = false;
+        portEXIT_CRITICAL(&step_gear_lock);
+        stepper_gear_print();
+        return 0;
+    }
+
+    if (motor_gear_args.master->count == 0 || motor_gear_args.ratio->count == 0)
+    {
+        ESP_LOGW(TAG, "a master axis and a ratio are needed, or --off");
+        return 0;
+    }
+    const char *master_name = motor_gear_args.master->sval[0];
+    int master = strlen(master_name) == 1 ? step_axis_of(master_name[0]) : -1;
+    int32_t num;
+    uint32_t den;
+    stepper_gear_t gear;
+    bool knob = motor_gear_args.knob->count != 0;
+    if (master < 0 || master == slave)
+    {
+        ESP_LOGW(TAG, "master is one of XYZ, other than the slave");
+        return 0;
+    }
+    if (!stepper_gear_parse(motor_gear_args.ratio->sval[0], &num, &den) || !stepper_gear_init(&gear, num, den))
+    {
+        ESP_LOGW(TAG, "ratio is n/d or a decimal, up to %d slave steps per master step, d up to %d",
+                 STEPPER_GEAR_RATIO_MAX, STEPPER_GEAR_DEN_MAX);
+        return 0;
+    }
+    // synced trains need the gear encoder on every channel that pulses
+    if (step_axis_backend[slave] != STEPPER_GEN_RMT || (!knob && step_axis_backend[master] != STEPPER_GEN_RMT))
+    {
+        ESP_LOGW(TAG, "gearing needs rmt step generators on the slave and a moving master");
+        return 0;
+    }
+    if (step_axis_resolution_hz[slave] != step_axis_resolution_hz[master])
+    {
+        ESP_LOGW(TAG, "gearing needs the same channel resolution on the slave and the master, see pulse");
+        return 0;
+    }
+
+    const char *refused = NULL;
+    portENTER_CRITICAL(&step_gear_lock);
+    for (int i = 0; i < STEP_AXIS_MAX && !refused; i++)
+    {
+        step_gear_link_t *link = &step_gear_links[i];
+        if (!link->on || i == slave)
+        {
+            continue;
+        }
+        if (link->master == slave)
+        {
+            refused = "the slave is a master itself, chains are not followed";
+        }
+        else if (i == master)
+        {
+            refused = "the master follows another axis, chains are not followed";
+        }
+        else if (link->master == master && link->knob != knob)
+        {
+            refused = "every slave of a master follows the axis, or every one only its knob";
+        }
+    }
+    if (!refused)
+    {
+        step_gear_links[slave].on = true;
+        step_gear_links[slave].master = master;
+        step_gear_links[slave].knob = knob;
+        step_gear_links[slave].gear = gear;
+    }
+    portEXIT_CRITICAL(&step_gear_lock);
+    if (refused)
+    {
+        ESP_LOGW(TAG, "%s", refused);
+        return 0;
+    }
+    stepper_gear_print();
+    return 0;
+}
+
+static void register_motor_gear(void)
+{
+    motor_gear_args.slave = arg_str0(NULL, NULL, "<slave>", "Axis that follows, print the links if omitted");
+    motor_gear_args.master = arg_str0(NULL, NULL, "<master>", "Axis whose jog moves it follows");
+    motor_gear_args.ratio = arg_str0(NULL, NULL, "<ratio>", "Slave steps per master step, n/d or decimal, negative reverses");
+    motor_gear_args.knob = arg_lit0("k", "knob", "Follow only the master's knob, the master axis stays");
+    motor_gear_args.off = arg_lit0("o", "off", "Release the slave");
+    motor_gear_args.end = arg_end(4);
+    const esp_console_cmd_t motor_gear_cmd = {
+        .command = "gear",
+        .help = "Slave an axis to the jog moves of another at a fixed ratio, e.g. gear Z X 1/4",
+        .hint = NULL,
+        .func = &do_motor_gear_cmd,
+        .argtable = &motor_gear_args};
+    ESP_ERROR_CHECK(esp_console_cmd_register(&motor_gear_cmd));
+}
+
+// the ramps in ram, which of them the speed settings start and stop on
+static int do_motor_ramp_cmd(int argc, char **argv)
+{
+    if (!step_ramp_image)
+    {
+        printf("no ramps in ram, moves start at full rate\n");
+        return 0;
+    }
+    const stepper_ramp_header_t *header = step_ramp_image;
+    printf("from partition \"%s\" at 0x%lx, %luB in ram, %u ramps\n", step_ramp_part->label, step_ramp_part->address,
+           header->size, header->num_entries);
+    for (uint32_t i = 0; i < header->num_entries; i++)
+    {
+        const stepper_ramp_entry_t *entry = &stepper_ramp_entries(step_ramp_image)[i];
+        uint32_t freq = entry->start_freq_hz < entry->end_freq_hz ? entry->end_freq_hz : entry->start_freq_hz;
+        bool used = false;
+        for (int axis = 0; axis < STEP_AXIS_MAX; axis++)
+        {
+            used |= entry->resolution == step_axis_resolution_hz[axis];
+        }
+        used &= freq == freq_x1 || freq == freq_x10 || freq == freq_x100;
+        printf("%2lu: %luHz -> %luHz, %lu steps at %luHz resolution%s\n", i, entry->start_freq_hz, entry->end_freq_hz,
+               entry->points, entry->resolution, used ? ", in use" : "");
+    }
+    return 0;
+}
+
+static void register_motor_ramp(void)
+{
+    const esp_console_cmd_t motor_ramp_cmd = {
+        .command = "ramp",
+        .help = "List the acceleration ramps copied from flash",
+        .hint = NULL,
+        .func = &do_motor_ramp_cmd,
+        .argtable = NULL};
+    ESP_ERROR_CHECK(esp_console_cmd_register(&motor_ramp_cmd));
+}
+
+static struct
+{
+    struct arg_int *percent;
+    struct arg_end *end;
+} motor_feed_args;
+
+// feed override of the running and queued moves, not saved, every boot starts at 100%
+static int do_motor_feed_cmd(int argc, char **argv)
+{
+    int nerrors = arg_parse(argc, argv, (void **)&motor_feed_args);
+    if (nerrors != 0)
+    {
+        arg_print_errors(stderr, motor_feed_args.end, argv[0]);
+        return 0;
+    }
+
+    if (motor_feed_args.percent->count)
+    {
+        int percent = motor_feed_args.percent->ival[0];
+        if (percent < STEPPER_FEED_OVERRIDE_MIN || percent > STEPPER_FEED_OVERRIDE_MAX)
+        {
+            printf("feed override is %d ~ %d%%\n", STEPPER_FEED_OVERRIDE_MIN, STEPPER_FEED_OVERRIDE_MAX);
+            return 0;
+        }
+        stepper_feed_override_set(percent);
+    }
+    printf("feed override: %lu%%, arcs, geared moves, homing and the pwm backends stay at 100%%\n", stepper_feed_override_get());
+    return 0;
+}
+
+static void register_motor_feed(void)
+{
+    motor_feed_args.percent = arg_int0(NULL, NULL, "<percent>", "Feed override (10 ~ 200 %), shows it without");
+    motor_feed_args.end = arg_end(2);
+    const esp_console_cmd_t motor_feed_cmd = {
+        .command = "feed",
+        .help = "Scale the step rate of running and queued moves, ramps keep their acceleration",
+        .hint = NULL,
+        .func = &do_motor_feed_cmd,
+        .argtable = &motor_feed_args};
+    ESP_ERROR_CHECK(esp_console_cmd_register(&motor_feed_cmd));
 }
 
 void register_motortools(void)
 {
     register_motor_set();
+    register_motor_shape();
+    register_motor_pulse();
+    register_motor_lash();
+    register_motor_arc();
+    register_motor_home();
+    register_motor_gear();
+    register_motor_ramp();
+    register_motor_feed();
 }
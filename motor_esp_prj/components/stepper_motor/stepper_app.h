@@ -1,7 +1,48 @@
 #ifndef _STEP_APP_H
 #define _STEP_APP_H
 
+#include <stdbool.h>
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+
+// jog moves, stepped by the motion executor (components/motion_exec)
+typedef struct
+{
+    // a started jog put out its last step, from the step generator's isr or the jog task, returns whether a
+    // task was woken
+    bool (*on_done)(int axis, void *arg);
+    // stepper_motor_jog_send queued knob counts, task context
+    void (*on_queued)(void *arg);
+    void *arg;
+} stepper_jog_callbacks_t;
+
+// one axis as telemetry samples it
+typedef struct
+{
+    int64_t pos;      // commanded position in steps, a started jog counts its steps as the generator puts them out
+    int32_t freq_hz;  // commanded step rate, negative counterclockwise, 0 when stopped
+    uint32_t queued;  // jog requests waiting for the executor
+    uint32_t pending; // transactions of the started jog still out
+} stepper_axis_sample_t;
+
 void stepper_motor_activate(void);
 void register_motortools(void);
 
-#endif
\ No newline at end of file
+void stepper_motor_jog_register_callbacks(const stepper_jog_callbacks_t *cbs);
+// queue x4 knob counts for an axis (0 ~ 2: X/Y/Z), blocks up to wait while the queue is full
+bool stepper_motor_jog_send(int axis, int counts, TickType_t wait);
+// the executor's side of the queue, never blocks
+bool stepper_motor_jog_receive(int axis, int *counts);
+// a count moves step_basic * speed / 2 steps, an odd half step is carried to the axis' next jog;
+// false while the axis or one of its slaves is taken, by a jog still out, an arc or homing;
+// every started jog ends in on_done, a geared one or one on a pwm backend from the jog task's run
+bool stepper_motor_jog_start(int axis, int counts);
+// a started jog is still out
+bool stepper_motor_jog_busy(int axis);
+// after on_done: books the steps and releases the axes taken
+void stepper_motor_jog_finish(int axis);
+
+// any task, any time after activate; arcs, geared moves and the pwm backends show at their end only
+void stepper_motor_sample(int axis, stepper_axis_sample_t *sample);
+
+#endif
@@ -0,0 +1,218 @@
+#include "esp_attr.h"
+#include "stepper_arc.h"
+
+FORCE_INLINE_ATTR int64_t stepper_arc_abs(int64_t value)
+{
+    return value < 0 ? -value : value;
+}
+
+FORCE_INLINE_ATTR int stepper_arc_sign(int64_t value)
+{
+    return (value > 0) - (value < 0);
+}
+
+// round to nearest, den > 0
+static int64_t stepper_arc_div_round(int64_t num, int64_t den)
+{
+    return num >= 0 ? (num + den / 2) / den : -((-num + den / 2) / den);
+}
+
+// sign of the end-to-position angle, positive once the position is past the end
+FORCE_INLINE_ATTR int64_t stepper_arc_cross(const stepper_arc_t *arc, int64_t a, int64_t b)
+{
+    int64_t cross = arc->end_a * b - arc->end_b * a;
+    return arc->cw ? -cross : cross;
+}
+
+FORCE_INLINE_ATTR bool stepper_arc_passes(const stepper_arc_t *arc, int64_t a, int64_t b)
+{
+    return arc->armed && stepper_arc_cross(arc, a, b) >= 0 && arc->end_a * a + arc->end_b * b > 0;
+}
+
+uint64_t IRAM_ATTR stepper_isqrt(uint64_t value)
+{
+    uint64_t root = 0;
+    uint64_t bit = 1ull << 62;
+
+    while (bit > value)
+    {
+        bit >>= 2;
+    }
+    while (bit)
+    {
+        if (value >= root + bit)
+        {
+            value -= root + bit;
+            root = (root >> 1) + bit;
+        }
+        else
+        {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return root;
+}
+
+bool stepper_arc_init_center(stepper_arc_t *arc, int64_t end_a, int64_t end_b, int64_t center_a, int64_t center_b, bool cw)
+{
+    if (stepper_arc_abs(end_a) > STEPPER_ARC_COORD_MAX || stepper_arc_abs(end_b) > STEPPER_ARC_COORD_MAX ||
+        stepper_arc_abs(center_a) > STEPPER_ARC_COORD_MAX || stepper_arc_abs(center_b) > STEPPER_ARC_COORD_MAX)
+    {
+        return false;
+    }
+
+    arc->a = -center_a;
+    arc->b = -center_b;
+    arc->end_a = end_a - center_a;
+    arc->end_b = end_b - center_b;
+    arc->r2 = arc->a * arc->a + arc->b * arc->b;
+    arc->cw = cw;
+    arc->armed = 0;
+    arc->closing = 0;
+    if (arc->r2 == 0)
+    {
+        return false;
+    }
+
+    // the end is reached by straight steps from where the arc passes its angle, keep that short
+    // an end less than a turn ahead arms the end check right away, an end on the start needs a full turn
+    arc->armed = stepper_arc_cross(arc, arc->a, arc->b) < 0;
+
+    int64_t r_start = stepper_isqrt(arc->r2);
+    int64_t r_end = stepper_isqrt(arc->end_a * arc->end_a + arc->end_b * arc->end_b);
+    return stepper_arc_abs(r_start - r_end) <= STEPPER_ARC_RADIUS_TOL;
+}
+
+bool stepper_arc_init_radius(stepper_arc_t *arc, int64_t end_a, int64_t end_b, int64_t radius, bool cw)
+{
+    int64_t r = stepper_arc_abs(radius);
+
+    if (stepper_arc_abs(end_a) > STEPPER_ARC_COORD_MAX || stepper_arc_abs(end_b) > STEPPER_ARC_COORD_MAX || r > STEPPER_ARC_COORD_MAX)
+    {
+        return false;
+    }
+    int64_t d2 = end_a * end_a + end_b * end_b;
+    if (d2 == 0 || r == 0)
+    {
+        return false;
+    }
+    int64_t d = stepper_isqrt(d2);
+    int64_t q = 4 * r * r - d2;
+    if (q < 0)
+    {
+        // a chord a hair longer than the diameter is a half turn
+        if (d - 2 * r > STEPPER_ARC_RADIUS_TOL)
+        {
+            return false;
+        }
+        q = 0;
+    }
+
+    // the center sits on the chord bisector, sqrt(q) / 2 from the midpoint, right of the chord for
+    // a clockwise short arc and left for a counterclockwise one, a negative radius swaps the side
+    int64_t side = (cw ? 1 : -1) * (radius < 0 ? -1 : 1);
+    int64_t sq = stepper_isqrt(q);
+    int64_t center_a = stepper_arc_div_round(end_a * d + side * end_b * sq, 2 * d);
+    int64_t center_b = stepper_arc_div_round(end_b * d - side * end_a * sq, 2 * d);
+
+    return stepper_arc_init_center(arc, end_a, end_b, center_a, center_b, cw);
+}
+
+static bool IRAM_ATTR stepper_arc_plan(const stepper_arc_t *arc, stepper_arc_step_t *step)
+{
+    if (arc->closing)
+    {
+        step->da = stepper_arc_sign(arc->end_a - arc->a);
+        step->db = stepper_arc_sign(arc->end_b - arc->b);
+        return step->da || step->db;
+    }
+
+    // the tangent picks the quadrant of the step, the squared radius picks the neighbour
+    int sa = stepper_arc_sign(arc->cw ? arc->b : -arc->b);
+    int sb = stepper_arc_sign(arc->cw ? -arc->a : arc->a);
+    const stepper_arc_step_t candidates[3] = {{sa, 0}, {0, sb}, {sa, sb}};
+    int64_t best = INT64_MAX;
+
+    for (int i = 0; i < 3; i++)
+    {
+        if (candidates[i].da == 0 && candidates[i].db == 0)
+        {
+            continue;
+        }
+        int64_t a = arc->a + candidates[i].da;
+        int64_t b = arc->b + candidates[i].db;
+        int64_t err = stepper_arc_abs(a * a + b * b - arc->r2);
+        if (err < best)
+        {
+            best = err;
+            *step = candidates[i];
+        }
+    }
+
+    // a step past the end angle would overshoot the end, head straight for it instead
+    if (stepper_arc_passes(arc, arc->a + step->da, arc->b + step->db))
+    {
+        step->da = stepper_arc_sign(arc->end_a - arc->a);
+        step->db = stepper_arc_sign(arc->end_b - arc->b);
+        return step->da || step->db;
+    }
+    return true;
+}
+
+static void IRAM_ATTR stepper_arc_apply(stepper_arc_t *arc, const stepper_arc_step_t *step)
+{
+    arc->a += step->da;
+    arc->b += step->db;
+    if (arc->closing)
+    {
+        return;
+    }
+
+    // one sign change after being behind the end passes it
+    if (stepper_arc_passes(arc, arc->a, arc->b))
+    {
+        arc->closing = 1;
+    }
+    else if (stepper_arc_cross(arc, arc->a, arc->b) < 0)
+    {
+        arc->armed = 1;
+    }
+}
+
+bool IRAM_ATTR stepper_arc_next(stepper_arc_t *arc, stepper_arc_step_t *step)
+{
+    if (!stepper_arc_plan(arc, step))
+    {
+        return false;
+    }
+    stepper_arc_apply(arc, step);
+    return true;
+}
+
+uint64_t stepper_arc_run(stepper_arc_t *arc, int *dir_a, int *dir_b)
+{
+    stepper_arc_step_t step;
+    uint64_t steps = 0;
+
+    *dir_a = 0;
+    *dir_b = 0;
+    while (stepper_arc_plan(arc, &step))
+    {
+        if ((step.da && *dir_a && step.da != *dir_a) || (step.db && *dir_b && step.db != *dir_b))
+        {
+            break;
+        }
+        if (step.da)
+        {
+            *dir_a = step.da;
+        }
+        if (step.db)
+        {
+            *dir_b = step.db;
+        }
+        stepper_arc_apply(arc, &step);
+        steps++;
+    }
+    return steps;
+}
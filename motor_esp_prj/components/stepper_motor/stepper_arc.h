@@ -0,0 +1,87 @@
+#ifndef _STEPPER_ARC_H
+#define _STEPPER_ARC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define STEPPER_ARC_COORD_MAX (1 << 20) // squares of offsets up to this stay well inside int64
+#define STEPPER_ARC_RADIUS_TOL 2        // largest start / end radius mismatch, in steps
+
+// path step lengths for the slot timing, an axis step is 128 and a diagonal step 128 * sqrt(2)
+#define STEPPER_ARC_AXIS_LEN 128
+#define STEPPER_ARC_DIAG_LEN 181
+
+/**
+ * @brief Midpoint arc stepper state, in steps relative to the arc center
+ *
+ * Each step moves one or both axes by one step towards the tangent, picking the neighbour whose
+ * squared radius is closest to the target, so no trig or floats are needed per step and every
+ * point stays within one step of the ideal arc.
+ */
+typedef struct {
+    int64_t a, b;         // current position
+    int64_t end_a, end_b; // end position
+    int64_t r2;           // squared radius
+    uint8_t cw;           // clockwise in the a-b plane
+    uint8_t armed;        // the position has been behind the end, so the next pass over it ends the arc
+    uint8_t closing;      // past the end angle, straight steps onto the exact end point
+} stepper_arc_t;
+
+/**
+ * @brief One arc step, each axis -1, 0 or +1
+ */
+typedef struct {
+    int8_t da;
+    int8_t db;
+} stepper_arc_step_t;
+
+/**
+ * @brief Start an arc from the current position given its center (G2/G3 I J form)
+ *
+ * @param[in] end_a, end_b End point, relative to the start
+ * @param[in] center_a, center_b Center, relative to the start
+ * @param[in] cw Clockwise in the a-b plane, end == start traces a full circle
+ * @return false for a zero radius, offsets beyond STEPPER_ARC_COORD_MAX or an end point off the circle
+ */
+bool stepper_arc_init_center(stepper_arc_t *arc, int64_t end_a, int64_t end_b, int64_t center_a, int64_t center_b, bool cw);
+
+/**
+ * @brief Start an arc from the current position given its radius (G2/G3 R form)
+ *
+ * The center is solved once in integers, a negative radius takes the arc longer than a half turn.
+ *
+ * @return false when the end point is further than a diameter away or out of range
+ */
+bool stepper_arc_init_radius(stepper_arc_t *arc, int64_t end_a, int64_t end_b, int64_t radius, bool cw);
+
+/**
+ * @brief Take the next step of the arc
+ *
+ * @return false once the end point is reached
+ */
+bool stepper_arc_next(stepper_arc_t *arc, stepper_arc_step_t *step);
+
+/**
+ * @brief Advance over the run of steps that keep both axis directions
+ *
+ * A DIR pin can't change inside an RMT transaction, an arc is sent one run (about a quadrant) at a time.
+ *
+ * @param[out] dir_a, dir_b Direction of each axis in the run, 0 if the axis doesn't move
+ * @return steps in the run, 0 once the end point is reached
+ */
+uint64_t stepper_arc_run(stepper_arc_t *arc, int *dir_a, int *dir_b);
+
+/**
+ * @brief Integer square root, floor
+ */
+uint64_t stepper_isqrt(uint64_t value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
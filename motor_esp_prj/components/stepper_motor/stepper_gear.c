@@ -0,0 +1,121 @@
+#include <stdlib.h>
+#include <string.h>
+#include "esp_attr.h"
+#include "stepper_gear.h"
+
+static uint32_t stepper_gear_gcd(uint32_t a, uint32_t b)
+{
+    while (b)
+    {
+        uint32_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+bool stepper_gear_init(stepper_gear_t *gear, int32_t num, uint32_t den)
+{
+    uint32_t mag = num < 0 ? -(uint32_t)num : (uint32_t)num;
+
+    if (den == 0 || den > STEPPER_GEAR_DEN_MAX || mag > (uint32_t)STEPPER_GEAR_RATIO_MAX * den)
+    {
+        return false;
+    }
+    uint32_t gcd = stepper_gear_gcd(mag, den);
+    memset(gear, 0, sizeof(*gear));
+    gear->num = num / (int32_t)gcd;
+    gear->den = den / gcd;
+    gear->split = (mag / gcd + gear->den - 1) / gear->den;
+    if (gear->split == 0)
+    {
+        gear->split = 1;
+    }
+    // rounds to the nearest slave step instead of trailing by up to one
+    gear->acc = (int64_t)gear->den * gear->split / 2;
+    return true;
+}
+
+int IRAM_ATTR stepper_gear_tick(stepper_gear_t *gear, int dir)
+{
+    int64_t unit = (int64_t)gear->den * gear->split;
+
+    gear->acc += dir > 0 ? gear->num : -gear->num;
+    if (gear->acc >= unit)
+    {
+        gear->acc -= unit;
+        return 1;
+    }
+    if (gear->acc < 0)
+    {
+        gear->acc += unit;
+        return -1;
+    }
+    return 0;
+}
+
+int64_t stepper_gear_follow(stepper_gear_t *gear, int64_t master_steps)
+{
+    int64_t unit = (int64_t)gear->den * gear->split;
+    int64_t total = gear->acc + master_steps * gear->split * gear->num;
+    // floor division, total may be negative
+    int64_t steps = total / unit;
+
+    if (total % unit < 0)
+    {
+        steps--;
+    }
+    gear->acc = total - steps * unit;
+    return steps;
+}
+
+bool stepper_gear_parse(const char *text, int32_t *num, uint32_t *den)
+{
+    const char *p = text;
+    bool negative = false;
+    int64_t n = 0;
+    int64_t d = 1;
+    bool digits = false;
+
+    if (*p == '-' || *p == '+')
+    {
+        negative = *p++ == '-';
+    }
+    for (; *p >= '0' && *p <= '9'; p++, digits = true)
+    {
+        n = n * 10 + (*p - '0');
+        if (n > (int64_t)STEPPER_GEAR_RATIO_MAX * STEPPER_GEAR_DEN_MAX)
+        {
+            return false;
+        }
+    }
+    if (*p == '.')
+    {
+        for (p++; *p >= '0' && *p <= '9'; p++, digits = true)
+        {
+            if (d >= STEPPER_GEAR_DEN_MAX)
+            {
+                return false;
+            }
+            n = n * 10 + (*p - '0');
+            d *= 10;
+        }
+    }
+    else if (*p == '/' && digits)
+    {
+        char *end;
+        d = strtol(p + 1, &end, 10);
+        if (end == p + 1 || d <= 0 || d > STEPPER_GEAR_DEN_MAX)
+        {
+            return false;
+        }
+        p = end;
+    }
+    if (!digits || *p != '\0' || n > (int64_t)STEPPER_GEAR_RATIO_MAX * d)
+    {
+        return false;
+    }
+    *num = negative ? -(int32_t)n : (int32_t)n;
+    *den = d;
+    return true;
+}
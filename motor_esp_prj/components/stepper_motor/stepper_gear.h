@@ -0,0 +1,60 @@
+#ifndef _STEPPER_GEAR_H
+#define _STEPPER_GEAR_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define STEPPER_GEAR_RATIO_MAX 8  // slave steps per master step, a master period is split into at most this many slots
+#define STEPPER_GEAR_DEN_MAX 10000 // ratio denominator, also the resolution of a decimal ratio
+
+/**
+ * @brief Electronic gear, a slave axis follows a master step stream at num / den
+ *
+ * Every master step period is split into `split` equal slots, enough for the slave to take at
+ * most one step per slot. Each slot adds num to the accumulator, a slave step comes out whenever it
+ * leaves [0, den * split), so the slave lands on the nearest step to ratio * master at every slot
+ * and the remainder carries from move to move, nothing drifts.
+ */
+typedef struct {
+    int32_t num;
+    uint32_t den;
+    uint32_t split; // slots per master step, ceil(|num| / den)
+    int64_t acc;    // in 1 / (den * split) slave steps, offset by half a step
+} stepper_gear_t;
+
+/**
+ * @brief Set up a gear at num / den, reduced, the slave half a step from the master
+ *
+ * @return false for a zero or too large denominator, or a ratio above STEPPER_GEAR_RATIO_MAX
+ */
+bool stepper_gear_init(stepper_gear_t *gear, int32_t num, uint32_t den);
+
+/**
+ * @brief One slot of a master step taken in dir
+ *
+ * @return slave step of the slot, -1, 0 or +1
+ */
+int stepper_gear_tick(stepper_gear_t *gear, int dir);
+
+/**
+ * @brief A whole master move at once, same result as ticking every slot of it
+ *
+ * @param[in] master_steps Signed, up to 2^40
+ * @return signed slave steps
+ */
+int64_t stepper_gear_follow(stepper_gear_t *gear, int64_t master_steps);
+
+/**
+ * @brief Parse a ratio, "3/7", "-2" or a decimal such as "0.125" (up to 4 decimals)
+ */
+bool stepper_gear_parse(const char *text, int32_t *num, uint32_t *den);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
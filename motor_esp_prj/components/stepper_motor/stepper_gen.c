@@ -0,0 +1,444 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_check.h"
+#include "driver/rmt_tx.h"
+#include "stepper_motor_encoder.h"
+#include "stepper_move.h"
+#include "stepper_ramp.h"
+#include "stepper_gen.h"
+#include "sys_monitor.h"
+
+static const char *TAG = "stepper_gen";
+
+static const char *const stepper_gen_backend_names[STEPPER_GEN_BACKEND_MAX] = {"rmt", "ledc", "mcpwm"};
+
+const char *stepper_gen_backend_name(stepper_gen_backend_t backend)
+{
+    return backend < STEPPER_GEN_BACKEND_MAX ? stepper_gen_backend_names[backend] : "?";
+}
+
+typedef struct
+{
+    stepper_gen_t base;
+    rmt_channel_handle_t chan;
+    rmt_encoder_handle_t encoder;
+    rmt_encoder_handle_t ramp_encoder; // copy encoder, kept across reuse of the pool slot
+    rmt_encoder_t ramp_counter;        // wraps ramp_encoder, counts the ramp steps for count
+    uint32_t ramp_at;                  // symbols of the ramp in progress written
+    volatile uint32_t ramp_steps;
+    volatile uint32_t ramp_freq_hz;    // rate of the last ramp symbol written, 0 between ramps
+    stepper_line_t ramp_line;          // where the ramp in progress is on the pin
+    const void *ramps;
+    uint32_t resolution;
+    bool dither;
+    bool in_use;
+    stepper_gen_done_cb_t on_done;
+    void *user_ctx;
+    // a started move: its payloads stay here until the channel is done with them, pending counts
+    // the transactions still out under the pool lock, set before queueing and counted down by the done isr
+    stepper_motor_dither_payload_t payloads[STEPPER_GEN_SEGMENT_MAX];
+    uint32_t pending;
+} stepper_rmt_gen_t;
+
+static stepper_rmt_gen_t rmt_gen_pool[STEPPER_GEN_POOL_SIZE];
+static portMUX_TYPE rmt_gen_pool_lock = portMUX_INITIALIZER_UNLOCKED;
+static sys_pool_t rmt_gen_pool_stats = {
+    .name = "rmt gen",
+    .blocks = STEPPER_GEN_POOL_SIZE,
+    .block_size = sizeof(stepper_rmt_gen_t),
+};
+
+// one symbol is one step, the copy encoder returns how many it wrote
+static size_t IRAM_ATTR stepper_rmt_gen_ramp_encode(rmt_encoder_t *encoder, rmt_channel_handle_t channel, const void *primary_data,
+                                          size_t data_size, rmt_encode_state_t *ret_state)
+{
+    stepper_rmt_gen_t *rmt_gen = __containerof(encoder, stepper_rmt_gen_t, ramp_counter);
+    const rmt_symbol_word_t *symbols = (const rmt_symbol_word_t *)primary_data;
+    if (rmt_gen->ramp_at == 0)
+    {
+        stepper_line_start(&rmt_gen->ramp_line);
+    }
+    size_t encoded = rmt_gen->ramp_encoder->encode(rmt_gen->ramp_encoder, channel, primary_data, data_size, ret_state);
+
+    if (encoded)
+    {
+        for (size_t i = rmt_gen->ramp_at; i < rmt_gen->ramp_at + encoded; i++)
+        {
+            stepper_line_step(&rmt_gen->ramp_line, symbols[i].duration0, symbols[i].duration1);
+        }
+        rmt_gen->ramp_at += encoded;
+        rmt_gen->ramp_steps += encoded;
+        const rmt_symbol_word_t *last = &symbols[rmt_gen->ramp_at - 1];
+        rmt_gen->ramp_freq_hz = rmt_gen->resolution / (last->duration0 + last->duration1);
+    }
+    if (*ret_state & RMT_ENCODING_COMPLETE)
+    {
+        rmt_gen->ramp_at = 0;
+        rmt_gen->ramp_freq_hz = 0;
+    }
+    return encoded;
+}
+
+static esp_err_t IRAM_ATTR stepper_rmt_gen_ramp_reset(rmt_encoder_t *encoder)
+{
+    stepper_rmt_gen_t *rmt_gen = __containerof(encoder, stepper_rmt_gen_t, ramp_counter);
+
+    rmt_gen->ramp_at = 0;
+    rmt_gen->ramp_freq_hz = 0;
+    return rmt_encoder_reset(rmt_gen->ramp_encoder);
+}
+
+// the copy encoder stays with the pool slot
+static esp_err_t stepper_rmt_gen_ramp_del(rmt_encoder_t *encoder)
+{
+    return ESP_OK;
+}
+
+// a ramp straight from the image, which is in internal ram so the isr never reads flash
+static esp_err_t stepper_rmt_gen_ramp(stepper_rmt_gen_t *rmt_gen, const stepper_ramp_entry_t *ramp)
+{
+    rmt_transmit_config_t tx_config = {
+        .loop_count = 0,
+    };
+
+    if (!ramp)
+    {
+        return ESP_OK;
+    }
+    return rmt_transmit(rmt_gen->chan, &rmt_gen->ramp_counter, stepper_ramp_symbols(rmt_gen->ramps, ramp),
+                        ramp->points * sizeof(rmt_symbol_word_t), &tx_config);
+}
+
+// a move of any length as one streamed transaction per segment, queued behind its take-up and ramps
+static esp_err_t stepper_rmt_gen_queue_dither(stepper_rmt_gen_t *rmt_gen, const stepper_segment_t *take_up, const stepper_ramp_entry_t *accel,
+                                              const stepper_segment_t *segments, uint32_t num_segments,
+                                              const stepper_ramp_entry_t *decel, stepper_motor_dither_payload_t *payloads)
+{
+    rmt_transmit_config_t tx_config = {
+        .loop_count = 0,
+    };
+
+    // the ramp plays from flash as it is, a take-up goes ahead of it in a transaction of its own
+    if (take_up && accel)
+    {
+        stepper_motor_dither_payload_t *payload = &payloads[num_segments];
+        memset(payload, 0, sizeof(*payload));
+        payload->freq_hz = take_up->freq_hz;
+        payload->first = true;
+        payload->exact = true;
+        payload->take_up = take_up->steps;
+        payload->take_up_hz = take_up->freq_hz;
+        ESP_RETURN_ON_ERROR(rmt_transmit(rmt_gen->chan, rmt_gen->encoder, payload, sizeof(*payload), &tx_config), TAG, "transmit failed");
+    }
+    // no more segments than trans_queue_depth, the rate steps are queued back to back
+    ESP_RETURN_ON_ERROR(stepper_rmt_gen_ramp(rmt_gen, accel), TAG, "transmit failed");
+    for (uint32_t i = 0; i < num_segments; i++)
+    {
+        payloads[i].freq_hz = segments[i].freq_hz;
+        payloads[i].steps = segments[i].steps;
+        payloads[i].first = i == 0 && !accel; // an accel ramp starts slower than any DIR setup time
+        payloads[i].exact = segments[i].exact;
+        // the feed override slews at the move's own ramps, the ramps themselves play unscaled
+        payloads[i].ramp_in = i == 0 && accel;
+        payloads[i].ramp_out = i == num_segments - 1 && decel;
+        payloads[i].accel = accel ? stepper_ramp_accel(accel) : 0;
+        // without a ramp the take-up leads the first transaction, no gap at the reversal
+        payloads[i].take_up = i == 0 && take_up && !accel ? take_up->steps : 0;
+        payloads[i].take_up_hz = take_up ? take_up->freq_hz : 0;
+        ESP_RETURN_ON_ERROR(rmt_transmit(rmt_gen->chan, rmt_gen->encoder, &payloads[i], sizeof(payloads[i]), &tx_config), TAG, "transmit failed");
+    }
+    return stepper_rmt_gen_ramp(rmt_gen, decel);
+}
+
+static esp_err_t stepper_rmt_gen_run_dither(stepper_rmt_gen_t *rmt_gen, const stepper_segment_t *take_up, const stepper_ramp_entry_t *accel,
+                                            const stepper_segment_t *segments, uint32_t num_segments, const stepper_ramp_entry_t *decel)
+{
+    // payloads are read when a queued transaction starts, keep them alive until all done
+    stepper_motor_dither_payload_t payloads[STEPPER_GEN_SEGMENT_MAX];
+
+    ESP_RETURN_ON_ERROR(stepper_rmt_gen_queue_dither(rmt_gen, take_up, accel, segments, num_segments, decel, payloads), TAG, "transmit failed");
+    return rmt_tx_wait_all_done(rmt_gen->chan, -1);
+}
+
+// one segment as hardware looped transactions, the payloads stay alive until all done
+static esp_err_t stepper_rmt_gen_queue_looped(stepper_rmt_gen_t *rmt_gen, const stepper_segment_t *segment,
+                                              stepper_motor_uniform_payload_t *body_payload, stepper_motor_uniform_payload_t *tail_payload)
+{
+    stepper_split_t split;
+    stepper_chunk_t chunk;
+
+    body_payload->freq_hz = segment->freq_hz;
+    body_payload->symbols = STEPPER_UNIFORM_MAX_SYMBOLS;
+    tail_payload->freq_hz = segment->freq_hz;
+    tail_payload->symbols = 0;
+
+    stepper_split_init(&split, segment->steps, STEPPER_UNIFORM_MAX_SYMBOLS, STEPPER_MOVE_LOOP_COUNT_MAX);
+    while (stepper_split_next(&split, &chunk))
+    {
+        rmt_transmit_config_t tx_config = {
+            .loop_count = chunk.passes > 1 ? chunk.passes : 0,
+        };
+        const stepper_motor_uniform_payload_t *payload = body_payload;
+        if (chunk.symbols != STEPPER_UNIFORM_MAX_SYMBOLS)
+        {
+            tail_payload->symbols = chunk.symbols;
+            payload = tail_payload;
+        }
+        // blocks while trans_queue_depth transactions are pending, so the queue never runs dry
+        ESP_RETURN_ON_ERROR(rmt_transmit(rmt_gen->chan, rmt_gen->encoder, payload, sizeof(*payload), &tx_config), TAG, "transmit failed");
+    }
+    return ESP_OK;
+}
+
+// a move of any length as back to back hardware looped transactions, per segment
+static esp_err_t stepper_rmt_gen_run_looped(stepper_rmt_gen_t *rmt_gen, const stepper_segment_t *take_up, const stepper_ramp_entry_t *accel,
+                                            const stepper_segment_t *segments, uint32_t num_segments, const stepper_ramp_entry_t *decel)
+{
+    // payloads are read when a queued transaction starts, keep them alive until all done
+    stepper_motor_uniform_payload_t body_payloads[STEPPER_GEN_SEGMENT_MAX];
+    stepper_motor_uniform_payload_t tail_payloads[STEPPER_GEN_SEGMENT_MAX];
+
+    if (take_up)
+    {
+        ESP_RETURN_ON_ERROR(stepper_rmt_gen_queue_looped(rmt_gen, take_up, &body_payloads[num_segments], &tail_payloads[num_segments]),
+                            TAG, "transmit failed");
+    }
+    ESP_RETURN_ON_ERROR(stepper_rmt_gen_ramp(rmt_gen, accel), TAG, "transmit failed");
+    for (uint32_t i = 0; i < num_segments; i++)
+    {
+        ESP_RETURN_ON_ERROR(stepper_rmt_gen_queue_looped(rmt_gen, &segments[i], &body_payloads[i], &tail_payloads[i]), TAG, "transmit failed");
+    }
+    ESP_RETURN_ON_ERROR(stepper_rmt_gen_ramp(rmt_gen, decel), TAG, "transmit failed");
+    return rmt_tx_wait_all_done(rmt_gen->chan, -1);
+}
+
+// a take-up leads the move, the ramps take their steps off the first and last segment behind it, a
+// move too short for both has none; returns the segments of the move, the last ones of body
+static uint32_t stepper_rmt_gen_plan(stepper_rmt_gen_t *rmt_gen, stepper_segment_t *body, uint32_t num_segments,
+                                     const stepper_segment_t **ret_take_up, const stepper_ramp_entry_t **ret_accel,
+                                     const stepper_ramp_entry_t **ret_decel)
+{
+    const stepper_ramp_entry_t *accel = NULL;
+    const stepper_ramp_entry_t *decel = NULL;
+
+    *ret_take_up = NULL;
+    if (num_segments && body[0].take_up)
+    {
+        *ret_take_up = body++;
+        num_segments--;
+    }
+    if (rmt_gen->ramps && num_segments)
+    {
+        stepper_segment_t *first = &body[0];
+        stepper_segment_t *last = &body[num_segments - 1];
+        accel = stepper_ramp_find(rmt_gen->ramps, rmt_gen->resolution, 0, first->freq_hz, true);
+        decel = stepper_ramp_find(rmt_gen->ramps, rmt_gen->resolution, last->freq_hz, 0, false);
+        if (!accel || !decel || first->steps <= accel->points + (first == last ? decel->points : 0) ||
+            last->steps <= decel->points)
+        {
+            accel = NULL;
+            decel = NULL;
+        }
+        else
+        {
+            first->steps -= accel->points;
+            last->steps -= decel->points;
+        }
+    }
+    *ret_accel = accel;
+    *ret_decel = decel;
+    return num_segments;
+}
+
+static esp_err_t stepper_rmt_gen_run(stepper_gen_t *gen, const stepper_segment_t *segments, uint32_t num_segments)
+{
+    stepper_rmt_gen_t *rmt_gen = __containerof(gen, stepper_rmt_gen_t, base);
+    stepper_segment_t body[STEPPER_GEN_SEGMENT_MAX];
+    const stepper_segment_t *take_up;
+    const stepper_ramp_entry_t *accel;
+    const stepper_ramp_entry_t *decel;
+
+    ESP_RETURN_ON_FALSE(num_segments <= STEPPER_GEN_SEGMENT_MAX, ESP_ERR_INVALID_ARG, TAG, "too many segments");
+    memcpy(body, segments, num_segments * sizeof(body[0]));
+    uint32_t num_move = stepper_rmt_gen_plan(rmt_gen, body, num_segments, &take_up, &accel, &decel);
+    ESP_RETURN_ON_FALSE(num_move <= STEPPER_SHAPER_SEGMENT_MAX, ESP_ERR_INVALID_ARG, TAG, "too many segments");
+    stepper_segment_t *move = &body[num_segments - num_move];
+    if (rmt_gen->dither)
+    {
+        return stepper_rmt_gen_run_dither(rmt_gen, take_up, accel, move, num_move, decel);
+    }
+    return stepper_rmt_gen_run_looped(rmt_gen, take_up, accel, move, num_move, decel);
+}
+
+// every transaction of the channel ends here, arcs and gears included, only a started move counts down
+static bool IRAM_ATTR stepper_rmt_gen_on_trans_done(rmt_channel_handle_t chan, const rmt_tx_done_event_data_t *edata, void *user_ctx)
+{
+    uint32_t isr_start = sys_isr_enter();
+    stepper_rmt_gen_t *rmt_gen = (stepper_rmt_gen_t *)user_ctx;
+    bool done = false;
+    bool woken = false;
+
+    portENTER_CRITICAL_ISR(&rmt_gen_pool_lock);
+    if (rmt_gen->pending)
+    {
+        done = --rmt_gen->pending == 0;
+    }
+    portEXIT_CRITICAL_ISR(&rmt_gen_pool_lock);
+    if (done)
+    {
+        woken = rmt_gen->on_done(&rmt_gen->base, rmt_gen->user_ctx);
+    }
+    sys_isr_exit(SYS_ISR_RMT_DONE, isr_start);
+    return woken;
+}
+
+static esp_err_t stepper_rmt_gen_start(stepper_gen_t *gen, const stepper_segment_t *segments, uint32_t num_segments)
+{
+    stepper_rmt_gen_t *rmt_gen = __containerof(gen, stepper_rmt_gen_t, base);
+    stepper_segment_t body[STEPPER_GEN_SEGMENT_MAX];
+    const stepper_segment_t *take_up;
+    const stepper_ramp_entry_t *accel;
+    const stepper_ramp_entry_t *decel;
+    esp_err_t ret;
+
+    ESP_RETURN_ON_FALSE(num_segments && num_segments <= STEPPER_GEN_SEGMENT_MAX, ESP_ERR_INVALID_ARG, TAG, "1 to %d segments",
+                        STEPPER_GEN_SEGMENT_MAX);
+    memcpy(body, segments, num_segments * sizeof(body[0]));
+    uint32_t num_move = stepper_rmt_gen_plan(rmt_gen, body, num_segments, &take_up, &accel, &decel);
+    ESP_RETURN_ON_FALSE(num_move && num_move <= STEPPER_SHAPER_SEGMENT_MAX, ESP_ERR_INVALID_ARG, TAG, "1 to %d segments behind a take-up",
+                        STEPPER_SHAPER_SEGMENT_MAX);
+    stepper_segment_t *move = &body[num_segments - num_move];
+    // a take-up has a transaction of its own only ahead of an accel ramp
+    uint32_t queued = num_move + (accel != NULL) + (decel != NULL) + (take_up && accel);
+
+    // counted before the first transaction can finish
+    portENTER_CRITICAL(&rmt_gen_pool_lock);
+    bool busy = rmt_gen->pending != 0;
+    if (!busy)
+    {
+        rmt_gen->pending = queued;
+    }
+    portEXIT_CRITICAL(&rmt_gen_pool_lock);
+    ESP_RETURN_ON_FALSE(!busy, ESP_ERR_INVALID_STATE, TAG, "a started move is still out");
+
+    ret = stepper_rmt_gen_queue_dither(rmt_gen, take_up, accel, move, num_move, decel, rmt_gen->payloads);
+    if (ret != ESP_OK)
+    {
+        // whatever made it into the queue still runs, it just no longer ends the move
+        portENTER_CRITICAL(&rmt_gen_pool_lock);
+        rmt_gen->pending = 0;
+        portEXIT_CRITICAL(&rmt_gen_pool_lock);
+    }
+    return ret;
+}
+
+static void IRAM_ATTR stepper_rmt_gen_count(stepper_gen_t *gen, stepper_gen_count_t *count)
+{
+    stepper_rmt_gen_t *rmt_gen = __containerof(gen, stepper_rmt_gen_t, base);
+    uint32_t steps;
+    uint32_t freq_hz;
+    uint32_t ramp_steps;
+    uint32_t ramp_ahead;
+
+    stepper_motor_uniform_encoder_count(rmt_gen->encoder, &steps, &freq_hz);
+    do
+    {
+        ramp_steps = rmt_gen->ramp_steps;
+        ramp_ahead = stepper_line_ahead(&rmt_gen->ramp_line, rmt_gen->resolution);
+    } while (ramp_steps != rmt_gen->ramp_steps);
+    count->steps = steps + ramp_steps - ramp_ahead;
+    // the ramps and the body never encode at the same time
+    count->freq_hz = freq_hz ? freq_hz : rmt_gen->ramp_freq_hz;
+    count->pending = rmt_gen->pending;
+}
+
+static esp_err_t stepper_rmt_gen_enable(stepper_gen_t *gen)
+{
+    return rmt_enable(__containerof(gen, stepper_rmt_gen_t, base)->chan);
+}
+
+static esp_err_t stepper_rmt_gen_disable(stepper_gen_t *gen)
+{
+    return rmt_disable(__containerof(gen, stepper_rmt_gen_t, base)->chan);
+}
+
+static esp_err_t stepper_rmt_gen_del(stepper_gen_t *gen)
+{
+    stepper_rmt_gen_t *rmt_gen = __containerof(gen, stepper_rmt_gen_t, base);
+
+    portENTER_CRITICAL(&rmt_gen_pool_lock);
+    rmt_gen->in_use = false;
+    sys_pool_give(&rmt_gen_pool_stats);
+    portEXIT_CRITICAL(&rmt_gen_pool_lock);
+    return ESP_OK;
+}
+
+esp_err_t stepper_new_rmt_gen(const stepper_rmt_gen_config_t *config, stepper_gen_handle_t *ret_gen)
+{
+    stepper_rmt_gen_t *rmt_gen = NULL;
+
+    ESP_RETURN_ON_FALSE(config && config->chan && config->encoder && ret_gen, ESP_ERR_INVALID_ARG, TAG, "invalid arguments");
+
+    portENTER_CRITICAL(&rmt_gen_pool_lock);
+    for (int i = 0; i < STEPPER_GEN_POOL_SIZE; i++)
+    {
+        if (!rmt_gen_pool[i].in_use)
+        {
+            rmt_gen = &rmt_gen_pool[i];
+            rmt_encoder_handle_t ramp_encoder = rmt_gen->ramp_encoder;
+            memset(rmt_gen, 0, sizeof(*rmt_gen));
+            rmt_gen->ramp_encoder = ramp_encoder;
+            rmt_gen->in_use = true;
+            sys_pool_take(&rmt_gen_pool_stats);
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&rmt_gen_pool_lock);
+    ESP_RETURN_ON_FALSE(rmt_gen, ESP_ERR_NO_MEM, TAG, "rmt generator pool exhausted");
+    if (config->ramps && !rmt_gen->ramp_encoder)
+    {
+        rmt_copy_encoder_config_t copy_encoder_config = {};
+        esp_err_t ret = rmt_new_copy_encoder(&copy_encoder_config, &rmt_gen->ramp_encoder);
+        if (ret != ESP_OK)
+        {
+            stepper_rmt_gen_del(&rmt_gen->base);
+            ESP_RETURN_ON_ERROR(ret, TAG, "create ramp encoder failed");
+        }
+    }
+
+    rmt_gen->chan = config->chan;
+    rmt_gen->encoder = config->encoder;
+    rmt_gen->ramps = config->ramps;
+    rmt_gen->resolution = config->resolution;
+    rmt_gen->dither = config->flags.dither;
+    rmt_gen->on_done = config->on_done;
+    rmt_gen->user_ctx = config->user_ctx;
+    rmt_gen->ramp_counter.encode = stepper_rmt_gen_ramp_encode;
+    rmt_gen->ramp_counter.reset = stepper_rmt_gen_ramp_reset;
+    rmt_gen->ramp_counter.del = stepper_rmt_gen_ramp_del;
+    if (config->on_done && config->flags.dither)
+    {
+        rmt_tx_event_callbacks_t cbs = {
+            .on_trans_done = stepper_rmt_gen_on_trans_done,
+        };
+        esp_err_t ret = rmt_tx_register_event_callbacks(config->chan, &cbs, rmt_gen);
+        if (ret != ESP_OK)
+        {
+            stepper_rmt_gen_del(&rmt_gen->base);
+            ESP_RETURN_ON_ERROR(ret, TAG, "tx callbacks failed");
+        }
+        rmt_gen->base.start = stepper_rmt_gen_start;
+    }
+    rmt_gen->base.name = stepper_gen_backend_name(STEPPER_GEN_RMT);
+    rmt_gen->base.run = stepper_rmt_gen_run;
+    if (rmt_gen->dither)
+    {
+        rmt_gen->base.count = stepper_rmt_gen_count;
+    }
+    rmt_gen->base.enable = stepper_rmt_gen_enable;
+    rmt_gen->base.disable = stepper_rmt_gen_disable;
+    rmt_gen->base.del = stepper_rmt_gen_del;
+
+    *ret_gen = &rmt_gen->base;
+    return ESP_OK;
+}
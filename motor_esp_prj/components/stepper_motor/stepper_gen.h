@@ -0,0 +1,206 @@
+#ifndef _STEPPER_GEN_H
+#define _STEPPER_GEN_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "driver/rmt_encoder.h"
+#include "stepper_shaper.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    STEPPER_GEN_RMT = 0, // symbol stream, exact average rate, the only backend arcs can sync
+    STEPPER_GEN_LEDC,    // free running PWM, a PCNT unit counts the pulses back off the pin
+    STEPPER_GEN_MCPWM,   // MCPWM timer, one interrupt per step counts the pulses
+    STEPPER_GEN_BACKEND_MAX,
+} stepper_gen_backend_t;
+
+#define STEPPER_GEN_POOL_SIZE 3 // generators of each backend come from a static pool of this size
+
+// LEDC and MCPWM have no hardware stop after n pulses, an isr stops them within half a period of the
+// last step or one more goes out; the isrs are iram-safe, this is the latency the rates are capped for
+#define STEPPER_GEN_STOP_LATENCY_US 10
+#define STEPPER_GEN_STOP_FREQ_MAX (1000000 / (2 * STEPPER_GEN_STOP_LATENCY_US))
+
+// LEDC timer on the 80MHz APB clock, 10 bit duty at 50% goes from about 77Hz, capped at 50kHz by the stop
+#define STEPPER_GEN_LEDC_CLK_HZ 80000000
+#define STEPPER_GEN_LEDC_DUTY_BITS 10
+#define STEPPER_GEN_LEDC_FREQ_MIN 80
+#define STEPPER_GEN_LEDC_FREQ_MAX STEPPER_GEN_STOP_FREQ_MAX
+// PCNT counts up to this and wraps, longer segments are counted in laps
+#define STEPPER_GEN_PCNT_LIMIT 32767
+
+// MCPWM timer resolution, the 16 bit period goes down to about 153Hz, capped at 50kHz by the stop
+#define STEPPER_GEN_MCPWM_RESOLUTION_HZ 10000000
+#define STEPPER_GEN_MCPWM_PERIOD_MAX 65535
+#define STEPPER_GEN_MCPWM_FREQ_MAX STEPPER_GEN_STOP_FREQ_MAX
+
+// a shaped move and the backlash take-up segment ahead of it
+#define STEPPER_GEN_SEGMENT_MAX (STEPPER_SHAPER_SEGMENT_MAX + 1)
+
+typedef struct stepper_gen_t stepper_gen_t;
+typedef stepper_gen_t *stepper_gen_handle_t;
+
+/**
+ * @brief Called after the last step pulse of a started move, from the generator's interrupt
+ *
+ * @return whether a higher priority task was woken
+ */
+typedef bool (*stepper_gen_done_cb_t)(stepper_gen_t *gen, void *user_ctx);
+
+/**
+ * @brief What a generator has put out, for telemetry
+ */
+typedef struct {
+    uint32_t steps;   // out on the pin since the generator was made, ramps and take-ups included, wraps
+    uint32_t freq_hz; // rate of the last step written, 0 when idle
+    uint32_t pending; // transactions of a started move still out
+} stepper_gen_count_t;
+
+/**
+ * @brief Step pulse generator of one axis
+ *
+ * Every backend takes the same constant rate segments, the caller owns DIR and shaping.
+ */
+struct stepper_gen_t {
+    const char *name;
+
+    /**
+     * @brief Send the segments back to back, return after the last step pulse
+     *
+     * An RMT generator with a ramp image starts and ends the move on the ramps made for the rates of
+     * its first and last segment, when the move has steps enough. The ramps are part of the steps.
+     * A take_up segment goes out ahead of the ramps, a dither generator puts it in the move's first
+     * transaction when there is no acceleration ramp.
+     *
+     * @param[in] segments Up to STEPPER_GEN_SEGMENT_MAX constant rate pieces, a take_up one first
+     * @return
+     *      - ESP_ERR_INVALID_ARG for too many segments or a rate the backend can't make
+     *      - ESP_OK once every step is out
+     */
+    esp_err_t (*run)(stepper_gen_t *gen, const stepper_segment_t *segments, uint32_t num_segments);
+
+    /**
+     * @brief Queue the same move as run and return at once, the done callback fires after the last step pulse
+     *
+     * NULL for a generator that can only run blocking. One started move at a time, run is not called
+     * while it is out.
+     *
+     * @return
+     *      - ESP_ERR_INVALID_ARG as for run
+     *      - ESP_ERR_INVALID_STATE while the last started move is still out
+     *      - ESP_OK once the move is queued
+     */
+    esp_err_t (*start)(stepper_gen_t *gen, const stepper_segment_t *segments, uint32_t num_segments);
+
+    /**
+     * @brief Read the step count, from any task or isr while the generator runs
+     *
+     * NULL for a backend that doesn't count. An RMT count is of the steps on the pin, the ones still
+     * in the channel memory are told from the time, see stepper_line_ahead. Arcs and geared moves go
+     * through their own encoders and are not in it.
+     */
+    void (*count)(stepper_gen_t *gen, stepper_gen_count_t *count);
+
+    // power gating by the idle manager, run is only called while enabled
+    esp_err_t (*enable)(stepper_gen_t *gen);
+    esp_err_t (*disable)(stepper_gen_t *gen);
+
+    esp_err_t (*del)(stepper_gen_t *gen);
+};
+
+/**
+ * @brief RMT generator configuration, the channel and encoder stay owned by the caller
+ */
+typedef struct {
+    rmt_channel_handle_t chan;     // TX channel, trans_queue_depth >= STEPPER_GEN_RMT_QUEUE_DEPTH
+    rmt_encoder_handle_t encoder;  // uniform encoder of the channel
+    const void *ramps;             // checked ramp image (stepper_ramp.h) in internal ram, NULL to start moves at full rate
+    uint32_t resolution;           // channel resolution, ramps are looked up for it
+    stepper_gen_done_cb_t on_done; // NULL for a generator without start, it takes the channel's tx done callback
+    void *user_ctx;                // passed to on_done
+    struct {
+        uint32_t dither : 1; // the encoder was made with flags.dither, only a dither generator can start
+    } flags;
+} stepper_rmt_gen_config_t;
+
+// transactions of a whole move, a take-up and the segments between two ramps, so a started move is queued at once
+#define STEPPER_GEN_RMT_QUEUE_DEPTH (STEPPER_GEN_SEGMENT_MAX + 2)
+
+/**
+ * @brief LEDC + PCNT generator configuration
+ *
+ * @note Takes a PCNT unit, on this board three of the four are used by the knobs
+ */
+typedef struct {
+    int gpio_num;  // STEP gpio
+    int timer_num; // LEDC timer, not shared with another channel
+    int channel;   // LEDC channel
+} stepper_ledc_gen_config_t;
+
+/**
+ * @brief MCPWM generator configuration
+ */
+typedef struct {
+    int gpio_num; // STEP gpio
+    int group_id; // MCPWM group, 3 generators per group
+} stepper_mcpwm_gen_config_t;
+
+esp_err_t stepper_new_rmt_gen(const stepper_rmt_gen_config_t *config, stepper_gen_handle_t *ret_gen);
+esp_err_t stepper_new_ledc_gen(const stepper_ledc_gen_config_t *config, stepper_gen_handle_t *ret_gen);
+esp_err_t stepper_new_mcpwm_gen(const stepper_mcpwm_gen_config_t *config, stepper_gen_handle_t *ret_gen);
+
+static inline esp_err_t stepper_gen_run(stepper_gen_handle_t gen, const stepper_segment_t *segments, uint32_t num_segments)
+{
+    return gen->run(gen, segments, num_segments);
+}
+
+static inline bool stepper_gen_can_start(stepper_gen_handle_t gen)
+{
+    return gen->start != NULL;
+}
+
+static inline esp_err_t stepper_gen_start(stepper_gen_handle_t gen, const stepper_segment_t *segments, uint32_t num_segments)
+{
+    return gen->start(gen, segments, num_segments);
+}
+
+// false and a zeroed count for a backend that doesn't count
+static inline bool stepper_gen_count(stepper_gen_handle_t gen, stepper_gen_count_t *count)
+{
+    if (gen->count == NULL)
+    {
+        count->steps = 0;
+        count->freq_hz = 0;
+        count->pending = 0;
+        return false;
+    }
+    gen->count(gen, count);
+    return true;
+}
+
+static inline esp_err_t stepper_gen_enable(stepper_gen_handle_t gen)
+{
+    return gen->enable(gen);
+}
+
+static inline esp_err_t stepper_gen_disable(stepper_gen_handle_t gen)
+{
+    return gen->disable(gen);
+}
+
+static inline esp_err_t stepper_gen_del(stepper_gen_handle_t gen)
+{
+    return gen->del(gen);
+}
+
+const char *stepper_gen_backend_name(stepper_gen_backend_t backend);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,254 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_check.h"
+#include "esp_rom_gpio.h"
+#include "soc/gpio_sig_map.h"
+#include "soc/ledc_periph.h"
+#include "driver/gpio.h"
+#include "driver/ledc.h"
+#include "driver/pulse_cnt.h"
+#include "stepper_gen.h"
+#include "sys_monitor.h"
+
+static const char *TAG = "stepper_gen_ledc";
+
+#define STEPPER_GEN_LEDC_MODE LEDC_LOW_SPEED_MODE
+#define STEPPER_GEN_LEDC_DUTY (1 << (STEPPER_GEN_LEDC_DUTY_BITS - 1)) // 50%
+#define STEPPER_GEN_PCNT_GLITCH_NS 1000
+
+/*
+ * LEDC runs free at the segment rate, it can't stop by itself after n pulses. The pin is looped back
+ * into a PCNT unit counting falling edges, the watch point of the last step hands the pin back to
+ * its plain gpio output (held low) from the ISR, which has to land inside the low half of the period
+ * (STEPPER_GEN_LEDC_FREQ_MAX); it is IRAM-safe so flash writes don't hold it off. The LEDC timer is
+ * then paused at leisure. Counts past the 16 bit limit are taken in laps, pulses that still got out
+ * past the last one are counted too and reported.
+ */
+typedef struct
+{
+    stepper_gen_t base;
+    int gpio_num;
+    ledc_timer_t timer_num;
+    ledc_channel_t channel;
+    pcnt_unit_handle_t unit;
+    pcnt_channel_handle_t pcnt_chan;
+    SemaphoreHandle_t done;
+    StaticSemaphore_t done_buffer;
+    int tail;                // watch point of the steps past the last full lap, 0 if none, where the count ends
+    volatile uint64_t laps;  // full laps left to count
+    bool in_use;
+} stepper_ledc_gen_t;
+
+static stepper_ledc_gen_t ledc_gen_pool[STEPPER_GEN_POOL_SIZE];
+static portMUX_TYPE ledc_gen_pool_lock = portMUX_INITIALIZER_UNLOCKED;
+static sys_pool_t ledc_gen_pool_stats = {
+    .name = "ledc gen",
+    .blocks = STEPPER_GEN_POOL_SIZE,
+    .block_size = sizeof(stepper_ledc_gen_t),
+};
+
+static bool IRAM_ATTR stepper_ledc_gen_on_reach(pcnt_unit_handle_t unit, const pcnt_watch_event_data_t *edata, void *user_ctx)
+{
+    uint32_t isr_start = sys_isr_enter();
+    stepper_ledc_gen_t *ledc_gen = (stepper_ledc_gen_t *)user_ctx;
+    BaseType_t task_woken = pdFALSE;
+    bool last;
+
+    if (edata->watch_point_value == STEPPER_GEN_PCNT_LIMIT)
+    {
+        // the count wraps to 0 at the limit
+        ledc_gen->laps--;
+        last = ledc_gen->laps == 0 && ledc_gen->tail == 0;
+    }
+    else
+    {
+        // the tail watch point is passed once per lap as well
+        last = ledc_gen->laps == 0;
+    }
+    if (last)
+    {
+        esp_rom_gpio_connect_out_signal(ledc_gen->gpio_num, SIG_GPIO_OUT_IDX, false, false);
+        xSemaphoreGiveFromISR(ledc_gen->done, &task_woken);
+    }
+
+    sys_isr_exit(SYS_ISR_LEDC_COUNT, isr_start);
+    return task_woken == pdTRUE;
+}
+
+static esp_err_t stepper_ledc_gen_segment(stepper_ledc_gen_t *ledc_gen, uint32_t freq_hz, uint64_t steps)
+{
+    ESP_RETURN_ON_FALSE(freq_hz >= STEPPER_GEN_LEDC_FREQ_MIN && freq_hz <= STEPPER_GEN_LEDC_FREQ_MAX, ESP_ERR_INVALID_ARG, TAG,
+                        "%luHz out of the ledc range", freq_hz);
+    ESP_RETURN_ON_ERROR(ledc_set_freq(STEPPER_GEN_LEDC_MODE, ledc_gen->timer_num, freq_hz), TAG, "set freq failed");
+    ESP_RETURN_ON_ERROR(ledc_timer_rst(STEPPER_GEN_LEDC_MODE, ledc_gen->timer_num), TAG, "timer reset failed");
+
+    ESP_RETURN_ON_ERROR(pcnt_unit_clear_count(ledc_gen->unit), TAG, "clear count failed");
+    if (ledc_gen->tail)
+    {
+        ESP_RETURN_ON_ERROR(pcnt_unit_remove_watch_point(ledc_gen->unit, ledc_gen->tail), TAG, "remove watch point failed");
+    }
+    ledc_gen->laps = steps / STEPPER_GEN_PCNT_LIMIT;
+    ledc_gen->tail = steps % STEPPER_GEN_PCNT_LIMIT;
+    if (ledc_gen->tail)
+    {
+        ESP_RETURN_ON_ERROR(pcnt_unit_add_watch_point(ledc_gen->unit, ledc_gen->tail), TAG, "add watch point failed");
+    }
+    ESP_RETURN_ON_ERROR(pcnt_unit_start(ledc_gen->unit), TAG, "start count failed");
+
+    // the first period starts as the timer is resumed, the pin follows the channel from here
+    ESP_RETURN_ON_ERROR(ledc_update_duty(STEPPER_GEN_LEDC_MODE, ledc_gen->channel), TAG, "update duty failed");
+    esp_rom_gpio_connect_out_signal(ledc_gen->gpio_num, ledc_periph_signal[STEPPER_GEN_LEDC_MODE].sig_out0_idx + ledc_gen->channel, false, false);
+    ESP_RETURN_ON_ERROR(ledc_timer_resume(STEPPER_GEN_LEDC_MODE, ledc_gen->timer_num), TAG, "timer resume failed");
+
+    xSemaphoreTake(ledc_gen->done, portMAX_DELAY);
+
+    ESP_RETURN_ON_ERROR(ledc_timer_pause(STEPPER_GEN_LEDC_MODE, ledc_gen->timer_num), TAG, "timer pause failed");
+    ESP_RETURN_ON_ERROR(ledc_stop(STEPPER_GEN_LEDC_MODE, ledc_gen->channel, 0), TAG, "stop failed");
+    ESP_RETURN_ON_ERROR(pcnt_unit_stop(ledc_gen->unit), TAG, "stop count failed");
+    // the pin still looped back, a late isr shows as counts past the last step
+    int count = 0;
+    ESP_RETURN_ON_ERROR(pcnt_unit_get_count(ledc_gen->unit, &count), TAG, "get count failed");
+    if (count > ledc_gen->tail)
+    {
+        ESP_LOGW(TAG, "%d steps past the end at %luHz, the stop isr was late", count - ledc_gen->tail, freq_hz);
+    }
+    return ESP_OK;
+}
+
+static esp_err_t stepper_ledc_gen_run(stepper_gen_t *gen, const stepper_segment_t *segments, uint32_t num_segments)
+{
+    stepper_ledc_gen_t *ledc_gen = __containerof(gen, stepper_ledc_gen_t, base);
+
+    ESP_RETURN_ON_FALSE(num_segments <= STEPPER_GEN_SEGMENT_MAX, ESP_ERR_INVALID_ARG, TAG, "too many segments");
+    // segments restart the timer, a rate change costs a gap of a few microseconds
+    for (uint32_t i = 0; i < num_segments; i++)
+    {
+        if (segments[i].steps)
+        {
+            ESP_RETURN_ON_ERROR(stepper_ledc_gen_segment(ledc_gen, segments[i].freq_hz, segments[i].steps), TAG, "segment failed");
+        }
+    }
+    return ESP_OK;
+}
+
+static esp_err_t stepper_ledc_gen_enable(stepper_gen_t *gen)
+{
+    return pcnt_unit_enable(__containerof(gen, stepper_ledc_gen_t, base)->unit);
+}
+
+static esp_err_t stepper_ledc_gen_disable(stepper_gen_t *gen)
+{
+    return pcnt_unit_disable(__containerof(gen, stepper_ledc_gen_t, base)->unit);
+}
+
+static esp_err_t stepper_ledc_gen_del(stepper_gen_t *gen)
+{
+    stepper_ledc_gen_t *ledc_gen = __containerof(gen, stepper_ledc_gen_t, base);
+
+    ESP_RETURN_ON_ERROR(pcnt_del_channel(ledc_gen->pcnt_chan), TAG, "delete pcnt channel failed");
+    ESP_RETURN_ON_ERROR(pcnt_del_unit(ledc_gen->unit), TAG, "delete pcnt unit failed");
+    portENTER_CRITICAL(&ledc_gen_pool_lock);
+    ledc_gen->in_use = false;
+    sys_pool_give(&ledc_gen_pool_stats);
+    portEXIT_CRITICAL(&ledc_gen_pool_lock);
+    return ESP_OK;
+}
+
+esp_err_t stepper_new_ledc_gen(const stepper_ledc_gen_config_t *config, stepper_gen_handle_t *ret_gen)
+{
+    esp_err_t ret = ESP_OK;
+    stepper_ledc_gen_t *ledc_gen = NULL;
+
+    ESP_RETURN_ON_FALSE(config && ret_gen && GPIO_IS_VALID_OUTPUT_GPIO(config->gpio_num), ESP_ERR_INVALID_ARG, TAG, "invalid arguments");
+
+    portENTER_CRITICAL(&ledc_gen_pool_lock);
+    for (int i = 0; i < STEPPER_GEN_POOL_SIZE; i++)
+    {
+        if (!ledc_gen_pool[i].in_use)
+        {
+            ledc_gen = &ledc_gen_pool[i];
+            memset(ledc_gen, 0, sizeof(*ledc_gen));
+            ledc_gen->in_use = true;
+            sys_pool_take(&ledc_gen_pool_stats);
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&ledc_gen_pool_lock);
+    ESP_RETURN_ON_FALSE(ledc_gen, ESP_ERR_NO_MEM, TAG, "ledc generator pool exhausted");
+
+    ledc_gen->gpio_num = config->gpio_num;
+    ledc_gen->timer_num = config->timer_num;
+    ledc_gen->channel = config->channel;
+    ledc_gen->done = xSemaphoreCreateBinaryStatic(&ledc_gen->done_buffer);
+
+    // the timer sits paused and the channel idles low between segments
+    ledc_timer_config_t timer_config = {
+        .speed_mode = STEPPER_GEN_LEDC_MODE,
+        .duty_resolution = (ledc_timer_bit_t)STEPPER_GEN_LEDC_DUTY_BITS,
+        .timer_num = ledc_gen->timer_num,
+        .freq_hz = STEPPER_GEN_LEDC_FREQ_MIN,
+        .clk_cfg = LEDC_USE_APB_CLK,
+    };
+    ESP_GOTO_ON_ERROR(ledc_timer_config(&timer_config), err, TAG, "ledc timer config failed");
+    ESP_GOTO_ON_ERROR(ledc_timer_pause(STEPPER_GEN_LEDC_MODE, ledc_gen->timer_num), err, TAG, "ledc timer pause failed");
+    ledc_channel_config_t channel_config = {
+        .speed_mode = STEPPER_GEN_LEDC_MODE,
+        .channel = ledc_gen->channel,
+        .timer_sel = ledc_gen->timer_num,
+        .intr_type = LEDC_INTR_DISABLE,
+        .gpio_num = ledc_gen->gpio_num,
+        .duty = STEPPER_GEN_LEDC_DUTY,
+        .hpoint = 0,
+    };
+    ESP_GOTO_ON_ERROR(ledc_channel_config(&channel_config), err, TAG, "ledc channel config failed");
+    ESP_GOTO_ON_ERROR(ledc_stop(STEPPER_GEN_LEDC_MODE, ledc_gen->channel, 0), err, TAG, "ledc stop failed");
+
+    pcnt_unit_config_t unit_config = {
+        .low_limit = -1,
+        .high_limit = STEPPER_GEN_PCNT_LIMIT,
+    };
+    pcnt_glitch_filter_config_t filter_config = {
+        .max_glitch_ns = STEPPER_GEN_PCNT_GLITCH_NS,
+    };
+    // loop back keeps the pad an output, it is left on the plain gpio output until a segment starts
+    pcnt_chan_config_t chan_config = {
+        .edge_gpio_num = ledc_gen->gpio_num,
+        .level_gpio_num = -1,
+        .flags.io_loop_back = 1,
+    };
+    pcnt_event_callbacks_t cbs = {
+        .on_reach = stepper_ledc_gen_on_reach,
+    };
+    ESP_GOTO_ON_ERROR(pcnt_new_unit(&unit_config, &ledc_gen->unit), err, TAG, "no free pcnt unit");
+    ESP_GOTO_ON_ERROR(pcnt_unit_set_glitch_filter(ledc_gen->unit, &filter_config), err, TAG, "pcnt filter failed");
+    ESP_GOTO_ON_ERROR(pcnt_new_channel(ledc_gen->unit, &chan_config, &ledc_gen->pcnt_chan), err, TAG, "pcnt channel failed");
+    gpio_set_level(ledc_gen->gpio_num, 0);
+    // a step is counted as its pulse ends
+    ESP_GOTO_ON_ERROR(pcnt_channel_set_edge_action(ledc_gen->pcnt_chan, PCNT_CHANNEL_EDGE_ACTION_HOLD, PCNT_CHANNEL_EDGE_ACTION_INCREASE), err, TAG, "pcnt edge action failed");
+    ESP_GOTO_ON_ERROR(pcnt_unit_add_watch_point(ledc_gen->unit, STEPPER_GEN_PCNT_LIMIT), err, TAG, "pcnt watch point failed");
+    ESP_GOTO_ON_ERROR(pcnt_unit_register_event_callbacks(ledc_gen->unit, &cbs, ledc_gen), err, TAG, "pcnt callbacks failed");
+
+    ledc_gen->base.name = stepper_gen_backend_name(STEPPER_GEN_LEDC);
+    ledc_gen->base.run = stepper_ledc_gen_run;
+    ledc_gen->base.enable = stepper_ledc_gen_enable;
+    ledc_gen->base.disable = stepper_ledc_gen_disable;
+    ledc_gen->base.del = stepper_ledc_gen_del;
+
+    *ret_gen = &ledc_gen->base;
+    return ESP_OK;
+err:
+    if (ledc_gen->unit)
+    {
+        if (ledc_gen->pcnt_chan)
+        {
+            pcnt_del_channel(ledc_gen->pcnt_chan);
+        }
+        pcnt_del_unit(ledc_gen->unit);
+    }
+    portENTER_CRITICAL(&ledc_gen_pool_lock);
+    ledc_gen->in_use = false;
+    sys_pool_give(&ledc_gen_pool_stats);
+    portEXIT_CRITICAL(&ledc_gen_pool_lock);
+    return ret;
+}
@@ -0,0 +1,218 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_check.h"
+#include "esp_idf_version.h"
+#include "driver/mcpwm_prelude.h"
+#include "stepper_gen.h"
+#include "sys_monitor.h"
+
+static const char *TAG = "stepper_gen_mcpwm";
+
+/*
+ * Each period of the timer is one step: the generator goes high on the compare at half period and
+ * low on the timer full event, so a pulse always ends with its period. The compare event (one
+ * interrupt per step) counts the pulses, the last one asks the timer to stop on the next empty,
+ * which comes right after that pulse has ended. That ISR has to land inside the high half of the
+ * period (STEPPER_GEN_MCPWM_FREQ_MAX), it is IRAM-safe so flash writes don't hold it off; a compare
+ * past the last step is a pulse too many, counted and reported.
+ */
+typedef struct
+{
+    stepper_gen_t base;
+    mcpwm_timer_handle_t timer;
+    mcpwm_oper_handle_t oper;
+    mcpwm_cmpr_handle_t cmpr;
+    mcpwm_gen_handle_t gen;
+    SemaphoreHandle_t done;
+    StaticSemaphore_t done_buffer;
+    volatile uint64_t steps_left;
+    volatile uint32_t overshoot; // compares past the last step of the segment
+    bool in_use;
+} stepper_mcpwm_gen_t;
+
+static stepper_mcpwm_gen_t mcpwm_gen_pool[STEPPER_GEN_POOL_SIZE];
+static portMUX_TYPE mcpwm_gen_pool_lock = portMUX_INITIALIZER_UNLOCKED;
+static sys_pool_t mcpwm_gen_pool_stats = {
+    .name = "mcpwm gen",
+    .blocks = STEPPER_GEN_POOL_SIZE,
+    .block_size = sizeof(stepper_mcpwm_gen_t),
+};
+
+static bool IRAM_ATTR stepper_mcpwm_gen_on_compare(mcpwm_cmpr_handle_t cmpr, const mcpwm_compare_event_data_t *edata, void *user_ctx)
+{
+    uint32_t isr_start = sys_isr_enter();
+    stepper_mcpwm_gen_t *mcpwm_gen = (stepper_mcpwm_gen_t *)user_ctx;
+
+    if (mcpwm_gen->steps_left == 0)
+    {
+        // the stop came after the next period had begun
+        mcpwm_gen->overshoot++;
+    }
+    else if (--mcpwm_gen->steps_left == 0)
+    {
+        mcpwm_timer_start_stop(mcpwm_gen->timer, MCPWM_TIMER_STOP_EMPTY);
+    }
+
+    sys_isr_exit(SYS_ISR_MCPWM_STEP, isr_start);
+    return false;
+}
+
+static bool IRAM_ATTR stepper_mcpwm_gen_on_stop(mcpwm_timer_handle_t timer, const mcpwm_timer_event_data_t *edata, void *user_ctx)
+{
+    stepper_mcpwm_gen_t *mcpwm_gen = (stepper_mcpwm_gen_t *)user_ctx;
+    BaseType_t task_woken = pdFALSE;
+
+    xSemaphoreGiveFromISR(mcpwm_gen->done, &task_woken);
+    return task_woken == pdTRUE;
+}
+
+static esp_err_t stepper_mcpwm_gen_run(stepper_gen_t *gen, const stepper_segment_t *segments, uint32_t num_segments)
+{
+    stepper_mcpwm_gen_t *mcpwm_gen = __containerof(gen, stepper_mcpwm_gen_t, base);
+
+    ESP_RETURN_ON_FALSE(num_segments <= STEPPER_GEN_SEGMENT_MAX, ESP_ERR_INVALID_ARG, TAG, "too many segments");
+    // the timer rests on empty between segments, a rate change costs a gap of a few microseconds
+    for (uint32_t i = 0; i < num_segments; i++)
+    {
+        if (segments[i].steps == 0)
+        {
+            continue;
+        }
+        ESP_RETURN_ON_FALSE(segments[i].freq_hz && segments[i].freq_hz <= STEPPER_GEN_MCPWM_FREQ_MAX, ESP_ERR_INVALID_ARG, TAG,
+                            "%luHz out of the mcpwm range", segments[i].freq_hz);
+        uint32_t period = (STEPPER_GEN_MCPWM_RESOLUTION_HZ + segments[i].freq_hz / 2) / segments[i].freq_hz;
+        ESP_RETURN_ON_FALSE(period <= STEPPER_GEN_MCPWM_PERIOD_MAX, ESP_ERR_INVALID_ARG, TAG,
+                            "%luHz out of the mcpwm range", segments[i].freq_hz);
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 1, 0)
+        ESP_RETURN_ON_ERROR(mcpwm_timer_set_period(mcpwm_gen->timer, period), TAG, "set period failed");
+#endif
+        ESP_RETURN_ON_ERROR(mcpwm_comparator_set_compare_value(mcpwm_gen->cmpr, period / 2), TAG, "set compare failed");
+        mcpwm_gen->steps_left = segments[i].steps;
+        mcpwm_gen->overshoot = 0;
+        ESP_RETURN_ON_ERROR(mcpwm_timer_start_stop(mcpwm_gen->timer, MCPWM_TIMER_START_NO_STOP), TAG, "start failed");
+        xSemaphoreTake(mcpwm_gen->done, portMAX_DELAY);
+        if (mcpwm_gen->overshoot)
+        {
+            ESP_LOGW(TAG, "%lu steps past the end at %luHz, the stop isr was late", mcpwm_gen->overshoot, segments[i].freq_hz);
+        }
+    }
+    return ESP_OK;
+}
+
+static esp_err_t stepper_mcpwm_gen_enable(stepper_gen_t *gen)
+{
+    return mcpwm_timer_enable(__containerof(gen, stepper_mcpwm_gen_t, base)->timer);
+}
+
+static esp_err_t stepper_mcpwm_gen_disable(stepper_gen_t *gen)
+{
+    return mcpwm_timer_disable(__containerof(gen, stepper_mcpwm_gen_t, base)->timer);
+}
+
+static void stepper_mcpwm_gen_free(stepper_mcpwm_gen_t *mcpwm_gen)
+{
+    if (mcpwm_gen->gen)
+    {
+        mcpwm_del_generator(mcpwm_gen->gen);
+    }
+    if (mcpwm_gen->cmpr)
+    {
+        mcpwm_del_comparator(mcpwm_gen->cmpr);
+    }
+    if (mcpwm_gen->oper)
+    {
+        mcpwm_del_operator(mcpwm_gen->oper);
+    }
+    if (mcpwm_gen->timer)
+    {
+        mcpwm_del_timer(mcpwm_gen->timer);
+    }
+    portENTER_CRITICAL(&mcpwm_gen_pool_lock);
+    mcpwm_gen->in_use = false;
+    sys_pool_give(&mcpwm_gen_pool_stats);
+    portEXIT_CRITICAL(&mcpwm_gen_pool_lock);
+}
+
+static esp_err_t stepper_mcpwm_gen_del(stepper_gen_t *gen)
+{
+    stepper_mcpwm_gen_free(__containerof(gen, stepper_mcpwm_gen_t, base));
+    return ESP_OK;
+}
+
+esp_err_t stepper_new_mcpwm_gen(const stepper_mcpwm_gen_config_t *config, stepper_gen_handle_t *ret_gen)
+{
+    esp_err_t ret = ESP_OK;
+    stepper_mcpwm_gen_t *mcpwm_gen = NULL;
+
+    ESP_RETURN_ON_FALSE(config && ret_gen, ESP_ERR_INVALID_ARG, TAG, "invalid arguments");
+#if ESP_IDF_VERSION < ESP_IDF_VERSION_VAL(5, 1, 0)
+    // the timer period is fixed at creation before mcpwm_timer_set_period
+    ESP_LOGE(TAG, "mcpwm steps need ESP-IDF 5.1 or later");
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+
+    portENTER_CRITICAL(&mcpwm_gen_pool_lock);
+    for (int i = 0; i < STEPPER_GEN_POOL_SIZE; i++)
+    {
+        if (!mcpwm_gen_pool[i].in_use)
+        {
+            mcpwm_gen = &mcpwm_gen_pool[i];
+            memset(mcpwm_gen, 0, sizeof(*mcpwm_gen));
+            mcpwm_gen->in_use = true;
+            sys_pool_take(&mcpwm_gen_pool_stats);
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&mcpwm_gen_pool_lock);
+    ESP_RETURN_ON_FALSE(mcpwm_gen, ESP_ERR_NO_MEM, TAG, "mcpwm generator pool exhausted");
+
+    mcpwm_gen->done = xSemaphoreCreateBinaryStatic(&mcpwm_gen->done_buffer);
+
+    mcpwm_timer_config_t timer_config = {
+        .group_id = config->group_id,
+        .clk_src = MCPWM_TIMER_CLK_SRC_DEFAULT,
+        .resolution_hz = STEPPER_GEN_MCPWM_RESOLUTION_HZ,
+        .period_ticks = STEPPER_GEN_MCPWM_PERIOD_MAX,
+        .count_mode = MCPWM_TIMER_COUNT_MODE_UP,
+    };
+    mcpwm_operator_config_t operator_config = {
+        .group_id = config->group_id,
+    };
+    // no update flags, the compare value is taken at once while the timer rests
+    mcpwm_comparator_config_t comparator_config = {};
+    mcpwm_generator_config_t generator_config = {
+        .gen_gpio_num = config->gpio_num,
+    };
+    mcpwm_timer_event_callbacks_t timer_cbs = {
+        .on_stop = stepper_mcpwm_gen_on_stop,
+    };
+    mcpwm_comparator_event_callbacks_t comparator_cbs = {
+        .on_reach = stepper_mcpwm_gen_on_compare,
+    };
+    ESP_GOTO_ON_ERROR(mcpwm_new_timer(&timer_config, &mcpwm_gen->timer), err, TAG, "no free mcpwm timer");
+    ESP_GOTO_ON_ERROR(mcpwm_new_operator(&operator_config, &mcpwm_gen->oper), err, TAG, "no free mcpwm operator");
+    ESP_GOTO_ON_ERROR(mcpwm_operator_connect_timer(mcpwm_gen->oper, mcpwm_gen->timer), err, TAG, "connect timer failed");
+    ESP_GOTO_ON_ERROR(mcpwm_new_comparator(mcpwm_gen->oper, &comparator_config, &mcpwm_gen->cmpr), err, TAG, "no free comparator");
+    ESP_GOTO_ON_ERROR(mcpwm_new_generator(mcpwm_gen->oper, &generator_config, &mcpwm_gen->gen), err, TAG, "no free generator");
+    ESP_GOTO_ON_ERROR(mcpwm_generator_set_action_on_compare_event(mcpwm_gen->gen,
+                      MCPWM_GEN_COMPARE_EVENT_ACTION(MCPWM_TIMER_DIRECTION_UP, mcpwm_gen->cmpr, MCPWM_GEN_ACTION_HIGH)),
+                      err, TAG, "compare action failed");
+    ESP_GOTO_ON_ERROR(mcpwm_generator_set_action_on_timer_event(mcpwm_gen->gen,
+                      MCPWM_GEN_TIMER_EVENT_ACTION(MCPWM_TIMER_DIRECTION_UP, MCPWM_TIMER_EVENT_FULL, MCPWM_GEN_ACTION_LOW)),
+                      err, TAG, "timer action failed");
+    ESP_GOTO_ON_ERROR(mcpwm_comparator_register_event_callbacks(mcpwm_gen->cmpr, &comparator_cbs, mcpwm_gen), err, TAG, "comparator callbacks failed");
+    ESP_GOTO_ON_ERROR(mcpwm_timer_register_event_callbacks(mcpwm_gen->timer, &timer_cbs, mcpwm_gen), err, TAG, "timer callbacks failed");
+
+    mcpwm_gen->base.name = stepper_gen_backend_name(STEPPER_GEN_MCPWM);
+    mcpwm_gen->base.run = stepper_mcpwm_gen_run;
+    mcpwm_gen->base.enable = stepper_mcpwm_gen_enable;
+    mcpwm_gen->base.disable = stepper_mcpwm_gen_disable;
+    mcpwm_gen->base.del = stepper_mcpwm_gen_del;
+
+    *ret_gen = &mcpwm_gen->base;
+    return ESP_OK;
+err:
+    stepper_mcpwm_gen_free(mcpwm_gen);
+    return ret;
+}
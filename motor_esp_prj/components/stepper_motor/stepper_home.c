@@ -0,0 +1,163 @@
+#include <string.h>
+#include "stepper_home.h"
+
+static const char *const stepper_home_phase_names[] = {"seek", "backoff", "approach", "locate", "done", "failed"};
+
+const char *stepper_home_phase_name(stepper_home_phase_t phase)
+{
+    return phase <= STEPPER_HOME_FAILED ? stepper_home_phase_names[phase] : "?";
+}
+
+// steps away from the switch point, on the side the cycle approaches from
+static int64_t stepper_home_away(const stepper_home_t *home)
+{
+    return (home->ref - home->pos) * home->config.dir;
+}
+
+static void stepper_home_enter(stepper_home_t *home, stepper_home_phase_t phase)
+{
+    home->phase = phase;
+    home->phase_steps = 0;
+    if (phase == STEPPER_HOME_BACKOFF)
+    {
+        home->released = false;
+    }
+    // backed off exactly the slow zone, nothing to approach fast
+    if (phase == STEPPER_HOME_APPROACH && stepper_home_away(home) <= home->config.slow_steps)
+    {
+        home->phase = STEPPER_HOME_LOCATE;
+    }
+}
+
+bool stepper_home_init(stepper_home_t *home, const stepper_home_config_t *config, bool active)
+{
+    if ((config->dir != 1 && config->dir != -1) || config->seek_hz == 0 || config->locate_hz == 0 ||
+        config->travel_max == 0 || config->slow_steps == 0)
+    {
+        return false;
+    }
+    memset(home, 0, sizeof(*home));
+    home->config = *config;
+    // parked on the switch, back off first
+    stepper_home_enter(home, active ? STEPPER_HOME_BACKOFF : STEPPER_HOME_SEEK);
+    return true;
+}
+
+bool stepper_home_next(stepper_home_t *home, stepper_home_move_t *move)
+{
+    const stepper_home_config_t *config = &home->config;
+    uint32_t chunk = (uint64_t)config->seek_hz * STEPPER_HOME_CHUNK_ms / 1000;
+    uint64_t travel_left = config->travel_max - home->phase_steps;
+
+    if (chunk == 0)
+    {
+        chunk = 1;
+    }
+    if (chunk > travel_left)
+    {
+        chunk = travel_left;
+    }
+
+    switch (home->phase)
+    {
+    case STEPPER_HOME_SEEK:
+        move->dir = config->dir;
+        move->freq_hz = config->seek_hz;
+        move->steps = chunk;
+        break;
+    case STEPPER_HOME_BACKOFF:
+        move->dir = -config->dir;
+        move->freq_hz = config->seek_hz;
+        // once released, straight to the far end of the slow zone
+        move->steps = home->released ? config->slow_steps - stepper_home_away(home) : chunk;
+        break;
+    case STEPPER_HOME_APPROACH:
+        move->dir = config->dir;
+        move->freq_hz = config->seek_hz;
+        move->steps = stepper_home_away(home) - config->slow_steps;
+        break;
+    case STEPPER_HOME_LOCATE:
+        move->dir = config->dir;
+        move->freq_hz = config->locate_hz;
+        move->steps = 1;
+        break;
+    default:
+        return false;
+    }
+
+    home->move = *move;
+    return true;
+}
+
+void stepper_home_report(stepper_home_t *home, const stepper_home_latch_t *latch)
+{
+    const stepper_home_config_t *config = &home->config;
+    const stepper_home_move_t *move = &home->move;
+    int64_t start = home->pos;
+    // an edge the isr missed counts as tripped at the end of the move
+    uint32_t trip_steps = latch->tripped && latch->trip_steps < move->steps ? latch->trip_steps : move->steps;
+
+    home->pos += (int64_t)move->dir * move->steps;
+    home->phase_steps += move->steps;
+
+    // a trip the debounced level doesn't confirm was a glitch, only the level decides
+    switch (home->phase)
+    {
+    case STEPPER_HOME_SEEK:
+        if (latch->active)
+        {
+            home->ref = start + (int64_t)move->dir * trip_steps;
+            home->has_ref = true;
+            stepper_home_enter(home, STEPPER_HOME_BACKOFF);
+        }
+        else if (home->phase_steps >= config->travel_max)
+        {
+            stepper_home_enter(home, STEPPER_HOME_FAILED);
+        }
+        break;
+    case STEPPER_HOME_BACKOFF:
+        if (!latch->active)
+        {
+            home->released = true;
+        }
+        if (home->released && !home->has_ref)
+        {
+            // started on the switch, the release point is a chunk off, seek it again for a latch
+            stepper_home_enter(home, STEPPER_HOME_SEEK);
+        }
+        else if (home->released && stepper_home_away(home) >= config->slow_steps)
+        {
+            stepper_home_enter(home, STEPPER_HOME_APPROACH);
+        }
+        else if (home->phase_steps >= config->travel_max)
+        {
+            stepper_home_enter(home, STEPPER_HOME_FAILED);
+        }
+        break;
+    case STEPPER_HOME_APPROACH:
+        if (latch->active)
+        {
+            // the switch came before the slow zone, take the new point and back off again
+            home->ref = start + (int64_t)move->dir * trip_steps;
+            stepper_home_enter(home, ++home->retries > STEPPER_HOME_RETRY_MAX ? STEPPER_HOME_FAILED : STEPPER_HOME_BACKOFF);
+        }
+        else
+        {
+            stepper_home_enter(home, STEPPER_HOME_LOCATE);
+        }
+        break;
+    case STEPPER_HOME_LOCATE:
+        if (latch->active)
+        {
+            home->found = home->pos;
+            stepper_home_enter(home, STEPPER_HOME_DONE);
+        }
+        else if (home->phase_steps >= (uint64_t)config->slow_steps * STEPPER_HOME_LOCATE_ZONES)
+        {
+            stepper_home_enter(home, STEPPER_HOME_FAILED);
+        }
+        break;
+    default:
+        break;
+    }
+}
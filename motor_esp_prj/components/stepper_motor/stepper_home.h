@@ -0,0 +1,99 @@
+#ifndef _STEPPER_HOME_H
+#define _STEPPER_HOME_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define STEPPER_HOME_CHUNK_ms 10  // fast moves are sent in pieces this long, the switch is checked between them
+#define STEPPER_HOME_RETRY_MAX 2  // fast approaches that may run into the switch before homing fails
+#define STEPPER_HOME_LOCATE_ZONES 3 // single steps the slow approach may take, in slow_steps
+
+typedef enum {
+    STEPPER_HOME_SEEK = 0, // fast toward the switch until it trips, the isr latches where
+    STEPPER_HOME_BACKOFF,  // fast away until the switch releases and the slow zone is behind
+    STEPPER_HOME_APPROACH, // fast back to the start of the slow zone
+    STEPPER_HOME_LOCATE,   // single steps toward the switch until it trips
+    STEPPER_HOME_DONE,     // stopped on the step that tripped the switch
+    STEPPER_HOME_FAILED,
+} stepper_home_phase_t;
+
+/**
+ * @brief Homing cycle configuration of one axis
+ */
+typedef struct {
+    int dir;             // direction of the switch, +1 or -1
+    uint32_t seek_hz;    // fast moves
+    uint32_t locate_hz;  // slow approach, single steps
+    uint32_t travel_max; // longest fast move without a switch change, in steps
+    uint32_t slow_steps; // slow zone before the switch, covers the seek latch error and the switch spread
+} stepper_home_config_t;
+
+/**
+ * @brief One move of the cycle, at a constant rate
+ */
+typedef struct {
+    int dir; // +1 or -1
+    uint32_t freq_hz;
+    uint32_t steps;
+} stepper_home_move_t;
+
+/**
+ * @brief What the limit input did during a move
+ */
+typedef struct {
+    bool active;         // debounced level once the move is over
+    bool tripped;        // went active during the move
+    uint32_t trip_steps; // steps of the move out when it tripped, latched by the isr
+} stepper_home_latch_t;
+
+/**
+ * @brief Homing cycle state, positions in steps from where the cycle started
+ *
+ * The caller runs the moves handed out by stepper_home_next and reports the limit input after each.
+ * The seek latch only has to be good to a few steps, the slow zone covers it. The switch point is
+ * the step of the slow approach after which the input reads active, repeatable to one step.
+ */
+typedef struct {
+    stepper_home_config_t config;
+    stepper_home_phase_t phase;
+    stepper_home_move_t move; // handed out, not yet reported
+    int64_t pos;
+    int64_t ref;         // switch point from the seek latch
+    int64_t found;       // switch point from the slow approach
+    uint64_t phase_steps;
+    uint32_t retries;
+    bool has_ref;
+    bool released;
+} stepper_home_t;
+
+/**
+ * @brief Start a homing cycle
+ *
+ * @param[in] active Debounced limit input now, an axis parked on its switch backs off first
+ * @return false for a config that can't home
+ */
+bool stepper_home_init(stepper_home_t *home, const stepper_home_config_t *config, bool active);
+
+/**
+ * @brief Next move of the cycle
+ *
+ * @return false once the cycle is DONE or FAILED
+ */
+bool stepper_home_next(stepper_home_t *home, stepper_home_move_t *move);
+
+/**
+ * @brief Report the limit input of the move handed out last, every step of it was sent
+ */
+void stepper_home_report(stepper_home_t *home, const stepper_home_latch_t *latch);
+
+const char *stepper_home_phase_name(stepper_home_phase_t phase);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
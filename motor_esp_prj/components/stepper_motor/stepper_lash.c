@@ -0,0 +1,30 @@
+#include <stddef.h>
+#include "stepper_lash.h"
+
+bool stepper_lash_set(stepper_lash_t *lash, uint32_t steps, uint32_t freq_hz)
+{
+    if (steps > STEPPER_LASH_STEPS_MAX || freq_hz < STEPPER_LASH_FREQ_MIN || freq_hz > STEPPER_LASH_FREQ_MAX)
+    {
+        return false;
+    }
+    lash->steps = steps;
+    lash->freq_hz = freq_hz;
+    return true;
+}
+
+uint32_t stepper_lash_dir(stepper_lash_t *lash, int dir, stepper_segment_t *take_up)
+{
+    int side = dir < 0 ? -1 : 1;
+    bool reversed = lash->side != 0 && lash->side != side;
+
+    lash->side = side;
+    if (!reversed || !lash->steps || !take_up)
+    {
+        return 0;
+    }
+    take_up->freq_hz = lash->freq_hz;
+    take_up->steps = lash->steps;
+    take_up->exact = true;
+    take_up->take_up = true;
+    return 1;
+}
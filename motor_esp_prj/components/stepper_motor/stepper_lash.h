@@ -0,0 +1,50 @@
+#ifndef _STEPPER_LASH_H
+#define _STEPPER_LASH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "stepper_shaper.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define STEPPER_LASH_STEPS_MAX 10000 // slack of one axis, in steps
+#define STEPPER_LASH_FREQ_MIN 100    // take-up rate range, the motor starts at it without a ramp
+#define STEPPER_LASH_FREQ_MAX 20000
+
+/**
+ * @brief Backlash of one axis, the slack between screw and nut
+ *
+ * A move that reverses the axis first turns the screw through the slack without moving the nut. The
+ * take-up puts out those steps at their own rate ahead of the move, so the nut travels the steps asked
+ * for. Which side the slack is on is known once the axis has moved, until then nothing is taken up.
+ */
+typedef struct {
+    uint32_t steps;   // slack, 0 for none
+    uint32_t freq_hz; // take-up rate
+    int side;         // +1 / -1: the direction the slack was last taken up in, 0 unknown
+} stepper_lash_t;
+
+/**
+ * @brief Set the slack and take-up rate, the side is kept
+ *
+ * @return false for more than STEPPER_LASH_STEPS_MAX steps or a rate out of range
+ */
+bool stepper_lash_set(stepper_lash_t *lash, uint32_t steps, uint32_t freq_hz);
+
+/**
+ * @brief The next move goes in dir, its take-up when it reverses the axis
+ *
+ * @param[in] dir +1 or -1
+ * @param[out] take_up Take-up segment, exact and take_up set, NULL for a move that can't take it up:
+ *                     the slack still ends up on dir's side, the nut loses the steps
+ * @return segments written to take_up, 0 or 1
+ */
+uint32_t stepper_lash_dir(stepper_lash_t *lash, int dir, stepper_segment_t *take_up);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -4,19 +4,15 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 
+#include <string.h>
+#include "freertos/FreeRTOS.h"
 #include "esp_check.h"
+#include "esp_timer.h"
 #include "stepper_motor_encoder.h"
+#include "sys_monitor.h"
 
 static const char *TAG = "stepper_motor_encoder";
 
-static float convert_to_smooth_freq(uint32_t freq1, uint32_t freq2, uint32_t freqx)
-{
-    float normalize_x = ((float)(freqx - freq1)) / (freq2 - freq1);
-    // third-order "smoothstep" function: https://en.wikipedia.org/wiki/Smoothstep
-    float smooth_x = normalize_x * normalize_x * (3 - 2 * normalize_x);
-    return smooth_x * (freq2 - freq1) + freq1;
-}
-
 typedef struct
 {
     rmt_encoder_t base;
@@ -26,11 +22,60 @@ typedef struct
     {
         uint32_t is_accel_curve : 1;
     } flags;
-    rmt_symbol_word_t curve_table[];
+    bool in_use;
+    const rmt_symbol_word_t *curve_table; // not owned, in internal ram, the encode callback runs in the isr
 } rmt_stepper_curve_encoder_t;
 
-static size_t rmt_encode_stepper_motor_curve(rmt_encoder_t *encoder, rmt_channel_handle_t channel, const void *primary_data, size_t data_size, rmt_encode_state_t *ret_state)
+/*
+ * Every encoder comes from a static pool, nothing on the motion path touches the heap. A slot keeps
+ * its copy encoder (the only allocation, made inside the RMT driver) across reuse, so only the
+ * first creation of each slot allocates, at boot in this firmware.
+ *
+ * The RMT driver is IRAM-safe (CONFIG_RMT_ISR_IRAM_SAFE) and keeps refilling while the flash cache
+ * is off, so the encode and reset callbacks and all they call are IRAM_ATTR, their data in internal ram.
+ */
+static rmt_stepper_curve_encoder_t curve_encoder_pool[STEPPER_CURVE_ENCODER_MAX];
+static portMUX_TYPE curve_encoder_pool_lock = portMUX_INITIALIZER_UNLOCKED;
+static sys_pool_t curve_encoder_pool_stats = {
+    .name = "curve encoder",
+    .blocks = STEPPER_CURVE_ENCODER_MAX,
+    .block_size = sizeof(rmt_stepper_curve_encoder_t),
+};
+
+static rmt_stepper_curve_encoder_t *curve_encoder_pool_get(void)
+{
+    rmt_stepper_curve_encoder_t *step_encoder = NULL;
+
+    portENTER_CRITICAL(&curve_encoder_pool_lock);
+    for (int i = 0; i < STEPPER_CURVE_ENCODER_MAX; i++)
+    {
+        if (!curve_encoder_pool[i].in_use)
+        {
+            step_encoder = &curve_encoder_pool[i];
+            rmt_encoder_handle_t copy_encoder = step_encoder->copy_encoder;
+            memset(step_encoder, 0, sizeof(*step_encoder));
+            step_encoder->copy_encoder = copy_encoder;
+            step_encoder->in_use = true;
+            sys_pool_take(&curve_encoder_pool_stats);
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&curve_encoder_pool_lock);
+
+    return step_encoder;
+}
+
+static void curve_encoder_pool_put(rmt_stepper_curve_encoder_t *step_encoder)
+{
+    portENTER_CRITICAL(&curve_encoder_pool_lock);
+    step_encoder->in_use = false;
+    sys_pool_give(&curve_encoder_pool_stats);
+    portEXIT_CRITICAL(&curve_encoder_pool_lock);
+}
+
+static size_t IRAM_ATTR rmt_encode_stepper_motor_curve(rmt_encoder_t *encoder, rmt_channel_handle_t channel, const void *primary_data, size_t data_size, rmt_encode_state_t *ret_state)
 {
+    uint32_t isr_start = sys_isr_enter();
     rmt_stepper_curve_encoder_t *motor_encoder = __containerof(encoder, rmt_stepper_curve_encoder_t, base);
     rmt_encoder_handle_t copy_encoder = motor_encoder->copy_encoder;
     rmt_encode_state_t session_state = 0;
@@ -47,18 +92,19 @@ static size_t rmt_encode_stepper_motor_curve(rmt_encoder_t *encoder, rmt_channel
                                                points_num * sizeof(rmt_symbol_word_t), &session_state);
     }
     *ret_state = session_state;
+    sys_isr_exit(SYS_ISR_RMT_ENCODE, isr_start);
     return encoded_symbols;
 }
 
 static esp_err_t rmt_del_stepper_motor_curve_encoder(rmt_encoder_t *encoder)
 {
     rmt_stepper_curve_encoder_t *motor_encoder = __containerof(encoder, rmt_stepper_curve_encoder_t, base);
-    rmt_del_encoder(motor_encoder->copy_encoder);
-    free(motor_encoder);
+    rmt_encoder_reset(motor_encoder->copy_encoder);
+    curve_encoder_pool_put(motor_encoder);
     return ESP_OK;
 }
 
-static esp_err_t rmt_reset_stepper_motor_curve_encoder(rmt_encoder_t *encoder)
+static esp_err_t IRAM_ATTR rmt_reset_stepper_motor_curve_encoder(rmt_encoder_t *encoder)
 {
     rmt_stepper_curve_encoder_t *motor_encoder = __containerof(encoder, rmt_stepper_curve_encoder_t, base);
     rmt_encoder_reset(motor_encoder->copy_encoder);
@@ -67,63 +113,26 @@ static esp_err_t rmt_reset_stepper_motor_curve_encoder(rmt_encoder_t *encoder)
 
 esp_err_t rmt_new_stepper_motor_curve_encoder(const stepper_motor_curve_encoder_config_t *config, rmt_encoder_handle_t *ret_encoder)
 {
-    // typedef struct
-    // {
-    //     rmt_encoder_t base;
-    //     rmt_encoder_handle_t copy_encoder;
-    //     uint32_t sample_points;
-    //     struct
-    //     {
-    //         uint32_t is_accel_curve : 1;
-    //     } flags;
-    //     rmt_symbol_word_t curve_table[];
-    // } rmt_stepper_curve_encoder_t;
-
     esp_err_t ret = ESP_OK;
     rmt_stepper_curve_encoder_t *step_encoder = NULL;
-    float smooth_freq;
-    uint32_t symbol_duration;
     ESP_GOTO_ON_FALSE(config && ret_encoder, ESP_ERR_INVALID_ARG, err, TAG, "invalid arguments");
+    ESP_GOTO_ON_FALSE(config->table, ESP_ERR_INVALID_ARG, err, TAG, "no curve table");
     ESP_GOTO_ON_FALSE(config->sample_points, ESP_ERR_INVALID_ARG, err, TAG, "sample points number can't be zero");
+    ESP_GOTO_ON_FALSE(config->sample_points <= STEPPER_CURVE_MAX_POINTS, ESP_ERR_INVALID_ARG, err, TAG, "more than %d sample points", STEPPER_CURVE_MAX_POINTS);
     ESP_GOTO_ON_FALSE(config->start_freq_hz != config->end_freq_hz, ESP_ERR_INVALID_ARG, err, TAG, "start freq can't equal to end freq");
 
-    step_encoder = calloc(1, sizeof(rmt_stepper_curve_encoder_t) + config->sample_points * sizeof(rmt_symbol_word_t));
-    ESP_GOTO_ON_FALSE(step_encoder, ESP_ERR_NO_MEM, err, TAG, "no mem for stepper curve encoder");
-    rmt_copy_encoder_config_t copy_encoder_config = {};
-    ESP_GOTO_ON_ERROR(rmt_new_copy_encoder(&copy_encoder_config, &step_encoder->copy_encoder), err, TAG, "create copy encoder failed");
-
-    bool is_accel_curve = config->start_freq_hz < config->end_freq_hz;
-
-    // prepare the curve table, in RMT symbol format
-    if (is_accel_curve)
+    step_encoder = curve_encoder_pool_get();
+    ESP_GOTO_ON_FALSE(step_encoder, ESP_ERR_NO_MEM, err, TAG, "stepper curve encoder pool exhausted");
+    if (!step_encoder->copy_encoder)
     {
-        uint32_t curve_step = (config->end_freq_hz - config->start_freq_hz) / (config->sample_points - 1);
-        for (uint32_t i = 0; i < config->sample_points; i++)
-        {
-            smooth_freq = convert_to_smooth_freq(config->start_freq_hz, config->end_freq_hz, config->start_freq_hz + curve_step * i);
-            symbol_duration = config->resolution / smooth_freq / 2;
-            step_encoder->curve_table[i].level0 = 0;
-            step_encoder->curve_table[i].duration0 = symbol_duration;
-            step_encoder->curve_table[i].level1 = 1;
-            step_encoder->curve_table[i].duration1 = symbol_duration;
-        }
-    }
-    else
-    {
-        uint32_t curve_step = (config->start_freq_hz - config->end_freq_hz) / (config->sample_points - 1);
-        for (uint32_t i = 0; i < config->sample_points; i++)
-        {
-            smooth_freq = convert_to_smooth_freq(config->end_freq_hz, config->start_freq_hz, config->end_freq_hz + curve_step * i);
-            symbol_duration = config->resolution / smooth_freq / 2;
-            step_encoder->curve_table[config->sample_points - i - 1].level0 = 0;
-            step_encoder->curve_table[config->sample_points - i - 1].duration0 = symbol_duration;
-            step_encoder->curve_table[config->sample_points - i - 1].level1 = 1;
-            step_encoder->curve_table[config->sample_points - i - 1].duration1 = symbol_duration;
-        }
+        rmt_copy_encoder_config_t copy_encoder_config = {};
+        ESP_GOTO_ON_ERROR(rmt_new_copy_encoder(&copy_encoder_config, &step_encoder->copy_encoder), err, TAG, "create copy encoder failed");
     }
 
+    // the table is read in place by the encode callback, nothing is copied
+    step_encoder->curve_table = config->table;
     step_encoder->sample_points = config->sample_points;
-    step_encoder->flags.is_accel_curve = is_accel_curve;
+    step_encoder->flags.is_accel_curve = config->start_freq_hz < config->end_freq_hz;
 
     step_encoder->base.del = rmt_del_stepper_motor_curve_encoder;
     step_encoder->base.encode = rmt_encode_stepper_motor_curve;     //注册状态机
@@ -134,52 +143,444 @@ esp_err_t rmt_new_stepper_motor_curve_encoder(const stepper_motor_curve_encoder_
 err:
     if (step_encoder)
     {
-        if (step_encoder->copy_encoder)
-        {
-            rmt_del_encoder(step_encoder->copy_encoder);
-        }
-        free(step_encoder);
+        curve_encoder_pool_put(step_encoder);
     }
     return ret;
 }
 
+static volatile uint32_t feed_override = 100; // percent, read by every period of the dither encoders
+
+void stepper_feed_override_set(uint32_t percent)
+{
+    if (percent < STEPPER_FEED_OVERRIDE_MIN)
+    {
+        percent = STEPPER_FEED_OVERRIDE_MIN;
+    }
+    else if (percent > STEPPER_FEED_OVERRIDE_MAX)
+    {
+        percent = STEPPER_FEED_OVERRIDE_MAX;
+    }
+    feed_override = percent;
+}
+
+uint32_t stepper_feed_override_get(void)
+{
+    return feed_override;
+}
+
 typedef struct
 {
     rmt_encoder_t base;
     rmt_encoder_handle_t copy_encoder;
     uint32_t resolution;
+    stepper_pulse_ticks_t pulse;
+    rmt_symbol_word_t body[STEPPER_UNIFORM_MAX_SYMBOLS];
+    // dither mode, the move in progress
+    uint32_t body_len;
+    uint32_t freq_hz;
+    uint32_t period_q;
+    uint32_t period_r;
+    uint32_t acc;
+    uint32_t low_left;
+    uint32_t high;
+    uint32_t lead; // low ticks the first step still waits for, the DIR setup time
+    uint64_t steps_left;
+    // feed override, freq_hz is the rate the move runs at, nom_hz the one it was given
+    uint32_t nom_hz;
+    uint32_t accel;
+    uint32_t scale_q16; // freq_hz / nom_hz, carried into the next transaction of the move
+    bool exact;
+    bool ramp_out;
+    // backlash take-up ahead of the move, run_hz is the rate the move starts on after it
+    uint32_t take_up_left;
+    uint32_t run_hz;
+    volatile uint32_t steps_count; // every step written, see stepper_motor_uniform_encoder_count
+    stepper_line_t line;
+    bool active;
+    bool in_use;
 } rmt_stepper_uniform_encoder_t;
 
-static size_t rmt_encode_stepper_motor_uniform(rmt_encoder_t *encoder, rmt_channel_handle_t channel, const void *primary_data, size_t data_size, rmt_encode_state_t *ret_state)
+static rmt_stepper_uniform_encoder_t uniform_encoder_pool[STEPPER_UNIFORM_ENCODER_MAX];
+static portMUX_TYPE uniform_encoder_pool_lock = portMUX_INITIALIZER_UNLOCKED;
+static sys_pool_t uniform_encoder_pool_stats = {
+    .name = "uniform encoder",
+    .blocks = STEPPER_UNIFORM_ENCODER_MAX,
+    .block_size = sizeof(rmt_stepper_uniform_encoder_t),
+};
+
+static rmt_stepper_uniform_encoder_t *uniform_encoder_pool_get(void)
+{
+    rmt_stepper_uniform_encoder_t *step_encoder = NULL;
+
+    portENTER_CRITICAL(&uniform_encoder_pool_lock);
+    for (int i = 0; i < STEPPER_UNIFORM_ENCODER_MAX; i++)
+    {
+        if (!uniform_encoder_pool[i].in_use)
+        {
+            step_encoder = &uniform_encoder_pool[i];
+            rmt_encoder_handle_t copy_encoder = step_encoder->copy_encoder;
+            memset(step_encoder, 0, sizeof(*step_encoder));
+            step_encoder->copy_encoder = copy_encoder;
+            step_encoder->scale_q16 = 1 << 16;
+            step_encoder->in_use = true;
+            sys_pool_take(&uniform_encoder_pool_stats);
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&uniform_encoder_pool_lock);
+
+    return step_encoder;
+}
+
+static void uniform_encoder_pool_put(rmt_stepper_uniform_encoder_t *step_encoder)
+{
+    portENTER_CRITICAL(&uniform_encoder_pool_lock);
+    step_encoder->in_use = false;
+    sys_pool_give(&uniform_encoder_pool_stats);
+    portEXIT_CRITICAL(&uniform_encoder_pool_lock);
+}
+
+// high ticks of a step period, the fixed pulse or half of it, the rest of the period is low
+static uint32_t IRAM_ATTR stepper_pulse_high(const stepper_pulse_ticks_t *pulse, uint32_t period)
 {
+    uint32_t high = pulse->high ? pulse->high : period / 2;
+    return high > STEPPER_SYMBOL_DURATION_MAX ? STEPPER_SYMBOL_DURATION_MAX : high;
+}
+
+static size_t IRAM_ATTR rmt_encode_stepper_motor_uniform(rmt_encoder_t *encoder, rmt_channel_handle_t channel, const void *primary_data, size_t data_size, rmt_encode_state_t *ret_state)
+{
+    uint32_t isr_start = sys_isr_enter();
     rmt_stepper_uniform_encoder_t *motor_encoder = __containerof(encoder, rmt_stepper_uniform_encoder_t, base);
     rmt_encoder_handle_t copy_encoder = motor_encoder->copy_encoder;
     rmt_encode_state_t session_state = 0;
     uint32_t target_freq_hz = *(uint32_t *)primary_data;
-    uint32_t symbol_duration = motor_encoder->resolution / target_freq_hz / 2;
+    uint32_t symbols = 1;
+    if (data_size >= sizeof(stepper_motor_uniform_payload_t))
+    {
+        symbols = ((const stepper_motor_uniform_payload_t *)primary_data)->symbols;
+        if (symbols > STEPPER_UNIFORM_MAX_SYMBOLS)
+        {
+            symbols = STEPPER_UNIFORM_MAX_SYMBOLS;
+        }
+    }
+    uint32_t period = motor_encoder->resolution / target_freq_hz;
+    period = period < motor_encoder->pulse.period_min ? motor_encoder->pulse.period_min : period;
+    uint32_t high = stepper_pulse_high(&motor_encoder->pulse, period);
     rmt_symbol_word_t freq_sample = {
         .level0 = 0,
-        .duration0 = symbol_duration,
+        .duration0 = period - high > STEPPER_SYMBOL_DURATION_MAX ? STEPPER_SYMBOL_DURATION_MAX : period - high,
         .level1 = 1,
-        .duration1 = symbol_duration,
+        .duration1 = high,
     };
-    size_t encoded_symbols = copy_encoder->encode(copy_encoder, channel, &freq_sample, sizeof(freq_sample), &session_state);
+    // the copy encoder keeps its own progress, so the body is rebuilt identically on every (re)entry
+    for (uint32_t i = 0; i < symbols; i++)
+    {
+        motor_encoder->body[i] = freq_sample;
+    }
+    size_t encoded_symbols = copy_encoder->encode(copy_encoder, channel, motor_encoder->body, symbols * sizeof(rmt_symbol_word_t), &session_state);
     *ret_state = session_state;
+    sys_isr_exit(SYS_ISR_RMT_ENCODE, isr_start);
+    return encoded_symbols;
+}
+
+// next symbol of a period ending in a `high` tick pulse (no pulse if 0), low_left counts the low ticks
+// still to send, a period longer than one symbol is led by low filler symbols
+static void IRAM_ATTR stepper_period_symbol(rmt_symbol_word_t *symbol, uint32_t *low_left, uint32_t high)
+{
+    // a zero duration would end the transaction, both halves and the remainder stay >= 1
+    uint32_t reserve = high ? 1 : 2;
+
+    if (*low_left > (high ? STEPPER_SYMBOL_DURATION_MAX : 2 * STEPPER_SYMBOL_DURATION_MAX))
+    {
+        uint32_t take = *low_left - reserve;
+        if (take > 2 * STEPPER_SYMBOL_DURATION_MAX)
+        {
+            take = 2 * STEPPER_SYMBOL_DURATION_MAX;
+        }
+        symbol->level0 = 0;
+        symbol->duration0 = take / 2;
+        symbol->level1 = 0;
+        symbol->duration1 = take - take / 2;
+        *low_left -= take;
+    }
+    else if (high)
+    {
+        symbol->level0 = 0;
+        symbol->duration0 = *low_left;
+        symbol->level1 = 1;
+        symbol->duration1 = high;
+        *low_left = 0;
+    }
+    else
+    {
+        symbol->level0 = 0;
+        symbol->duration0 = *low_left / 2;
+        symbol->level1 = 0;
+        symbol->duration1 = *low_left - *low_left / 2;
+        *low_left = 0;
+    }
+}
+
+// the rate a move runs at, with the override nominal * percent / 100
+static void IRAM_ATTR stepper_dither_rate(rmt_stepper_uniform_encoder_t *motor_encoder, uint32_t freq_hz)
+{
+    freq_hz = freq_hz ? freq_hz : 1;
+    motor_encoder->freq_hz = freq_hz;
+    motor_encoder->period_q = motor_encoder->resolution / freq_hz;
+    motor_encoder->period_r = motor_encoder->resolution % freq_hz;
+    motor_encoder->acc = 0;
+}
+
+// before every period: slew toward the feed override, no faster than accel
+static void IRAM_ATTR stepper_dither_feed(rmt_stepper_uniform_encoder_t *motor_encoder)
+{
+    uint64_t nom = motor_encoder->nom_hz;
+    uint64_t f = motor_encoder->freq_hz;
+    uint64_t target = nom * feed_override / 100;
+    bool jump = motor_encoder->accel == 0;
+
+    if (motor_encoder->ramp_out)
+    {
+        // the deceleration ramp starts from nominal, stay where it can be reached: a slew step below
+        // moves f^2 by accel at least, so |f^2 - nom^2| <= accel * steps
+        uint64_t steps = motor_encoder->steps_left - 1;
+        uint64_t reach = (uint64_t)motor_encoder->accel * (steps < (1ULL << 31) ? steps : (1ULL << 31));
+        if (target > nom && target * target > nom * nom + reach)
+        {
+            target = stepper_isqrt(nom * nom + reach);
+        }
+        else if (target < nom && target * target + reach < nom * nom)
+        {
+            target = stepper_isqrt(nom * nom - reach);
+        }
+        // what rounding leaves, a few Hz, goes in the last step
+        jump = jump || motor_encoder->steps_left <= 1;
+    }
+    target = target ? target : 1;
+    if (target == f)
+    {
+        return;
+    }
+    if (!jump)
+    {
+        // a rate change over one step takes the period of the faster side, df * max(f, f') <= accel
+        uint64_t next;
+        if (target > f)
+        {
+            next = (f + stepper_isqrt(f * f + 4ULL * motor_encoder->accel)) / 2;
+            next = next > f ? next : f + 1;
+            target = target < next ? target : next;
+        }
+        else
+        {
+            uint64_t slew = motor_encoder->accel / f;
+            next = f > slew ? f - (slew ? slew : 1) : 1;
+            target = target > next ? target : next;
+        }
+    }
+    stepper_dither_rate(motor_encoder, (uint32_t)target);
+    motor_encoder->scale_q16 = (uint32_t)((target << 16) / nom);
+}
+
+// next batch of the move
+static uint32_t IRAM_ATTR stepper_dither_fill(rmt_stepper_uniform_encoder_t *motor_encoder)
+{
+    uint32_t len = 0;
+
+    while (len < STEPPER_UNIFORM_MAX_SYMBOLS)
+    {
+        if (motor_encoder->low_left == 0)
+        {
+            if (motor_encoder->steps_left == 0)
+            {
+                break;
+            }
+            if (!motor_encoder->exact && !motor_encoder->take_up_left)
+            {
+                stepper_dither_feed(motor_encoder);
+            }
+            uint32_t period = motor_encoder->period_q;
+            motor_encoder->acc += motor_encoder->period_r;
+            if (motor_encoder->acc >= motor_encoder->freq_hz)
+            {
+                motor_encoder->acc -= motor_encoder->freq_hz;
+                period++;
+            }
+            if (period < motor_encoder->pulse.period_min)
+            {
+                period = motor_encoder->pulse.period_min;
+            }
+            motor_encoder->high = stepper_pulse_high(&motor_encoder->pulse, period);
+            motor_encoder->low_left = period - motor_encoder->high;
+            if (motor_encoder->low_left < motor_encoder->lead)
+            {
+                motor_encoder->low_left = motor_encoder->lead;
+            }
+            motor_encoder->lead = 0;
+            motor_encoder->steps_left--;
+            stepper_line_step(&motor_encoder->line, motor_encoder->low_left, motor_encoder->high);
+            motor_encoder->steps_count++;
+            if (motor_encoder->take_up_left && --motor_encoder->take_up_left == 0)
+            {
+                // slack taken up, the move goes on at the rate it would have started on
+                stepper_dither_rate(motor_encoder, motor_encoder->run_hz);
+            }
+        }
+
+        stepper_period_symbol(&motor_encoder->body[len++], &motor_encoder->low_left, motor_encoder->high);
+    }
+
+    return len;
+}
+
+static size_t IRAM_ATTR rmt_encode_stepper_motor_dither(rmt_encoder_t *encoder, rmt_channel_handle_t channel, const void *primary_data, size_t data_size, rmt_encode_state_t *ret_state)
+{
+    uint32_t isr_start = sys_isr_enter();
+    rmt_stepper_uniform_encoder_t *motor_encoder = __containerof(encoder, rmt_stepper_uniform_encoder_t, base);
+    rmt_encoder_handle_t copy_encoder = motor_encoder->copy_encoder;
+    rmt_encode_state_t session_state = 0;
+    rmt_encode_state_t state = 0;
+    size_t encoded_symbols = 0;
+
+    if (!motor_encoder->active)
+    {
+        // first call of a transaction, later calls are memory refills
+        const stepper_motor_dither_payload_t *payload = (const stepper_motor_dither_payload_t *)primary_data;
+        bool full = data_size >= sizeof(stepper_motor_dither_payload_t);
+        motor_encoder->nom_hz = payload->freq_hz ? payload->freq_hz : 1;
+        motor_encoder->exact = !full || payload->exact;
+        motor_encoder->ramp_out = full && payload->ramp_out;
+        motor_encoder->accel = full ? payload->accel : 0;
+        if (motor_encoder->exact || payload->ramp_in)
+        {
+            motor_encoder->scale_q16 = 1 << 16;
+        }
+        else if (payload->first)
+        {
+            // from standstill, nothing to slew from
+            motor_encoder->scale_q16 = (feed_override << 16) / 100;
+        }
+        // the rate the last transaction ended on, the first period slews on from there
+        uint32_t freq_hz = ((uint64_t)motor_encoder->nom_hz * motor_encoder->scale_q16 + (1 << 15)) >> 16;
+        motor_encoder->run_hz = motor_encoder->exact ? motor_encoder->nom_hz : freq_hz;
+        motor_encoder->take_up_left = full ? payload->take_up : 0;
+        stepper_dither_rate(motor_encoder, motor_encoder->take_up_left ? payload->take_up_hz : motor_encoder->run_hz);
+        motor_encoder->low_left = 0;
+        motor_encoder->steps_left = (full ? payload->steps : 1) + motor_encoder->take_up_left;
+        motor_encoder->lead = full && payload->first ? motor_encoder->pulse.dir_setup : 0;
+        motor_encoder->body_len = 0;
+        motor_encoder->active = true;
+        stepper_line_start(&motor_encoder->line);
+    }
+
+    for (;;)
+    {
+        if (motor_encoder->body_len == 0)
+        {
+            motor_encoder->body_len = stepper_dither_fill(motor_encoder);
+            if (motor_encoder->body_len == 0)
+            {
+                motor_encoder->active = false;
+                state |= RMT_ENCODING_COMPLETE;
+                break;
+            }
+        }
+        // the copy encoder resumes a batch cut by MEM_FULL, the body is only refilled once it is done
+        encoded_symbols += copy_encoder->encode(copy_encoder, channel, motor_encoder->body, motor_encoder->body_len * sizeof(rmt_symbol_word_t), &session_state);
+        if (session_state & RMT_ENCODING_COMPLETE)
+        {
+            motor_encoder->body_len = 0;
+        }
+        if (session_state & RMT_ENCODING_MEM_FULL)
+        {
+            state |= RMT_ENCODING_MEM_FULL;
+            break;
+        }
+    }
+    *ret_state = state;
+    sys_isr_exit(SYS_ISR_RMT_ENCODE, isr_start);
     return encoded_symbols;
 }
 
+void IRAM_ATTR stepper_motor_uniform_encoder_count(rmt_encoder_handle_t encoder, uint32_t *steps, uint32_t *freq_hz)
+{
+    rmt_stepper_uniform_encoder_t *motor_encoder = __containerof(encoder, rmt_stepper_uniform_encoder_t, base);
+
+    uint32_t written;
+    uint32_t ahead;
+
+    // a step written in between moves both, read again
+    do
+    {
+        written = motor_encoder->steps_count;
+        ahead = stepper_line_ahead(&motor_encoder->line, motor_encoder->resolution);
+    } while (written != motor_encoder->steps_count);
+    *steps = written - ahead;
+    *freq_hz = motor_encoder->active ? motor_encoder->freq_hz : 0;
+}
+
+void IRAM_ATTR stepper_line_start(stepper_line_t *line)
+{
+    // the stamp goes last, a reader that sees it sees the rest reset
+    line->steps = 0;
+    line->ticks = 0;
+    line->start_us = esp_timer_get_time();
+}
+
+void IRAM_ATTR stepper_line_step(stepper_line_t *line, uint32_t low, uint32_t high)
+{
+    line->rises[line->steps % STEPPER_LINE_RISES] = (uint32_t)(line->ticks + low);
+    line->ticks += low + high;
+    line->steps++;
+}
+
+uint32_t IRAM_ATTR stepper_line_ahead(const stepper_line_t *line, uint32_t resolution)
+{
+    int64_t now = esp_timer_get_time();
+    int64_t start_us;
+    uint32_t steps;
+    uint32_t ahead;
+
+    // a transaction started or a step written in between, read again
+    do
+    {
+        start_us = line->start_us;
+        steps = line->steps;
+        uint32_t pin_ticks = now > start_us ? (uint32_t)((uint64_t)(now - start_us) * resolution / 1000000) : 0;
+        // the rises are in order, the newest ones are past the pin
+        uint32_t lo = 0;
+        uint32_t hi = steps < STEPPER_LINE_RISES ? steps : STEPPER_LINE_RISES;
+        while (lo < hi)
+        {
+            uint32_t mid = (lo + hi) / 2;
+            if ((int32_t)(line->rises[(steps - 1 - mid) % STEPPER_LINE_RISES] - pin_ticks) > 0)
+            {
+                lo = mid + 1;
+            }
+            else
+            {
+                hi = mid;
+            }
+        }
+        ahead = lo;
+    } while (start_us != line->start_us || steps != line->steps);
+    return ahead;
+}
+
 static esp_err_t rmt_del_stepper_motor_uniform_encoder(rmt_encoder_t *encoder)
 {
     rmt_stepper_uniform_encoder_t *motor_encoder = __containerof(encoder, rmt_stepper_uniform_encoder_t, base);
-    rmt_del_encoder(motor_encoder->copy_encoder);
-    free(motor_encoder);
+    rmt_encoder_reset(motor_encoder->copy_encoder);
+    uniform_encoder_pool_put(motor_encoder);
     return ESP_OK;
 }
 
-static esp_err_t rmt_reset_stepper_motor_uniform(rmt_encoder_t *encoder)
+static esp_err_t IRAM_ATTR rmt_reset_stepper_motor_uniform(rmt_encoder_t *encoder)
 {
     rmt_stepper_uniform_encoder_t *motor_encoder = __containerof(encoder, rmt_stepper_uniform_encoder_t, base);
     rmt_encoder_reset(motor_encoder->copy_encoder);
+    motor_encoder->active = false;
+    motor_encoder->body_len = 0;
     return ESP_OK;
 }
 
@@ -187,26 +588,446 @@ esp_err_t  rmt_new_stepper_motor_uniform_encoder(const stepper_motor_uniform_enc
 {
     esp_err_t ret = ESP_OK;
     rmt_stepper_uniform_encoder_t *step_encoder = NULL;
-    ESP_GOTO_ON_FALSE(config && ret_encoder, ESP_ERR_INVALID_ARG, err, TAG, "invalid arguments");
-    step_encoder = calloc(1, sizeof(rmt_stepper_uniform_encoder_t));
-    ESP_GOTO_ON_FALSE(step_encoder, ESP_ERR_NO_MEM, err, TAG, "no mem for stepper uniform encoder");
-    rmt_copy_encoder_config_t copy_encoder_config = {};
-    ESP_GOTO_ON_ERROR(rmt_new_copy_encoder(&copy_encoder_config, &step_encoder->copy_encoder), err, TAG, "create copy encoder failed");
+    stepper_pulse_ticks_t pulse;
+    ESP_GOTO_ON_FALSE(config && ret_encoder && config->resolution, ESP_ERR_INVALID_ARG, err, TAG, "invalid arguments");
+    stepper_pulse_ticks(&config->pulse, config->resolution, &pulse);
+    ESP_GOTO_ON_FALSE(pulse.high <= STEPPER_SYMBOL_DURATION_MAX, ESP_ERR_INVALID_ARG, err, TAG, "step pulse longer than %d ticks", STEPPER_SYMBOL_DURATION_MAX);
+    step_encoder = uniform_encoder_pool_get();
+    ESP_GOTO_ON_FALSE(step_encoder, ESP_ERR_NO_MEM, err, TAG, "stepper uniform encoder pool exhausted");
+    if (!step_encoder->copy_encoder)
+    {
+        rmt_copy_encoder_config_t copy_encoder_config = {};
+        ESP_GOTO_ON_ERROR(rmt_new_copy_encoder(&copy_encoder_config, &step_encoder->copy_encoder), err, TAG, "create copy encoder failed");
+    }
 
     step_encoder->resolution = config->resolution;
+    step_encoder->pulse = pulse;
     step_encoder->base.del = rmt_del_stepper_motor_uniform_encoder;
-    step_encoder->base.encode = rmt_encode_stepper_motor_uniform;
+    step_encoder->base.encode = config->flags.dither ? rmt_encode_stepper_motor_dither : rmt_encode_stepper_motor_uniform;
     step_encoder->base.reset = rmt_reset_stepper_motor_uniform;
     *ret_encoder = &(step_encoder->base);
     return ESP_OK;
 err:
     if (step_encoder)
     {
-        if (step_encoder->copy_encoder)
+        uniform_encoder_pool_put(step_encoder);
+    }
+    return ret;
+}
+
+
+typedef struct
+{
+    rmt_encoder_t base;
+    rmt_encoder_handle_t copy_encoder;
+    uint32_t resolution;
+    rmt_symbol_word_t body[STEPPER_UNIFORM_MAX_SYMBOLS];
+    // the run in progress
+    uint32_t body_len;
+    stepper_arc_t arc;
+    uint64_t steps_left;
+    uint64_t slot_den;
+    uint64_t acc;
+    uint32_t axis;
+    uint32_t low_left;
+    uint32_t high;
+    bool active;
+    bool in_use;
+} rmt_stepper_arc_encoder_t;
+
+static rmt_stepper_arc_encoder_t arc_encoder_pool[STEPPER_ARC_ENCODER_MAX];
+static portMUX_TYPE arc_encoder_pool_lock = portMUX_INITIALIZER_UNLOCKED;
+static sys_pool_t arc_encoder_pool_stats = {
+    .name = "arc encoder",
+    .blocks = STEPPER_ARC_ENCODER_MAX,
+    .block_size = sizeof(rmt_stepper_arc_encoder_t),
+};
+
+static rmt_stepper_arc_encoder_t *arc_encoder_pool_get(void)
+{
+    rmt_stepper_arc_encoder_t *arc_encoder = NULL;
+
+    portENTER_CRITICAL(&arc_encoder_pool_lock);
+    for (int i = 0; i < STEPPER_ARC_ENCODER_MAX; i++)
+    {
+        if (!arc_encoder_pool[i].in_use)
         {
-            rmt_del_encoder(step_encoder->copy_encoder);
+            arc_encoder = &arc_encoder_pool[i];
+            rmt_encoder_handle_t copy_encoder = arc_encoder->copy_encoder;
+            memset(arc_encoder, 0, sizeof(*arc_encoder));
+            arc_encoder->copy_encoder = copy_encoder;
+            arc_encoder->in_use = true;
+            sys_pool_take(&arc_encoder_pool_stats);
+            break;
         }
-        free(step_encoder);
+    }
+    portEXIT_CRITICAL(&arc_encoder_pool_lock);
+
+    return arc_encoder;
+}
+
+static void arc_encoder_pool_put(rmt_stepper_arc_encoder_t *arc_encoder)
+{
+    portENTER_CRITICAL(&arc_encoder_pool_lock);
+    arc_encoder->in_use = false;
+    sys_pool_give(&arc_encoder_pool_stats);
+    portEXIT_CRITICAL(&arc_encoder_pool_lock);
+}
+
+// next batch of the run, one period per arc step, pulsed only where this axis moves
+static uint32_t IRAM_ATTR stepper_arc_fill(rmt_stepper_arc_encoder_t *arc_encoder)
+{
+    uint32_t len = 0;
+    stepper_arc_step_t step;
+
+    while (len < STEPPER_UNIFORM_MAX_SYMBOLS)
+    {
+        if (arc_encoder->low_left == 0)
+        {
+            if (arc_encoder->steps_left == 0 || !stepper_arc_next(&arc_encoder->arc, &step))
+            {
+                arc_encoder->steps_left = 0;
+                break;
+            }
+            // slot length follows the path length of the step, the remainder carries to the next slot
+            uint64_t len_ticks = (uint64_t)arc_encoder->resolution * (step.da && step.db ? STEPPER_ARC_DIAG_LEN : STEPPER_ARC_AXIS_LEN);
+            arc_encoder->acc += len_ticks;
+            uint64_t slot = arc_encoder->acc / arc_encoder->slot_den;
+            arc_encoder->acc -= slot * arc_encoder->slot_den;
+            if (slot < 2)
+            {
+                slot = 2;
+            }
+            bool moves = arc_encoder->axis ? step.db : step.da;
+            uint32_t high = slot / 2 > STEPPER_SYMBOL_DURATION_MAX ? STEPPER_SYMBOL_DURATION_MAX : slot / 2;
+            arc_encoder->high = moves ? high : 0;
+            arc_encoder->low_left = slot - arc_encoder->high;
+            arc_encoder->steps_left--;
+        }
+
+        stepper_period_symbol(&arc_encoder->body[len++], &arc_encoder->low_left, arc_encoder->high);
+    }
+
+    return len;
+}
+
+static size_t IRAM_ATTR rmt_encode_stepper_motor_arc(rmt_encoder_t *encoder, rmt_channel_handle_t channel, const void *primary_data, size_t data_size, rmt_encode_state_t *ret_state)
+{
+    uint32_t isr_start = sys_isr_enter();
+    rmt_stepper_arc_encoder_t *arc_encoder = __containerof(encoder, rmt_stepper_arc_encoder_t, base);
+    rmt_encoder_handle_t copy_encoder = arc_encoder->copy_encoder;
+    rmt_encode_state_t session_state = 0;
+    rmt_encode_state_t state = 0;
+    size_t encoded_symbols = 0;
+
+    if (!arc_encoder->active)
+    {
+        // first call of a transaction, later calls are memory refills
+        const stepper_motor_arc_payload_t *payload = (const stepper_motor_arc_payload_t *)primary_data;
+        arc_encoder->arc = payload->arc;
+        arc_encoder->steps_left = payload->steps;
+        arc_encoder->slot_den = (uint64_t)(payload->feed_hz ? payload->feed_hz : 1) * STEPPER_ARC_AXIS_LEN;
+        arc_encoder->acc = 0;
+        arc_encoder->axis = payload->axis;
+        arc_encoder->low_left = 0;
+        arc_encoder->body_len = 0;
+        arc_encoder->active = true;
+    }
+
+    for (;;)
+    {
+        if (arc_encoder->body_len == 0)
+        {
+            arc_encoder->body_len = stepper_arc_fill(arc_encoder);
+            if (arc_encoder->body_len == 0)
+            {
+                arc_encoder->active = false;
+                state |= RMT_ENCODING_COMPLETE;
+                break;
+            }
+        }
+        encoded_symbols += copy_encoder->encode(copy_encoder, channel, arc_encoder->body, arc_encoder->body_len * sizeof(rmt_symbol_word_t), &session_state);
+        if (session_state & RMT_ENCODING_COMPLETE)
+        {
+            arc_encoder->body_len = 0;
+        }
+        if (session_state & RMT_ENCODING_MEM_FULL)
+        {
+            state |= RMT_ENCODING_MEM_FULL;
+            break;
+        }
+    }
+    *ret_state = state;
+    sys_isr_exit(SYS_ISR_RMT_ENCODE, isr_start);
+    return encoded_symbols;
+}
+
+static esp_err_t rmt_del_stepper_motor_arc_encoder(rmt_encoder_t *encoder)
+{
+    rmt_stepper_arc_encoder_t *arc_encoder = __containerof(encoder, rmt_stepper_arc_encoder_t, base);
+    rmt_encoder_reset(arc_encoder->copy_encoder);
+    arc_encoder_pool_put(arc_encoder);
+    return ESP_OK;
+}
+
+static esp_err_t IRAM_ATTR rmt_reset_stepper_motor_arc(rmt_encoder_t *encoder)
+{
+    rmt_stepper_arc_encoder_t *arc_encoder = __containerof(encoder, rmt_stepper_arc_encoder_t, base);
+    rmt_encoder_reset(arc_encoder->copy_encoder);
+    arc_encoder->active = false;
+    arc_encoder->body_len = 0;
+    return ESP_OK;
+}
+
+esp_err_t rmt_new_stepper_motor_arc_encoder(const stepper_motor_arc_encoder_config_t *config, rmt_encoder_handle_t *ret_encoder)
+{
+    esp_err_t ret = ESP_OK;
+    rmt_stepper_arc_encoder_t *arc_encoder = NULL;
+    ESP_GOTO_ON_FALSE(config && ret_encoder, ESP_ERR_INVALID_ARG, err, TAG, "invalid arguments");
+    arc_encoder = arc_encoder_pool_get();
+    ESP_GOTO_ON_FALSE(arc_encoder, ESP_ERR_NO_MEM, err, TAG, "stepper arc encoder pool exhausted");
+    if (!arc_encoder->copy_encoder)
+    {
+        rmt_copy_encoder_config_t copy_encoder_config = {};
+        ESP_GOTO_ON_ERROR(rmt_new_copy_encoder(&copy_encoder_config, &arc_encoder->copy_encoder), err, TAG, "create copy encoder failed");
+    }
+
+    arc_encoder->resolution = config->resolution;
+    arc_encoder->base.del = rmt_del_stepper_motor_arc_encoder;
+    arc_encoder->base.encode = rmt_encode_stepper_motor_arc;
+    arc_encoder->base.reset = rmt_reset_stepper_motor_arc;
+    *ret_encoder = &(arc_encoder->base);
+    return ESP_OK;
+err:
+    if (arc_encoder)
+    {
+        arc_encoder_pool_put(arc_encoder);
+    }
+    return ret;
+}
+
+typedef struct
+{
+    rmt_encoder_t base;
+    rmt_encoder_handle_t copy_encoder;
+    uint32_t resolution;
+    rmt_symbol_word_t body[STEPPER_UNIFORM_MAX_SYMBOLS];
+    // the move in progress
+    uint32_t body_len;
+    stepper_motor_gear_payload_t move;
+    uint32_t segment;
+    uint64_t steps_left;
+    uint32_t freq_hz;
+    uint32_t period_q;
+    uint32_t period_r;
+    uint32_t acc;
+    uint32_t period;
+    uint32_t slot;
+    uint32_t low_left;
+    uint32_t high;
+    bool active;
+    bool in_use;
+} rmt_stepper_gear_encoder_t;
+
+static rmt_stepper_gear_encoder_t gear_encoder_pool[STEPPER_GEAR_ENCODER_MAX];
+static portMUX_TYPE gear_encoder_pool_lock = portMUX_INITIALIZER_UNLOCKED;
+static sys_pool_t gear_encoder_pool_stats = {
+    .name = "gear encoder",
+    .blocks = STEPPER_GEAR_ENCODER_MAX,
+    .block_size = sizeof(rmt_stepper_gear_encoder_t),
+};
+
+static rmt_stepper_gear_encoder_t *gear_encoder_pool_get(void)
+{
+    rmt_stepper_gear_encoder_t *gear_encoder = NULL;
+
+    portENTER_CRITICAL(&gear_encoder_pool_lock);
+    for (int i = 0; i < STEPPER_GEAR_ENCODER_MAX; i++)
+    {
+        if (!gear_encoder_pool[i].in_use)
+        {
+            gear_encoder = &gear_encoder_pool[i];
+            rmt_encoder_handle_t copy_encoder = gear_encoder->copy_encoder;
+            memset(gear_encoder, 0, sizeof(*gear_encoder));
+            gear_encoder->copy_encoder = copy_encoder;
+            gear_encoder->in_use = true;
+            sys_pool_take(&gear_encoder_pool_stats);
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&gear_encoder_pool_lock);
+
+    return gear_encoder;
+}
+
+static void gear_encoder_pool_put(rmt_stepper_gear_encoder_t *gear_encoder)
+{
+    portENTER_CRITICAL(&gear_encoder_pool_lock);
+    gear_encoder->in_use = false;
+    sys_pool_give(&gear_encoder_pool_stats);
+    portEXIT_CRITICAL(&gear_encoder_pool_lock);
+}
+
+// next master period, false once the last segment is done
+static bool IRAM_ATTR stepper_gear_period(rmt_stepper_gear_encoder_t *gear_encoder)
+{
+    stepper_motor_gear_payload_t *move = &gear_encoder->move;
+
+    while (gear_encoder->steps_left == 0)
+    {
+        if (gear_encoder->segment >= move->num_segments)
+        {
+            return false;
+        }
+        // same periods as the dither encoder, the accumulator restarts with every segment
+        uint32_t freq_hz = move->segments[gear_encoder->segment].freq_hz;
+        gear_encoder->freq_hz = freq_hz ? freq_hz : 1;
+        gear_encoder->period_q = gear_encoder->resolution / gear_encoder->freq_hz;
+        gear_encoder->period_r = gear_encoder->resolution % gear_encoder->freq_hz;
+        gear_encoder->acc = 0;
+        gear_encoder->steps_left = move->segments[gear_encoder->segment].steps;
+        gear_encoder->segment++;
+    }
+
+    uint32_t period = gear_encoder->period_q;
+    gear_encoder->acc += gear_encoder->period_r;
+    if (gear_encoder->acc >= gear_encoder->freq_hz)
+    {
+        gear_encoder->acc -= gear_encoder->freq_hz;
+        period++;
+    }
+    // the same floor on every channel of the move, whatever its split, keeps their periods equal
+    gear_encoder->period = period < 2 * STEPPER_GEAR_RATIO_MAX ? 2 * STEPPER_GEAR_RATIO_MAX : period;
+    gear_encoder->slot = 0;
+    gear_encoder->steps_left--;
+    return true;
+}
+
+// next batch of the move, one symbol run per slot, the master pulses in the last slot of a period
+static uint32_t IRAM_ATTR stepper_gear_fill(rmt_stepper_gear_encoder_t *gear_encoder)
+{
+    stepper_motor_gear_payload_t *move = &gear_encoder->move;
+    uint32_t split = move->gear.split;
+    uint32_t len = 0;
+
+    while (len < STEPPER_UNIFORM_MAX_SYMBOLS)
+    {
+        if (gear_encoder->low_left == 0)
+        {
+            if (gear_encoder->slot == split || gear_encoder->period == 0)
+            {
+                if (!stepper_gear_period(gear_encoder))
+                {
+                    break;
+                }
+            }
+            uint32_t slot_len = gear_encoder->period / split + (gear_encoder->slot < gear_encoder->period % split);
+            bool pulse = move->axis ? stepper_gear_tick(&move->gear, move->dir) != 0 : gear_encoder->slot == split - 1;
+            uint32_t high = slot_len / 2 > STEPPER_SYMBOL_DURATION_MAX ? STEPPER_SYMBOL_DURATION_MAX : slot_len / 2;
+            gear_encoder->high = pulse ? high : 0;
+            gear_encoder->low_left = slot_len - gear_encoder->high;
+            gear_encoder->slot++;
+        }
+
+        stepper_period_symbol(&gear_encoder->body[len++], &gear_encoder->low_left, gear_encoder->high);
+    }
+
+    return len;
+}
+
+static size_t IRAM_ATTR rmt_encode_stepper_motor_gear(rmt_encoder_t *encoder, rmt_channel_handle_t channel, const void *primary_data, size_t data_size, rmt_encode_state_t *ret_state)
+{
+    uint32_t isr_start = sys_isr_enter();
+    rmt_stepper_gear_encoder_t *gear_encoder = __containerof(encoder, rmt_stepper_gear_encoder_t, base);
+    rmt_encoder_handle_t copy_encoder = gear_encoder->copy_encoder;
+    rmt_encode_state_t session_state = 0;
+    rmt_encode_state_t state = 0;
+    size_t encoded_symbols = 0;
+
+    if (!gear_encoder->active)
+    {
+        // first call of a transaction, later calls are memory refills
+        gear_encoder->move = *(const stepper_motor_gear_payload_t *)primary_data;
+        if (gear_encoder->move.num_segments > STEPPER_SHAPER_SEGMENT_MAX)
+        {
+            gear_encoder->move.num_segments = STEPPER_SHAPER_SEGMENT_MAX;
+        }
+        gear_encoder->segment = 0;
+        gear_encoder->steps_left = 0;
+        gear_encoder->period = 0;
+        gear_encoder->low_left = 0;
+        gear_encoder->body_len = 0;
+        gear_encoder->active = true;
+    }
+
+    for (;;)
+    {
+        if (gear_encoder->body_len == 0)
+        {
+            gear_encoder->body_len = stepper_gear_fill(gear_encoder);
+            if (gear_encoder->body_len == 0)
+            {
+                gear_encoder->active = false;
+                state |= RMT_ENCODING_COMPLETE;
+                break;
+            }
+        }
+        encoded_symbols += copy_encoder->encode(copy_encoder, channel, gear_encoder->body, gear_encoder->body_len * sizeof(rmt_symbol_word_t), &session_state);
+        if (session_state & RMT_ENCODING_COMPLETE)
+        {
+            gear_encoder->body_len = 0;
+        }
+        if (session_state & RMT_ENCODING_MEM_FULL)
+        {
+            state |= RMT_ENCODING_MEM_FULL;
+            break;
+        }
+    }
+    *ret_state = state;
+    sys_isr_exit(SYS_ISR_RMT_ENCODE, isr_start);
+    return encoded_symbols;
+}
+
+static esp_err_t rmt_del_stepper_motor_gear_encoder(rmt_encoder_t *encoder)
+{
+    rmt_stepper_gear_encoder_t *gear_encoder = __containerof(encoder, rmt_stepper_gear_encoder_t, base);
+    rmt_encoder_reset(gear_encoder->copy_encoder);
+    gear_encoder_pool_put(gear_encoder);
+    return ESP_OK;
+}
+
+static esp_err_t IRAM_ATTR rmt_reset_stepper_motor_gear(rmt_encoder_t *encoder)
+{
+    rmt_stepper_gear_encoder_t *gear_encoder = __containerof(encoder, rmt_stepper_gear_encoder_t, base);
+    rmt_encoder_reset(gear_encoder->copy_encoder);
+    gear_encoder->active = false;
+    gear_encoder->body_len = 0;
+    return ESP_OK;
+}
+
+esp_err_t rmt_new_stepper_motor_gear_encoder(const stepper_motor_gear_encoder_config_t *config, rmt_encoder_handle_t *ret_encoder)
+{
+    esp_err_t ret = ESP_OK;
+    rmt_stepper_gear_encoder_t *gear_encoder = NULL;
+    ESP_GOTO_ON_FALSE(config && ret_encoder, ESP_ERR_INVALID_ARG, err, TAG, "invalid arguments");
+    gear_encoder = gear_encoder_pool_get();
+    ESP_GOTO_ON_FALSE(gear_encoder, ESP_ERR_NO_MEM, err, TAG, "stepper gear encoder pool exhausted");
+    if (!gear_encoder->copy_encoder)
+    {
+        rmt_copy_encoder_config_t copy_encoder_config = {};
+        ESP_GOTO_ON_ERROR(rmt_new_copy_encoder(&copy_encoder_config, &gear_encoder->copy_encoder), err, TAG, "create copy encoder failed");
+    }
+
+    gear_encoder->resolution = config->resolution;
+    gear_encoder->base.del = rmt_del_stepper_motor_gear_encoder;
+    gear_encoder->base.encode = rmt_encode_stepper_motor_gear;
+    gear_encoder->base.reset = rmt_reset_stepper_motor_gear;
+    *ret_encoder = &(gear_encoder->base);
+    return ESP_OK;
+err:
+    if (gear_encoder)
+    {
+        gear_encoder_pool_put(gear_encoder);
     }
     return ret;
 }
@@ -7,6 +7,10 @@
 
 #include <stdint.h>
 #include "driver/rmt_encoder.h"
+#include "stepper_arc.h"
+#include "stepper_gear.h"
+#include "stepper_move.h"
+#include "stepper_shaper.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -20,23 +24,140 @@ typedef struct {
     uint32_t sample_points; // Sample points used for deceleration phase
     uint32_t start_freq_hz; // Start frequency on the curve, in Hz
     uint32_t end_freq_hz;   // End frequency on the curve, in Hz
+    const rmt_symbol_word_t *table; // Sample points symbols in playing order, in internal ram, the encode callback reads it from the isr
+                                    // or made by stepper_ramp_fill, must outlive the encoder
 } stepper_motor_curve_encoder_config_t;
 
+#define STEPPER_CURVE_ENCODER_MAX 2    // Curve encoders are taken from a static pool of this size
+#define STEPPER_CURVE_MAX_POINTS 1000  // Longest curve table, in sample points
+
 /**
  * @brief Stepper motor uniform encoder configuration
  */
 typedef struct {
-    uint32_t resolution; // Encoder resolution, in Hz
+    uint32_t resolution;   // Encoder resolution, in Hz
+    stepper_pulse_t pulse; // STEP and DIR timing of the driver, zeroed: 50% duty and no minimums
+    struct {
+        uint32_t dither : 1; // Stream exact-average periods, the payload is stepper_motor_dither_payload_t
+    } flags;
 } stepper_motor_uniform_encoder_config_t;
 
+#define STEPPER_UNIFORM_ENCODER_MAX 4 // Uniform encoders are taken from a static pool of this size
+#define STEPPER_UNIFORM_MAX_SYMBOLS 32 // Longest symbol body, loop bodies (plus end marker) must fit one 48 word RMT memory block
+
+/**
+ * @brief Stepper motor uniform encoder payload
+ *
+ * @note A bare uint32_t frequency is still accepted as payload, it encodes a single symbol
+ */
+typedef struct {
+    uint32_t freq_hz; // Step frequency, in Hz
+    uint32_t symbols; // Identical step symbols to encode, up to STEPPER_UNIFORM_MAX_SYMBOLS
+} stepper_motor_uniform_payload_t;
+
+#define STEPPER_SYMBOL_DURATION_MAX 32767 // 15-bit duration field of an RMT symbol half
+
+/**
+ * @brief Stepper motor uniform encoder payload, dither mode
+ *
+ * Step periods are resolution / freq_hz ticks rounded up or down by a Bresenham accumulator, so the
+ * average rate over the move is exactly freq_hz at 100% feed. Periods too long for one symbol are stretched with
+ * low filler symbols. The whole move is streamed through memory refills, it can't be hardware looped.
+ * No period is shorter than the pulse timing allows, a faster freq_hz runs at stepper_pulse_max_hz.
+ * A backlash take-up goes out first in the same transaction, the first of its steps waits out the DIR
+ * setup time, the move's first step follows one take-up period after its last.
+ */
+typedef struct {
+    uint32_t freq_hz; // Step frequency, in Hz
+    uint64_t steps;   // Step pulses of the whole move
+    bool first;       // First transaction of a move, DIR was just set: the first step waits out dir_setup_ns
+    bool exact;       // Run at freq_hz whatever the feed override
+    bool ramp_in;     // An acceleration ramp leads in, start at freq_hz and slew to the override from there
+    bool ramp_out;    // A deceleration ramp follows, be back at freq_hz by the last step
+    uint32_t accel;   // Rate change allowed when the override moves, in steps/s^2, 0: at once
+    uint32_t take_up; // Backlash steps ahead of the move, at take_up_hz whatever the override, not in steps
+    uint32_t take_up_hz;
+} stepper_motor_dither_payload_t;
+
+#define STEPPER_FEED_OVERRIDE_MIN 10  // Feed override range, in percent of the programmed rate
+#define STEPPER_FEED_OVERRIDE_MAX 200
+
+/**
+ * @brief Set the feed override of every dither encoder, clamped to the range
+ *
+ * The rate of a running move is time-scaled from its next step period on, so a change shows within one
+ * memory block. Steps are never added or dropped, only their timing changes. Slewing to a new override
+ * is held to the payload's accel, and a move followed by a deceleration ramp is back on its programmed
+ * rate when the ramp starts, ramps are always played as they are.
+ *
+ * @param[in] percent Rate in percent of the programmed one, 100 for none
+ */
+void stepper_feed_override_set(uint32_t percent);
+
+/**
+ * @brief Feed override in percent
+ */
+uint32_t stepper_feed_override_get(void);
+
+/**
+ * @brief Stepper motor arc encoder configuration
+ */
+typedef struct {
+    uint32_t resolution; // Encoder resolution, in Hz
+} stepper_motor_arc_encoder_config_t;
+
+#define STEPPER_ARC_ENCODER_MAX 3 // Arc encoders are taken from a static pool of this size, one per channel
+
+/**
+ * @brief Stepper motor arc encoder payload, one direction run of an arc
+ *
+ * Both channels of the arc are given the same run and replay the same midpoint steps. Each arc step
+ * takes one time slot (sqrt(2) longer for a diagonal step), a channel pulses in the slots where its
+ * own axis moves, so the two trains stay aligned from a synced start.
+ */
+typedef struct {
+    stepper_arc_t arc; // Arc state at the start of the run
+    uint64_t steps;    // Arc steps in the run
+    uint32_t feed_hz;  // Path speed, in axis steps per second
+    uint32_t axis;     // 0: pulse the steps of axis a, 1: axis b
+} stepper_motor_arc_payload_t;
+
+/**
+ * @brief Stepper motor gear encoder configuration
+ */
+typedef struct {
+    uint32_t resolution; // Encoder resolution, in Hz
+} stepper_motor_gear_encoder_config_t;
+
+#define STEPPER_GEAR_ENCODER_MAX 3 // Gear encoders are taken from a static pool of this size, one per channel
+
+/**
+ * @brief Stepper motor gear encoder payload, one master move and the gear of one slave
+ *
+ * Master and slave channels are given the same move. Master periods follow the segments with the
+ * exact average rate of the dither encoder, each period is cut into gear.split slots: the master
+ * pulses in the last slot of its period, the slave in the slots where the gear steps, so the two
+ * trains stay aligned from a synced start.
+ */
+typedef struct {
+    stepper_segment_t segments[STEPPER_SHAPER_SEGMENT_MAX]; // Master rate steps, back to back
+    uint32_t num_segments;
+    stepper_gear_t gear; // Gear state at the start of the move
+    int32_t dir;         // Master direction, +1 or -1
+    uint32_t axis;       // 0: pulse the master steps, 1: the slave steps
+} stepper_motor_gear_payload_t;
+
 /**
  * @brief Create stepper motor curve encoder
  *
+ * @note The encoder object comes from a static pool of STEPPER_CURVE_ENCODER_MAX entries, the table is
+ *       only referenced, so a ramp costs no RAM and no time to create
+ *
  * @param[in] config Encoder configuration
  * @param[out] ret_encoder Returned encoder handle
  * @return
- *      - ESP_ERR_INVALID_ARG for any invalid arguments
- *      - ESP_ERR_NO_MEM out of memory when creating step motor encoder
+ *      - ESP_ERR_INVALID_ARG for any invalid arguments, no table, or more than STEPPER_CURVE_MAX_POINTS sample points
+ *      - ESP_ERR_NO_MEM all STEPPER_CURVE_ENCODER_MAX encoders are in use
  *      - ESP_OK if creating encoder successfully
  */
 esp_err_t rmt_new_stepper_motor_curve_encoder(const stepper_motor_curve_encoder_config_t *config, rmt_encoder_handle_t *ret_encoder);
@@ -44,15 +165,82 @@ esp_err_t rmt_new_stepper_motor_curve_encoder(const stepper_motor_curve_encoder_
 /**
  * @brief Create RMT encoder for encoding step motor uniform phase into RMT symbols
  *
+ * @note The encoder object comes from a static pool of STEPPER_UNIFORM_ENCODER_MAX entries
+ *
  * @param[in] config Encoder configuration
  * @param[out] ret_encoder Returned encoder handle
  * @return
- *      - ESP_ERR_INVALID_ARG for any invalid arguments
- *      - ESP_ERR_NO_MEM out of memory when creating step motor encoder
+ *      - ESP_ERR_INVALID_ARG for any invalid arguments, or a fixed pulse longer than one symbol half
+ *      - ESP_ERR_NO_MEM when the encoder pool is exhausted
  *      - ESP_OK if creating encoder successfully
  */
 esp_err_t rmt_new_stepper_motor_uniform_encoder(const stepper_motor_uniform_encoder_config_t *config, rmt_encoder_handle_t *ret_encoder);
 
+/**
+ * @brief Steps a dither encoder has put on the pin and the rate it is on
+ *
+ * @note Read from any task or isr while the encoder runs. The count wraps, differences of two reads
+ *       are the steps in between
+ *
+ * @param[in] encoder Uniform encoder made with flags.dither
+ * @param[out] steps Steps out on the pin since the encoder was made, see stepper_line_ahead
+ * @param[out] freq_hz Rate of the last period written, 0 between transactions
+ */
+void stepper_motor_uniform_encoder_count(rmt_encoder_handle_t encoder, uint32_t *steps, uint32_t *freq_hz);
+
+/**
+ * @brief Where a transaction of step symbols is on the pin
+ *
+ * The encoder writes up to one memory block and one batch ahead of the pin. It stamps the
+ * transaction on its first encode call, the channel starts right after it, and notes the tick of
+ * every rise it writes. The steps still in the memory are the rises past the ticks since the stamp.
+ */
+#define STEPPER_LINE_RISES 128 // rises kept, more than a memory block and a batch of steps
+
+typedef struct {
+    volatile int64_t start_us;           // first encode call of the transaction
+    volatile uint32_t steps;             // steps written in the transaction
+    uint64_t ticks;                      // ticks written in the transaction
+    uint32_t rises[STEPPER_LINE_RISES];  // tick of the rise of step n at n % STEPPER_LINE_RISES, wraps
+} stepper_line_t;
+
+// first encode call of a transaction
+void stepper_line_start(stepper_line_t *line);
+
+// a step written, low then high ticks
+void stepper_line_step(stepper_line_t *line, uint32_t low, uint32_t high);
+
+// steps written but not on the pin yet, from any task or isr
+uint32_t stepper_line_ahead(const stepper_line_t *line, uint32_t resolution);
+
+/**
+ * @brief Create RMT encoder for encoding one axis of an arc into RMT symbols
+ *
+ * @note The encoder object comes from a static pool of STEPPER_ARC_ENCODER_MAX entries
+ *
+ * @param[in] config Encoder configuration
+ * @param[out] ret_encoder Returned encoder handle
+ * @return
+ *      - ESP_ERR_INVALID_ARG for any invalid arguments
+ *      - ESP_ERR_NO_MEM when the encoder pool is exhausted
+ *      - ESP_OK if creating encoder successfully
+ */
+esp_err_t rmt_new_stepper_motor_arc_encoder(const stepper_motor_arc_encoder_config_t *config, rmt_encoder_handle_t *ret_encoder);
+
+/**
+ * @brief Create RMT encoder for encoding the master or a slave of a geared move into RMT symbols
+ *
+ * @note The encoder object comes from a static pool of STEPPER_GEAR_ENCODER_MAX entries
+ *
+ * @param[in] config Encoder configuration
+ * @param[out] ret_encoder Returned encoder handle
+ * @return
+ *      - ESP_ERR_INVALID_ARG for any invalid arguments
+ *      - ESP_ERR_NO_MEM when the encoder pool is exhausted
+ *      - ESP_OK if creating encoder successfully
+ */
+esp_err_t rmt_new_stepper_motor_gear_encoder(const stepper_motor_gear_encoder_config_t *config, rmt_encoder_handle_t *ret_encoder);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,104 @@
+#include <stddef.h>
+#include "stepper_move.h"
+
+void stepper_split_init(stepper_split_t *split, uint64_t steps, uint32_t block_symbols, uint32_t loop_max)
+{
+    split->remain = steps;
+    split->block_symbols = block_symbols ? block_symbols : 1;
+    split->loop_max = loop_max ? loop_max : 1;
+}
+
+bool stepper_split_next(stepper_split_t *split, stepper_chunk_t *chunk)
+{
+    uint64_t full = (uint64_t)split->block_symbols * split->loop_max;
+
+    if (split->remain == 0)
+    {
+        return false;
+    }
+
+    if (split->remain >= full)
+    {
+        // a whole hardware loop
+        chunk->symbols = split->block_symbols;
+        chunk->passes = split->loop_max;
+    }
+    else if (split->remain >= split->block_symbols)
+    {
+        // whole bodies left over
+        chunk->symbols = split->block_symbols;
+        chunk->passes = split->remain / split->block_symbols;
+    }
+    else
+    {
+        // tail shorter than one body
+        chunk->symbols = split->remain;
+        chunk->passes = 1;
+    }
+    split->remain -= (uint64_t)chunk->symbols * chunk->passes;
+
+    return true;
+}
+
+uint32_t stepper_pick_resolution(uint32_t freq_min_hz)
+{
+    return stepper_pick_pulse_resolution(freq_min_hz, NULL);
+}
+
+static uint32_t stepper_ns_to_ticks(uint32_t ns, uint32_t resolution)
+{
+    return (uint32_t)(((uint64_t)ns * resolution + 999999999) / 1000000000);
+}
+
+void stepper_pulse_ticks(const stepper_pulse_t *pulse, uint32_t resolution, stepper_pulse_ticks_t *ticks)
+{
+    uint32_t high = pulse ? stepper_ns_to_ticks(pulse->high_ns, resolution) : 0;
+    uint32_t low = pulse ? stepper_ns_to_ticks(pulse->low_ns, resolution) : 0;
+
+    high = high ? high : 1;
+    low = low ? low : 1;
+    if (pulse && pulse->fixed)
+    {
+        ticks->high = high;
+        ticks->period_min = high + low;
+    }
+    else
+    {
+        ticks->high = 0;
+        ticks->period_min = 2 * (high > low ? high : low);
+    }
+    ticks->dir_setup = pulse ? stepper_ns_to_ticks(pulse->dir_setup_ns, resolution) : 0;
+}
+
+uint32_t stepper_pulse_max_hz(const stepper_pulse_t *pulse, uint32_t resolution)
+{
+    stepper_pulse_ticks_t ticks;
+
+    stepper_pulse_ticks(pulse, resolution, &ticks);
+    return resolution / ticks.period_min;
+}
+
+uint32_t stepper_pick_pulse_resolution(uint32_t freq_min_hz, const stepper_pulse_t *pulse)
+{
+    uint64_t freq_min = freq_min_hz ? freq_min_hz : 1;
+    uint32_t div = 1;
+
+    for (; div < STEPPER_MOVE_CLK_DIV_MAX; div++)
+    {
+        uint32_t resolution = STEPPER_MOVE_CLK_SRC_HZ / div;
+        stepper_pulse_ticks_t ticks;
+        if (STEPPER_MOVE_CLK_SRC_HZ % div)
+        {
+            continue;
+        }
+        // one symbol holds a period of 2 * 32767 ticks, a fixed pulse has to fit the high half itself
+        stepper_pulse_ticks(pulse, resolution, &ticks);
+        uint64_t symbol_max = ticks.high ? 32767 + (uint64_t)ticks.high : 65534;
+        if (ticks.high <= 32767 && resolution <= freq_min * symbol_max)
+        {
+            break;
+        }
+    }
+
+    return STEPPER_MOVE_CLK_SRC_HZ / div;
+}
@@ -0,0 +1,114 @@
+#ifndef _STEPPER_MOVE_H
+#define _STEPPER_MOVE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// hardware loop counter limit of one RMT TX transaction (RMT_LL_MAX_LOOP_COUNT_PER_BATCH on ESP32-S3)
+#define STEPPER_MOVE_LOOP_COUNT_MAX 1023
+
+// RMT_CLK_SRC_DEFAULT is the 80MHz APB clock, a channel divides it by an integer 1 ~ 256
+#define STEPPER_MOVE_CLK_SRC_HZ 80000000
+#define STEPPER_MOVE_CLK_DIV_MAX 256
+
+/**
+ * @brief One RMT transaction of a split move: `symbols` identical step symbols sent `passes` times
+ */
+typedef struct {
+    uint32_t symbols; // symbols in the transmitted body, 1 ~ block_symbols
+    uint32_t passes;  // times the body is sent, 1 ~ loop_max
+} stepper_chunk_t;
+
+/**
+ * @brief Splitter state, walks a 64-bit step count down to hardware sized transactions
+ */
+typedef struct {
+    uint64_t remain;
+    uint32_t block_symbols;
+    uint32_t loop_max;
+} stepper_split_t;
+
+/**
+ * @brief Start splitting a move of `steps` step pulses
+ *
+ * @param[out] split Splitter state
+ * @param[in] steps Total step pulses of the move
+ * @param[in] block_symbols Largest loop body, in symbols
+ * @param[in] loop_max Largest hardware loop count
+ */
+void stepper_split_init(stepper_split_t *split, uint64_t steps, uint32_t block_symbols, uint32_t loop_max);
+
+/**
+ * @brief Get the next transaction of the move
+ *
+ * Full bodies are looped as far as the hardware counter allows, a move never needs more than
+ * two transactions beyond its `steps / (block_symbols * loop_max)` full ones.
+ * Every chunk is made of whole step periods, so back to back chunks stay phase continuous.
+ *
+ * @return false when the whole move has been handed out
+ */
+bool stepper_split_next(stepper_split_t *split, stepper_chunk_t *chunk);
+
+/**
+ * @brief Pick the channel resolution for a step frequency range
+ *
+ * The finest resolution (least dither jitter) whose period at freq_min_hz still fits a single
+ * symbol, from the exact divisions of the source clock. Slower rates still work, the dither
+ * encoder stretches their periods with filler symbols.
+ *
+ * @return resolution in Hz
+ */
+uint32_t stepper_pick_resolution(uint32_t freq_min_hz);
+
+/**
+ * @brief STEP and DIR timing a driver needs, its datasheet minimums
+ */
+typedef struct {
+    uint32_t high_ns;      // shortest STEP high time
+    uint32_t low_ns;       // shortest STEP low time
+    uint32_t dir_setup_ns; // DIR change to the next STEP rising edge
+    bool fixed;            // one symbol per step: a high_ns pulse and the rest of the period low, false: 50% duty
+} stepper_pulse_t;
+
+/**
+ * @brief Step timing in ticks of one channel resolution, rounded up
+ */
+typedef struct {
+    uint32_t high;       // high time of a fixed pulse, 0 for half the period
+    uint32_t period_min; // shortest period both minimums allow, at least 2
+    uint32_t dir_setup;  // low time before the first rising edge of a move
+} stepper_pulse_ticks_t;
+
+/**
+ * @brief Convert a step timing to ticks of a resolution
+ *
+ * @param[in] pulse Timing, NULL for none: 50% duty and a 2 tick period floor
+ */
+void stepper_pulse_ticks(const stepper_pulse_t *pulse, uint32_t resolution, stepper_pulse_ticks_t *ticks);
+
+/**
+ * @brief Fastest step rate a timing allows at a resolution, faster rates are held to it
+ *
+ * A 50% duty period has to fit the longer minimum twice, a fixed pulse only the sum of both.
+ */
+uint32_t stepper_pulse_max_hz(const stepper_pulse_t *pulse, uint32_t resolution);
+
+/**
+ * @brief Pick the channel resolution for a step frequency range and a step timing
+ *
+ * As stepper_pick_resolution, a fixed pulse leaves one symbol 32767 low ticks plus its high time
+ * for the slowest period.
+ *
+ * @return resolution in Hz
+ */
+uint32_t stepper_pick_pulse_resolution(uint32_t freq_min_hz, const stepper_pulse_t *pulse);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
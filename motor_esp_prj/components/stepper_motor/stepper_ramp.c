@@ -0,0 +1,196 @@
+#include <string.h>
+#include "stepper_ramp.h"
+
+static uint32_t stepper_ramp_crc32(const uint8_t *data, size_t len)
+{
+    uint32_t crc = 0xffffffff;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+        }
+    }
+    return ~crc;
+}
+
+// third-order "smoothstep" function: https://en.wikipedia.org/wiki/Smoothstep
+static float stepper_ramp_smooth_freq(uint32_t freq1, uint32_t freq2, uint32_t freqx)
+{
+    float normalize_x = ((float)(freqx - freq1)) / (freq2 - freq1);
+    float smooth_x = normalize_x * normalize_x * (3 - 2 * normalize_x);
+    return smooth_x * (freq2 - freq1) + freq1;
+}
+
+// rmt_symbol_word_t {duration0 : 15, level0 : 1, duration1 : 15, level1 : 1}, low then high
+static uint32_t stepper_ramp_symbol(uint32_t half_period)
+{
+    return half_period | (half_period << 16) | (1u << 31);
+}
+
+bool stepper_ramp_fill(uint32_t *symbols, uint32_t resolution, uint32_t start_freq_hz, uint32_t end_freq_hz, uint32_t points)
+{
+    uint32_t low = start_freq_hz < end_freq_hz ? start_freq_hz : end_freq_hz;
+    uint32_t high = start_freq_hz < end_freq_hz ? end_freq_hz : start_freq_hz;
+
+    if (points < 2 || points > STEPPER_RAMP_POINTS_MAX || low == high || low == 0 ||
+        resolution / low / 2 > STEPPER_RAMP_HALF_PERIOD_MAX || resolution / high / 2 == 0)
+    {
+        return false;
+    }
+    // sampled evenly in rate from the low end, a deceleration is the same curve played backwards
+    uint32_t curve_step = (high - low) / (points - 1);
+    for (uint32_t i = 0; i < points; i++)
+    {
+        float smooth_freq = stepper_ramp_smooth_freq(low, high, low + curve_step * i);
+        uint32_t symbol_duration = resolution / smooth_freq / 2;
+        symbols[start_freq_hz < end_freq_hz ? i : points - i - 1] = stepper_ramp_symbol(symbol_duration);
+    }
+    return true;
+}
+
+size_t stepper_ramp_build(void *image, size_t capacity, const stepper_ramp_profile_t *profiles, uint32_t num_profiles)
+{
+    stepper_ramp_header_t *header = image;
+    stepper_ramp_entry_t *entries = (stepper_ramp_entry_t *)(header + 1);
+    size_t size = sizeof(*header) + num_profiles * sizeof(*entries);
+
+    if (num_profiles > STEPPER_RAMP_ENTRIES_MAX || size > capacity)
+    {
+        return 0;
+    }
+    memset(image, 0, size);
+    for (uint32_t i = 0; i < num_profiles; i++)
+    {
+        const stepper_ramp_profile_t *profile = &profiles[i];
+        size_t bytes = profile->points * sizeof(uint32_t);
+
+        if (profile->points > STEPPER_RAMP_POINTS_MAX || size + bytes > capacity ||
+            !stepper_ramp_fill((uint32_t *)((uint8_t *)image + size), profile->resolution, profile->start_freq_hz,
+                               profile->end_freq_hz, profile->points))
+        {
+            return 0;
+        }
+        entries[i].resolution = profile->resolution;
+        entries[i].start_freq_hz = profile->start_freq_hz;
+        entries[i].end_freq_hz = profile->end_freq_hz;
+        entries[i].points = profile->points;
+        entries[i].offset = size;
+        size += bytes;
+    }
+    header->magic = STEPPER_RAMP_MAGIC;
+    header->version = STEPPER_RAMP_VERSION;
+    header->num_entries = num_profiles;
+    header->size = size;
+    header->crc = stepper_ramp_crc32((const uint8_t *)(header + 1), size - sizeof(*header));
+    return size;
+}
+
+bool stepper_ramp_check(const void *image, size_t size)
+{
+    const stepper_ramp_header_t *header = image;
+    const stepper_ramp_entry_t *entries = stepper_ramp_entries(image);
+
+    if (size < sizeof(*header) || header->magic != STEPPER_RAMP_MAGIC || header->version != STEPPER_RAMP_VERSION ||
+        header->num_entries > STEPPER_RAMP_ENTRIES_MAX || header->size > size ||
+        header->size < sizeof(*header) + header->num_entries * sizeof(*entries))
+    {
+        return false;
+    }
+    for (uint32_t i = 0; i < header->num_entries; i++)
+    {
+        const stepper_ramp_entry_t *entry = &entries[i];
+        if (entry->points < 2 || entry->points > STEPPER_RAMP_POINTS_MAX || entry->offset % 4 ||
+            entry->offset < sizeof(*header) + header->num_entries * sizeof(*entries) ||
+            entry->offset > header->size || header->size - entry->offset < entry->points * sizeof(uint32_t) ||
+            entry->start_freq_hz == entry->end_freq_hz)
+        {
+            return false;
+        }
+    }
+    return header->crc == stepper_ramp_crc32((const uint8_t *)(header + 1), header->size - sizeof(*header));
+}
+
+size_t stepper_ramp_copy(void *dst, size_t capacity, const void *image, const uint32_t *resolutions, uint32_t num_resolutions)
+{
+    const stepper_ramp_header_t *header = image;
+    const stepper_ramp_entry_t *entries = stepper_ramp_entries(image);
+    bool keep[STEPPER_RAMP_ENTRIES_MAX] = {false};
+    uint32_t num_keep = 0;
+
+    for (uint32_t i = 0; i < header->num_entries; i++)
+    {
+        for (uint32_t r = 0; r < num_resolutions; r++)
+        {
+            keep[i] = keep[i] || entries[i].resolution == resolutions[r];
+        }
+        num_keep += keep[i];
+    }
+    // room for every index entry, the ones that don't fit leave theirs unused
+    size_t room = sizeof(*header) + num_keep * sizeof(*entries);
+    if (num_keep == 0 || room > capacity)
+    {
+        return 0;
+    }
+    num_keep = 0;
+    for (uint32_t i = 0; i < header->num_entries; i++)
+    {
+        size_t bytes = entries[i].points * sizeof(uint32_t);
+        keep[i] = keep[i] && room + bytes <= capacity;
+        room += keep[i] ? bytes : 0;
+        num_keep += keep[i];
+    }
+
+    stepper_ramp_header_t *copy = dst;
+    stepper_ramp_entry_t *copy_entries = (stepper_ramp_entry_t *)(copy + 1);
+    size_t size = sizeof(*copy) + num_keep * sizeof(*copy_entries);
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < header->num_entries; i++)
+    {
+        if (keep[i])
+        {
+            size_t bytes = entries[i].points * sizeof(uint32_t);
+            copy_entries[n] = entries[i];
+            copy_entries[n].offset = size;
+            memcpy((uint8_t *)dst + size, stepper_ramp_symbols(image, &entries[i]), bytes);
+            size += bytes;
+            n++;
+        }
+    }
+    copy->magic = STEPPER_RAMP_MAGIC;
+    copy->version = STEPPER_RAMP_VERSION;
+    copy->num_entries = n;
+    copy->size = size;
+    copy->crc = stepper_ramp_crc32((const uint8_t *)(copy + 1), size - sizeof(*copy));
+    return size;
+}
+
+const stepper_ramp_entry_t *stepper_ramp_find(const void *image, uint32_t resolution, uint32_t start_freq_hz,
+                                              uint32_t end_freq_hz, bool accel)
+{
+    const stepper_ramp_header_t *header = image;
+    const stepper_ramp_entry_t *entries = stepper_ramp_entries(image);
+
+    for (uint32_t i = 0; i < header->num_entries; i++)
+    {
+        const stepper_ramp_entry_t *entry = &entries[i];
+        if (entry->resolution == resolution && (entry->start_freq_hz < entry->end_freq_hz) == accel &&
+            (!start_freq_hz || entry->start_freq_hz == start_freq_hz) &&
+            (!end_freq_hz || entry->end_freq_hz == end_freq_hz))
+        {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+uint32_t stepper_ramp_accel(const stepper_ramp_entry_t *entry)
+{
+    uint64_t low = entry->start_freq_hz < entry->end_freq_hz ? entry->start_freq_hz : entry->end_freq_hz;
+    uint64_t high = entry->start_freq_hz < entry->end_freq_hz ? entry->end_freq_hz : entry->start_freq_hz;
+
+    // a step at rate f lasts 1/f, so f^2 grows by 2 * accel per step
+    return (uint32_t)((high * high - low * low) / (2 * entry->points));
+}
@@ -0,0 +1,113 @@
+#ifndef _STEPPER_RAMP_H
+#define _STEPPER_RAMP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define STEPPER_RAMP_MAGIC 0x504d4152 // "RAMP", little endian
+#define STEPPER_RAMP_VERSION 1
+#define STEPPER_RAMP_ENTRIES_MAX 32
+#define STEPPER_RAMP_POINTS_MAX 1000      // same as STEPPER_CURVE_MAX_POINTS
+#define STEPPER_RAMP_HALF_PERIOD_MAX 32767 // a half period is one symbol half, 15-bit duration
+
+/**
+ * @brief Ramp table image, as flashed into the "ramp" partition
+ *
+ * A header, an index of entries keyed by profile, then the symbol arrays, every field little endian
+ * and 4 byte aligned so the symbols can be handed to the RMT as they are. Symbols are RMT symbol words in playing
+ * order, low then high half period, the step pulse at the end of every period.
+ */
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t num_entries;
+    uint32_t size; // whole image, in bytes
+    uint32_t crc;  // crc32 of everything after the header
+} stepper_ramp_header_t;
+
+typedef struct {
+    uint32_t resolution;    // tick rate the symbols are made for, in Hz
+    uint32_t start_freq_hz; // rate of the first step
+    uint32_t end_freq_hz;   // rate the ramp leads into, a deceleration has end < start
+    uint32_t points;        // steps of the ramp
+    uint32_t offset;        // symbols, in bytes from the start of the image
+} stepper_ramp_entry_t;
+
+/**
+ * @brief One ramp for the generator to put in an image
+ */
+typedef struct {
+    uint32_t resolution;
+    uint32_t start_freq_hz;
+    uint32_t end_freq_hz;
+    uint32_t points;
+} stepper_ramp_profile_t;
+
+/**
+ * @brief Symbols of a smoothstep ramp, the curve the RMT curve encoder has always used
+ *
+ * @param[out] symbols Points RMT symbol words
+ * @return false for fewer than 2 or more than STEPPER_RAMP_POINTS_MAX points, equal rates or a half
+ *         period too long for a symbol
+ */
+bool stepper_ramp_fill(uint32_t *symbols, uint32_t resolution, uint32_t start_freq_hz, uint32_t end_freq_hz, uint32_t points);
+
+/**
+ * @brief Write an image of the profiles, in the given order
+ *
+ * @return image size in bytes, 0 when a profile is bad or it doesn't fit the capacity
+ */
+size_t stepper_ramp_build(void *image, size_t capacity, const stepper_ramp_profile_t *profiles, uint32_t num_profiles);
+
+/**
+ * @brief Validate an image: magic, version, size, crc and every entry inside it
+ *
+ * @param[in] size Bytes available, a partition can be larger than the image
+ */
+bool stepper_ramp_check(const void *image, size_t size);
+
+/**
+ * @brief Copy the ramps made for some resolutions out of a checked image into an image of their own
+ *
+ * Ramps are kept in image order while they fit, the copy is a checked image.
+ *
+ * @return copy size in bytes, 0 when no ramp is at the resolutions or none fits the capacity
+ */
+size_t stepper_ramp_copy(void *dst, size_t capacity, const void *image, const uint32_t *resolutions, uint32_t num_resolutions);
+
+/**
+ * @brief Find the ramp of a profile in a checked image
+ *
+ * @param[in] start_freq_hz 0 for any start rate
+ * @param[in] end_freq_hz 0 for any end rate
+ * @param[in] accel Only ramps going up (true) or down (false)
+ * @return the first matching entry, NULL if there is none
+ */
+const stepper_ramp_entry_t *stepper_ramp_find(const void *image, uint32_t resolution, uint32_t start_freq_hz,
+                                              uint32_t end_freq_hz, bool accel);
+
+/**
+ * @brief Mean acceleration of a ramp, in steps/s^2, the smoothstep peaks above it halfway up
+ */
+uint32_t stepper_ramp_accel(const stepper_ramp_entry_t *entry);
+
+static inline const stepper_ramp_entry_t *stepper_ramp_entries(const void *image)
+{
+    return (const stepper_ramp_entry_t *)((const stepper_ramp_header_t *)image + 1);
+}
+
+static inline const uint32_t *stepper_ramp_symbols(const void *image, const stepper_ramp_entry_t *entry)
+{
+    return (const uint32_t *)((const uint8_t *)image + entry->offset);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,145 @@
+#include <math.h>
+#include "stepper_shaper.h"
+
+static const char *const stepper_shaper_names[STEPPER_SHAPER_TYPE_MAX] = {"none", "zv", "zvd", "ei"};
+
+const char *stepper_shaper_name(stepper_shaper_type_t type)
+{
+    return type < STEPPER_SHAPER_TYPE_MAX ? stepper_shaper_names[type] : "?";
+}
+
+bool stepper_shaper_init(stepper_shaper_t *shaper, stepper_shaper_type_t type, float freq_hz, float damping)
+{
+    shaper->count = 1;
+    shaper->amp[0] = 1.0f;
+    shaper->time_s[0] = 0.0f;
+
+    if (type == STEPPER_SHAPER_NONE)
+    {
+        return true;
+    }
+    if (type >= STEPPER_SHAPER_TYPE_MAX || !(freq_hz > 0.0f) || !(damping >= 0.0f && damping < 1.0f) ||
+        (type == STEPPER_SHAPER_EI && damping > STEPPER_SHAPER_EI_DAMPING_MAX))
+    {
+        return false;
+    }
+
+    // damped period of the mode and the decay of one half period
+    float root = sqrtf(1.0f - damping * damping);
+    float period = 1.0f / (freq_hz * root);
+    float k = expf(-damping * (float)M_PI / root);
+    float z = damping;
+
+    switch (type)
+    {
+    case STEPPER_SHAPER_ZV:
+        shaper->count = 2;
+        shaper->amp[0] = 1.0f / (1.0f + k);
+        shaper->amp[1] = k / (1.0f + k);
+        shaper->time_s[1] = period / 2;
+        break;
+    case STEPPER_SHAPER_ZVD:
+        shaper->count = 3;
+        shaper->amp[0] = 1.0f / ((1.0f + k) * (1.0f + k));
+        shaper->amp[1] = 2.0f * k / ((1.0f + k) * (1.0f + k));
+        shaper->amp[2] = k * k / ((1.0f + k) * (1.0f + k));
+        shaper->time_s[1] = period / 2;
+        shaper->time_s[2] = period;
+        break;
+    case STEPPER_SHAPER_EI:
+        // curve fit of the 5% extra-insensitive shaper over damping (Singer, Seering)
+        shaper->count = 3;
+        shaper->amp[0] = 0.24968f + 0.24961f * z + 0.80008f * z * z + 1.23328f * z * z * z;
+        shaper->amp[1] = 0.49755f + 0.00516f * z - 0.92989f * z * z - 1.58410f * z * z * z;
+        shaper->amp[2] = 1.0f - shaper->amp[0] - shaper->amp[1];
+        shaper->time_s[1] = (0.49890f + 0.16270f * z - 0.54262f * z * z + 6.16180f * z * z * z) * period;
+        shaper->time_s[2] = (0.99748f + 0.18382f * z - 1.58270f * z * z + 8.17083f * z * z * z) * period;
+        break;
+    default:
+        break;
+    }
+
+    return true;
+}
+
+// shaped position at time t, in steps
+static double stepper_shaper_position(const stepper_shaper_t *shaper, uint32_t freq_hz, double duration, double t)
+{
+    double position = 0;
+
+    for (uint32_t i = 0; i < shaper->count; i++)
+    {
+        double run = t - shaper->time_s[i];
+        if (run > duration)
+        {
+            run = duration;
+        }
+        if (run > 0)
+        {
+            position += shaper->amp[i] * run;
+        }
+    }
+    return position * freq_hz;
+}
+
+uint32_t stepper_shaper_apply(const stepper_shaper_t *shaper, uint32_t freq_hz, uint64_t steps, stepper_segment_t *segments)
+{
+    double breaks[2 * STEPPER_SHAPER_IMPULSE_MAX];
+    uint32_t num_breaks = 0;
+    uint32_t num_segments = 0;
+
+    if (steps == 0 || freq_hz == 0)
+    {
+        return 0;
+    }
+    if (shaper->count <= 1)
+    {
+        segments[0].freq_hz = freq_hz;
+        segments[0].steps = steps;
+        segments[0].exact = false;
+        segments[0].take_up = false;
+        return 1;
+    }
+
+    // the rate only changes where an impulse's copy of the move starts or ends
+    double duration = (double)steps / freq_hz;
+    for (uint32_t i = 0; i < shaper->count; i++)
+    {
+        breaks[num_breaks++] = shaper->time_s[i];
+        breaks[num_breaks++] = shaper->time_s[i] + duration;
+    }
+    for (uint32_t i = 1; i < num_breaks; i++)
+    {
+        for (uint32_t j = i; j > 0 && breaks[j] < breaks[j - 1]; j--)
+        {
+            double tmp = breaks[j];
+            breaks[j] = breaks[j - 1];
+            breaks[j - 1] = tmp;
+        }
+    }
+
+    uint64_t done = 0;
+    for (uint32_t i = 1; i < num_breaks; i++)
+    {
+        double span = breaks[i] - breaks[i - 1];
+        uint64_t target = i == num_breaks - 1 ? steps : (uint64_t)llround(stepper_shaper_position(shaper, freq_hz, duration, breaks[i]));
+        if (target > steps)
+        {
+            target = steps;
+        }
+        if (span <= 0 || target <= done)
+        {
+            continue;
+        }
+        uint64_t seg_steps = target - done;
+        double rate = seg_steps / span;
+        segments[num_segments].freq_hz = rate < 1.0 ? 1 : (uint32_t)llround(rate);
+        segments[num_segments].steps = seg_steps;
+        segments[num_segments].exact = false;
+        segments[num_segments].take_up = false;
+        num_segments++;
+        done = target;
+    }
+
+    return num_segments;
+}
@@ -0,0 +1,71 @@
+#ifndef _STEPPER_SHAPER_H
+#define _STEPPER_SHAPER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define STEPPER_SHAPER_IMPULSE_MAX 3
+// a constant rate move convolved with n impulses has at most 2n - 1 constant rate pieces
+#define STEPPER_SHAPER_SEGMENT_MAX (2 * STEPPER_SHAPER_IMPULSE_MAX - 1)
+#define STEPPER_SHAPER_EI_DAMPING_MAX 0.3f // range of the EI curve fit
+
+typedef enum {
+    STEPPER_SHAPER_NONE = 0,
+    STEPPER_SHAPER_ZV,
+    STEPPER_SHAPER_ZVD,
+    STEPPER_SHAPER_EI, // 5% vibration tolerance
+    STEPPER_SHAPER_TYPE_MAX,
+} stepper_shaper_type_t;
+
+/**
+ * @brief Impulse sequence of an input shaper, amplitudes sum to 1
+ */
+typedef struct {
+    uint32_t count;
+    float amp[STEPPER_SHAPER_IMPULSE_MAX];
+    float time_s[STEPPER_SHAPER_IMPULSE_MAX];
+} stepper_shaper_t;
+
+/**
+ * @brief Constant step rate piece of a shaped move
+ */
+typedef struct {
+    uint32_t freq_hz;
+    uint64_t steps;
+    bool exact;   // kept at freq_hz by the feed override, homing's rates
+    bool take_up; // backlash take-up, only ever the first segment of a move, steps the axis doesn't travel
+} stepper_segment_t;
+
+/**
+ * @brief Build the impulses of a shaper tuned to a mode of the machine
+ *
+ * @param[out] shaper Impulse sequence, a single unit impulse for STEPPER_SHAPER_NONE
+ * @param[in] type Shaper type
+ * @param[in] freq_hz Natural frequency of the ringing mode, in Hz
+ * @param[in] damping Damping ratio of the mode, 0 ~ 1 (0 ~ STEPPER_SHAPER_EI_DAMPING_MAX for EI)
+ * @return false for an unknown type or out of range frequency or damping, shaper is then NONE
+ */
+bool stepper_shaper_init(stepper_shaper_t *shaper, stepper_shaper_type_t type, float freq_hz, float damping);
+
+/**
+ * @brief Shape a constant rate move of `steps` at `freq_hz`
+ *
+ * The rate profile is convolved with the impulses, the move gets longer by the last impulse time.
+ * Segment step counts are taken from the rounded shaped position, so they add up to `steps` exactly.
+ *
+ * @param[out] segments At least STEPPER_SHAPER_SEGMENT_MAX entries
+ * @return number of segments, 0 for an empty move
+ */
+uint32_t stepper_shaper_apply(const stepper_shaper_t *shaper, uint32_t freq_hz, uint64_t steps, stepper_segment_t *segments);
+
+const char *stepper_shaper_name(stepper_shaper_type_t type);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,400 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "esp_attr.h"
+#include "esp_cpu.h"
+#include "esp_private/esp_clk.h"
+#include "esp_console.h"
+#include "argtable3/argtable3.h"
+
+#include "sys_monitor.h"
+
+#define BOOT_STAGE_MAX 16
+
+typedef struct
+{
+    const char *stage;
+    int64_t time_us;
+} boot_record_t;
+
+static boot_record_t boot_records[BOOT_STAGE_MAX];
+static int boot_record_num = 0;
+static portMUX_TYPE boot_record_lock = portMUX_INITIALIZER_UNLOCKED;
+
+#define SYS_TASK_MAX 16
+
+typedef struct
+{
+    TaskHandle_t task;
+    uint32_t stack_size;
+} sys_task_record_t;
+
+static sys_task_record_t sys_tasks[SYS_TASK_MAX];
+static int sys_task_num = 0;
+static portMUX_TYPE sys_task_lock = portMUX_INITIALIZER_UNLOCKED;
+
+#define SYS_POOL_MAX 12
+
+static sys_pool_t *sys_pools[SYS_POOL_MAX];
+static int sys_pool_num = 0;
+static portMUX_TYPE sys_pool_lock = portMUX_INITIALIZER_UNLOCKED;
+
+#define SYS_HEAP_GUARD_TASK_MAX 8
+
+typedef struct
+{
+    uint32_t allocs;
+    uint32_t last_size;
+    TaskHandle_t last_task; // NULL for an isr
+} sys_heap_guard_record_t;
+
+static TaskHandle_t sys_heap_guard_tasks[SYS_HEAP_GUARD_TASK_MAX];
+static int sys_heap_guard_task_num = 0;
+static volatile bool sys_heap_guard_armed = false;
+static sys_heap_guard_record_t sys_heap_guard_record;
+static portMUX_TYPE sys_heap_guard_lock = portMUX_INITIALIZER_UNLOCKED;
+
+typedef struct
+{
+    uint32_t calls;
+    uint64_t cycles;
+    uint32_t max_cycles;
+} sys_isr_record_t;
+
+static const char *const sys_isr_names[SYS_ISR_MAX] = {"rmt encode", "pcnt watch", "ledc count", "mcpwm step", "limit latch", "rmt done"};
+static sys_isr_record_t sys_isrs[SYS_ISR_MAX];
+static portMUX_TYPE sys_isr_lock = portMUX_INITIALIZER_UNLOCKED;
+
+#define SYS_TOP_TASK_MAX 24
+#define SYS_TOP_WINDOW_DEFAULT_ms 1000
+
+// stages are marked from app_main and the console boot task at the same time
+void sys_boot_mark(const char *stage)
+{
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL(&boot_record_lock);
+    if (boot_record_num < BOOT_STAGE_MAX)
+    {
+        boot_records[boot_record_num].stage = stage;
+        boot_records[boot_record_num].time_us = now;
+        boot_record_num++;
+    }
+    portEXIT_CRITICAL(&boot_record_lock);
+}
+
+void sys_task_register(TaskHandle_t task, uint32_t stack_size)
+{
+    portENTER_CRITICAL(&sys_task_lock);
+    if (sys_task_num < SYS_TASK_MAX)
+    {
+        sys_tasks[sys_task_num].task = task;
+        sys_tasks[sys_task_num].stack_size = stack_size;
+        sys_task_num++;
+    }
+    portEXIT_CRITICAL(&sys_task_lock);
+}
+
+void sys_pool_take(sys_pool_t *pool)
+{
+    // listed on first use, used and peak are kept consistent by the owner's lock
+    if (!pool->listed)
+    {
+        portENTER_CRITICAL(&sys_pool_lock);
+        if (sys_pool_num < SYS_POOL_MAX)
+        {
+            sys_pools[sys_pool_num++] = pool;
+        }
+        portEXIT_CRITICAL(&sys_pool_lock);
+        pool->listed = true;
+    }
+    if (++pool->used > pool->peak)
+    {
+        pool->peak = pool->used;
+    }
+}
+
+void sys_pool_give(sys_pool_t *pool)
+{
+    pool->used--;
+}
+
+// guarded tasks are added before arming, the hook reads the list without the lock
+void sys_heap_guard_task(TaskHandle_t task)
+{
+    portENTER_CRITICAL(&sys_heap_guard_lock);
+    if (sys_heap_guard_task_num < SYS_HEAP_GUARD_TASK_MAX)
+    {
+        sys_heap_guard_tasks[sys_heap_guard_task_num++] = task;
+    }
+    portEXIT_CRITICAL(&sys_heap_guard_lock);
+}
+
+void sys_heap_guard_arm(void)
+{
+    sys_heap_guard_armed = true;
+}
+
+#ifdef CONFIG_HEAP_USE_HOOKS
+// called by heap_caps after every allocation, also with the flash cache off
+void IRAM_ATTR esp_heap_trace_alloc_hook(void *ptr, size_t size, uint32_t caps)
+{
+    TaskHandle_t task = NULL;
+    bool guarded = xPortInIsrContext();
+
+    if (!sys_heap_guard_armed)
+    {
+        return;
+    }
+    if (!guarded)
+    {
+        task = xTaskGetCurrentTaskHandle();
+        for (int i = 0; i < sys_heap_guard_task_num; i++)
+        {
+            guarded |= sys_heap_guard_tasks[i] == task;
+        }
+    }
+    if (!guarded)
+    {
+        return;
+    }
+#if SYS_HEAP_GUARD_ABORT
+    abort();
+#endif
+    portENTER_CRITICAL_SAFE(&sys_heap_guard_lock);
+    sys_heap_guard_record.allocs++;
+    sys_heap_guard_record.last_size = size;
+    sys_heap_guard_record.last_task = task;
+    portEXIT_CRITICAL_SAFE(&sys_heap_guard_lock);
+}
+#endif
+
+void IRAM_ATTR sys_isr_exit(sys_isr_t isr, uint32_t start)
+{
+    uint32_t cycles = esp_cpu_get_cycle_count() - start;
+
+    if (!xPortInIsrContext())
+    {
+        return;
+    }
+    portENTER_CRITICAL_ISR(&sys_isr_lock);
+    sys_isrs[isr].calls++;
+    sys_isrs[isr].cycles += cycles;
+    if (cycles > sys_isrs[isr].max_cycles)
+    {
+        sys_isrs[isr].max_cycles = cycles;
+    }
+    portEXIT_CRITICAL_ISR(&sys_isr_lock);
+}
+
+/*************************************************/
+// command tools:
+
+static int do_boot_cmd(int argc, char **argv)
+{
+    int64_t last_us = 0;
+
+    printf("%-16s %10s %10s\n", "stage", "at(ms)", "took(ms)");
+    for (int i = 0; i < boot_record_num; i++)
+    {
+        printf("%-16s %10.3f %10.3f\n", boot_records[i].stage,
+               boot_records[i].time_us / 1000.0,
+               (boot_records[i].time_us - last_us) / 1000.0);
+        last_us = boot_records[i].time_us;
+    }
+
+    return 0;
+}
+
+static void register_boot(void)
+{
+    const esp_console_cmd_t boot_cmd = {
+        .command = "boot",
+        .help = "Print the boot timing breakdown",
+        .hint = NULL,
+        .func = &do_boot_cmd,
+        .argtable = NULL};
+    ESP_ERROR_CHECK(esp_console_cmd_register(&boot_cmd));
+}
+
+static void print_heap(const char *name, uint32_t caps)
+{
+    printf("%-10s %8u %8u %8u %8u\n", name,
+           heap_caps_get_total_size(caps),
+           heap_caps_get_free_size(caps),
+           heap_caps_get_minimum_free_size(caps),
+           heap_caps_get_largest_free_block(caps));
+}
+
+static int do_mem_cmd(int argc, char **argv)
+{
+    // stack high water marks are in bytes, StackType_t is a byte on this port
+    printf("%-30s %6s %6s %6s\n", "task", "stack", "used", "free");
+    for (int i = 0; i < sys_task_num; i++)
+    {
+        uint32_t free_min = uxTaskGetStackHighWaterMark(sys_tasks[i].task);
+        printf("%-30s %6lu %6lu %6lu\n", pcTaskGetName(sys_tasks[i].task),
+               sys_tasks[i].stack_size, sys_tasks[i].stack_size - free_min, free_min);
+    }
+
+    printf("\n%-10s %8s %8s %8s %8s\n", "heap", "total", "free", "min", "largest");
+    print_heap("internal", MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    print_heap("dma", MALLOC_CAP_DMA);
+
+    printf("\n%-20s %6s %6s %6s %6s\n", "pool", "blocks", "size", "used", "peak");
+    for (int i = 0; i < sys_pool_num; i++)
+    {
+        sys_pool_t pool = *sys_pools[i];
+        printf("%-20s %6lu %6lu %6lu %6lu\n", pool.name, pool.blocks, pool.block_size, pool.used, pool.peak);
+    }
+
+#ifdef CONFIG_HEAP_USE_HOOKS
+    sys_heap_guard_record_t record;
+    portENTER_CRITICAL(&sys_heap_guard_lock);
+    record = sys_heap_guard_record;
+    portEXIT_CRITICAL(&sys_heap_guard_lock);
+    printf("\nheap guard %s, %d tasks, %lu allocations", sys_heap_guard_armed ? "armed" : "off",
+           sys_heap_guard_task_num, record.allocs);
+    if (record.allocs)
+    {
+        printf(", last %lu bytes from %s", record.last_size, record.last_task ? pcTaskGetName(record.last_task) : "isr");
+    }
+    printf("\n");
+#else
+    printf("\nheap guard needs CONFIG_HEAP_USE_HOOKS\n");
+#endif
+
+
+    return 0;
+}
+
+static void register_mem(void)
+{
+    const esp_console_cmd_t mem_cmd = {
+        .command = "mem",
+        .help = "Print task stack high water marks, heap minimums, pool usage and the heap guard",
+        .hint = NULL,
+        .func = &do_mem_cmd,
+        .argtable = NULL};
+    ESP_ERROR_CHECK(esp_console_cmd_register(&mem_cmd));
+}
+
+static struct
+{
+    struct arg_int *window;
+    struct arg_end *end;
+} top_args;
+
+// snapshots are large, keep them off the console task stack
+static TaskStatus_t top_before[SYS_TOP_TASK_MAX];
+static TaskStatus_t top_after[SYS_TOP_TASK_MAX];
+static UBaseType_t top_switches[SYS_TOP_TASK_MAX];
+static sys_isr_record_t top_isrs[SYS_ISR_MAX];
+
+static int do_top_cmd(int argc, char **argv)
+{
+    uint32_t window_ms = SYS_TOP_WINDOW_DEFAULT_ms;
+    uint32_t total_before, total_after;
+    UBaseType_t num_before, num_after;
+
+    int nerrors = arg_parse(argc, argv, (void **)&top_args);
+    if (nerrors != 0)
+    {
+        arg_print_errors(stderr, top_args.end, argv[0]);
+        return 0;
+    }
+    if (top_args.window->count && top_args.window->ival[0] > 0)
+    {
+        window_ms = top_args.window->ival[0];
+    }
+
+    num_before = uxTaskGetSystemState(top_before, SYS_TOP_TASK_MAX, &total_before);
+    for (int i = 0; i < num_before; i++)
+    {
+        top_switches[i] = uxTaskGetTaskNumber(top_before[i].xHandle);
+    }
+    portENTER_CRITICAL(&sys_isr_lock);
+    for (int i = 0; i < SYS_ISR_MAX; i++)
+    {
+        sys_isrs[i].max_cycles = 0;
+    }
+    memcpy(top_isrs, sys_isrs, sizeof(sys_isrs));
+    portEXIT_CRITICAL(&sys_isr_lock);
+
+    vTaskDelay(pdMS_TO_TICKS(window_ms));
+
+    num_after = uxTaskGetSystemState(top_after, SYS_TOP_TASK_MAX, &total_after);
+    if (num_before == 0 || num_after == 0)
+    {
+        printf("more than %d tasks, raise SYS_TOP_TASK_MAX\n", SYS_TOP_TASK_MAX);
+        return 0;
+    }
+
+    // run time counters are esp_timer microseconds per task, summed over both cores
+    uint64_t elapsed = (uint32_t)(total_after - total_before) * (uint64_t)portNUM_PROCESSORS;
+    printf("%-30s %4s %6s %9s\n", "task", "core", "cpu%", "switches");
+    for (int i = 0; i < num_after; i++)
+    {
+        for (int j = 0; j < num_before; j++)
+        {
+            if (top_after[i].xHandle != top_before[j].xHandle)
+            {
+                continue;
+            }
+            uint32_t run = top_after[i].ulRunTimeCounter - top_before[j].ulRunTimeCounter;
+            UBaseType_t switches = uxTaskGetTaskNumber(top_after[i].xHandle) - top_switches[j];
+            BaseType_t core = xTaskGetAffinity(top_after[i].xHandle);
+            char core_name[5] = "any";
+            if (core != tskNO_AFFINITY)
+            {
+                snprintf(core_name, sizeof(core_name), "%d", (int)core);
+            }
+            printf("%-30s %4s %5.1f%% %9u\n", top_after[i].pcTaskName, core_name,
+                   elapsed ? run * 100.0 / elapsed : 0.0, switches);
+            break;
+        }
+    }
+
+    // isr callbacks run inside the tasks' time above, this is their share of it
+    uint32_t cpu_mhz = esp_clk_cpu_freq() / 1000000;
+    printf("\n%-30s %8s %10s %8s %6s\n", "isr", "calls", "total(us)", "max(us)", "cpu%");
+    for (int i = 0; i < SYS_ISR_MAX; i++)
+    {
+        sys_isr_record_t now;
+        portENTER_CRITICAL(&sys_isr_lock);
+        now = sys_isrs[i];
+        portEXIT_CRITICAL(&sys_isr_lock);
+        uint64_t total_us = (now.cycles - top_isrs[i].cycles) / cpu_mhz;
+        printf("%-30s %8u %10llu %8u %5.1f%%\n", sys_isr_names[i],
+               now.calls - top_isrs[i].calls, total_us, now.max_cycles / cpu_mhz,
+               elapsed ? total_us * 100.0 / elapsed : 0.0);
+    }
+
+    return 0;
+}
+
+static void register_top(void)
+{
+    top_args.window = arg_int0("w", "window", "<ms>", "Sampling window (default 1000ms)");
+    top_args.end = arg_end(2);
+    const esp_console_cmd_t top_cmd = {
+        .command = "top",
+        .help = "Sample per task CPU usage, context switches and isr callback time",
+        .hint = NULL,
+        .func = &do_top_cmd,
+        .argtable = &top_args};
+    ESP_ERROR_CHECK(esp_console_cmd_register(&top_cmd));
+}
+
+void register_systools(void)
+{
+    register_boot();
+    register_mem();
+    register_top();
+}
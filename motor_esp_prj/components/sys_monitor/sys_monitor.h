@@ -0,0 +1,58 @@
+#ifndef _SYS_MONITOR_H_
+#define _SYS_MONITOR_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_attr.h"
+#include "esp_cpu.h"
+
+// boot stages, timestamps are esp_timer time (systimer, counting since reset)
+void sys_boot_mark(const char *stage);
+// tasks listed by the mem command, stack_size in bytes as passed to xTaskCreate
+void sys_task_register(TaskHandle_t task, uint32_t stack_size);
+
+// fixed block pools listed by the mem command, take/give are called under the owner's pool lock
+typedef struct
+{
+    const char *name;
+    uint32_t blocks;
+    uint32_t block_size;
+    uint32_t used;
+    uint32_t peak;
+    bool listed;
+} sys_pool_t;
+
+void sys_pool_take(sys_pool_t *pool);
+void sys_pool_give(sys_pool_t *pool);
+
+// once armed, any heap allocation from a guarded task or an isr is a violation, counted for the
+// mem command or, with SYS_HEAP_GUARD_ABORT, a panic with the allocating backtrace
+// needs CONFIG_HEAP_USE_HOOKS (ESP-IDF 5.1+), without it the guard only lists its tasks
+#define SYS_HEAP_GUARD_ABORT 0
+void sys_heap_guard_task(TaskHandle_t task);
+void sys_heap_guard_arm(void);
+
+// time spent in the callbacks we run from driver interrupts, listed by the top command
+typedef enum
+{
+    SYS_ISR_RMT_ENCODE = 0,
+    SYS_ISR_PCNT_WATCH,
+    SYS_ISR_LEDC_COUNT,
+    SYS_ISR_MCPWM_STEP,
+    SYS_ISR_LIMIT_LATCH,
+    SYS_ISR_RMT_DONE,
+    SYS_ISR_MAX,
+} sys_isr_t;
+
+FORCE_INLINE_ATTR uint32_t sys_isr_enter(void)
+{
+    return esp_cpu_get_cycle_count();
+}
+// calls from task context are ignored, e.g. the first fill done by rmt_transmit
+void sys_isr_exit(sys_isr_t isr, uint32_t start);
+
+void register_systools(void);
+
+#endif
@@ -0,0 +1,10 @@
+#ifndef _SYS_TRACE_H_
+#define _SYS_TRACE_H_
+
+/*
+ * Forced into every C unit by the project CMakeLists, only FreeRTOS tasks.c expands the hook.
+ * uxTaskNumber is otherwise unused, it counts how often the task was switched in (read by top).
+ */
+#define traceTASK_SWITCHED_IN() (pxCurrentTCB[xPortGetCoreID()]->uxTaskNumber++)
+
+#endif
@@ -0,0 +1,579 @@
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/stream_buffer.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_console.h"
+#include "argtable3/argtable3.h"
+
+#include "teach_replay.h"
+#include "sys_monitor.h"
+#include "stepper_app.h"
+
+static const char *TAG = "teach";
+
+/*
+ * Session file on the /data FAT partition:
+ *   header, then records of varint((dt_ms << 2) | tag) + zigzag varint(value)
+ *   tag 0 ~ 2: knob delta of axis X/Y/Z, tag 3: motor_speed in effect from here on
+ * A knob delta is a few x4 counts per 10ms poll, so most records take 2 bytes.
+ */
+#define TEACH_DIR "/data"
+#define TEACH_EXT ".tch"
+#define TEACH_NAME_MAX 8 // FAT is built without long file names
+#define TEACH_MAGIC 0x31484354 // "TCH1"
+#define TEACH_VERSION 2 // a version 1 delta moved step_basic, a count moves half of it
+#define TEACH_TAG_SPEED 3
+#define TEACH_DT_MAX 0x3FFFFFFF
+#define TEACH_RECORD_MAX 10 // two 5 byte varints
+
+typedef struct
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t reserved;
+} teach_file_header_t;
+
+typedef struct
+{
+    uint32_t time_ms;
+    int32_t delta;
+    uint32_t speed; // motor_speed the count was taken at, the jog moves by it
+    uint8_t axis;
+} teach_event_t;
+
+typedef enum
+{
+    TEACH_STATE_IDLE = 0,
+    TEACH_STATE_RECORD,
+    TEACH_STATE_REPLAY,
+} teach_state_t;
+
+#define TEACH_SCALE_MAX 10
+#define TEACH_GAP_DEFAULT_ms 500
+#define TEACH_BLOCK_SIZE 512
+// read ahead window, several FAT sector reads worth of records
+#define TEACH_STREAM_SIZE 4096
+#define TEACH_STREAM_TIMEOUT_ms 100
+
+// knob events wait here until the io task writes them out
+#define TEACH_EVENT_QUEUE_LENGTH 32
+static QueueHandle_t teach_event_queue = NULL;
+static uint8_t teach_event_queue_storage[TEACH_EVENT_QUEUE_LENGTH * sizeof(teach_event_t)];
+static StaticQueue_t teach_event_queue_buffer;
+
+static StreamBufferHandle_t teach_stream = NULL;
+static uint8_t teach_stream_storage[TEACH_STREAM_SIZE + 1];
+static StaticStreamBuffer_t teach_stream_buffer;
+
+// file access, record writer and replay read ahead
+TaskHandle_t task_teach_io_handle;
+#define task_teach_io_stackdepth 1024 * 4
+static StackType_t task_teach_io_stack[task_teach_io_stackdepth];
+static StaticTask_t task_teach_io_tcb;
+#define task_teach_io_priority 1
+
+// replay timing, above the motion tasks so dispatch is on time
+TaskHandle_t task_teach_play_handle;
+#define task_teach_play_stackdepth 1024 * 3
+static StackType_t task_teach_play_stack[task_teach_play_stackdepth];
+static StaticTask_t task_teach_play_tcb;
+#define task_teach_play_priority 2
+
+extern SemaphoreHandle_t motor_speed_semphr;
+extern uint32_t motor_speed;
+
+static volatile teach_state_t teach_state = TEACH_STATE_IDLE;
+static volatile bool teach_stop_request = false;
+static volatile bool teach_read_done = false;
+static FILE *teach_file = NULL;
+static char teach_name[TEACH_NAME_MAX + 1];
+static uint8_t teach_block[TEACH_BLOCK_SIZE];
+
+// replay options
+static uint32_t teach_scale = 1;
+static uint32_t teach_gap_ms = TEACH_GAP_DEFAULT_ms;
+
+// stats of the last session
+static uint32_t teach_records = 0;
+static uint32_t teach_bytes = 0;
+static uint32_t teach_dropped = 0;
+static uint32_t teach_underruns = 0;
+static uint32_t teach_duration_ms = 0;
+
+static uint32_t teach_get_motor_speed(void)
+{
+    uint32_t speed;
+
+    xSemaphoreTake(motor_speed_semphr, portMAX_DELAY);
+    speed = motor_speed;
+    xSemaphoreGive(motor_speed_semphr);
+
+    return speed;
+}
+
+static size_t teach_put_varint(uint8_t *buf, uint32_t value)
+{
+    size_t len = 0;
+
+    while (value >= 0x80)
+    {
+        buf[len++] = (value & 0x7F) | 0x80;
+        value >>= 7;
+    }
+    buf[len++] = value;
+    return len;
+}
+
+static inline uint32_t teach_zigzag(int32_t value)
+{
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static inline int32_t teach_unzigzag(uint32_t value)
+{
+    return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+/*************************************************/
+// record
+
+void teach_record_step(teach_axis_t axis, int delta)
+{
+    if (teach_state != TEACH_STATE_RECORD)
+    {
+        return;
+    }
+
+    // read as the jog reads it, without the semaphore, this never blocks
+    teach_event_t event = {
+        .time_ms = esp_timer_get_time() / 1000,
+        .delta = delta,
+        .speed = motor_speed,
+        .axis = axis,
+    };
+    if (xQueueSend(teach_event_queue, &event, 0) != pdTRUE)
+    {
+        teach_dropped++;
+    }
+}
+
+// runs while the recorded jogs stream, the flash cache goes off meanwhile: the step generator isrs are iram-safe
+static void teach_block_flush(size_t *len)
+{
+    if (*len && fwrite(teach_block, 1, *len, teach_file) != *len)
+    {
+        ESP_LOGW(TAG, "write %s failed", teach_name);
+    }
+    teach_bytes += *len;
+    *len = 0;
+}
+
+static void teach_block_put(size_t *len, uint32_t dt_ms, uint32_t tag, int32_t value)
+{
+    if (dt_ms > TEACH_DT_MAX)
+    {
+        dt_ms = TEACH_DT_MAX;
+    }
+    if (*len > TEACH_BLOCK_SIZE - TEACH_RECORD_MAX)
+    {
+        teach_block_flush(len);
+    }
+    *len += teach_put_varint(&teach_block[*len], (dt_ms << 2) | tag);
+    *len += teach_put_varint(&teach_block[*len], teach_zigzag(value));
+    teach_records++;
+}
+
+static void teach_record_session(void)
+{
+    teach_event_t event;
+    uint32_t start_ms = esp_timer_get_time() / 1000;
+    uint32_t last_ms = start_ms;
+    uint32_t speed = 0;
+    size_t len = 0;
+
+    while (!teach_stop_request)
+    {
+        if (!xQueueReceive(teach_event_queue, &event, pdMS_TO_TICKS(TEACH_STREAM_TIMEOUT_ms)))
+        {
+            continue;
+        }
+
+        uint32_t dt_ms = event.time_ms - last_ms;
+        if (event.speed != speed)
+        {
+            // replay rescales the deltas if the speed switch is elsewhere by then
+            teach_block_put(&len, dt_ms, TEACH_TAG_SPEED, event.speed);
+            speed = event.speed;
+            dt_ms = 0;
+        }
+        teach_block_put(&len, dt_ms, event.axis, event.delta);
+        last_ms = event.time_ms;
+    }
+    teach_block_flush(&len);
+    fclose(teach_file);
+    teach_file = NULL;
+    teach_duration_ms = esp_timer_get_time() / 1000 - start_ms;
+    ESP_LOGI(TAG, "recorded %s: %" PRIu32 " records, %" PRIu32 " bytes, %" PRIu32 " dropped",
+             teach_name, teach_records, teach_bytes, teach_dropped);
+    teach_state = TEACH_STATE_IDLE;
+}
+
+/*************************************************/
+// replay
+
+// stays ahead of the player by up to TEACH_STREAM_SIZE bytes, so a slow FAT read never stalls dispatch
+static void teach_read_session(void)
+{
+    size_t len;
+
+    while (!teach_stop_request && (len = fread(teach_block, 1, TEACH_BLOCK_SIZE, teach_file)) > 0)
+    {
+        size_t sent = 0;
+        while (sent < len && !teach_stop_request)
+        {
+            sent += xStreamBufferSend(teach_stream, &teach_block[sent], len - sent, pdMS_TO_TICKS(TEACH_STREAM_TIMEOUT_ms));
+        }
+        teach_bytes += len;
+    }
+    fclose(teach_file);
+    teach_file = NULL;
+    teach_read_done = true;
+}
+
+typedef struct
+{
+    uint8_t buf[64];
+    size_t len;
+    size_t pos;
+} teach_reader_t;
+
+static bool teach_stream_byte(teach_reader_t *reader, uint8_t *byte)
+{
+    while (reader->pos == reader->len)
+    {
+        reader->pos = 0;
+        reader->len = xStreamBufferReceive(teach_stream, reader->buf, sizeof(reader->buf), pdMS_TO_TICKS(TEACH_STREAM_TIMEOUT_ms));
+        if (reader->len)
+        {
+            break;
+        }
+        if (teach_stop_request || (teach_read_done && xStreamBufferBytesAvailable(teach_stream) == 0))
+        {
+            return false;
+        }
+        // the file is not done but nothing is buffered, flash fell behind
+        teach_underruns++;
+    }
+    *byte = reader->buf[reader->pos++];
+    return true;
+}
+
+static bool teach_stream_varint(teach_reader_t *reader, uint32_t *value)
+{
+    uint8_t byte;
+
+    *value = 0;
+    for (int shift = 0; shift < 35; shift += 7)
+    {
+        if (!teach_stream_byte(reader, &byte))
+        {
+            return false;
+        }
+        *value |= (uint32_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void teach_play_session(void)
+{
+    static teach_reader_t reader;
+    int64_t residue[TEACH_AXIS_MAX] = {0};
+    uint32_t rec_speed = 1;
+    uint64_t play_ms = 0;
+    uint32_t key, value;
+
+    reader.len = 0;
+    reader.pos = 0;
+
+    // let the read ahead fill before the first pulse
+    while (!teach_stop_request && !teach_read_done && xStreamBufferBytesAvailable(teach_stream) < TEACH_STREAM_SIZE / 2)
+    {
+        vTaskDelay(1);
+    }
+
+    TickType_t start_tick = xTaskGetTickCount();
+    while (teach_stream_varint(&reader, &key) && teach_stream_varint(&reader, &value))
+    {
+        uint32_t dt_ms = key >> 2;
+        uint32_t tag = key & 0x03;
+
+        // merge idle gaps, then compress time
+        if (teach_gap_ms && dt_ms > teach_gap_ms)
+        {
+            dt_ms = teach_gap_ms;
+        }
+        play_ms += dt_ms;
+        TickType_t due = start_tick + pdMS_TO_TICKS(play_ms / teach_scale);
+        int32_t wait = (int32_t)(due - xTaskGetTickCount());
+        if (wait > 0)
+        {
+            vTaskDelay(wait);
+        }
+
+        if (tag == TEACH_TAG_SPEED)
+        {
+            rec_speed = teach_unzigzag(value);
+            continue;
+        }
+
+        // steps per delta follow the speed switch, carry the remainder so the total stays exact
+        uint32_t speed_now = teach_get_motor_speed();
+        int64_t scaled = (int64_t)teach_unzigzag(value) * rec_speed + residue[tag];
+        int delta = scaled / speed_now;
+        residue[tag] = scaled - (int64_t)delta * speed_now;
+        if (delta)
+        {
+            // motion sets the pace when compressed time asks for more than the axis can step
+            stepper_motor_jog_send(tag, delta, portMAX_DELAY);
+        }
+        teach_records++;
+    }
+    teach_duration_ms = (xTaskGetTickCount() - start_tick) * portTICK_PERIOD_MS;
+
+    // the reader closes the file on its own once it sees the stop
+    while (!teach_read_done)
+    {
+        vTaskDelay(1);
+    }
+    xStreamBufferReset(teach_stream);
+    ESP_LOGI(TAG, "replayed %s: %" PRIu32 " records in %" PRIu32 "ms, %" PRIu32 " underruns",
+             teach_name, teach_records, teach_duration_ms, teach_underruns);
+    teach_state = TEACH_STATE_IDLE;
+}
+
+static void task_teach_io(void *Param)
+{
+    for (;;)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        if (teach_state == TEACH_STATE_RECORD)
+        {
+            teach_record_session();
+        }
+        else if (teach_state == TEACH_STATE_REPLAY)
+        {
+            teach_read_session();
+        }
+    }
+}
+
+static void task_teach_play(void *Param)
+{
+    for (;;)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        teach_play_session();
+    }
+}
+
+void teach_replay_activate(void)
+{
+    teach_event_queue = xQueueCreateStatic(TEACH_EVENT_QUEUE_LENGTH, sizeof(teach_event_t), teach_event_queue_storage, &teach_event_queue_buffer);
+    teach_stream = xStreamBufferCreateStatic(TEACH_STREAM_SIZE, 1, teach_stream_storage, &teach_stream_buffer);
+
+    task_teach_io_handle = xTaskCreateStatic(task_teach_io,
+                                             "task_teach_io",
+                                             task_teach_io_stackdepth,
+                                             NULL,
+                                             task_teach_io_priority,
+                                             task_teach_io_stack,
+                                             &task_teach_io_tcb);
+    sys_task_register(task_teach_io_handle, task_teach_io_stackdepth);
+
+    task_teach_play_handle = xTaskCreateStatic(task_teach_play,
+                                               "task_teach_play",
+                                               task_teach_play_stackdepth,
+                                               NULL,
+                                               task_teach_play_priority,
+                                               task_teach_play_stack,
+                                               &task_teach_play_tcb);
+    sys_task_register(task_teach_play_handle, task_teach_play_stackdepth);
+    sys_heap_guard_task(task_teach_play_handle);
+}
+
+/*************************************************/
+// command tools:
+
+static struct
+{
+    struct arg_str *record;
+    struct arg_str *play;
+    struct arg_int *scale;
+    struct arg_int *gap;
+    struct arg_lit *stop;
+    struct arg_end *end;
+} teach_args;
+
+static FILE *teach_open(const char *name, const char *mode)
+{
+    char path[sizeof(TEACH_DIR "/") + TEACH_NAME_MAX + sizeof(TEACH_EXT)];
+
+    if (strlen(name) == 0 || strlen(name) > TEACH_NAME_MAX || strchr(name, '/') || strchr(name, '.'))
+    {
+        ESP_LOGW(TAG, "name must be 1 ~ %d characters, no '/' or '.'", TEACH_NAME_MAX);
+        return NULL;
+    }
+    snprintf(path, sizeof(path), TEACH_DIR "/%s" TEACH_EXT, name);
+    FILE *file = fopen(path, mode);
+    if (file == NULL)
+    {
+        ESP_LOGW(TAG, "cannot open %s", path);
+        return NULL;
+    }
+    strcpy(teach_name, name);
+    return file;
+}
+
+static void teach_session_reset(void)
+{
+    teach_stop_request = false;
+    teach_read_done = false;
+    teach_records = 0;
+    teach_bytes = 0;
+    teach_dropped = 0;
+    teach_underruns = 0;
+    teach_duration_ms = 0;
+}
+
+static void teach_record_start(const char *name)
+{
+    teach_file_header_t header = {
+        .magic = TEACH_MAGIC,
+        .version = TEACH_VERSION,
+    };
+
+    teach_file = teach_open(name, "wb");
+    if (teach_file == NULL)
+    {
+        return;
+    }
+    fwrite(&header, sizeof(header), 1, teach_file);
+    teach_session_reset();
+    xQueueReset(teach_event_queue);
+    teach_state = TEACH_STATE_RECORD;
+    xTaskNotifyGive(task_teach_io_handle);
+    ESP_LOGI(TAG, "recording knob jogs to %s", teach_name);
+}
+
+static void teach_play_start(const char *name)
+{
+    teach_file_header_t header;
+
+    teach_file = teach_open(name, "rb");
+    if (teach_file == NULL)
+    {
+        return;
+    }
+    if (fread(&header, sizeof(header), 1, teach_file) != 1 || header.magic != TEACH_MAGIC || header.version != TEACH_VERSION)
+    {
+        ESP_LOGW(TAG, "%s is not a teach session", teach_name);
+        fclose(teach_file);
+        teach_file = NULL;
+        return;
+    }
+    teach_session_reset();
+    xStreamBufferReset(teach_stream);
+    teach_state = TEACH_STATE_REPLAY;
+    xTaskNotifyGive(task_teach_io_handle);
+    xTaskNotifyGive(task_teach_play_handle);
+    ESP_LOGI(TAG, "replaying %s at x%" PRIu32 ", idle gaps merged above %" PRIu32 "ms", teach_name, teach_scale, teach_gap_ms);
+}
+
+static int do_teach_cmd(int argc, char **argv)
+{
+    int nerrors = arg_parse(argc, argv, (void **)&teach_args);
+    if (nerrors != 0)
+    {
+        arg_print_errors(stderr, teach_args.end, argv[0]);
+        return 0;
+    }
+
+    if (teach_args.stop->count)
+    {
+        if (teach_state != TEACH_STATE_IDLE)
+        {
+            teach_stop_request = true;
+            ESP_LOGI(TAG, "stopping %s", teach_name);
+        }
+        return 0;
+    }
+
+    if (teach_args.record->count || teach_args.play->count)
+    {
+        if (teach_state != TEACH_STATE_IDLE)
+        {
+            ESP_LOGW(TAG, "%s is still %s, stop it first", teach_name, teach_state == TEACH_STATE_RECORD ? "recording" : "replaying");
+            return 0;
+        }
+        if (teach_args.scale->count)
+        {
+            if (teach_args.scale->ival[0] >= 1 && teach_args.scale->ival[0] <= TEACH_SCALE_MAX)
+                teach_scale = teach_args.scale->ival[0];
+            else
+                ESP_LOGW(TAG, "scale out of range, keep x%" PRIu32, teach_scale);
+        }
+        if (teach_args.gap->count)
+        {
+            if (teach_args.gap->ival[0] >= 0)
+                teach_gap_ms = teach_args.gap->ival[0];
+            else
+                ESP_LOGW(TAG, "gap out of range, keep %" PRIu32 "ms", teach_gap_ms);
+        }
+        if (teach_args.record->count)
+            teach_record_start(teach_args.record->sval[0]);
+        else
+            teach_play_start(teach_args.play->sval[0]);
+        return 0;
+    }
+
+    // status
+    const char *state_name[] = {"idle", "recording", "replaying"};
+    printf("state: %s %s\n", state_name[teach_state], teach_state == TEACH_STATE_IDLE ? "" : teach_name);
+    printf("last session: %s, %" PRIu32 " records, %" PRIu32 " bytes, %" PRIu32 "ms\n",
+           teach_name, teach_records, teach_bytes, teach_duration_ms);
+    printf("dropped: %" PRIu32 ", underruns: %" PRIu32 "\n", teach_dropped, teach_underruns);
+    printf("replay: x%" PRIu32 ", gap %" PRIu32 "ms\n", teach_scale, teach_gap_ms);
+    return 0;
+}
+
+static void register_teach(void)
+{
+    teach_args.record = arg_str0("r", "record", "<name>", "Record knob jogs to " TEACH_DIR "/<name>" TEACH_EXT);
+    teach_args.play = arg_str0("p", "play", "<name>", "Replay " TEACH_DIR "/<name>" TEACH_EXT " through the motors");
+    teach_args.scale = arg_int0("s", "scale", "<x>", "Replay time compression (1 ~ 10)");
+    teach_args.gap = arg_int0("g", "gap", "<ms>", "Merge idle gaps longer than this on replay, 0 keeps them");
+    teach_args.stop = arg_lit0("x", "stop", "Stop recording or replay");
+    teach_args.end = arg_end(2);
+    const esp_console_cmd_t teach_cmd = {
+        .command = "teach",
+        .help = "Teach and replay knob jog sessions, status without arguments",
+        .hint = NULL,
+        .func = &do_teach_cmd,
+        .argtable = &teach_args};
+    ESP_ERROR_CHECK(esp_console_cmd_register(&teach_cmd));
+}
+
+void register_teachtools(void)
+{
+    register_teach();
+}
@@ -0,0 +1,19 @@
+#ifndef _TEACH_REPLAY_H_
+#define _TEACH_REPLAY_H_
+
+#include <stdint.h>
+
+typedef enum
+{
+    TEACH_AXIS_X = 0,
+    TEACH_AXIS_Y,
+    TEACH_AXIS_Z,
+    TEACH_AXIS_MAX,
+} teach_axis_t;
+
+void teach_replay_activate(void);
+// called by the knob task once a jog delta is queued to motion, never blocks
+void teach_record_step(teach_axis_t axis, int delta);
+void register_teachtools(void);
+
+#endif
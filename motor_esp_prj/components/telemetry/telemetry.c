@@ -0,0 +1,289 @@
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "driver/gpio.h"
+#include "driver/uart.h"
+#include "esp_cpu.h"
+#include "esp_log.h"
+#include "esp_pm.h"
+#include "esp_timer.h"
+#include "esp_console.h"
+#include "esp_private/esp_clk.h"
+#include "argtable3/argtable3.h"
+
+#include "telemetry.h"
+#include "telemetry_frame.h"
+#include "ec11_encoder.h"
+#include "stepper_app.h"
+#include "stepper_motor_encoder.h"
+#include "sys_monitor.h"
+
+static const char *TAG = "telemetry";
+
+#define TELEMETRY_UART UART_NUM_1
+#define TELEMETRY_GPIO_TX GPIO_NUM_18
+#define TELEMETRY_BAUD 2000000    // 1kHz of frames takes a third of it
+#define TELEMETRY_BLOCK_FRAMES 16 // frames per half of the double buffer
+#define TELEMETRY_BLOCK_ms 50     // a half is handed over this often at most, slow rates send sooner
+#define TELEMETRY_BLOCK_SIZE (TELEMETRY_BLOCK_FRAMES * TELEMETRY_FRAME_SIZE)
+
+TaskHandle_t task_telemetry_handle;
+#define task_telemetry_stackdepth 1024 * 2
+static StackType_t task_telemetry_stack[task_telemetry_stackdepth];
+static StaticTask_t task_telemetry_tcb;
+#define task_telemetry_priority 1 // below every app task, a late half only costs frames
+#define task_telemetry_core 1     // away from the motion core
+
+// the sampler fills one half while the sender task has the other one in the uart driver
+static uint8_t telemetry_buf[2][TELEMETRY_BLOCK_SIZE];
+
+typedef struct
+{
+    uint32_t rate_hz; // 0 when off
+    uint32_t block_frames;
+    uint32_t seq;
+    int fill_half; // written by the sampler only
+    uint32_t fill;
+    int send_half;          // valid while sending
+    uint32_t send_len;
+    volatile bool sending;  // set by the sampler, cleared by the sender
+    volatile bool stopping; // the sampler hands over what it has and stops its timer
+    // statistics for the telem command
+    uint32_t frames;
+    uint32_t dropped;
+    uint64_t bytes;
+    uint32_t sample_count;
+    uint64_t sample_cycles;
+    uint32_t sample_cycles_max;
+} telemetry_state_t;
+
+static telemetry_state_t tm;
+static esp_timer_handle_t telemetry_timer = NULL;
+static esp_pm_lock_handle_t telemetry_pm_lock = NULL;
+
+static void telemetry_hand_over(void)
+{
+    tm.send_half = tm.fill_half;
+    tm.send_len = tm.fill * TELEMETRY_FRAME_SIZE;
+    tm.sending = true;
+    tm.fill_half ^= 1;
+    tm.fill = 0;
+    xTaskNotifyGive(task_telemetry_handle);
+}
+
+static void telemetry_sample(void *arg)
+{
+    uint32_t start = esp_cpu_get_cycle_count();
+    telemetry_frame_t frame;
+    stepper_axis_sample_t sample;
+
+    if (tm.stopping)
+    {
+        if (tm.fill && !tm.sending)
+        {
+            telemetry_hand_over();
+        }
+        esp_timer_stop(telemetry_timer);
+        tm.stopping = false;
+        return;
+    }
+
+    frame.seq = tm.seq++;
+    frame.t_us = (uint32_t)esp_timer_get_time();
+    frame.feed = stepper_feed_override_get();
+    for (int axis = 0; axis < TELEMETRY_AXES; axis++)
+    {
+        stepper_motor_sample(axis, &sample);
+        frame.axis[axis].pos = (int32_t)sample.pos;
+        frame.axis[axis].freq_hz = sample.freq_hz;
+        frame.axis[axis].knob = axis < EC11_KNOB_AXIS_MAX ? (int32_t)ec11_get_position(axis) : 0;
+        frame.axis[axis].queued = sample.queued > UINT8_MAX ? UINT8_MAX : sample.queued;
+        frame.axis[axis].pending = sample.pending > UINT8_MAX ? UINT8_MAX : sample.pending;
+    }
+
+    // both halves full, the uart is behind: the frame is lost, its seq stays taken
+    if (tm.fill == tm.block_frames)
+    {
+        tm.dropped++;
+    }
+    else
+    {
+        telemetry_frame_encode(&frame, &telemetry_buf[tm.fill_half][tm.fill * TELEMETRY_FRAME_SIZE]);
+        tm.fill++;
+    }
+    if (tm.fill == tm.block_frames && !tm.sending)
+    {
+        telemetry_hand_over();
+    }
+
+    uint32_t cycles = esp_cpu_get_cycle_count() - start;
+    tm.sample_count++;
+    tm.sample_cycles += cycles;
+    if (cycles > tm.sample_cycles_max)
+    {
+        tm.sample_cycles_max = cycles;
+    }
+}
+
+static void task_telemetry(void *Param)
+{
+    for (;;)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        // a copy into the driver's tx ring, the fifo interrupt drains it while the next half fills
+        int len = uart_write_bytes(TELEMETRY_UART, telemetry_buf[tm.send_half], tm.send_len);
+        if (len > 0)
+        {
+            tm.frames += len / TELEMETRY_FRAME_SIZE;
+            tm.bytes += len;
+        }
+        tm.sending = false;
+    }
+}
+
+void telemetry_activate(void)
+{
+    const uart_config_t uart_config = {
+        .baud_rate = TELEMETRY_BAUD,
+        .data_bits = UART_DATA_8_BITS,
+        .parity = UART_PARITY_DISABLE,
+        .stop_bits = UART_STOP_BITS_1,
+        .flow_ctrl = UART_HW_FLOWCTRL_DISABLE,
+        .source_clk = UART_SCLK_XTAL, // keeps the baud rate when the pm lowers the apb clock
+    };
+    // rx is unused, the driver wants more than the fifo; tx ring holds both halves
+    ESP_ERROR_CHECK(uart_driver_install(TELEMETRY_UART, 256, 2 * TELEMETRY_BLOCK_SIZE, 0, NULL, 0));
+    ESP_ERROR_CHECK(uart_param_config(TELEMETRY_UART, &uart_config));
+    ESP_ERROR_CHECK(uart_set_pin(TELEMETRY_UART, TELEMETRY_GPIO_TX, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE));
+
+    // held while streaming, light sleep would stop the uart mid frame
+    ESP_ERROR_CHECK(esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "telemetry", &telemetry_pm_lock));
+
+    const esp_timer_create_args_t telemetry_timer_args = {
+        .callback = telemetry_sample,
+        .name = "telemetry",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&telemetry_timer_args, &telemetry_timer));
+
+    task_telemetry_handle = xTaskCreateStaticPinnedToCore(task_telemetry,
+                                                          "task_telemetry",
+                                                          task_telemetry_stackdepth,
+                                                          NULL,
+                                                          task_telemetry_priority,
+                                                          task_telemetry_stack,
+                                                          &task_telemetry_tcb,
+                                                          task_telemetry_core);
+    sys_task_register(task_telemetry_handle, task_telemetry_stackdepth);
+    sys_heap_guard_task(task_telemetry_handle);
+
+    ESP_LOGI(TAG, "uart%d tx on gpio%d at %d baud, %d byte frames", TELEMETRY_UART, TELEMETRY_GPIO_TX, TELEMETRY_BAUD,
+             TELEMETRY_FRAME_SIZE);
+}
+
+bool telemetry_start(uint32_t rate_hz)
+{
+    if (rate_hz == 0 || rate_hz > TELEMETRY_RATE_MAX_HZ)
+    {
+        return false;
+    }
+    telemetry_stop();
+
+    uint32_t block_frames = rate_hz * TELEMETRY_BLOCK_ms / 1000;
+    block_frames = block_frames < 1 ? 1 : block_frames;
+    block_frames = block_frames > TELEMETRY_BLOCK_FRAMES ? TELEMETRY_BLOCK_FRAMES : block_frames;
+
+    // the timer is stopped and the sender idle, nothing else touches the state
+    memset(&tm, 0, sizeof(tm));
+    tm.rate_hz = rate_hz;
+    tm.block_frames = block_frames;
+    ESP_ERROR_CHECK(esp_pm_lock_acquire(telemetry_pm_lock));
+    ESP_ERROR_CHECK(esp_timer_start_periodic(telemetry_timer, 1000000 / rate_hz));
+    ESP_LOGI(TAG, "streaming at %luHz, %lu frames per block", rate_hz, block_frames);
+    return true;
+}
+
+void telemetry_stop(void)
+{
+    if (!tm.rate_hz)
+    {
+        return;
+    }
+    // the sampler runs in the esp_timer task, it stops its own timer after the last half
+    tm.stopping = true;
+    while (tm.stopping || tm.sending)
+    {
+        vTaskDelay(1);
+    }
+    ESP_ERROR_CHECK(esp_pm_lock_release(telemetry_pm_lock));
+    tm.rate_hz = 0;
+    ESP_LOGI(TAG, "stopped after %lu frames, %lu dropped", tm.frames, tm.dropped);
+}
+
+/*************************************************/
+// command tools:
+
+static struct
+{
+    struct arg_int *rate;
+    struct arg_lit *off;
+    struct arg_end *end;
+} telem_args;
+
+static int do_telem_cmd(int argc, char **argv)
+{
+    int nerrors = arg_parse(argc, argv, (void **)&telem_args);
+    if (nerrors != 0)
+    {
+        arg_print_errors(stderr, telem_args.end, argv[0]);
+        return 0;
+    }
+
+    if (telem_args.off->count)
+    {
+        telemetry_stop();
+        return 0;
+    }
+    if (telem_args.rate->count)
+    {
+        if (!telemetry_start(telem_args.rate->ival[0]))
+        {
+            printf("rate must be 1 ~ %dHz\n", TELEMETRY_RATE_MAX_HZ);
+        }
+        return 0;
+    }
+
+    // a snapshot, the sampler may bump a counter while this copies
+    telemetry_state_t state = tm;
+    uint32_t cpu_mhz = esp_clk_cpu_freq() / 1000000;
+    uint32_t avg_cycles = state.sample_count ? state.sample_cycles / state.sample_count : 0;
+    if (state.rate_hz)
+    {
+        printf("streaming at %" PRIu32 "Hz on uart%d tx gpio%d, %d baud\n", state.rate_hz, TELEMETRY_UART, TELEMETRY_GPIO_TX,
+               TELEMETRY_BAUD);
+    }
+    else
+    {
+        printf("off\n");
+    }
+    printf("frames: %" PRIu32 " sent, %" PRIu32 " dropped, %" PRIu64 " bytes\n", state.frames, state.dropped, state.bytes);
+    printf("sample: avg %" PRIu32 "us, max %" PRIu32 "us, %" PRIu32 ".%02" PRIu32 "%% of a core\n", avg_cycles / cpu_mhz,
+           state.sample_cycles_max / cpu_mhz, avg_cycles * state.rate_hz / cpu_mhz / 10000,
+           avg_cycles * state.rate_hz / cpu_mhz / 100 % 100);
+    return 0;
+}
+
+void register_telemetrytools(void)
+{
+    telem_args.rate = arg_int0("r", "rate", "<Hz>", "Start streaming at this sample rate, 1 ~ 1000");
+    telem_args.off = arg_lit0(NULL, "off", "Stop streaming");
+    telem_args.end = arg_end(3);
+    const esp_console_cmd_t telem_cmd = {
+        .command = "telem",
+        .help = "Binary telemetry of every axis on the second uart, no arguments for its state",
+        .hint = NULL,
+        .func = &do_telem_cmd,
+        .argtable = &telem_args};
+    ESP_ERROR_CHECK(esp_console_cmd_register(&telem_cmd));
+}
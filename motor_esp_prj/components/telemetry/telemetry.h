@@ -0,0 +1,17 @@
+#ifndef _TELEMETRY_H_
+#define _TELEMETRY_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define TELEMETRY_RATE_MAX_HZ 1000
+
+// fixed size binary frames (telemetry_frame.h) of every axis on a second uart, tools/telemetry_csv
+// turns a capture into csv; off until started
+void telemetry_activate(void);
+// sample at rate_hz (1 ~ TELEMETRY_RATE_MAX_HZ), a running stream restarts at the new rate
+bool telemetry_start(uint32_t rate_hz);
+void telemetry_stop(void);
+void register_telemetrytools(void);
+
+#endif
@@ -0,0 +1,98 @@
+#include "telemetry_frame.h"
+
+#define TELEMETRY_AXIS_SIZE 16
+#define TELEMETRY_HEADER_SIZE 12
+#define TELEMETRY_CRC_OFFSET (TELEMETRY_FRAME_SIZE - 2)
+
+_Static_assert(TELEMETRY_HEADER_SIZE + TELEMETRY_AXES * TELEMETRY_AXIS_SIZE + 4 == TELEMETRY_FRAME_SIZE, "frame layout");
+
+uint16_t telemetry_crc16(const uint8_t *data, size_t len)
+{
+    uint16_t crc = 0xffff;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        crc ^= (uint16_t)data[i] << 8;
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+static void telemetry_put_u16(uint8_t *p, uint16_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+}
+
+static void telemetry_put_u32(uint8_t *p, uint32_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+static uint16_t telemetry_get_u16(const uint8_t *p)
+{
+    return p[0] | (uint16_t)p[1] << 8;
+}
+
+static uint32_t telemetry_get_u32(const uint8_t *p)
+{
+    return p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+void telemetry_frame_encode(const telemetry_frame_t *frame, uint8_t *bytes)
+{
+    uint8_t *p = bytes;
+
+    telemetry_put_u16(p, TELEMETRY_SYNC);
+    p[2] = TELEMETRY_VERSION;
+    p[3] = TELEMETRY_AXES;
+    telemetry_put_u32(p + 4, frame->seq);
+    telemetry_put_u32(p + 8, frame->t_us);
+    p += TELEMETRY_HEADER_SIZE;
+    for (int i = 0; i < TELEMETRY_AXES; i++)
+    {
+        const telemetry_axis_t *axis = &frame->axis[i];
+        telemetry_put_u32(p, (uint32_t)axis->pos);
+        telemetry_put_u32(p + 4, (uint32_t)axis->freq_hz);
+        telemetry_put_u32(p + 8, (uint32_t)axis->knob);
+        p[12] = axis->queued;
+        p[13] = axis->pending;
+        p[14] = 0;
+        p[15] = 0;
+        p += TELEMETRY_AXIS_SIZE;
+    }
+    telemetry_put_u16(p, frame->feed);
+    telemetry_put_u16(bytes + TELEMETRY_CRC_OFFSET, telemetry_crc16(bytes, TELEMETRY_CRC_OFFSET));
+}
+
+bool telemetry_frame_decode(const uint8_t *bytes, telemetry_frame_t *frame)
+{
+    const uint8_t *p = bytes;
+
+    if (telemetry_get_u16(p) != TELEMETRY_SYNC || p[2] != TELEMETRY_VERSION || p[3] != TELEMETRY_AXES ||
+        telemetry_get_u16(bytes + TELEMETRY_CRC_OFFSET) != telemetry_crc16(bytes, TELEMETRY_CRC_OFFSET))
+    {
+        return false;
+    }
+    frame->seq = telemetry_get_u32(p + 4);
+    frame->t_us = telemetry_get_u32(p + 8);
+    p += TELEMETRY_HEADER_SIZE;
+    for (int i = 0; i < TELEMETRY_AXES; i++)
+    {
+        telemetry_axis_t *axis = &frame->axis[i];
+        axis->pos = (int32_t)telemetry_get_u32(p);
+        axis->freq_hz = (int32_t)telemetry_get_u32(p + 4);
+        axis->knob = (int32_t)telemetry_get_u32(p + 8);
+        axis->queued = p[12];
+        axis->pending = p[13];
+        p += TELEMETRY_AXIS_SIZE;
+    }
+    frame->feed = telemetry_get_u16(p);
+    return true;
+}
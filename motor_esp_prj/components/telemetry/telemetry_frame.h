@@ -0,0 +1,67 @@
+#ifndef _TELEMETRY_FRAME_H
+#define _TELEMETRY_FRAME_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TELEMETRY_SYNC 0x5aa5 // first two bytes of a frame, a5 5a on the wire
+#define TELEMETRY_VERSION 1
+#define TELEMETRY_AXES 3
+#define TELEMETRY_FRAME_SIZE 64
+
+/**
+ * @brief One axis of a sample
+ */
+typedef struct {
+    int32_t pos;     // commanded position in steps, low 32 bits
+    int32_t freq_hz; // commanded step rate, negative counterclockwise
+    int32_t knob;    // knob position in quadrature counts, low 32 bits
+    uint8_t queued;  // jog requests waiting for the executor
+    uint8_t pending; // transactions of the started jog still out
+} telemetry_axis_t;
+
+/**
+ * @brief One sample, as TELEMETRY_FRAME_SIZE bytes on the wire
+ *
+ * Every field little endian, in this order: sync u16, version u8, axes u8, seq u32, t_us u32,
+ * then per axis pos i32, freq_hz i32, knob i32, queued u8, pending u8 and two zero bytes, then
+ * feed u16 and the crc u16 over all bytes before it. A frame the sampler had no room for still
+ * takes its seq, the reader sees the gap.
+ */
+typedef struct {
+    uint32_t seq;  // sample number since the stream was started
+    uint32_t t_us; // sample time, esp_timer low 32 bits
+    uint16_t feed; // feed override in percent
+    telemetry_axis_t axis[TELEMETRY_AXES];
+} telemetry_frame_t;
+
+/**
+ * @brief CRC-16/CCITT-FALSE, poly 0x1021, init 0xffff
+ */
+uint16_t telemetry_crc16(const uint8_t *data, size_t len);
+
+/**
+ * @brief Write a frame as its wire bytes, crc included
+ *
+ * @param[out] bytes TELEMETRY_FRAME_SIZE bytes
+ */
+void telemetry_frame_encode(const telemetry_frame_t *frame, uint8_t *bytes);
+
+/**
+ * @brief Read a frame from its wire bytes
+ *
+ * @param[in] bytes TELEMETRY_FRAME_SIZE bytes
+ * @return false for a wrong sync, version, axis count or crc
+ */
+bool telemetry_frame_decode(const uint8_t *bytes, telemetry_frame_t *frame);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -1,5 +1,7 @@
 #include <stdio.h>
 #include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 #include "esp_system.h"
 #include "esp_log.h"
 #include "esp_console.h"
@@ -9,6 +11,13 @@
 
 #include "user_console.h"
 #include "stepper_app.h"
+#include "idle_manager.h"
+#include "sys_monitor.h"
+#include "teach_replay.h"
+#include "deferred_log.h"
+#include "pos_journal.h"
+#include "motion_exec.h"
+#include "telemetry.h"
 
 /* Console command history can be stored to and loaded from a file.
  * The easiest way to do this is to use FATFS filesystem on top of
@@ -20,6 +29,12 @@
 
 static const char *TAG = "user_console";
 
+// storage and console come up on the other core while app_main brings up motion
+TaskHandle_t task_console_boot_handle;
+#define task_console_boot_stackdepth 1024 * 4
+#define task_console_boot_priority 1
+#define task_console_boot_core 1
+
 static void initialize_filesystem(void)
 {
     static wl_handle_t wl_handle;
@@ -34,24 +49,56 @@ static void initialize_filesystem(void)
     }
 }
 
-void user_console_activate(void)
+static void task_console_boot(void *Param)
 {
     esp_console_repl_t *repl = NULL;
     esp_console_repl_config_t repl_config = ESP_CONSOLE_REPL_CONFIG_DEFAULT();
 
     repl_config.prompt = "user_cmd=>";
-    repl_config.max_cmdline_length = 20;
+    repl_config.max_cmdline_length = 48;
     repl_config.history_save_path = HISTORY_PATH;
 
+    // may format a blank partition, which takes seconds
     initialize_filesystem();
+    sys_boot_mark("fat_mount");
+
+    // commands touch motion state, wait until app_main is done with it
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
 
     /* Register commands */
     esp_console_register_help_command();
     register_motortools();
+    register_idletools();
+    register_systools();
+    register_teachtools();
+    register_logtools();
+    register_journaltools();
+    register_exectools();
+    register_telemetrytools();
     /*********************/
 
+    // the repl loads history from the mounted partition
     esp_console_dev_uart_config_t hw_config = ESP_CONSOLE_DEV_UART_CONFIG_DEFAULT();
     ESP_ERROR_CHECK(esp_console_new_repl_uart(&hw_config, &repl_config, &repl));
 
     ESP_ERROR_CHECK(esp_console_start_repl(repl));
+    sys_boot_mark("console");
+
+    vTaskDelete(NULL);
+}
+
+void user_console_activate(void)
+{
+    xTaskCreatePinnedToCore(task_console_boot,
+                            "task_console_boot",
+                            task_console_boot_stackdepth,
+                            NULL,
+                            task_console_boot_priority,
+                            &task_console_boot_handle,
+                            task_console_boot_core);
+}
+
+void user_console_start(void)
+{
+    xTaskNotifyGive(task_console_boot_handle);
 }
\ No newline at end of file
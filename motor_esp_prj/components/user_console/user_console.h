@@ -2,5 +2,6 @@
 #define _USER_CONSOLE_H_
 
 void user_console_activate(void);
+void user_console_start(void);
 
 #endif
@@ -11,14 +11,41 @@
 #include "speed_switch.h"
 #include "user_console.h"
 #include "user_nvs.h"
+#include "idle_manager.h"
+#include "sys_monitor.h"
+#include "teach_replay.h"
+#include "deferred_log.h"
+#include "pos_journal.h"
+#include "motion_exec.h"
+#include "telemetry.h"
 
 void app_main(void)
 {
+    sys_boot_mark("app_main");
+    // from here on ESP_LOGx only queues, the UART is written from the console core
+    deferred_log_activate();
+
+    // FAT mount and console run in the background, motion comes up first
+    user_console_activate();
+
     user_nvs_init();
-    ec11_activate();
+    sys_boot_mark("nvs");
+    idle_manager_activate();
     // freq_test_activate();
     speed_switch_activate();
+    // positions from before the reset, the stepper side picks them up
+    pos_journal_activate();
+    sys_boot_mark("journal");
     stepper_motor_activate();
+    sys_boot_mark("stepper_motor");
+    ec11_activate();
+    // consumers are ready, knobs go live last, wired to the one task that steps them
+    motion_exec_activate();
+    sys_boot_mark("knobs_live");
+    teach_replay_activate();
+    telemetry_activate();
+    // every motion object exists now, the motion tasks must not allocate from here on
+    sys_heap_guard_arm();
 
-    user_console_activate();
+    user_console_start();
 }
\ No newline at end of file
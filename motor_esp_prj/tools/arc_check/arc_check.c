@@ -0,0 +1,235 @@
+/*
+ * Host check of the midpoint arc stepper.
+ *
+ * components/stepper_motor/stepper_arc.c is run over a sweep of radii, start angles, spans and both
+ * directions, in the center and the radius form. Every point of the step sequence is measured
+ * against the ideal arc (allowing for an end point given off the circle), the sequence has to end
+ * exactly on the end point, and the direction runs the firmware sends as separate transactions have
+ * to replay the same steps.
+ *
+ * usage: arc_check [--csv] [--tol steps]
+ * exits non zero when any arc leaves the tolerance
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "stepper_arc.h"
+
+static const int64_t check_radii[] = {1, 2, 3, 5, 10, 37, 100, 1000, 12345, 100000};
+static const double check_spans_deg[] = {1, 30, 89, 90, 135, 179, 180, 181, 270, 359, 360};
+#define CHECK_START_ANGLES 16
+
+typedef struct {
+    uint64_t arcs;
+    uint64_t steps;
+    uint64_t runs;
+    double max_dev;
+    uint64_t failures;
+} check_stats_t;
+
+static bool check_csv = false;
+static double check_tol = 1.0;
+
+// distance from a point to the arc of radius r from angle t0 over span (signed), around the origin
+static double check_arc_distance(double a, double b, double r, double t0, double span)
+{
+    double t = atan2(b, a);
+    double rel = span >= 0 ? t - t0 : t0 - t;
+    double len = fabs(span);
+
+    rel = fmod(rel, 2 * M_PI);
+    if (rel < 0)
+    {
+        rel += 2 * M_PI;
+    }
+    if (rel <= len + 1e-12 || len >= 2 * M_PI - 1e-12)
+    {
+        return fabs(hypot(a, b) - r);
+    }
+    double t1 = t0 + span;
+    double d0 = hypot(a - r * cos(t0), b - r * sin(t0));
+    double d1 = hypot(a - r * cos(t1), b - r * sin(t1));
+    return d0 < d1 ? d0 : d1;
+}
+
+static void check_arc(check_stats_t *stats, const stepper_arc_t *start, int64_t ca, int64_t cb, int64_t ea, int64_t eb, double span)
+{
+    stepper_arc_t arc = *start;
+    stepper_arc_t runner = *start;
+    stepper_arc_step_t step;
+    double r = sqrt((double)start->r2);
+    // an end point given off the circle can't be closer than its own distance to it
+    double allow = check_tol + fabs(hypot((double)start->end_a, (double)start->end_b) - r);
+    double t0 = atan2((double)start->b, (double)start->a);
+    uint64_t limit = (uint64_t)(8 * r + 64);
+    uint64_t steps = 0;
+    double dev = 0;
+    bool ok = true;
+
+    while (stepper_arc_next(&arc, &step))
+    {
+        double d = check_arc_distance((double)arc.a, (double)arc.b, r, t0, span);
+        if (d > dev)
+        {
+            dev = d;
+        }
+        if (++steps > limit)
+        {
+            ok = false;
+            break;
+        }
+    }
+    if (arc.a != start->end_a || arc.b != start->end_b)
+    {
+        ok = false;
+    }
+
+    // the runs have to cover the same steps, each with one direction per axis
+    uint64_t run_steps = 0;
+    uint64_t runs = 0;
+    int dir_a, dir_b;
+    for (uint64_t n; ok && (n = stepper_arc_run(&runner, &dir_a, &dir_b)) != 0;)
+    {
+        run_steps += n;
+        runs++;
+        if (runs > 16)
+        {
+            break;
+        }
+    }
+    if (run_steps != steps || runner.a != arc.a || runner.b != arc.b)
+    {
+        ok = false;
+    }
+
+    stats->arcs++;
+    stats->steps += steps;
+    stats->runs += runs;
+    if (dev > stats->max_dev)
+    {
+        stats->max_dev = dev;
+    }
+    if (!ok || dev > allow)
+    {
+        if (stats->failures++ < 10)
+        {
+            fprintf(stderr, "fail: center %lld,%lld end %lld,%lld %s span %.1f deg: steps %llu dev %.3f end %lld,%lld\n",
+                    (long long)ca, (long long)cb, (long long)ea, (long long)eb, start->cw ? "cw" : "ccw", span * 180 / M_PI,
+                    (unsigned long long)steps, dev, (long long)arc.a, (long long)arc.b);
+        }
+    }
+}
+
+static void check_print(const char *form, int64_t radius, const check_stats_t *s)
+{
+    if (check_csv)
+    {
+        printf("%s,%lld,%llu,%llu,%llu,%.4f,%llu\n", form, (long long)radius, (unsigned long long)s->arcs,
+               (unsigned long long)s->steps, (unsigned long long)s->runs, s->max_dev, (unsigned long long)s->failures);
+    }
+    else
+    {
+        printf("%-6s %8lld %6llu %12llu %6llu %10.4f %8llu\n", form, (long long)radius, (unsigned long long)s->arcs,
+               (unsigned long long)s->steps, (unsigned long long)s->runs, s->max_dev, (unsigned long long)s->failures);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    uint64_t failures = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--csv") == 0)
+        {
+            check_csv = true;
+        }
+        else if (strcmp(argv[i], "--tol") == 0 && i + 1 < argc)
+        {
+            check_tol = strtod(argv[++i], NULL);
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [--csv] [--tol steps]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    if (check_csv)
+    {
+        printf("form,radius,arcs,steps,runs,max_dev,failures\n");
+    }
+    else
+    {
+        printf("%-6s %8s %6s %12s %6s %10s %8s\n", "form", "radius", "arcs", "steps", "runs", "max dev", "failures");
+    }
+
+    for (int form = 0; form < 2; form++)
+    {
+        for (size_t ri = 0; ri < sizeof(check_radii) / sizeof(check_radii[0]); ri++)
+        {
+            int64_t radius = check_radii[ri];
+            check_stats_t stats = {0};
+
+            for (int k = 0; k < CHECK_START_ANGLES; k++)
+            {
+                double t0 = 2 * M_PI * k / CHECK_START_ANGLES + 0.1;
+                for (size_t si = 0; si < sizeof(check_spans_deg) / sizeof(check_spans_deg[0]); si++)
+                {
+                    for (int cw = 0; cw < 2; cw++)
+                    {
+                        double span = check_spans_deg[si] * M_PI / 180 * (cw ? -1 : 1);
+                        // start on the integer grid, center offset from it
+                        int64_t ca = llround(-radius * cos(t0));
+                        int64_t cb = llround(-radius * sin(t0));
+                        double rr = hypot((double)ca, (double)cb);
+                        double ts = atan2((double)-cb, (double)-ca);
+                        int64_t ea = ca + llround(rr * cos(ts + span));
+                        int64_t eb = cb + llround(rr * sin(ts + span));
+                        stepper_arc_t arc;
+                        bool valid;
+
+                        if (form == 0)
+                        {
+                            valid = stepper_arc_init_center(&arc, ea, eb, ca, cb, cw);
+                        }
+                        else
+                        {
+                            // the radius form can't say a full turn, and near a half turn it is ill conditioned
+                            if (fabs(fabs(span) - M_PI) < 0.05 || fabs(span) >= 2 * M_PI - 0.05 || (ea == 0 && eb == 0))
+                            {
+                                continue;
+                            }
+                            valid = stepper_arc_init_radius(&arc, ea, eb, fabs(span) > M_PI ? -radius : radius, cw);
+                            ts = atan2((double)arc.b, (double)arc.a);
+                        }
+                        if (!valid)
+                        {
+                            if (stats.failures++ < 10)
+                            {
+                                fprintf(stderr, "fail: %s r %lld span %.1f rejected\n", form ? "radius" : "center", (long long)radius, span * 180 / M_PI);
+                            }
+                            continue;
+                        }
+                        // a tiny span on a small circle rounds onto the start, which asks for a full turn
+                        if (ea == 0 && eb == 0)
+                        {
+                            span = cw ? -2 * M_PI : 2 * M_PI;
+                        }
+                        else
+                        {
+                            double te = atan2((double)arc.end_b, (double)arc.end_a);
+                            span = cw ? -fmod(ts - te + 4 * M_PI, 2 * M_PI) : fmod(te - ts + 4 * M_PI, 2 * M_PI);
+                        }
+                        check_arc(&stats, &arc, ca, cb, ea, eb, span);
+                    }
+                }
+            }
+            check_print(form ? "radius" : "center", radius, &stats);
+            failures += stats.failures;
+        }
+    }
+
+    return failures ? 1 : 0;
+}
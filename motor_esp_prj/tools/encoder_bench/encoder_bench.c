@@ -0,0 +1,424 @@
+/*
+ * Host benchmark of the RMT stepper encoders.
+ *
+ * The encoders from components/stepper_motor are built unchanged against host stubs and run
+ * through a fake channel that reports MEM_FULL the way the driver does (a full 48 word block first,
+ * then half block refills), so every run crosses the same encode boundaries as on the chip. A
+ * uniform payload fits a 48 word block whole, its rows run on a BENCH_UNIFORM_MEM_SYMBOLS block
+ * instead so the refill path is timed too (a one symbol payload can't fill any block).
+ *
+ * Curve rows also time the two things the firmware does around a ramp: pool ns is a create and
+ * delete of the curve encoder (a pool slot, the table is not copied), table ns builds the ramp
+ * image holding the points the way tools/ramp_gen does. A ramp is at most STEPPER_RAMP_POINTS_MAX
+ * points, a larger count is split over several ramps to the end rate and played one after another.
+ *
+ * --rate reports the average step rate each uniform encoder mode really produces instead.
+ *
+ * usage: encoder_bench [--csv] [--rate] [--symbols N]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "rmt_fake.h"
+#include "stepper_motor_encoder.h"
+#include "stepper_move.h"
+#include "stepper_ramp.h"
+
+#define BENCH_MEM_BLOCK_SYMBOLS 48 // SOC_RMT_MEM_WORDS_PER_CHANNEL on ESP32-S3
+#define BENCH_UNIFORM_MEM_SYMBOLS 6 // smaller than a payload, the uniform encoder resumes after MEM_FULL
+#define BENCH_UNIFORM_FREQ_HZ 5000
+#define BENCH_CURVE_START_HZ 1000
+#define BENCH_CURVE_END_HZ 5000
+#define BENCH_BUILD_ROUNDS 200
+#define BENCH_CURVE_POINTS_MAX 5000
+#define BENCH_CURVE_RAMPS_MAX ((BENCH_CURVE_POINTS_MAX + STEPPER_RAMP_POINTS_MAX - 1) / STEPPER_RAMP_POINTS_MAX)
+#define BENCH_IMAGE_SIZE (sizeof(stepper_ramp_header_t) + BENCH_CURVE_RAMPS_MAX * sizeof(stepper_ramp_entry_t) + \
+                          BENCH_CURVE_POINTS_MAX * sizeof(uint32_t))
+
+typedef struct {
+    const char *encoder;
+    uint32_t resolution;
+    uint32_t size;          // payload symbols (uniform) or sample points (curve)
+    uint64_t symbols;       // symbols sent
+    uint64_t encode_calls;
+    uint64_t mem_full;
+    double ns_per_call;
+    double symbols_per_sec;
+    double pool_ns;         // encoder create and delete, 0 when not measured
+    double table_ns;        // ramp image build, 0 when not measured
+} bench_result_t;
+
+static const uint32_t bench_resolutions[] = {1000000, 10000000, 40000000};
+static const uint32_t bench_uniform_symbols[] = {1, 8, STEPPER_UNIFORM_MAX_SYMBOLS};
+static const uint32_t bench_curve_points[] = {100, 500, 1000, BENCH_CURVE_POINTS_MAX};
+static const uint32_t bench_rate_freqs[] = {20, 500, 3000, 15000, 18000, 33333, 60000};
+
+static bool bench_csv = false;
+
+static uint64_t bench_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void bench_print_header(void)
+{
+    if (bench_csv)
+    {
+        printf("encoder,resolution_hz,size,symbols,encode_calls,mem_full,ns_per_call,symbols_per_sec,pool_ns,table_ns\n");
+    }
+    else
+    {
+        printf("%-8s %12s %6s %12s %12s %10s %12s %14s %10s %12s\n",
+               "encoder", "resolution", "size", "symbols", "calls", "mem_full", "ns/call", "symbols/s", "pool ns", "table ns");
+    }
+}
+
+static void bench_print(const bench_result_t *r)
+{
+    if (bench_csv)
+    {
+        printf("%s,%u,%u,%llu,%llu,%llu,%.2f,%.0f,%.0f,%.0f\n",
+               r->encoder, r->resolution, r->size, (unsigned long long)r->symbols, (unsigned long long)r->encode_calls,
+               (unsigned long long)r->mem_full, r->ns_per_call, r->symbols_per_sec, r->pool_ns, r->table_ns);
+    }
+    else
+    {
+        printf("%-8s %12u %6u %12llu %12llu %10llu %12.2f %14.0f %10.0f %12.0f\n",
+               r->encoder, r->resolution, r->size, (unsigned long long)r->symbols, (unsigned long long)r->encode_calls,
+               (unsigned long long)r->mem_full, r->ns_per_call, r->symbols_per_sec, r->pool_ns, r->table_ns);
+    }
+}
+
+static void bench_finish(bench_result_t *r, const rmt_fake_channel_t *chan, uint64_t sent, uint64_t elapsed_ns)
+{
+    r->symbols = sent;
+    r->encode_calls = chan->encode_calls;
+    r->mem_full = chan->mem_full_events;
+    r->ns_per_call = chan->encode_calls ? (double)elapsed_ns / chan->encode_calls : 0;
+    r->symbols_per_sec = elapsed_ns ? sent * 1e9 / elapsed_ns : 0;
+}
+
+static int bench_uniform(uint32_t resolution, uint32_t symbols, uint64_t total)
+{
+    rmt_symbol_word_t mem[BENCH_UNIFORM_MEM_SYMBOLS];
+    rmt_fake_channel_t chan;
+    rmt_encoder_handle_t encoder = NULL;
+    stepper_motor_uniform_encoder_config_t config = {
+        .resolution = resolution,
+    };
+    stepper_motor_uniform_payload_t payload = {
+        .freq_hz = BENCH_UNIFORM_FREQ_HZ,
+        .symbols = symbols,
+    };
+    bench_result_t r = {
+        .encoder = "uniform",
+        .resolution = resolution,
+        .size = symbols,
+    };
+    uint64_t sent = 0;
+
+    if (rmt_new_stepper_motor_uniform_encoder(&config, &encoder) != ESP_OK)
+    {
+        return -1;
+    }
+    rmt_fake_channel_init(&chan, mem, BENCH_UNIFORM_MEM_SYMBOLS);
+
+    // one transaction per payload, as stepper_motor_run sends its chunks
+    uint64_t start = bench_now_ns();
+    while (sent < total)
+    {
+        sent += rmt_fake_transmit(&chan, encoder, &payload, sizeof(payload), 0);
+    }
+    bench_finish(&r, &chan, sent, bench_now_ns() - start);
+
+    rmt_del_encoder(encoder);
+    bench_print(&r);
+    return 0;
+}
+
+static int bench_dither(uint32_t resolution, uint64_t total)
+{
+    rmt_symbol_word_t mem[BENCH_MEM_BLOCK_SYMBOLS];
+    rmt_fake_channel_t chan;
+    rmt_encoder_handle_t encoder = NULL;
+    stepper_motor_uniform_encoder_config_t config = {
+        .resolution = resolution,
+        .flags.dither = 1,
+    };
+    stepper_motor_dither_payload_t payload = {
+        .freq_hz = BENCH_UNIFORM_FREQ_HZ,
+        .steps = total,
+    };
+    bench_result_t r = {
+        .encoder = "dither",
+        .resolution = resolution,
+        .size = 0,
+    };
+
+    if (rmt_new_stepper_motor_uniform_encoder(&config, &encoder) != ESP_OK)
+    {
+        return -1;
+    }
+    rmt_fake_channel_init(&chan, mem, BENCH_MEM_BLOCK_SYMBOLS);
+
+    // the whole move is one streamed transaction
+    uint64_t start = bench_now_ns();
+    uint64_t sent = rmt_fake_transmit(&chan, encoder, &payload, sizeof(payload), 0);
+    bench_finish(&r, &chan, sent, bench_now_ns() - start);
+
+    rmt_del_encoder(encoder);
+    bench_print(&r);
+    return 0;
+}
+
+// the points as ramps from the start rate, one per end rate up to BENCH_CURVE_END_HZ, as ramp_gen lays them out
+static uint32_t bench_curve_profiles(uint32_t resolution, uint32_t points, stepper_ramp_profile_t *profiles)
+{
+    uint32_t num = (points + STEPPER_RAMP_POINTS_MAX - 1) / STEPPER_RAMP_POINTS_MAX;
+
+    for (uint32_t i = 0; i < num; i++)
+    {
+        uint32_t end_hz = BENCH_CURVE_START_HZ + (BENCH_CURVE_END_HZ - BENCH_CURVE_START_HZ) * (i + 1) / num;
+        uint32_t left = points - i * STEPPER_RAMP_POINTS_MAX;
+        profiles[i] = (stepper_ramp_profile_t){resolution, BENCH_CURVE_START_HZ, end_hz,
+                                               left < STEPPER_RAMP_POINTS_MAX ? left : STEPPER_RAMP_POINTS_MAX};
+    }
+    return num;
+}
+
+static int bench_curve(uint32_t resolution, uint32_t points, uint64_t total)
+{
+    static uint8_t image[BENCH_IMAGE_SIZE];
+    stepper_ramp_profile_t profiles[BENCH_CURVE_RAMPS_MAX];
+    rmt_symbol_word_t mem[BENCH_MEM_BLOCK_SYMBOLS];
+    rmt_fake_channel_t chan;
+    rmt_encoder_handle_t encoder = NULL;
+    bench_result_t r = {
+        .encoder = "curve",
+        .resolution = resolution,
+        .size = points,
+    };
+    uint64_t sent = 0;
+    uint64_t elapsed = 0;
+
+    uint32_t num_ramps = bench_curve_profiles(resolution, points, profiles);
+    uint64_t start = bench_now_ns();
+    for (int i = 0; i < BENCH_BUILD_ROUNDS; i++)
+    {
+        if (!stepper_ramp_build(image, sizeof(image), profiles, num_ramps))
+        {
+            return -1;
+        }
+    }
+    r.table_ns = (double)(bench_now_ns() - start) / BENCH_BUILD_ROUNDS;
+
+    const stepper_ramp_entry_t *entries = stepper_ramp_entries(image);
+    stepper_motor_curve_encoder_config_t config = {
+        .resolution = resolution,
+        .sample_points = entries[0].points,
+        .start_freq_hz = entries[0].start_freq_hz,
+        .end_freq_hz = entries[0].end_freq_hz,
+        .table = (const rmt_symbol_word_t *)stepper_ramp_symbols(image, &entries[0]),
+    };
+    // create and delete only take a pool slot, as on the chip
+    start = bench_now_ns();
+    for (int i = 0; i < BENCH_BUILD_ROUNDS; i++)
+    {
+        if (rmt_new_stepper_motor_curve_encoder(&config, &encoder) != ESP_OK)
+        {
+            return -1;
+        }
+        rmt_del_encoder(encoder);
+    }
+    r.pool_ns = (double)(bench_now_ns() - start) / BENCH_BUILD_ROUNDS;
+
+    rmt_fake_channel_init(&chan, mem, BENCH_MEM_BLOCK_SYMBOLS);
+
+    // every ramp of the image as a whole curve per transaction, crossing a MEM_FULL every half block
+    while (sent < total)
+    {
+        for (uint32_t i = 0; i < num_ramps; i++)
+        {
+            config.sample_points = entries[i].points;
+            config.start_freq_hz = entries[i].start_freq_hz;
+            config.end_freq_hz = entries[i].end_freq_hz;
+            config.table = (const rmt_symbol_word_t *)stepper_ramp_symbols(image, &entries[i]);
+            if (rmt_new_stepper_motor_curve_encoder(&config, &encoder) != ESP_OK)
+            {
+                return -1;
+            }
+            start = bench_now_ns();
+            sent += rmt_fake_transmit(&chan, encoder, &config.sample_points, sizeof(config.sample_points), 0);
+            elapsed += bench_now_ns() - start;
+            rmt_del_encoder(encoder);
+        }
+    }
+    bench_finish(&r, &chan, sent, elapsed);
+
+    bench_print(&r);
+    return 0;
+}
+
+typedef struct {
+    uint64_t ticks;
+    uint64_t steps;
+} bench_rate_sink_t;
+
+static void bench_rate_sink(void *user_ctx, rmt_symbol_word_t symbol)
+{
+    bench_rate_sink_t *sink = (bench_rate_sink_t *)user_ctx;
+
+    sink->ticks += symbol.duration0 + symbol.duration1;
+    // a step is a rising edge, filler symbols stay low
+    if (symbol.level1 && !symbol.level0)
+    {
+        sink->steps++;
+    }
+}
+
+static int bench_rate_one(const char *mode, uint32_t resolution, bool dither, uint32_t freq_hz)
+{
+    rmt_symbol_word_t mem[BENCH_MEM_BLOCK_SYMBOLS];
+    rmt_fake_channel_t chan;
+    rmt_encoder_handle_t encoder = NULL;
+    stepper_motor_uniform_encoder_config_t config = {
+        .resolution = resolution,
+        .flags.dither = dither,
+    };
+    bench_rate_sink_t sink = {0};
+    // about a second of motion, at least a thousand steps
+    uint64_t steps = freq_hz > 1000 ? freq_hz : 1000;
+
+    if (rmt_new_stepper_motor_uniform_encoder(&config, &encoder) != ESP_OK)
+    {
+        return -1;
+    }
+    rmt_fake_channel_init(&chan, mem, BENCH_MEM_BLOCK_SYMBOLS);
+    rmt_fake_channel_set_sink(&chan, bench_rate_sink, &sink);
+
+    if (dither)
+    {
+        stepper_motor_dither_payload_t payload = {
+            .freq_hz = freq_hz,
+            .steps = steps,
+        };
+        rmt_fake_transmit(&chan, encoder, &payload, sizeof(payload), 0);
+    }
+    else
+    {
+        // looped identical symbols, as the looped move path sends them
+        stepper_motor_uniform_payload_t payload = {
+            .freq_hz = freq_hz,
+            .symbols = 1,
+        };
+        rmt_fake_transmit(&chan, encoder, &payload, sizeof(payload), (int)steps);
+    }
+    rmt_del_encoder(encoder);
+
+    double rate = sink.ticks ? (double)sink.steps * resolution / sink.ticks : 0;
+    double error_ppm = (rate - freq_hz) * 1e6 / freq_hz;
+    if (bench_csv)
+    {
+        printf("%s,%u,%u,%llu,%.4f,%.1f\n", mode, resolution, freq_hz, (unsigned long long)sink.steps, rate, error_ppm);
+    }
+    else
+    {
+        printf("%-8s %12u %8u %10llu %14.4f %12.1f\n", mode, resolution, freq_hz, (unsigned long long)sink.steps, rate, error_ppm);
+    }
+    return 0;
+}
+
+static int bench_rate(void)
+{
+    if (bench_csv)
+    {
+        printf("mode,resolution_hz,freq_hz,steps,measured_hz,error_ppm\n");
+    }
+    else
+    {
+        printf("%-8s %12s %8s %10s %14s %12s\n", "mode", "resolution", "freq", "steps", "measured Hz", "error ppm");
+    }
+    for (size_t i = 0; i < sizeof(bench_rate_freqs) / sizeof(bench_rate_freqs[0]); i++)
+    {
+        uint32_t freq_hz = bench_rate_freqs[i];
+        if (bench_rate_one("uniform", 1000000, false, freq_hz) ||
+            bench_rate_one("dither", 1000000, true, freq_hz) ||
+            bench_rate_one("auto", stepper_pick_resolution(freq_hz), true, freq_hz))
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    uint64_t total = 4000000;
+    bool rate = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--csv") == 0)
+        {
+            bench_csv = true;
+        }
+        else if (strcmp(argv[i], "--rate") == 0)
+        {
+            rate = true;
+        }
+        else if (strcmp(argv[i], "--symbols") == 0 && i + 1 < argc)
+        {
+            total = strtoull(argv[++i], NULL, 0);
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [--csv] [--rate] [--symbols N]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    if (rate)
+    {
+        if (bench_rate())
+        {
+            fprintf(stderr, "uniform encoder failed\n");
+            return 1;
+        }
+        return 0;
+    }
+
+    bench_print_header();
+    for (size_t i = 0; i < sizeof(bench_resolutions) / sizeof(bench_resolutions[0]); i++)
+    {
+        for (size_t j = 0; j < sizeof(bench_uniform_symbols) / sizeof(bench_uniform_symbols[0]); j++)
+        {
+            if (bench_uniform(bench_resolutions[i], bench_uniform_symbols[j], total))
+            {
+                fprintf(stderr, "uniform encoder failed\n");
+                return 1;
+            }
+        }
+        if (bench_dither(bench_resolutions[i], total))
+        {
+            fprintf(stderr, "uniform encoder failed\n");
+            return 1;
+        }
+    }
+    for (size_t i = 0; i < sizeof(bench_resolutions) / sizeof(bench_resolutions[0]); i++)
+    {
+        for (size_t j = 0; j < sizeof(bench_curve_points) / sizeof(bench_curve_points[0]); j++)
+        {
+            if (bench_curve(bench_resolutions[i], bench_curve_points[j], total))
+            {
+                fprintf(stderr, "curve encoder failed\n");
+                return 1;
+            }
+        }
+    }
+
+    return 0;
+}
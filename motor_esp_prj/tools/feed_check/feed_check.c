@@ -0,0 +1,252 @@
+/*
+ * Host check of the feed override.
+ *
+ * The uniform encoder from components/stepper_motor is run in dither mode on a fake channel, one
+ * long move per case, and the override (stepper_feed_override_set) is changed from the sink when
+ * the line has put out CHECK_CHANGE_STEP steps, the way the console or the feed knob change it
+ * while the move runs. Moves with ramps get the payload the step generator queues between an
+ * acceleration and a deceleration ramp, the slew limit taken from a ramp_gen style ramp up to the
+ * rate (stepper_ramp_accel); moves without ramps get none.
+ *
+ * Checked per case:
+ *   steps       every step of the move is put out, the override only moves them in time
+ *   100%        the override left at 100 gives the exact periods of a plain move
+ *   latency     without ramps the rate changes within one memory block and one encoder batch
+ *   accel       with ramps the rate, averaged over CHECK_WINDOW steps, changes no faster than the
+ *               ramp's mean acceleration
+ *   reached     the rate gets to nominal * percent / 100
+ *   end rate    with ramps the last period is on the nominal rate, where the deceleration ramp starts
+ *
+ * usage: feed_check [--csv]
+ * exits non zero when a case fails
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "rmt_fake.h"
+#include "stepper_motor_encoder.h"
+#include "stepper_move.h"
+#include "stepper_ramp.h"
+
+#define CHECK_MEM_BLOCK_SYMBOLS 48 // SOC_RMT_MEM_WORDS_PER_CHANNEL on ESP32-S3
+#define CHECK_STEPS 30000
+#define CHECK_CHANGE_STEP 3000
+#define CHECK_WINDOW 100        // steps, averages the dither out of the rate
+#define CHECK_RAMP_START_HZ 500 // tools/ramp_gen defaults
+#define CHECK_RAMP_POINTS 400
+#define CHECK_FREQ_MIN_HZ 400
+
+static const uint32_t check_freqs[] = {3000, 18000, 60000};
+static const uint32_t check_percents[] = {100, 10, 50, 150, 200};
+
+static bool check_csv = false;
+
+typedef struct {
+    uint32_t percent; // set once the line reaches CHECK_CHANGE_STEP
+    uint8_t level;
+    uint64_t t;       // ticks since the start of the move
+    uint64_t last_rise;
+    uint64_t steps;
+    uint32_t periods[CHECK_STEPS]; // rise to rise, the first one from the start
+} check_line_t;
+
+static void check_line_level(check_line_t *line, uint8_t level, uint32_t ticks)
+{
+    if (ticks == 0)
+    {
+        return;
+    }
+    if (level && !line->level)
+    {
+        if (line->steps < CHECK_STEPS)
+        {
+            line->periods[line->steps] = (uint32_t)(line->t - line->last_rise);
+        }
+        line->last_rise = line->t;
+        line->steps++;
+        if (line->steps == CHECK_CHANGE_STEP)
+        {
+            stepper_feed_override_set(line->percent);
+        }
+    }
+    line->level = level;
+    line->t += ticks;
+}
+
+static void check_sink(void *user_ctx, rmt_symbol_word_t symbol)
+{
+    check_line_t *line = (check_line_t *)user_ctx;
+
+    check_line_level(line, symbol.level0, symbol.duration0);
+    check_line_level(line, symbol.level1, symbol.duration1);
+}
+
+// mean rate of the window starting at a step
+static double check_window_hz(const check_line_t *line, uint64_t start, uint32_t resolution, double *ticks)
+{
+    uint64_t sum = 0;
+
+    for (uint64_t i = start; i < start + CHECK_WINDOW; i++)
+    {
+        sum += line->periods[i];
+    }
+    *ticks = sum;
+    return (double)CHECK_WINDOW * resolution / sum;
+}
+
+static bool check_case(uint32_t resolution, uint32_t freq_hz, uint32_t percent, bool ramps)
+{
+    static check_line_t line;
+    rmt_symbol_word_t mem[CHECK_MEM_BLOCK_SYMBOLS];
+    rmt_fake_channel_t chan;
+    rmt_encoder_handle_t encoder = NULL;
+    stepper_motor_uniform_encoder_config_t config = {
+        .resolution = resolution,
+        .flags.dither = 1,
+    };
+    stepper_ramp_entry_t ramp = {
+        .resolution = resolution,
+        .start_freq_hz = CHECK_RAMP_START_HZ,
+        .end_freq_hz = freq_hz,
+        .points = CHECK_RAMP_POINTS,
+    };
+    stepper_motor_dither_payload_t payload = {
+        .freq_hz = freq_hz,
+        .steps = CHECK_STEPS,
+        .first = !ramps,
+        .ramp_in = ramps,
+        .ramp_out = ramps,
+        .accel = ramps ? stepper_ramp_accel(&ramp) : 0,
+    };
+    const char *broken = NULL;
+    double target = (double)freq_hz * percent / 100;
+    double period = (double)resolution / freq_hz;
+    double accel_max = 0;
+    double reached = freq_hz;
+    int64_t latency = -1;
+
+    if (rmt_new_stepper_motor_uniform_encoder(&config, &encoder) != ESP_OK)
+    {
+        fprintf(stderr, "no encoder at %uHz resolution\n", resolution);
+        return false;
+    }
+    memset(&line, 0, sizeof(line));
+    line.percent = percent;
+    stepper_feed_override_set(100);
+    rmt_fake_channel_init(&chan, mem, CHECK_MEM_BLOCK_SYMBOLS);
+    rmt_fake_channel_set_sink(&chan, check_sink, &line);
+    rmt_fake_transmit(&chan, encoder, &payload, sizeof(payload), 0);
+    rmt_del_encoder(encoder);
+    stepper_feed_override_set(100);
+
+    // the first period also holds the start of the line, it is left out below
+    for (uint64_t i = 1; i < CHECK_STEPS && latency < 0; i++)
+    {
+        if (fabs(line.periods[i] - period) > 1.0)
+        {
+            latency = (int64_t)i - CHECK_CHANGE_STEP;
+        }
+    }
+    double prev_ticks = 0;
+    double prev_hz = 0;
+    for (uint64_t start = 1; start + CHECK_WINDOW <= CHECK_STEPS; start += CHECK_WINDOW)
+    {
+        double ticks;
+        double hz = check_window_hz(&line, start, resolution, &ticks);
+        if (prev_ticks > 0)
+        {
+            // a window is off by one tick at most, its rate by hz / ticks
+            double dt = (prev_ticks + ticks) / 2 / resolution;
+            double accel = fabs(hz - prev_hz) / dt;
+            double slack = (hz / ticks + prev_hz / prev_ticks) / dt;
+            if (accel - slack > accel_max)
+            {
+                accel_max = accel - slack;
+            }
+        }
+        if (fabs(hz - target) < fabs(reached - target))
+        {
+            reached = hz;
+        }
+        prev_ticks = ticks;
+        prev_hz = hz;
+    }
+    // the last period, the deceleration ramp goes on from its rate
+    double end_hz = (double)resolution / line.periods[CHECK_STEPS - 1];
+
+    if (line.steps != CHECK_STEPS)
+    {
+        broken = "steps lost";
+    }
+    else if (percent == 100 && latency >= 0)
+    {
+        broken = "periods moved at 100%";
+    }
+    else if (percent != 100 && !ramps && (latency < 0 || latency > CHECK_MEM_BLOCK_SYMBOLS + STEPPER_UNIFORM_MAX_SYMBOLS))
+    {
+        broken = "override late";
+    }
+    else if (ramps && accel_max > payload.accel * 1.01)
+    {
+        broken = "faster than the ramp's acceleration";
+    }
+    else if (fabs(reached - target) > target * 0.005)
+    {
+        broken = "override rate not reached";
+    }
+    else if (ramps && fabs(end_hz - freq_hz) > freq_hz * 0.005)
+    {
+        broken = "off nominal at the deceleration ramp";
+    }
+
+    if (check_csv)
+    {
+        printf("%u,%u,%u,%s,%lld,%.0f,%u,%.1f,%.1f,%s\n", resolution, freq_hz, percent, ramps ? "yes" : "no",
+               (long long)latency, accel_max, payload.accel, reached, end_hz, broken ? broken : "ok");
+    }
+    else
+    {
+        printf("%10u %8u %4u%% %5s %8lld %12.0f %12u %10.1f %10.1f  %s\n", resolution, freq_hz, percent,
+               ramps ? "yes" : "no", (long long)latency, accel_max, payload.accel, reached, end_hz, broken ? broken : "ok");
+    }
+    return broken == NULL;
+}
+
+int main(int argc, char **argv)
+{
+    bool ok = true;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--csv") == 0)
+        {
+            check_csv = true;
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [--csv]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    if (check_csv)
+    {
+        printf("resolution_hz,freq_hz,percent,ramps,latency_steps,accel_max,accel_limit,reached_hz,end_hz,result\n");
+    }
+    else
+    {
+        printf("%10s %8s %5s %5s %8s %12s %12s %10s %10s  %s\n", "resolution", "rate", "feed", "ramps", "latency",
+               "accel max", "accel limit", "reached", "end rate", "result");
+    }
+    uint32_t resolution = stepper_pick_resolution(CHECK_FREQ_MIN_HZ);
+    for (size_t f = 0; f < sizeof(check_freqs) / sizeof(check_freqs[0]); f++)
+    {
+        for (size_t p = 0; p < sizeof(check_percents) / sizeof(check_percents[0]); p++)
+        {
+            ok = check_case(resolution, check_freqs[f], check_percents[p], false) && ok;
+            ok = check_case(resolution, check_freqs[f], check_percents[p], true) && ok;
+        }
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,361 @@
+/*
+ * Host simulation of electronic gearing, a slave axis following a master step stream.
+ *
+ * The gear encoder from components/stepper_motor is run unchanged on fake RMT channels, once as the
+ * master and once per slave with the same payload, the way the firmware sends a geared jog move to a
+ * synced channel group. The pulse trains are rebuilt from the symbols, every rising edge is a step.
+ *
+ * Following error is the slave position against ratio * master position, where the master position
+ * runs linearly from one of its steps to the next. It is taken at every step of either axis and has
+ * to stay within one step. Moves are shaped like the firmware's (a ZV shaper makes several rate
+ * segments), each scenario runs a string of back and forth moves at the speed x100 rate and the gear
+ * remainder carries from move to move like stepper_gear_run does, the slave has to end every move on
+ * the nearest step to ratio * master (no drift) and make exactly the steps stepper_gear_follow says.
+ *
+ * usage: gear_sim [--csv] [--moves N] [--freq Hz] [--seed N]
+ * exits non zero when the error passes one step, a move drifts or the counts disagree
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "rmt_fake.h"
+#include "stepper_motor_encoder.h"
+#include "stepper_move.h"
+#include "stepper_shaper.h"
+#include "stepper_gear.h"
+
+#define SIM_MEM_BLOCK_SYMBOLS 48  // SOC_RMT_MEM_WORDS_PER_CHANNEL on ESP32-S3
+#define SIM_FREQ_HZ 18000         // FREQ_DEFAULT_x100
+#define SIM_FREQ_MIN_HZ 3000      // FREQ_DEFAULT_x1, picks the resolution
+#define SIM_MOVE_STEPS_MAX 20000
+#define SIM_EDGES_MAX (8 * SIM_MOVE_STEPS_MAX + 16)
+#define SIM_SLAVES_MAX 2
+
+typedef struct {
+    const char *name;
+    const char *ratio[SIM_SLAVES_MAX]; // NULL when unused
+    stepper_shaper_type_t shaper;
+} sim_scenario_t;
+
+static const sim_scenario_t sim_scenarios[] = {
+    {"1:1", {"1"}, STEPPER_SHAPER_NONE},
+    {"quarter", {"1/4"}, STEPPER_SHAPER_NONE},
+    {"third dec", {"0.3333"}, STEPPER_SHAPER_NONE},
+    {"reverse 3/7", {"-3/7"}, STEPPER_SHAPER_ZV},
+    {"7/8 zvd", {"7/8"}, STEPPER_SHAPER_ZVD},
+    {"up 3/2", {"1.5"}, STEPPER_SHAPER_ZV},
+    {"up 5/2", {"5/2"}, STEPPER_SHAPER_NONE},
+    {"reverse 8", {"-8"}, STEPPER_SHAPER_ZV},
+    {"two slaves", {"1", "-13/4"}, STEPPER_SHAPER_ZV},
+};
+
+static bool sim_csv = false;
+
+// rising edges seen on a channel, in ticks from the synced start
+typedef struct {
+    uint64_t t;
+    uint32_t level;
+    uint64_t edges[SIM_EDGES_MAX];
+    uint32_t num_edges;
+    uint32_t high_min; // narrowest pulse, in ticks
+} sim_train_t;
+
+static void sim_sink(void *ctx, rmt_symbol_word_t symbol)
+{
+    sim_train_t *train = ctx;
+    uint32_t levels[2] = {symbol.level0, symbol.level1};
+    uint32_t durations[2] = {symbol.duration0, symbol.duration1};
+
+    for (int i = 0; i < 2; i++)
+    {
+        if (levels[i] && !train->level && train->num_edges < SIM_EDGES_MAX)
+        {
+            train->edges[train->num_edges++] = train->t;
+        }
+        if (levels[i] && durations[i] < train->high_min)
+        {
+            train->high_min = durations[i];
+        }
+        train->level = levels[i];
+        train->t += durations[i];
+    }
+}
+
+static void sim_send(rmt_encoder_handle_t encoder, const stepper_motor_gear_payload_t *payload, sim_train_t *train)
+{
+    rmt_symbol_word_t mem[SIM_MEM_BLOCK_SYMBOLS];
+    rmt_fake_channel_t chan;
+
+    memset(train, 0, sizeof(*train));
+    train->high_min = UINT32_MAX;
+    rmt_fake_channel_init(&chan, mem, SIM_MEM_BLOCK_SYMBOLS);
+    rmt_fake_channel_set_sink(&chan, sim_sink, train);
+    rmt_fake_transmit(&chan, encoder, payload, sizeof(*payload), 0);
+}
+
+// master position at t, linear between its steps
+static double sim_master_at(const sim_train_t *master, uint64_t t)
+{
+    const uint64_t *e = master->edges;
+    uint32_t n = master->num_edges;
+
+    if (n == 0)
+    {
+        return 0;
+    }
+    if (t >= e[n - 1])
+    {
+        return n;
+    }
+    // before the first step, ramp in over the first period
+    if (t < e[0])
+    {
+        double period = n > 1 ? (double)(e[1] - e[0]) : (double)e[0];
+        double m = 1.0 - (e[0] - t) / period;
+        return m > 0 ? m : 0;
+    }
+    uint32_t lo = 0, hi = n - 1;
+    while (hi - lo > 1)
+    {
+        uint32_t mid = (lo + hi) / 2;
+        if (e[mid] <= t)
+        {
+            lo = mid;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    return lo + 1 + (double)(t - e[lo]) / (e[hi] - e[lo]);
+}
+
+typedef struct {
+    double err_max;      // steps
+    double rest_err_max; // after a move
+    uint32_t high_min;
+    double slave_gap_min_us; // closest slave steps
+    uint32_t moves;
+    uint32_t failures;
+} sim_stats_t;
+
+static void sim_run(const sim_scenario_t *scenario, uint32_t moves, uint32_t freq_hz, uint32_t resolution,
+                    rmt_encoder_handle_t *encoders, sim_stats_t *stats)
+{
+    static sim_train_t master_train;
+    static sim_train_t slave_trains[SIM_SLAVES_MAX];
+    stepper_gear_t gears[SIM_SLAVES_MAX];
+    uint32_t num_slaves = 0;
+    stepper_shaper_t shaper;
+    int64_t master_pos = 0;
+    int64_t slave_pos[SIM_SLAVES_MAX] = {0};
+
+    for (uint32_t i = 0; i < SIM_SLAVES_MAX && scenario->ratio[i]; i++, num_slaves++)
+    {
+        int32_t num;
+        uint32_t den;
+        if (!stepper_gear_parse(scenario->ratio[i], &num, &den) || !stepper_gear_init(&gears[i], num, den))
+        {
+            fprintf(stderr, "%s: bad ratio %s\n", scenario->name, scenario->ratio[i]);
+            stats->failures++;
+            return;
+        }
+    }
+    stepper_shaper_init(&shaper, scenario->shaper, 40.0f, 0.05f);
+    stats->err_max = 0;
+    stats->rest_err_max = 0;
+    stats->high_min = UINT32_MAX;
+    stats->slave_gap_min_us = INFINITY;
+
+    for (uint32_t move = 0; move < moves; move++)
+    {
+        stepper_motor_gear_payload_t payload = {0};
+        uint64_t steps = 1 + rand() % SIM_MOVE_STEPS_MAX;
+        int dir = rand() % 3 ? 1 : -1;
+
+        // as stepper_gear_run: the master cut as finely as its finest slave
+        payload.num_segments = stepper_shaper_apply(&shaper, freq_hz, steps, payload.segments);
+        payload.dir = dir;
+        stepper_gear_init(&payload.gear, 1, 1);
+        for (uint32_t i = 0; i < num_slaves; i++)
+        {
+            if (gears[i].split > payload.gear.split)
+            {
+                payload.gear.split = gears[i].split;
+            }
+        }
+        payload.axis = 0;
+        sim_send(encoders[0], &payload, &master_train);
+        if (master_train.num_edges != steps)
+        {
+            fprintf(stderr, "%s: master made %u of %llu steps\n", scenario->name, master_train.num_edges,
+                    (unsigned long long)steps);
+            stats->failures++;
+            return;
+        }
+        if (master_train.high_min < stats->high_min)
+        {
+            stats->high_min = master_train.high_min;
+        }
+
+        for (uint32_t i = 0; i < num_slaves; i++)
+        {
+            sim_train_t *slave = &slave_trains[i];
+            double ratio = (double)gears[i].num / gears[i].den;
+            int slave_dir = gears[i].num < 0 ? -dir : dir;
+
+            payload.axis = 1;
+            payload.gear = gears[i];
+            sim_send(encoders[1 + i], &payload, slave);
+            if (slave->t != master_train.t)
+            {
+                fprintf(stderr, "%s: slave train is %llu ticks, master %llu\n", scenario->name,
+                        (unsigned long long)slave->t, (unsigned long long)master_train.t);
+                stats->failures++;
+                return;
+            }
+
+            // error at every step of either axis, both trains run from the same synced start
+            uint32_t si = 0;
+            for (uint32_t mi = 0; mi <= master_train.num_edges; mi++)
+            {
+                uint64_t until = mi < master_train.num_edges ? master_train.edges[mi] : UINT64_MAX;
+                for (; si < slave->num_edges && slave->edges[si] <= until; si++)
+                {
+                    double m = master_pos + dir * sim_master_at(&master_train, slave->edges[si]);
+                    double err = fabs(slave_pos[i] + slave_dir * (int64_t)(si + 1) - ratio * m);
+                    stats->err_max = err > stats->err_max ? err : stats->err_max;
+                    if (si > 0)
+                    {
+                        double gap_us = (slave->edges[si] - slave->edges[si - 1]) * 1e6 / resolution;
+                        stats->slave_gap_min_us = gap_us < stats->slave_gap_min_us ? gap_us : stats->slave_gap_min_us;
+                    }
+                }
+                if (mi < master_train.num_edges)
+                {
+                    double m = master_pos + dir * (int64_t)(mi + 1);
+                    double err = fabs(slave_pos[i] + slave_dir * (int64_t)si - ratio * m);
+                    stats->err_max = err > stats->err_max ? err : stats->err_max;
+                }
+            }
+            if (slave->high_min < stats->high_min)
+            {
+                stats->high_min = slave->high_min;
+            }
+
+            // the firmware's bookkeeping has to agree with the pulses
+            int64_t followed = stepper_gear_follow(&gears[i], dir * (int64_t)steps);
+            if (followed != slave_dir * (int64_t)slave->num_edges)
+            {
+                fprintf(stderr, "%s: slave made %u steps, the gear says %lld\n", scenario->name, slave->num_edges,
+                        (long long)followed);
+                stats->failures++;
+                return;
+            }
+            slave_pos[i] += followed;
+            double rest = fabs(slave_pos[i] - ratio * (master_pos + dir * (int64_t)steps));
+            stats->rest_err_max = rest > stats->rest_err_max ? rest : stats->rest_err_max;
+        }
+        master_pos += dir * (int64_t)steps;
+        stats->moves++;
+    }
+    if (stats->err_max > 1.0 || stats->rest_err_max > 0.5 + 1e-9)
+    {
+        stats->failures++;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t moves = 40;
+    uint32_t freq_hz = SIM_FREQ_HZ;
+    unsigned seed = 1;
+    int rc = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--csv") == 0)
+        {
+            sim_csv = true;
+        }
+        else if (strcmp(argv[i], "--moves") == 0 && i + 1 < argc)
+        {
+            moves = strtoul(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "--freq") == 0 && i + 1 < argc)
+        {
+            freq_hz = strtoul(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+        {
+            seed = strtoul(argv[++i], NULL, 0);
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [--csv] [--moves N] [--freq Hz] [--seed N]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (freq_hz == 0)
+    {
+        fprintf(stderr, "freq must be above 0Hz\n");
+        return 2;
+    }
+    srand(seed);
+
+    uint32_t resolution = stepper_pick_resolution(SIM_FREQ_MIN_HZ < freq_hz ? SIM_FREQ_MIN_HZ : freq_hz);
+    stepper_motor_gear_encoder_config_t config = {
+        .resolution = resolution,
+    };
+    rmt_encoder_handle_t encoders[1 + SIM_SLAVES_MAX];
+    for (int i = 0; i < 1 + SIM_SLAVES_MAX; i++)
+    {
+        if (rmt_new_stepper_motor_gear_encoder(&config, &encoders[i]) != ESP_OK)
+        {
+            fprintf(stderr, "cannot create gear encoder %d\n", i);
+            return 1;
+        }
+    }
+
+    if (sim_csv)
+    {
+        printf("scenario,ratio,shaper,freq_hz,resolution_hz,moves,err_max_steps,rest_err_max_steps,pulse_min_us,slave_gap_min_us,result\n");
+    }
+    else
+    {
+        printf("master at %uHz, resolution %uHz\n", freq_hz, resolution);
+        printf("%-12s %-10s %-5s %6s %9s %9s %9s %9s %6s\n", "scenario", "ratio", "shape", "moves", "err max",
+               "rest err", "pulse us", "gap us", "result");
+    }
+    for (size_t i = 0; i < sizeof(sim_scenarios) / sizeof(sim_scenarios[0]); i++)
+    {
+        const sim_scenario_t *scenario = &sim_scenarios[i];
+        sim_stats_t stats = {0};
+        char ratio[32];
+
+        snprintf(ratio, sizeof(ratio), "%s%s%s", scenario->ratio[0], scenario->ratio[1] ? "," : "",
+                 scenario->ratio[1] ? scenario->ratio[1] : "");
+        sim_run(scenario, moves, freq_hz, resolution, encoders, &stats);
+        double pulse_us = stats.high_min * 1e6 / resolution;
+        const char *result = stats.failures ? "FAIL" : "ok";
+        if (sim_csv)
+        {
+            printf("%s,%s,%s,%u,%u,%u,%.3f,%.3f,%.2f,%.2f,%s\n", scenario->name, ratio,
+                   stepper_shaper_name(scenario->shaper), freq_hz, resolution, stats.moves, stats.err_max,
+                   stats.rest_err_max, pulse_us, stats.slave_gap_min_us, result);
+        }
+        else
+        {
+            printf("%-12s %-10s %-5s %6u %9.3f %9.3f %9.2f %9.2f %6s\n", scenario->name, ratio,
+                   stepper_shaper_name(scenario->shaper), stats.moves, stats.err_max, stats.rest_err_max, pulse_us,
+                   stats.slave_gap_min_us, result);
+        }
+        if (stats.failures)
+        {
+            rc = 1;
+        }
+    }
+
+    return rc;
+}
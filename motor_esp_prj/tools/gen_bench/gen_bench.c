@@ -0,0 +1,240 @@
+/*
+ * Host comparison of the step generator backends.
+ *
+ * Every backend gets the same one second move through stepper_gen_run. RMT is the firmware
+ * backend itself on a fake channel, LEDC and MCPWM are the fakes from host_stub that round each
+ * period the way their timers do. Reported per backend and rate:
+ *   error ppm   average rate against the asked one
+ *   jitter ns   longest minus shortest step period inside the move
+ *   irq/1k      interrupts the backend takes on the chip per 1000 steps (RMT: refills + done)
+ *   host ns     host time per step through the backend, only meaningful for RMT's encoder
+ *
+ * On the chip the interrupt cost of LEDC and MCPWM shows in the top command as "ledc count" and
+ * "mcpwm step", RMT's as "rmt encode".
+ *
+ * usage: gen_bench [--csv]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "rmt_fake.h"
+#include "stepper_motor_encoder.h"
+#include "stepper_move.h"
+#include "stepper_gen.h"
+#include "stepper_gen_fake.h"
+
+#define BENCH_MEM_BLOCK_SYMBOLS 48 // SOC_RMT_MEM_WORDS_PER_CHANNEL on ESP32-S3
+
+static const uint32_t bench_freqs[] = {100, 500, 3000, 15000, 18000, 33333, 60000};
+
+static bool bench_csv = false;
+
+typedef struct {
+    double elapsed_ns;
+    double period_min_ns;
+    double period_max_ns;
+    uint64_t steps;
+} bench_train_t;
+
+static uint64_t bench_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void bench_train_period(bench_train_t *train, double period_ns)
+{
+    if (train->steps == 0 || period_ns < train->period_min_ns)
+    {
+        train->period_min_ns = period_ns;
+    }
+    if (train->steps == 0 || period_ns > train->period_max_ns)
+    {
+        train->period_max_ns = period_ns;
+    }
+    train->elapsed_ns += period_ns;
+    train->steps++;
+}
+
+static void bench_fake_sink(void *user_ctx, double period_ns)
+{
+    bench_train_period((bench_train_t *)user_ctx, period_ns);
+}
+
+typedef struct {
+    bench_train_t *train;
+    double tick_ns;
+    double since_rise_ns; // time since the last rising edge
+    bool started;
+} bench_rmt_sink_t;
+
+static void bench_rmt_sink(void *user_ctx, rmt_symbol_word_t symbol)
+{
+    bench_rmt_sink_t *sink = (bench_rmt_sink_t *)user_ctx;
+
+    // a step period runs from the low half before its rising edge to the next one, filler symbols stay low
+    sink->since_rise_ns += symbol.duration0 * sink->tick_ns;
+    if (symbol.level1 && !symbol.level0)
+    {
+        if (sink->started)
+        {
+            bench_train_period(sink->train, sink->since_rise_ns);
+        }
+        sink->started = true;
+        sink->since_rise_ns = 0;
+    }
+    sink->since_rise_ns += symbol.duration1 * sink->tick_ns;
+}
+
+static void bench_print(const char *backend, uint32_t freq_hz, const bench_train_t *train, double irq_per_k, double host_ns)
+{
+    double rate = train->elapsed_ns > 0 ? train->steps * 1e9 / train->elapsed_ns : 0;
+    double error_ppm = (rate - freq_hz) * 1e6 / freq_hz;
+    double jitter_ns = train->period_max_ns - train->period_min_ns;
+
+    if (bench_csv)
+    {
+        printf("%s,%u,%llu,%.1f,%.1f,%.2f,%.1f\n", backend, freq_hz, (unsigned long long)train->steps, error_ppm, jitter_ns, irq_per_k, host_ns);
+    }
+    else
+    {
+        printf("%-6s %8u %10llu %12.1f %11.1f %9.2f %10.1f\n", backend, freq_hz, (unsigned long long)train->steps, error_ppm, jitter_ns, irq_per_k, host_ns);
+    }
+}
+
+static int bench_rmt(uint32_t freq_hz, uint64_t steps)
+{
+    rmt_symbol_word_t mem[BENCH_MEM_BLOCK_SYMBOLS];
+    rmt_fake_channel_t chan;
+    rmt_encoder_handle_t encoder = NULL;
+    stepper_gen_handle_t gen = NULL;
+    // the firmware picks the resolution from the slowest configured speed, here the move's own
+    uint32_t resolution = stepper_pick_resolution(freq_hz);
+    stepper_motor_uniform_encoder_config_t encoder_config = {
+        .resolution = resolution,
+        .flags.dither = 1,
+    };
+    stepper_segment_t segment = {
+        .freq_hz = freq_hz,
+        .steps = steps + 1, // the first rising edge starts the first measured period
+    };
+    bench_train_t train = {0};
+    bench_rmt_sink_t sink = {
+        .train = &train,
+        .tick_ns = 1e9 / resolution,
+    };
+
+    if (rmt_new_stepper_motor_uniform_encoder(&encoder_config, &encoder) != ESP_OK)
+    {
+        return -1;
+    }
+    rmt_fake_channel_init(&chan, mem, BENCH_MEM_BLOCK_SYMBOLS);
+    rmt_fake_channel_set_sink(&chan, bench_rmt_sink, &sink);
+    stepper_rmt_gen_config_t gen_config = {
+        .chan = &chan,
+        .encoder = encoder,
+        .flags.dither = 1,
+    };
+    if (stepper_new_rmt_gen(&gen_config, &gen) != ESP_OK)
+    {
+        rmt_del_encoder(encoder);
+        return -1;
+    }
+
+    uint64_t start = bench_now_ns();
+    esp_err_t err = stepper_gen_run(gen, &segment, 1);
+    uint64_t host_ns = bench_now_ns() - start;
+
+    stepper_gen_del(gen);
+    rmt_del_encoder(encoder);
+    if (err != ESP_OK)
+    {
+        return -1;
+    }
+    bench_print("rmt", freq_hz, &train, (chan.mem_full_events + chan.transactions) * 1000.0 / segment.steps, (double)host_ns / segment.steps);
+    return 0;
+}
+
+static int bench_fake(stepper_gen_backend_t model, uint32_t freq_hz, uint64_t steps)
+{
+    stepper_gen_handle_t gen = NULL;
+    bench_train_t train = {0};
+    stepper_gen_fake_config_t config = {
+        .model = model,
+        .sink = bench_fake_sink,
+        .sink_ctx = &train,
+    };
+    stepper_segment_t segment = {
+        .freq_hz = freq_hz,
+        .steps = steps,
+    };
+    stepper_gen_fake_stats_t stats;
+
+    if (stepper_new_fake_gen(&config, &gen) != ESP_OK)
+    {
+        return -1;
+    }
+    uint64_t start = bench_now_ns();
+    esp_err_t err = stepper_gen_run(gen, &segment, 1);
+    uint64_t host_ns = bench_now_ns() - start;
+    stepper_gen_fake_get_stats(gen, &stats);
+    stepper_gen_del(gen);
+
+    if (err != ESP_OK)
+    {
+        // out of the backend's range, not a failure of the bench
+        if (bench_csv)
+        {
+            printf("%s,%u,0,,,,\n", stepper_gen_backend_name(model), freq_hz);
+        }
+        else
+        {
+            printf("%-6s %8u %10s\n", stepper_gen_backend_name(model), freq_hz, "no rate");
+        }
+        return 0;
+    }
+    bench_print(stepper_gen_backend_name(model), freq_hz, &train, stats.interrupts * 1000.0 / stats.steps, (double)host_ns / stats.steps);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--csv") == 0)
+        {
+            bench_csv = true;
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [--csv]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    if (bench_csv)
+    {
+        printf("backend,freq_hz,steps,error_ppm,jitter_ns,irq_per_1k_steps,host_ns_per_step\n");
+    }
+    else
+    {
+        printf("%-6s %8s %10s %12s %11s %9s %10s\n", "gen", "freq", "steps", "error ppm", "jitter ns", "irq/1k", "host ns");
+    }
+    for (size_t i = 0; i < sizeof(bench_freqs) / sizeof(bench_freqs[0]); i++)
+    {
+        // about a second of motion, at least a thousand steps
+        uint64_t steps = bench_freqs[i] > 1000 ? bench_freqs[i] : 1000;
+        if (bench_rmt(bench_freqs[i], steps) ||
+            bench_fake(STEPPER_GEN_LEDC, bench_freqs[i], steps) ||
+            bench_fake(STEPPER_GEN_MCPWM, bench_freqs[i], steps))
+        {
+            fprintf(stderr, "step generator failed at %uHz\n", bench_freqs[i]);
+            return 1;
+        }
+    }
+
+    return 0;
+}
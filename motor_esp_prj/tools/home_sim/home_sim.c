@@ -0,0 +1,358 @@
+/*
+ * Host simulation of the homing cycle against a synthetic limit switch.
+ *
+ * components/stepper_motor/stepper_home.c is driven the way the firmware's homing task drives it.
+ * Each move is played step by step in time, the switch follows the carriage with hysteresis, bounce
+ * after every change and optional glitches, and every edge goes through the same latch rule as the
+ * firmware's limit isr: the generator's count of the steps out on the pin. A move's first pulse can
+ * come late after the arm (queueing, encoding, DIR setup), the latch doesn't see that. After a move the input is debounced the same way (quiet for the debounce
+ * time), waiting counts as homing time.
+ *
+ * Every scenario homes from random starts, some of them parked on the switch. Reported:
+ *   home err    switch point found against the true one, in steps (min / max)
+ *   latch err   largest seek latch error, covered by the slow zone
+ *   start       latency from arming the latch to the move's first period, in us
+ *   time        mean / max homing time, and the mean of a slow-only approach for comparison
+ *
+ * usage: home_sim [--csv] [--runs N] [--seed N]
+ * exits non zero when a cycle fails, the found point spreads over more than one step or a seek latch
+ * lands outside the slow zone
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "stepper_home.h"
+
+#define SIM_DEBOUNCE_us 2000     // STEP_LIMIT_DEBOUNCE_us
+#define SIM_SETTLE_TRIES 10      // STEP_LIMIT_SETTLE_TRIES
+#define SIM_MOVE_OVERHEAD_us 60  // transmit, wait and debounce read around every move
+#define SIM_GLITCH_us 20
+#define SIM_EDGE_MAX 4096
+
+typedef struct {
+    const char *name;
+    uint32_t seek_hz;
+    uint32_t locate_hz;
+    uint32_t slow_steps;
+    uint32_t hysteresis; // the switch releases this many steps past where it trips
+    double bounce_us;    // chatter after every change
+    double glitch_per_step;
+    double start_us; // the move's first period starts this late after the latch is armed
+} sim_scenario_t;
+
+static const sim_scenario_t sim_scenarios[] = {
+    {"clean", 6000, 400, 40, 0, 0, 0, 0},
+    {"hysteresis", 6000, 400, 40, 25, 0, 0, 0},
+    {"bounce", 6000, 400, 40, 25, 1500, 0, 0},
+    {"glitches", 6000, 400, 40, 25, 1500, 1e-3, 0},
+    {"wide hysteresis", 6000, 400, 40, 120, 1500, 1e-3, 0},
+    {"fast seek", 20000, 400, 60, 25, 1500, 1e-3, 0},
+    {"slow locate", 6000, 100, 40, 25, 1500, 1e-3, 0},
+    {"start latency", 20000, 400, 60, 25, 1500, 1e-3, 4000},
+};
+
+#define SIM_TRAVEL 50000 // random starts up to this far from the switch
+#define SIM_PARKED_EVERY 8 // every n-th run starts on the switch
+
+static bool sim_csv = false;
+
+typedef struct {
+    double t_us;
+    bool level;
+} sim_edge_t;
+
+// the carriage, its switch and the input as the isr sees it
+typedef struct {
+    const sim_scenario_t *scenario;
+    int64_t pos;          // switch frame, the switch trips at 0 coming from above
+    bool clean;           // switch state without bounce
+    bool level;           // input level
+    double t_us;
+    double last_edge_us;
+    // firmware isr state
+    bool tripped;
+    uint32_t trip_steps;
+    // the move on the pin, what the generator's count tells the isr
+    double start_us; // first period
+    uint32_t freq_hz;
+    uint32_t steps;
+    sim_edge_t edges[SIM_EDGE_MAX];
+    uint32_t num_edges;
+} sim_axis_t;
+
+static double sim_rand(void)
+{
+    return rand() / (RAND_MAX + 1.0);
+}
+
+static void sim_add_edge(sim_axis_t *axis, double t_us, bool level)
+{
+    if (axis->num_edges < SIM_EDGE_MAX)
+    {
+        axis->edges[axis->num_edges].t_us = t_us;
+        axis->edges[axis->num_edges].level = level;
+        axis->num_edges++;
+    }
+}
+
+static int sim_edge_cmp(const void *a, const void *b)
+{
+    double ta = ((const sim_edge_t *)a)->t_us;
+    double tb = ((const sim_edge_t *)b)->t_us;
+    return ta < tb ? -1 : ta > tb;
+}
+
+// the limit isr, same rule as step_limit_isr_handler
+static void sim_isr(sim_axis_t *axis, double now_us, bool level)
+{
+    if (level == axis->level)
+    {
+        return;
+    }
+    axis->level = level;
+    if (level && (!axis->tripped || now_us - axis->last_edge_us >= SIM_DEBOUNCE_us))
+    {
+        // the steps out on the pin, a pulse is out half a period before its period ends
+        double elapsed_us = now_us > axis->start_us ? now_us - axis->start_us : 0;
+        uint64_t on_pin = (uint64_t)(elapsed_us * axis->freq_hz + 500000) / 1000000;
+        axis->trip_steps = on_pin < axis->steps ? on_pin : axis->steps;
+        axis->tripped = true;
+    }
+    axis->last_edge_us = now_us;
+}
+
+// play edges up to a time
+static void sim_play(sim_axis_t *axis, double until_us)
+{
+    uint32_t n = 0;
+
+    qsort(axis->edges, axis->num_edges, sizeof(sim_edge_t), sim_edge_cmp);
+    while (n < axis->num_edges && axis->edges[n].t_us <= until_us)
+    {
+        sim_isr(axis, axis->edges[n].t_us, axis->edges[n].level);
+        n++;
+    }
+    memmove(axis->edges, axis->edges + n, (axis->num_edges - n) * sizeof(sim_edge_t));
+    axis->num_edges -= n;
+}
+
+// the switch changes, with chatter ending on the new state
+static void sim_switch(sim_axis_t *axis, double t_us, bool clean)
+{
+    axis->clean = clean;
+    sim_add_edge(axis, t_us, clean);
+    if (axis->scenario->bounce_us > 0)
+    {
+        int toggles = 2 * (1 + rand() % 4);
+        double t = t_us;
+        for (int i = 0; i < toggles; i++)
+        {
+            t += sim_rand() * axis->scenario->bounce_us / toggles;
+            sim_add_edge(axis, t, (i % 2) ? clean : !clean);
+        }
+    }
+}
+
+static void sim_move(sim_axis_t *axis, const stepper_home_move_t *move, stepper_home_latch_t *latch)
+{
+    const sim_scenario_t *scenario = axis->scenario;
+    double period_us = 1e6 / move->freq_hz;
+
+    axis->t_us += SIM_MOVE_OVERHEAD_us;
+    axis->tripped = false;
+    axis->start_us = axis->t_us + scenario->start_us;
+    axis->freq_hz = move->freq_hz;
+    axis->steps = move->steps;
+    for (uint32_t j = 1; j <= move->steps; j++)
+    {
+        // the pulse is the high half at the end of its period
+        double pulse_us = axis->start_us + (j - 0.5) * period_us;
+        axis->pos += move->dir;
+        bool clean = axis->clean;
+        if (!clean && axis->pos <= 0)
+        {
+            clean = true;
+        }
+        else if (clean && axis->pos > (int64_t)scenario->hysteresis)
+        {
+            clean = false;
+        }
+        if (clean != axis->clean)
+        {
+            sim_switch(axis, pulse_us, clean);
+        }
+        else if (!clean && sim_rand() < scenario->glitch_per_step)
+        {
+            sim_add_edge(axis, pulse_us, true);
+            sim_add_edge(axis, pulse_us + SIM_GLITCH_us, false);
+        }
+        if (axis->num_edges > SIM_EDGE_MAX / 2)
+        {
+            sim_play(axis, pulse_us);
+        }
+    }
+    axis->t_us = axis->start_us + move->steps * period_us;
+    sim_play(axis, axis->t_us);
+
+    // step_limit_active: wait for a quiet input
+    for (int i = 0; i < SIM_SETTLE_TRIES; i++)
+    {
+        double quiet_us = axis->t_us - axis->last_edge_us;
+        if (quiet_us >= SIM_DEBOUNCE_us)
+        {
+            break;
+        }
+        axis->t_us += SIM_DEBOUNCE_us - quiet_us;
+        sim_play(axis, axis->t_us);
+    }
+    latch->active = axis->level;
+    latch->tripped = axis->tripped;
+    latch->trip_steps = axis->trip_steps;
+}
+
+typedef struct {
+    uint32_t runs;
+    uint32_t failures;
+    int64_t err_min;
+    int64_t err_max;
+    int64_t latch_err_max;
+    double time_sum_us;
+    double time_max_us;
+    double slow_sum_us;
+} sim_stats_t;
+
+static void sim_run(const sim_scenario_t *scenario, sim_stats_t *stats, int run)
+{
+    static sim_axis_t axis;
+    stepper_home_config_t config = {
+        .dir = -1,
+        .seek_hz = scenario->seek_hz,
+        .locate_hz = scenario->locate_hz,
+        .travel_max = SIM_TRAVEL * 2,
+        .slow_steps = scenario->slow_steps,
+    };
+    stepper_home_t home;
+    stepper_home_move_t move;
+    stepper_home_latch_t latch;
+
+    memset(&axis, 0, sizeof(axis));
+    axis.scenario = scenario;
+    axis.last_edge_us = -1e9;
+    if (run % SIM_PARKED_EVERY == 0)
+    {
+        // parked somewhere on the switch, past its trip point
+        axis.pos = -(int64_t)(sim_rand() * 200);
+        axis.clean = axis.level = true;
+    }
+    else
+    {
+        axis.pos = 1 + (int64_t)(sim_rand() * SIM_TRAVEL);
+    }
+    int64_t start = axis.pos;
+
+    stepper_home_init(&home, &config, axis.level);
+    while (stepper_home_next(&home, &move))
+    {
+        sim_move(&axis, &move, &latch);
+        stepper_home_report(&home, &latch);
+    }
+
+    stats->runs++;
+    if (home.phase != STEPPER_HOME_DONE || axis.pos != start + home.pos)
+    {
+        stats->failures++;
+        return;
+    }
+    // the true switch point is 0, the first position that trips it from above
+    int64_t err = start + home.found;
+    if (stats->runs == 1 || err < stats->err_min)
+    {
+        stats->err_min = err;
+    }
+    if (stats->runs == 1 || err > stats->err_max)
+    {
+        stats->err_max = err;
+    }
+    int64_t latch_err = llabs(start + home.ref);
+    if (run % SIM_PARKED_EVERY && latch_err > stats->latch_err_max)
+    {
+        stats->latch_err_max = latch_err;
+    }
+    stats->time_sum_us += axis.t_us;
+    if (axis.t_us > stats->time_max_us)
+    {
+        stats->time_max_us = axis.t_us;
+    }
+    stats->slow_sum_us += llabs(start) * 1e6 / scenario->locate_hz;
+}
+
+int main(int argc, char **argv)
+{
+    int runs = 400;
+    unsigned seed = 1;
+    int rc = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--csv") == 0)
+        {
+            sim_csv = true;
+        }
+        else if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc)
+        {
+            runs = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+        {
+            seed = strtoul(argv[++i], NULL, 0);
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [--csv] [--runs N] [--seed N]\n", argv[0]);
+            return 2;
+        }
+    }
+    srand(seed);
+
+    if (sim_csv)
+    {
+        printf("scenario,seek_hz,locate_hz,runs,failures,home_err_min,home_err_max,latch_err_max,start_us,time_mean_ms,time_max_ms,slow_only_mean_ms\n");
+    }
+    else
+    {
+        printf("%-16s %6s %6s %5s %5s %11s %9s %6s %10s %10s %10s\n", "scenario", "seek", "locate", "runs", "fail",
+               "home err", "latch err", "start", "mean ms", "max ms", "slow ms");
+    }
+    for (size_t i = 0; i < sizeof(sim_scenarios) / sizeof(sim_scenarios[0]); i++)
+    {
+        const sim_scenario_t *scenario = &sim_scenarios[i];
+        sim_stats_t stats = {0};
+
+        for (int run = 0; run < runs; run++)
+        {
+            sim_run(scenario, &stats, run);
+        }
+        uint32_t done = stats.runs - stats.failures;
+        double mean_ms = done ? stats.time_sum_us / done / 1000 : 0;
+        double slow_ms = done ? stats.slow_sum_us / done / 1000 : 0;
+        if (sim_csv)
+        {
+            printf("%s,%u,%u,%u,%u,%lld,%lld,%lld,%.0f,%.1f,%.1f,%.1f\n", scenario->name, scenario->seek_hz,
+                   scenario->locate_hz, stats.runs, stats.failures, (long long)stats.err_min, (long long)stats.err_max,
+                   (long long)stats.latch_err_max, scenario->start_us, mean_ms, stats.time_max_us / 1000, slow_ms);
+        }
+        else
+        {
+            printf("%-16s %6u %6u %5u %5u %5lld/%-5lld %9lld %6.0f %10.1f %10.1f %10.1f\n", scenario->name, scenario->seek_hz,
+                   scenario->locate_hz, stats.runs, stats.failures, (long long)stats.err_min, (long long)stats.err_max,
+                   (long long)stats.latch_err_max, scenario->start_us, mean_ms, stats.time_max_us / 1000, slow_ms);
+        }
+        if (stats.failures || stats.err_max - stats.err_min > 1 || stats.latch_err_max > scenario->slow_steps)
+        {
+            rc = 1;
+        }
+    }
+
+    return rc;
+}
@@ -0,0 +1,8 @@
+/*
+ * Host build stand-in for esp_attr.h, placement attributes compile away, forced inlining stays.
+ */
+#pragma once
+
+#define IRAM_ATTR
+#define DRAM_ATTR
+#define FORCE_INLINE_ATTR static inline __attribute__((always_inline))
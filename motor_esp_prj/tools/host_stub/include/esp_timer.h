@@ -0,0 +1,17 @@
+/*
+ * Host build stand-in for the IDF header of the same name. The clock is the fake RMT line's, it
+ * moves on as rmt_fake.h plays symbols out (see rmt_fake_channel_t resolution_hz).
+ */
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int64_t esp_timer_get_time(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,47 @@
+/*
+ * Host build stand-in for components/sys_monitor, isr profiling and pool stats compile away.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef enum {
+    SYS_ISR_RMT_ENCODE = 0,
+    SYS_ISR_PCNT_WATCH,
+    SYS_ISR_LEDC_COUNT,
+    SYS_ISR_MCPWM_STEP,
+    SYS_ISR_LIMIT_LATCH,
+    SYS_ISR_RMT_DONE,
+    SYS_ISR_MAX,
+} sys_isr_t;
+
+static inline uint32_t sys_isr_enter(void)
+{
+    return 0;
+}
+
+static inline void sys_isr_exit(sys_isr_t isr, uint32_t start)
+{
+    (void)isr;
+    (void)start;
+}
+
+typedef struct {
+    const char *name;
+    uint32_t blocks;
+    uint32_t block_size;
+    uint32_t used;
+    uint32_t peak;
+    bool listed;
+} sys_pool_t;
+
+static inline void sys_pool_take(sys_pool_t *pool)
+{
+    (void)pool;
+}
+
+static inline void sys_pool_give(sys_pool_t *pool)
+{
+    (void)pool;
+}
@@ -0,0 +1,226 @@
+#include <stdlib.h>
+#include <string.h>
+#include "esp_check.h"
+#include "driver/rmt_tx.h"
+#include "esp_timer.h"
+#include "rmt_fake.h"
+
+static const char *TAG = "rmt_fake";
+
+// the line's clock, esp_timer_get_time
+static double rmt_fake_time_us;
+
+typedef struct {
+    rmt_encoder_t base;
+    size_t last_symbol_index;
+} rmt_fake_copy_encoder_t;
+
+void rmt_fake_channel_init(rmt_fake_channel_t *chan, rmt_symbol_word_t *mem, size_t mem_symbols)
+{
+    memset(chan, 0, sizeof(*chan));
+    chan->mem = mem;
+    chan->mem_symbols = mem_symbols;
+    chan->room = mem_symbols;
+    chan->resolution_hz = 1000000;
+}
+
+int64_t esp_timer_get_time(void)
+{
+    return (int64_t)rmt_fake_time_us;
+}
+
+static void rmt_fake_channel_play(rmt_fake_channel_t *chan, rmt_symbol_word_t symbol)
+{
+    rmt_fake_time_us += (symbol.duration0 + symbol.duration1) * 1e6 / chan->resolution_hz;
+    if (chan->sink)
+    {
+        chan->sink(chan->sink_ctx, symbol);
+    }
+}
+
+void rmt_fake_channel_set_sink(rmt_fake_channel_t *chan, rmt_fake_sink_t sink, void *sink_ctx)
+{
+    chan->sink = sink;
+    chan->sink_ctx = sink_ctx;
+}
+
+size_t rmt_fake_channel_write(rmt_fake_channel_t *chan, const rmt_symbol_word_t *symbols, size_t num)
+{
+    size_t len = num < chan->room ? num : chan->room;
+
+    memcpy(&chan->mem[chan->fill], symbols, len * sizeof(rmt_symbol_word_t));
+    chan->fill += len;
+    chan->room -= len;
+    chan->symbols += len;
+    return len;
+}
+
+static void rmt_fake_channel_drain(rmt_fake_channel_t *chan)
+{
+    for (size_t i = 0; i < chan->fill; i++)
+    {
+        rmt_fake_channel_play(chan, chan->mem[i]);
+    }
+    chan->fill = 0;
+}
+
+uint64_t rmt_fake_transmit(rmt_fake_channel_t *chan, rmt_encoder_handle_t encoder, const void *payload, size_t payload_size, int loop_count)
+{
+    rmt_encode_state_t state = RMT_ENCODING_RESET;
+    uint64_t sent = 0;
+
+    chan->fill = 0;
+    chan->room = chan->mem_symbols;
+    for (;;)
+    {
+        chan->encode_calls++;
+        encoder->encode(encoder, chan, payload, payload_size, &state);
+        if (state & RMT_ENCODING_COMPLETE)
+        {
+            break;
+        }
+        if (state & RMT_ENCODING_MEM_FULL)
+        {
+            // the ISR refills half a block each time the line has consumed it
+            chan->mem_full_events++;
+            sent += chan->fill;
+            rmt_fake_channel_drain(chan);
+            chan->room = chan->mem_symbols / 2;
+        }
+    }
+
+    if (loop_count > 0)
+    {
+        // a looped body must fit the memory, the hardware replays it from there
+        uint64_t body = chan->fill;
+        for (int i = 1; i < loop_count && chan->sink; i++)
+        {
+            for (size_t j = 0; j < body; j++)
+            {
+                rmt_fake_channel_play(chan, chan->mem[j]);
+            }
+        }
+        if (!chan->sink)
+        {
+            // nothing to see, only the clock moves on
+            uint64_t ticks = 0;
+            for (size_t j = 0; j < body; j++)
+            {
+                ticks += chan->mem[j].duration0 + chan->mem[j].duration1;
+            }
+            rmt_fake_time_us += (double)ticks * (loop_count - 1) * 1e6 / chan->resolution_hz;
+        }
+        sent += body * (uint64_t)(loop_count - 1);
+    }
+    sent += chan->fill;
+    rmt_fake_channel_drain(chan);
+    encoder->reset(encoder);
+
+    return sent;
+}
+
+esp_err_t rmt_transmit(rmt_channel_handle_t tx_channel, rmt_encoder_handle_t encoder, const void *payload, size_t payload_bytes, const rmt_transmit_config_t *config)
+{
+    ESP_RETURN_ON_FALSE(tx_channel && encoder && payload && config, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    tx_channel->transactions++;
+    rmt_tx_done_event_data_t edata = {
+        .num_symbols = rmt_fake_transmit(tx_channel, encoder, payload, payload_bytes, config->loop_count),
+    };
+    if (tx_channel->on_trans_done)
+    {
+        tx_channel->on_trans_done(tx_channel, &edata, tx_channel->done_ctx);
+    }
+    return ESP_OK;
+}
+
+esp_err_t rmt_tx_wait_all_done(rmt_channel_handle_t tx_channel, int timeout_ms)
+{
+    (void)timeout_ms;
+    ESP_RETURN_ON_FALSE(tx_channel, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    return ESP_OK;
+}
+
+esp_err_t rmt_tx_register_event_callbacks(rmt_channel_handle_t tx_channel, const rmt_tx_event_callbacks_t *cbs, void *user_data)
+{
+    ESP_RETURN_ON_FALSE(tx_channel && cbs, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    tx_channel->on_trans_done = cbs->on_trans_done;
+    tx_channel->done_ctx = user_data;
+    return ESP_OK;
+}
+
+esp_err_t rmt_enable(rmt_channel_handle_t channel)
+{
+    ESP_RETURN_ON_FALSE(channel, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    return ESP_OK;
+}
+
+esp_err_t rmt_disable(rmt_channel_handle_t channel)
+{
+    ESP_RETURN_ON_FALSE(channel, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    return ESP_OK;
+}
+
+static size_t rmt_fake_copy_encode(rmt_encoder_t *encoder, rmt_channel_handle_t channel, const void *primary_data, size_t data_size, rmt_encode_state_t *ret_state)
+{
+    rmt_fake_copy_encoder_t *copy_encoder = __containerof(encoder, rmt_fake_copy_encoder_t, base);
+    const rmt_symbol_word_t *symbols = (const rmt_symbol_word_t *)primary_data;
+    size_t num = data_size / sizeof(rmt_symbol_word_t);
+    size_t written = 0;
+    rmt_encode_state_t state = RMT_ENCODING_RESET;
+
+    if (copy_encoder->last_symbol_index < num)
+    {
+        written = rmt_fake_channel_write(channel, symbols + copy_encoder->last_symbol_index, num - copy_encoder->last_symbol_index);
+        copy_encoder->last_symbol_index += written;
+    }
+    if (copy_encoder->last_symbol_index == num)
+    {
+        copy_encoder->last_symbol_index = 0;
+        state |= RMT_ENCODING_COMPLETE;
+    }
+    if (channel->room == 0)
+    {
+        state |= RMT_ENCODING_MEM_FULL;
+    }
+    *ret_state = state;
+    return written;
+}
+
+static esp_err_t rmt_fake_copy_reset(rmt_encoder_t *encoder)
+{
+    rmt_fake_copy_encoder_t *copy_encoder = __containerof(encoder, rmt_fake_copy_encoder_t, base);
+    copy_encoder->last_symbol_index = 0;
+    return ESP_OK;
+}
+
+static esp_err_t rmt_fake_copy_del(rmt_encoder_t *encoder)
+{
+    free(__containerof(encoder, rmt_fake_copy_encoder_t, base));
+    return ESP_OK;
+}
+
+esp_err_t rmt_new_copy_encoder(const rmt_copy_encoder_config_t *config, rmt_encoder_handle_t *ret_encoder)
+{
+    rmt_fake_copy_encoder_t *copy_encoder = NULL;
+
+    ESP_RETURN_ON_FALSE(config && ret_encoder, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    copy_encoder = calloc(1, sizeof(rmt_fake_copy_encoder_t));
+    ESP_RETURN_ON_FALSE(copy_encoder, ESP_ERR_NO_MEM, TAG, "no mem for copy encoder");
+    copy_encoder->base.encode = rmt_fake_copy_encode;
+    copy_encoder->base.reset = rmt_fake_copy_reset;
+    copy_encoder->base.del = rmt_fake_copy_del;
+    *ret_encoder = &copy_encoder->base;
+    return ESP_OK;
+}
+
+esp_err_t rmt_del_encoder(rmt_encoder_handle_t encoder)
+{
+    ESP_RETURN_ON_FALSE(encoder, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    return encoder->del(encoder);
+}
+
+esp_err_t rmt_encoder_reset(rmt_encoder_handle_t encoder)
+{
+    ESP_RETURN_ON_FALSE(encoder, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    return encoder->reset(encoder);
+}
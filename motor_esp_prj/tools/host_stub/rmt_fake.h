@@ -0,0 +1,63 @@
+/*
+ * Fake RMT TX channel for host builds.
+ *
+ * It models the channel memory the way the IDF driver uses it: the first encode call may fill
+ * the whole block, after that every MEM_FULL hands back half a block (ping-pong refill).
+ * Symbols leaving the memory can be observed through a sink callback. rmt_transmit from
+ * driver/rmt_tx.h runs each transaction to completion on the fake channel, then calls the tx done
+ * callback the way the driver's interrupt does. Every symbol played moves the esp_timer.h clock on
+ * by its length at the channel resolution, the sink sees the clock at the end of the symbol.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "driver/rmt_encoder.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef void (*rmt_fake_sink_t)(void *user_ctx, rmt_symbol_word_t symbol);
+
+struct rmt_channel_t {
+    rmt_symbol_word_t *mem;    // channel memory, mem_symbols long
+    size_t mem_symbols;        // memory block size, in symbols
+    uint32_t resolution_hz;    // ticks per second of the clock, 1MHz unless set after init
+    size_t fill;               // symbols written since the last drain
+    size_t room;               // symbols the encoder may still write before MEM_FULL
+    uint64_t encode_calls;     // encoder->encode invocations
+    uint64_t mem_full_events;  // refills
+    uint64_t symbols;          // symbols written to the memory
+    uint64_t transactions;     // rmt_transmit calls
+    rmt_fake_sink_t sink;      // optional, sees every transmitted symbol in order
+    void *sink_ctx;
+    rmt_tx_done_callback_t on_trans_done; // rmt_tx_register_event_callbacks, called at the end of rmt_transmit
+    void *done_ctx;
+};
+
+typedef struct rmt_channel_t rmt_fake_channel_t;
+
+void rmt_fake_channel_init(rmt_fake_channel_t *chan, rmt_symbol_word_t *mem, size_t mem_symbols);
+void rmt_fake_channel_set_sink(rmt_fake_channel_t *chan, rmt_fake_sink_t sink, void *sink_ctx);
+
+/**
+ * @brief Write symbols into the channel memory, used by the fake copy encoder
+ *
+ * @return symbols written, less than num when the memory is full
+ */
+size_t rmt_fake_channel_write(rmt_fake_channel_t *chan, const rmt_symbol_word_t *symbols, size_t num);
+
+/**
+ * @brief Run one transaction the way rmt_transmit does
+ *
+ * The encoder is called until it reports RMT_ENCODING_COMPLETE, the memory is drained on every
+ * RMT_ENCODING_MEM_FULL. A positive loop_count replays the encoded body that many times to the sink.
+ *
+ * @return symbols sent on the line
+ */
+uint64_t rmt_fake_transmit(rmt_fake_channel_t *chan, rmt_encoder_handle_t encoder, const void *payload, size_t payload_size, int loop_count);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,123 @@
+#include <stdlib.h>
+#include <string.h>
+#include "esp_check.h"
+#include "stepper_gen_fake.h"
+
+static const char *TAG = "stepper_gen_fake";
+
+typedef struct {
+    stepper_gen_t base;
+    stepper_gen_fake_config_t config;
+    stepper_gen_fake_stats_t stats;
+} stepper_gen_fake_t;
+
+// LEDC: ledc_set_freq rounds a 10.8 fixed point clock divider, a period is 2^duty_bits divided ticks
+static bool stepper_gen_fake_ledc_period(uint32_t freq_hz, double *period_ns)
+{
+    uint64_t precision = 1ull << STEPPER_GEN_LEDC_DUTY_BITS;
+
+    if (freq_hz < STEPPER_GEN_LEDC_FREQ_MIN || freq_hz > STEPPER_GEN_LEDC_FREQ_MAX)
+    {
+        return false;
+    }
+    uint64_t div_q8 = (((uint64_t)STEPPER_GEN_LEDC_CLK_HZ << 8) + freq_hz * precision / 2) / (freq_hz * precision);
+    // the fractional divider spreads its remainder over the period, whole periods are exact
+    *period_ns = (double)div_q8 * precision / 256 * 1e9 / STEPPER_GEN_LEDC_CLK_HZ;
+    return true;
+}
+
+// MCPWM: the period is a whole number of timer ticks
+static bool stepper_gen_fake_mcpwm_period(uint32_t freq_hz, double *period_ns)
+{
+    if (freq_hz == 0 || freq_hz > STEPPER_GEN_MCPWM_FREQ_MAX)
+    {
+        return false;
+    }
+    uint32_t period = (STEPPER_GEN_MCPWM_RESOLUTION_HZ + freq_hz / 2) / freq_hz;
+    if (period < 2 || period > STEPPER_GEN_MCPWM_PERIOD_MAX)
+    {
+        return false;
+    }
+    *period_ns = (double)period * 1e9 / STEPPER_GEN_MCPWM_RESOLUTION_HZ;
+    return true;
+}
+
+static esp_err_t stepper_gen_fake_run(stepper_gen_t *gen, const stepper_segment_t *segments, uint32_t num_segments)
+{
+    stepper_gen_fake_t *fake = __containerof(gen, stepper_gen_fake_t, base);
+
+    ESP_RETURN_ON_FALSE(num_segments <= STEPPER_GEN_SEGMENT_MAX, ESP_ERR_INVALID_ARG, TAG, "too many segments");
+    for (uint32_t i = 0; i < num_segments; i++)
+    {
+        double period_ns = 0;
+        bool valid = fake->config.model == STEPPER_GEN_LEDC ? stepper_gen_fake_ledc_period(segments[i].freq_hz, &period_ns)
+                                                            : stepper_gen_fake_mcpwm_period(segments[i].freq_hz, &period_ns);
+        ESP_RETURN_ON_FALSE(valid, ESP_ERR_INVALID_ARG, TAG, "%uHz out of the %s range", segments[i].freq_hz, gen->name);
+        if (segments[i].steps == 0)
+        {
+            continue;
+        }
+
+        if (fake->config.model == STEPPER_GEN_LEDC)
+        {
+            // a watch point per PCNT lap, the last one stops the pin
+            fake->stats.interrupts += (segments[i].steps - 1) / STEPPER_GEN_PCNT_LIMIT + 1;
+        }
+        else
+        {
+            // a compare per step, then the timer stop
+            fake->stats.interrupts += segments[i].steps + 1;
+        }
+        if (fake->config.sink)
+        {
+            for (uint64_t j = 0; j < segments[i].steps; j++)
+            {
+                fake->config.sink(fake->config.sink_ctx, period_ns);
+            }
+        }
+        fake->stats.steps += segments[i].steps;
+        fake->stats.segments++;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t stepper_gen_fake_enable(stepper_gen_t *gen)
+{
+    (void)gen;
+    return ESP_OK;
+}
+
+static esp_err_t stepper_gen_fake_disable(stepper_gen_t *gen)
+{
+    (void)gen;
+    return ESP_OK;
+}
+
+static esp_err_t stepper_gen_fake_del(stepper_gen_t *gen)
+{
+    free(__containerof(gen, stepper_gen_fake_t, base));
+    return ESP_OK;
+}
+
+esp_err_t stepper_new_fake_gen(const stepper_gen_fake_config_t *config, stepper_gen_handle_t *ret_gen)
+{
+    stepper_gen_fake_t *fake = NULL;
+
+    ESP_RETURN_ON_FALSE(config && ret_gen && (config->model == STEPPER_GEN_LEDC || config->model == STEPPER_GEN_MCPWM),
+                        ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    fake = calloc(1, sizeof(stepper_gen_fake_t));
+    ESP_RETURN_ON_FALSE(fake, ESP_ERR_NO_MEM, TAG, "no mem for fake generator");
+    fake->config = *config;
+    fake->base.name = stepper_gen_backend_name(config->model);
+    fake->base.run = stepper_gen_fake_run;
+    fake->base.enable = stepper_gen_fake_enable;
+    fake->base.disable = stepper_gen_fake_disable;
+    fake->base.del = stepper_gen_fake_del;
+    *ret_gen = &fake->base;
+    return ESP_OK;
+}
+
+void stepper_gen_fake_get_stats(stepper_gen_handle_t gen, stepper_gen_fake_stats_t *stats)
+{
+    *stats = __containerof(gen, stepper_gen_fake_t, base)->stats;
+}
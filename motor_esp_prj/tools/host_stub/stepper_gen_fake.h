@@ -0,0 +1,38 @@
+/*
+ * Fake step generators for host builds.
+ *
+ * They take segments through the same stepper_gen_t ops as the firmware backends and play back
+ * the step train the LEDC or MCPWM hardware would make: every period rounded the way its timer
+ * rounds it, and the interrupts the backend needs counted. The RMT backend needs no fake, the real
+ * one from stepper_gen.c runs on a fake channel from rmt_fake.h.
+ */
+#pragma once
+
+#include <stdint.h>
+#include "stepper_gen.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// sees the period of every step, in ns, in order
+typedef void (*stepper_gen_fake_sink_t)(void *user_ctx, double period_ns);
+
+typedef struct {
+    stepper_gen_backend_t model; // STEPPER_GEN_LEDC or STEPPER_GEN_MCPWM
+    stepper_gen_fake_sink_t sink; // optional
+    void *sink_ctx;
+} stepper_gen_fake_config_t;
+
+typedef struct {
+    uint64_t steps;      // step pulses made
+    uint64_t segments;   // segments run
+    uint64_t interrupts; // interrupts the backend takes on the chip for them
+} stepper_gen_fake_stats_t;
+
+esp_err_t stepper_new_fake_gen(const stepper_gen_fake_config_t *config, stepper_gen_handle_t *ret_gen);
+void stepper_gen_fake_get_stats(stepper_gen_handle_t gen, stepper_gen_fake_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,452 @@
+/*
+ * Host simulation of the position journal against a NOR flash model with power cuts.
+ *
+ * components/pos_journal/pos_journal_log.c runs on a RAM copy of the "journal" partition. A write
+ * can only clear bits and an erase sets a sector back to 0xff. The machine starts a move (the latest
+ * record is marked moving), changes its positions and appends a record once settled, like the
+ * journal task does. At random points the power goes: the flash operation in flight is torn (a
+ * prefix of a write lands, its last byte only in part, or an erase sets only some of the bits of
+ * its sector) and every later operation fails. The journal is then opened again and the restored
+ * state has to be the last record that completed, or the one in flight if it did complete, and it
+ * has to be flagged as not settled whenever a move had been marked.
+ *
+ * Reported:
+ *   cuts        power cuts, how many of them tore a write, a mark or an erase
+ *   restore     mean / max open time on this host, flash bytes read by the single scan
+ *   wear        erases per sector (min / max), write amplification, flash bytes per byte of positions
+ *   duty        records per hour and sector life for a jogging pattern under the firmware's settle
+ *               and interval limits, against a record per move
+ *
+ * usage: journal_sim [--csv] [--cycles N] [--sectors N] [--seed N]
+ * exits non zero when a restore returns a state that was never written or loses a completed one
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "pos_journal_log.h"
+
+#define SIM_SECTORS_MAX 64
+#define SIM_CUT_EVERY 40        // mean flash operations between power cuts
+#define SIM_ENDURANCE 100000    // erase cycles of a NOR sector
+#define SIM_SETTLE_ms 500       // JOURNAL_SETTLE_ms
+#define SIM_INTERVAL_ms 2000    // JOURNAL_INTERVAL_ms
+#define SIM_DUTY_HOURS 8
+#define SIM_JOG_STEPS 10000
+#define SIM_LONG_STEPS (1LL << 40)
+
+static bool sim_csv = false;
+
+typedef enum {
+    SIM_OP_WRITE = 0,
+    SIM_OP_MARK, // single byte write
+    SIM_OP_ERASE,
+    SIM_OP_MAX,
+} sim_op_t;
+
+// the partition and its power
+typedef struct {
+    uint8_t mem[SIM_SECTORS_MAX * POS_JOURNAL_SECTOR_SIZE];
+    size_t size;
+    uint32_t erases[SIM_SECTORS_MAX];
+    uint64_t bytes_read;
+    uint32_t ops_left; // operations before the power goes, the last one is torn
+    bool dead;
+    bool torn;
+    sim_op_t torn_op;
+} sim_flash_t;
+
+static double sim_rand(void)
+{
+    return rand() / (RAND_MAX + 1.0);
+}
+
+// true when this operation is the one the power cut tears
+static bool sim_cut(sim_flash_t *flash, sim_op_t op)
+{
+    if (flash->ops_left == 0)
+    {
+        return false;
+    }
+    if (--flash->ops_left)
+    {
+        return false;
+    }
+    flash->dead = true;
+    flash->torn = true;
+    flash->torn_op = op;
+    return true;
+}
+
+static esp_err_t sim_read(void *ctx, size_t offset, void *buf, size_t len)
+{
+    sim_flash_t *flash = ctx;
+
+    if (flash->dead || offset + len > flash->size)
+    {
+        return ESP_FAIL;
+    }
+    memcpy(buf, flash->mem + offset, len);
+    flash->bytes_read += len;
+    return ESP_OK;
+}
+
+static esp_err_t sim_write(void *ctx, size_t offset, const void *buf, size_t len)
+{
+    sim_flash_t *flash = ctx;
+    const uint8_t *bytes = buf;
+    size_t done = len;
+    bool torn;
+
+    if (flash->dead || offset + len > flash->size)
+    {
+        return ESP_FAIL;
+    }
+    torn = sim_cut(flash, len == 1 ? SIM_OP_MARK : SIM_OP_WRITE);
+    if (torn)
+    {
+        done = rand() % (len + 1);
+    }
+    for (size_t i = 0; i < done; i++)
+    {
+        flash->mem[offset + i] &= bytes[i];
+    }
+    if (torn && done < len)
+    {
+        // the byte being programmed got only some of its bits
+        flash->mem[offset + done] &= bytes[done] | (uint8_t)rand();
+    }
+    return torn ? ESP_FAIL : ESP_OK;
+}
+
+static esp_err_t sim_erase(void *ctx, size_t offset, size_t len)
+{
+    sim_flash_t *flash = ctx;
+
+    if (flash->dead || offset % POS_JOURNAL_SECTOR_SIZE || len % POS_JOURNAL_SECTOR_SIZE || offset + len > flash->size)
+    {
+        return ESP_FAIL;
+    }
+    if (sim_cut(flash, SIM_OP_ERASE))
+    {
+        for (size_t i = 0; i < len; i++)
+        {
+            flash->mem[offset + i] |= (uint8_t)rand() & (uint8_t)rand();
+        }
+        return ESP_FAIL;
+    }
+    memset(flash->mem + offset, 0xff, len);
+    for (size_t s = 0; s < len / POS_JOURNAL_SECTOR_SIZE; s++)
+    {
+        flash->erases[offset / POS_JOURNAL_SECTOR_SIZE + s]++;
+    }
+    return ESP_OK;
+}
+
+static bool sim_state_equal(const pos_journal_state_t *a, const pos_journal_state_t *b)
+{
+    return memcmp(a->pos, b->pos, sizeof(a->pos)) == 0 && a->homed == b->homed;
+}
+
+static sim_flash_t sim_flash;
+
+typedef struct {
+    uint32_t cuts;
+    uint32_t torn[SIM_OP_MAX];
+    uint32_t torn_max; // most torn slots a scan saw
+    uint32_t opens;
+    double open_sum_us;
+    double open_max_us;
+    uint64_t read_max;
+    uint64_t records;
+    uint64_t bytes_programmed;
+    uint64_t erases;
+} sim_stats_t;
+
+// what the machine knows it wrote
+typedef struct {
+    pos_journal_state_t done;             // last record that completed
+    const pos_journal_state_t *in_flight; // record the cut hit, NULL when it hit a mark
+    bool any;                             // done holds a record
+    bool marked;                          // the mark on done completed
+} sim_model_t;
+
+static void sim_stats_add(sim_stats_t *stats, const pos_journal_t *journal)
+{
+    stats->records += journal->stats.records;
+    stats->bytes_programmed += journal->stats.bytes_programmed;
+    stats->erases += journal->stats.erases;
+}
+
+static esp_err_t sim_open(pos_journal_t *journal, sim_stats_t *stats, pos_journal_state_t *state, bool *found,
+                          bool *settled)
+{
+    pos_journal_flash_t config = {
+        .read = sim_read,
+        .write = sim_write,
+        .erase = sim_erase,
+        .ctx = &sim_flash,
+        .size = sim_flash.size,
+    };
+    struct timespec t0, t1;
+
+    sim_flash.dead = false;
+    sim_flash.bytes_read = 0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    esp_err_t err = pos_journal_open(journal, &config, state, found, settled);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double us = (t1.tv_sec - t0.tv_sec) * 1e6 + (t1.tv_nsec - t0.tv_nsec) / 1e3;
+
+    stats->opens++;
+    stats->open_sum_us += us;
+    if (us > stats->open_max_us)
+    {
+        stats->open_max_us = us;
+    }
+    if (sim_flash.bytes_read > stats->read_max)
+    {
+        stats->read_max = sim_flash.bytes_read;
+    }
+    if (journal->stats.torn > stats->torn_max)
+    {
+        stats->torn_max = journal->stats.torn;
+    }
+    return err;
+}
+
+// the restored state after a cut, NULL when it is right
+static const char *sim_check(const sim_model_t *model, sim_op_t torn_op, const pos_journal_state_t *state, bool found,
+                             bool settled)
+{
+    bool is_done = model->any && sim_state_equal(state, &model->done);
+    bool is_in_flight = model->in_flight && sim_state_equal(state, model->in_flight);
+
+    if (!found)
+    {
+        return model->any ? "a completed record was lost" : NULL;
+    }
+    if (is_in_flight)
+    {
+        // it landed whole, nothing marked it yet
+        return settled ? NULL : "a fresh record came back moving";
+    }
+    if (!is_done)
+    {
+        return "a state that was never written came back";
+    }
+    if (torn_op == SIM_OP_MARK)
+    {
+        return NULL; // either way
+    }
+    if (model->marked && settled)
+    {
+        return "a move was lost, the record came back settled";
+    }
+    if (!model->marked && !settled)
+    {
+        return "a record came back moving without a move";
+    }
+    return NULL;
+}
+
+static int sim_cuts(uint32_t sectors, uint32_t cycles, sim_stats_t *stats)
+{
+    pos_journal_t journal;
+    pos_journal_state_t state, next;
+    sim_model_t model = {0};
+    bool found, settled;
+
+    memset(sim_flash.mem, 0xff, sizeof(sim_flash.mem));
+    sim_flash.size = sectors * POS_JOURNAL_SECTOR_SIZE;
+    if (sim_open(&journal, stats, &state, &found, &settled) != ESP_OK || found)
+    {
+        fprintf(stderr, "cannot open an empty journal\n");
+        return 1;
+    }
+    sim_flash.ops_left = 1 + rand() % (2 * SIM_CUT_EVERY);
+
+    for (uint32_t cycle = 0; cycle < cycles; cycle++)
+    {
+        // a move starts from the latest record, ends somewhere else and settles
+        model.in_flight = NULL;
+        esp_err_t err = pos_journal_mark_moving(&journal);
+        if (err == ESP_OK)
+        {
+            model.marked = model.any;
+            next = model.done;
+            for (int i = 0; i < POS_JOURNAL_AXES; i++)
+            {
+                // jogs mostly, now and then a move far past 32 bits
+                int64_t reach = rand() % 8 ? SIM_JOG_STEPS : SIM_LONG_STEPS;
+                next.pos[i] += (int64_t)(sim_rand() * (2 * reach + 1)) - reach;
+            }
+            next.homed = rand() & 0x7;
+            model.in_flight = &next;
+            err = pos_journal_append(&journal, &next);
+        }
+        if (err == ESP_OK)
+        {
+            model.done = next;
+            model.any = true;
+            model.marked = false;
+            continue;
+        }
+
+        // the power went, come back up and check
+        sim_op_t torn_op = sim_flash.torn_op;
+        stats->cuts++;
+        stats->torn[torn_op]++;
+        sim_stats_add(stats, &journal);
+        if (sim_open(&journal, stats, &state, &found, &settled) != ESP_OK)
+        {
+            fprintf(stderr, "cycle %u: cannot open the journal\n", cycle);
+            return 1;
+        }
+        const char *why = sim_check(&model, torn_op, &state, found, settled);
+        if (why)
+        {
+            fprintf(stderr, "cycle %u, torn %s: %s\n", cycle,
+                    torn_op == SIM_OP_WRITE ? "write" : torn_op == SIM_OP_MARK ? "mark" : "erase", why);
+            return 1;
+        }
+        // carry on from what came back
+        model.done = state;
+        model.any = found;
+        model.marked = !settled;
+        sim_flash.ops_left = 1 + rand() % (2 * SIM_CUT_EVERY);
+    }
+    sim_stats_add(stats, &journal);
+    return 0;
+}
+
+// records written under the firmware's settle and interval limits, a move of move_ms every gap_ms on average
+static uint32_t sim_duty(uint32_t gap_ms, uint32_t move_ms, uint32_t hours, uint32_t *moves)
+{
+    uint64_t end_ms = (uint64_t)hours * 3600 * 1000;
+    uint64_t last_write = 0;
+    uint32_t records = 0;
+
+    *moves = 0;
+    for (uint64_t t = 0; t < end_ms;)
+    {
+        t += move_ms;
+        (*moves)++;
+        uint64_t next_move = t + gap_ms / 2 + (uint64_t)(sim_rand() * gap_ms);
+        uint64_t write_at = t + SIM_SETTLE_ms;
+        if (records && write_at < last_write + SIM_INTERVAL_ms)
+        {
+            write_at = last_write + SIM_INTERVAL_ms;
+        }
+        // a move before the write makes it wait for the next settle
+        if (write_at < next_move)
+        {
+            records++;
+            last_write = write_at;
+        }
+        t = next_move;
+    }
+    return records;
+}
+
+int main(int argc, char **argv)
+{
+    static const struct {
+        const char *name;
+        uint32_t gap_ms;
+        uint32_t move_ms;
+    } duties[] = {
+        {"jog taps", 600, 100},
+        {"jogging", 1500, 400},
+        {"positioning", 10000, 2000},
+    };
+    uint32_t cycles = 200000;
+    uint32_t sectors = 16; // the 64K partition
+    unsigned seed = 1;
+    sim_stats_t stats = {0};
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--csv") == 0)
+        {
+            sim_csv = true;
+        }
+        else if (strcmp(argv[i], "--cycles") == 0 && i + 1 < argc)
+        {
+            cycles = strtoul(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "--sectors") == 0 && i + 1 < argc)
+        {
+            sectors = strtoul(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+        {
+            seed = strtoul(argv[++i], NULL, 0);
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [--csv] [--cycles N] [--sectors N] [--seed N]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (sectors < 2 || sectors > SIM_SECTORS_MAX)
+    {
+        fprintf(stderr, "sectors is 2..%d\n", SIM_SECTORS_MAX);
+        return 2;
+    }
+    srand(seed);
+
+    int rc = sim_cuts(sectors, cycles, &stats);
+
+    uint32_t wear_min = UINT32_MAX, wear_max = 0;
+    for (uint32_t s = 0; s < sectors; s++)
+    {
+        wear_min = sim_flash.erases[s] < wear_min ? sim_flash.erases[s] : wear_min;
+        wear_max = sim_flash.erases[s] > wear_max ? sim_flash.erases[s] : wear_max;
+    }
+    double flash_bytes = stats.bytes_programmed + (double)stats.erases * POS_JOURNAL_SECTOR_SIZE;
+    double amplification = stats.records ? flash_bytes / (stats.records * (double)POS_JOURNAL_PAYLOAD_SIZE) : 0;
+    uint32_t slots = sectors * POS_JOURNAL_SECTOR_RECORDS;
+
+    if (sim_csv)
+    {
+        printf("sectors,cycles,records,cuts,torn_write,torn_mark,torn_erase,torn_slots_max,open_mean_us,open_max_us,scan_bytes,wear_min,wear_max,write_amp,result\n");
+        printf("%u,%u,%llu,%u,%u,%u,%u,%u,%.1f,%.1f,%llu,%u,%u,%.2f,%s\n", sectors, cycles,
+               (unsigned long long)stats.records, stats.cuts, stats.torn[SIM_OP_WRITE], stats.torn[SIM_OP_MARK],
+               stats.torn[SIM_OP_ERASE], stats.torn_max, stats.open_sum_us / stats.opens, stats.open_max_us,
+               (unsigned long long)stats.read_max, wear_min, wear_max, amplification, rc ? "fail" : "ok");
+        printf("\nduty,moves_per_h,records_per_h,sector_life_h,record_per_move_life_h\n");
+    }
+    else
+    {
+        printf("journal: %u sectors, %u slots of %dB, %u cycles, %llu records\n", sectors, slots, POS_JOURNAL_RECORD_SIZE,
+               cycles, (unsigned long long)stats.records);
+        printf("cuts:    %u (torn write %u, mark %u, erase %u), at most %u torn slots in a scan, %s\n", stats.cuts,
+               stats.torn[SIM_OP_WRITE], stats.torn[SIM_OP_MARK], stats.torn[SIM_OP_ERASE], stats.torn_max,
+               rc ? "FAIL" : "every restore ok");
+        printf("restore: %.1f us mean, %.1f us max on this host, %llu flash bytes read by the scan\n",
+               stats.open_sum_us / stats.opens, stats.open_max_us, (unsigned long long)stats.read_max);
+        printf("wear:    %u..%u erases per sector, write amplification %.2fx (%dB record, %dB of positions)\n",
+               wear_min, wear_max, amplification, POS_JOURNAL_RECORD_SIZE, POS_JOURNAL_PAYLOAD_SIZE);
+        printf("\n%-12s %10s %10s %14s %14s\n", "duty", "moves/h", "records/h", "sector life h", "per move h");
+    }
+    for (size_t i = 0; i < sizeof(duties) / sizeof(duties[0]); i++)
+    {
+        uint32_t moves;
+        uint32_t records = sim_duty(duties[i].gap_ms, duties[i].move_ms, SIM_DUTY_HOURS, &moves);
+        double records_h = (double)records / SIM_DUTY_HOURS;
+        double moves_h = (double)moves / SIM_DUTY_HOURS;
+        // a sector is erased once per ring turn
+        double life_h = records_h > 0 ? (double)SIM_ENDURANCE * slots / records_h : 0;
+        double per_move_h = (double)SIM_ENDURANCE * slots / moves_h;
+        if (sim_csv)
+        {
+            printf("%s,%.0f,%.0f,%.0f,%.0f\n", duties[i].name, moves_h, records_h, life_h, per_move_h);
+        }
+        else
+        {
+            printf("%-12s %10.0f %10.0f %14.0f %14.0f\n", duties[i].name, moves_h, records_h, life_h, per_move_h);
+        }
+    }
+
+    return rc;
+}
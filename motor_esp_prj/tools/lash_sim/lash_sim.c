@@ -0,0 +1,374 @@
+/*
+ * Host simulation of the backlash compensation.
+ *
+ * A leadscrew with slack is driven by the real RMT step generator (dither encoder, with and without
+ * a ramp image made like ramp_gen's) on a fake channel. Every jog sets its direction through
+ * stepper_lash_dir the way stepper_motor_jog_start does, the take-up segment leads the move into
+ * stepper_gen_start, and the nut only moves once the screw has closed the slack on the move's side.
+ * The position the firmware books for a jog is the steps asked for.
+ *
+ * Checked per case, from the second move on, the first one puts the slack on a known side:
+ *   nut       the nut travels exactly the steps asked for, reversal or not
+ *   position  steps on the line less the take-up are the steps asked for, the count op agrees
+ *   count     read as every symbol ends, the count op is off the steps on the line by one at most,
+ *             ramps and take-ups included
+ *   same      without ramps a reversing jog takes no more transactions than one that doesn't, with
+ *             ramps one more at most, the take-up ahead of the accel ramp
+ *   gap       without ramps the move's first period starts as the last take-up pulse ends, rise to
+ *             rise the two half periods and nothing idling in between
+ *   rate      every take-up period is resolution / take-up rate, whatever the feed override
+ * The same moves are run with the compensation off for reference, the nut error that leaves (the
+ * slack at every reversal) is reported, not checked.
+ *
+ * usage: lash_sim [--csv]
+ * exits non zero when a check fails
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "rmt_fake.h"
+#include "stepper_motor_encoder.h"
+#include "stepper_move.h"
+#include "stepper_shaper.h"
+#include "stepper_ramp.h"
+#include "stepper_gen.h"
+#include "stepper_lash.h"
+
+#define SIM_MEM_BLOCK_SYMBOLS 48 // SOC_RMT_MEM_WORDS_PER_CHANNEL on ESP32-S3
+#define SIM_FREQ_MIN_HZ 400      // the slowest take-up rate, picks the resolution
+#define SIM_RAMP_START_HZ 500    // tools/ramp_gen defaults
+#define SIM_RAMP_SLOPE_HZ 25
+#define SIM_RAMP_IMAGE_SIZE 0x10000
+#define SIM_RISES_MAX 8192 // first rising edges of a move kept for the timing checks
+
+// jogs of step_basic 64 at the x1 and x10 speeds, signed
+typedef struct {
+    int64_t steps;
+    uint32_t freq_hz;
+} sim_move_t;
+
+static const sim_move_t sim_moves[] = {
+    {640, 3000}, {64, 3000}, {-64, 3000}, {-64, 3000}, {128, 3000}, {-6400, 15000}, {6400, 15000},
+    {-640, 15000}, {64, 3000}, {-64, 3000}, {64, 3000}, {-12800, 15000}, {192, 3000},
+};
+
+static const uint32_t sim_slacks[] = {1, 12, 250};
+static const uint32_t sim_take_up_hz[] = {400, 1000, 5000};
+static const uint32_t sim_feeds[] = {100, 50};
+
+static bool sim_csv = false;
+
+typedef struct {
+    uint32_t slack; // the machine's, in steps
+    int dir;
+    int64_t screw;
+    int64_t nut;
+    uint8_t level;
+    uint64_t t; // ticks
+    uint64_t steps;
+    uint64_t rises[SIM_RISES_MAX];
+    uint32_t done;
+    // the count op against the line, read as every symbol ends
+    stepper_gen_handle_t gen;
+    uint32_t count_at; // at the start of the move
+    uint64_t count_err_max;
+} sim_axis_t;
+
+typedef struct {
+    double nut_err_max;  // steps
+    double gap_err_max;  // ticks off the two half periods
+    double rate_err_max; // ticks off the take-up period
+    uint64_t count_err_max; // steps the count op is off the line
+    uint64_t reversals;
+    const char *broken;
+} sim_result_t;
+
+static void sim_line_level(sim_axis_t *axis, uint8_t level, uint32_t ticks)
+{
+    if (ticks == 0)
+    {
+        return;
+    }
+    if (level && !axis->level)
+    {
+        if (axis->steps < SIM_RISES_MAX)
+        {
+            axis->rises[axis->steps] = axis->t;
+        }
+        axis->steps++;
+        // the screw turns a step, the nut is pushed once the slack on this side is closed
+        axis->screw += axis->dir;
+        if (axis->screw > axis->nut + axis->slack)
+        {
+            axis->nut = axis->screw - axis->slack;
+        }
+        else if (axis->screw < axis->nut)
+        {
+            axis->nut = axis->screw;
+        }
+    }
+    axis->level = level;
+    axis->t += ticks;
+}
+
+static void sim_sink(void *user_ctx, rmt_symbol_word_t symbol)
+{
+    sim_axis_t *axis = (sim_axis_t *)user_ctx;
+
+    sim_line_level(axis, symbol.level0, symbol.duration0);
+    sim_line_level(axis, symbol.level1, symbol.duration1);
+    if (axis->gen)
+    {
+        stepper_gen_count_t count;
+        stepper_gen_count(axis->gen, &count);
+        int64_t err = (int64_t)(uint32_t)(count.steps - axis->count_at) - (int64_t)axis->steps;
+        err = err < 0 ? -err : err;
+        axis->count_err_max = (uint64_t)err > axis->count_err_max ? (uint64_t)err : axis->count_err_max;
+    }
+}
+
+// the fake channel ends transactions in rmt_transmit, so this fires inside stepper_gen_start
+static bool sim_on_done(stepper_gen_t *gen, void *user_ctx)
+{
+    (void)gen;
+    ((sim_axis_t *)user_ctx)->done++;
+    return false;
+}
+
+static bool sim_ramp_image(uint8_t *image, uint32_t resolution)
+{
+    static const uint32_t speeds[] = {3000, 15000};
+    stepper_ramp_profile_t profiles[4];
+    uint32_t num_profiles = 0;
+
+    for (size_t i = 0; i < sizeof(speeds) / sizeof(speeds[0]); i++)
+    {
+        uint32_t points = (speeds[i] - SIM_RAMP_START_HZ) / SIM_RAMP_SLOPE_HZ + 1;
+        points = points > STEPPER_RAMP_POINTS_MAX ? STEPPER_RAMP_POINTS_MAX : points;
+        profiles[num_profiles++] = (stepper_ramp_profile_t){resolution, SIM_RAMP_START_HZ, speeds[i], points};
+        profiles[num_profiles++] = (stepper_ramp_profile_t){resolution, speeds[i], SIM_RAMP_START_HZ, points};
+    }
+    return stepper_ramp_build(image, SIM_RAMP_IMAGE_SIZE, profiles, num_profiles) != 0;
+}
+
+// every move of the script, the compensation on (lash_steps = slack) or off (0)
+static bool sim_run(uint32_t resolution, const void *ramps, uint32_t slack, uint32_t lash_steps, uint32_t take_up_hz,
+                    uint32_t feed, uint64_t *transactions, sim_result_t *result)
+{
+    static sim_axis_t axis;
+    rmt_symbol_word_t mem[SIM_MEM_BLOCK_SYMBOLS];
+    rmt_fake_channel_t chan;
+    rmt_encoder_handle_t encoder = NULL;
+    stepper_gen_handle_t gen = NULL;
+    stepper_motor_uniform_encoder_config_t encoder_config = {
+        .resolution = resolution,
+        .flags.dither = 1,
+    };
+    stepper_lash_t lash = {0};
+    stepper_shaper_t shaper;
+    bool ok = true;
+
+    memset(&axis, 0, sizeof(axis));
+    memset(result, 0, sizeof(*result));
+    axis.slack = slack;
+    // the nut anywhere in the slack at power up
+    axis.nut = -(int64_t)slack / 2;
+    stepper_shaper_init(&shaper, STEPPER_SHAPER_NONE, 0, 0);
+    stepper_lash_set(&lash, lash_steps, take_up_hz);
+    stepper_feed_override_set(feed);
+    rmt_fake_channel_init(&chan, mem, SIM_MEM_BLOCK_SYMBOLS);
+    chan.resolution_hz = resolution;
+    rmt_fake_channel_set_sink(&chan, sim_sink, &axis);
+    if (rmt_new_stepper_motor_uniform_encoder(&encoder_config, &encoder) != ESP_OK)
+    {
+        fprintf(stderr, "no encoder at %uHz resolution\n", resolution);
+        return false;
+    }
+    stepper_rmt_gen_config_t gen_config = {
+        .chan = &chan,
+        .encoder = encoder,
+        .ramps = ramps,
+        .resolution = resolution,
+        .on_done = sim_on_done,
+        .user_ctx = &axis,
+        .flags.dither = 1,
+    };
+    if (stepper_new_rmt_gen(&gen_config, &gen) != ESP_OK || !stepper_gen_can_start(gen))
+    {
+        fprintf(stderr, "no generator\n");
+        rmt_del_encoder(encoder);
+        return false;
+    }
+
+    for (size_t i = 0; i < sizeof(sim_moves) / sizeof(sim_moves[0]) && ok; i++)
+    {
+        const sim_move_t *move = &sim_moves[i];
+        int dir = move->steps < 0 ? -1 : 1;
+        uint64_t steps = move->steps < 0 ? -move->steps : move->steps;
+        stepper_segment_t segments[STEPPER_GEN_SEGMENT_MAX];
+        stepper_gen_count_t before, after;
+
+        // as stepper_motor_jog_start: DIR and the take-up, then the shaped move behind it
+        uint32_t num = stepper_lash_dir(&lash, dir, &segments[0]);
+        uint32_t take_up = num ? (uint32_t)segments[0].steps : 0;
+        num += stepper_shaper_apply(&shaper, move->freq_hz, steps, &segments[num]);
+
+        int64_t nut = axis.nut;
+        uint64_t chan_transactions = chan.transactions;
+        stepper_gen_count(gen, &before);
+        axis.dir = dir;
+        axis.steps = 0;
+        axis.t = 0;
+        axis.done = 0;
+        axis.gen = gen;
+        axis.count_at = before.steps;
+        if (stepper_gen_start(gen, segments, num) != ESP_OK || axis.done != 1)
+        {
+            result->broken = "start failed";
+            ok = false;
+            break;
+        }
+        stepper_gen_count(gen, &after);
+        transactions[i] = chan.transactions - chan_transactions;
+        if (i == 0)
+        {
+            continue;
+        }
+
+        result->reversals += (sim_moves[i - 1].steps < 0) != (move->steps < 0);
+        double nut_err = llabs(axis.nut - nut - move->steps);
+        result->nut_err_max = nut_err > result->nut_err_max ? nut_err : result->nut_err_max;
+        if (axis.steps - take_up != steps || (uint32_t)(after.steps - before.steps) != axis.steps)
+        {
+            result->broken = "position off by the take-up";
+            ok = false;
+        }
+        if (!take_up || take_up >= SIM_RISES_MAX)
+        {
+            continue;
+        }
+        // rise to rise, the first take-up step also waits out the DIR setup time
+        double period = (double)resolution / take_up_hz;
+        for (uint32_t j = 1; j < take_up; j++)
+        {
+            double err = (double)(axis.rises[j] - axis.rises[j - 1]) - period;
+            err = err < 0 ? -err : err;
+            result->rate_err_max = err > result->rate_err_max ? err : result->rate_err_max;
+        }
+        if (!ramps)
+        {
+            // the high half of the last take-up period, then the low half of the move's first one at
+            // its own rate, feed scaled like any move from standstill
+            double move_period = (double)resolution / ((uint64_t)move->freq_hz * feed / 100);
+            double gap = (double)(axis.rises[take_up] - axis.rises[take_up - 1]) - (period + move_period) / 2;
+            gap = gap < 0 ? -gap : gap;
+            result->gap_err_max = gap > result->gap_err_max ? gap : result->gap_err_max;
+        }
+    }
+    result->count_err_max = axis.count_err_max;
+    axis.gen = NULL;
+    stepper_feed_override_set(100);
+    stepper_gen_del(gen);
+    rmt_del_encoder(encoder);
+    return ok;
+}
+
+static bool sim_case(uint32_t resolution, const void *ramps, uint32_t slack, uint32_t take_up_hz, uint32_t feed)
+{
+    static const size_t num_moves = sizeof(sim_moves) / sizeof(sim_moves[0]);
+    uint64_t on_transactions[sizeof(sim_moves) / sizeof(sim_moves[0])];
+    uint64_t off_transactions[sizeof(sim_moves) / sizeof(sim_moves[0])];
+    // off is left as is when the run with the compensation on fails
+    sim_result_t on = {0}, off = {0};
+
+    bool ok = sim_run(resolution, ramps, slack, slack, take_up_hz, feed, on_transactions, &on) &&
+              sim_run(resolution, ramps, slack, 0, take_up_hz, feed, off_transactions, &off);
+    const char *broken = on.broken ? on.broken : off.broken;
+
+    for (size_t i = 1; ok && !broken && i < num_moves; i++)
+    {
+        if (on_transactions[i] > off_transactions[i] + (ramps ? 1 : 0))
+        {
+            broken = "take-up in a transaction of its own";
+        }
+    }
+    if (!broken && on.nut_err_max > 0)
+    {
+        broken = "nut off the steps asked for";
+    }
+    else if (!broken && on.rate_err_max > 1.0)
+    {
+        broken = "take-up off its rate";
+    }
+    else if (!broken && on.gap_err_max > 1.0)
+    {
+        broken = "idle between take-up and move";
+    }
+    else if (!broken && on.count_err_max > 1)
+    {
+        broken = "count op off the line";
+    }
+
+    if (sim_csv)
+    {
+        printf("%u,%s,%u,%u,%u,%llu,%.0f,%.0f,%.1f,%.1f,%llu,%s\n", resolution, ramps ? "yes" : "no", slack, take_up_hz,
+               feed, (unsigned long long)on.reversals, on.nut_err_max, off.nut_err_max, on.rate_err_max, on.gap_err_max,
+               (unsigned long long)on.count_err_max, broken ? broken : "ok");
+    }
+    else
+    {
+        printf("%10u %5s %6u %8u %5u%% %9llu %8.0f %8.0f %9.1f %9.1f %9llu  %s\n", resolution, ramps ? "yes" : "no", slack,
+               take_up_hz, feed, (unsigned long long)on.reversals, on.nut_err_max, off.nut_err_max, on.rate_err_max,
+               on.gap_err_max, (unsigned long long)on.count_err_max, broken ? broken : "ok");
+    }
+    return ok && !broken;
+}
+
+int main(int argc, char **argv)
+{
+    static uint8_t ramp_image[SIM_RAMP_IMAGE_SIZE];
+    bool ok = true;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--csv") == 0)
+        {
+            sim_csv = true;
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [--csv]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    uint32_t resolution = stepper_pick_resolution(SIM_FREQ_MIN_HZ);
+    if (!sim_ramp_image(ramp_image, resolution))
+    {
+        fprintf(stderr, "cannot build the ramp image\n");
+        return 1;
+    }
+    if (sim_csv)
+    {
+        printf("resolution_hz,ramps,slack_steps,take_up_hz,feed,reversals,nut_err,nut_err_off,rate_err_ticks,gap_err_ticks,count_err_steps,result\n");
+    }
+    else
+    {
+        printf("%10s %5s %6s %8s %6s %9s %8s %8s %9s %9s %9s  %s\n", "resolution", "ramps", "slack", "take-up", "feed",
+               "reversals", "nut err", "off err", "rate err", "gap err", "count err", "result");
+    }
+    for (int r = 0; r < 2; r++)
+    {
+        for (size_t s = 0; s < sizeof(sim_slacks) / sizeof(sim_slacks[0]); s++)
+        {
+            for (size_t h = 0; h < sizeof(sim_take_up_hz) / sizeof(sim_take_up_hz[0]); h++)
+            {
+                for (size_t f = 0; f < sizeof(sim_feeds) / sizeof(sim_feeds[0]); f++)
+                {
+                    ok = sim_case(resolution, r ? ramp_image : NULL, sim_slacks[s], sim_take_up_hz[h], sim_feeds[f]) && ok;
+                }
+            }
+        }
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,279 @@
+/*
+ * Host check of the STEP pulse timing.
+ *
+ * The uniform encoder from components/stepper_motor is run in dither mode over a sweep of step
+ * rates, channel resolutions and driver timings (components/stepper_motor/stepper_move.h,
+ * stepper_pulse_t), with the 50% duty and the fixed pulse encoding. A move is sent as the step
+ * generator sends it, a first transaction right after the DIR change and a second one behind it.
+ * On the captured line every high time has to meet high_ns, every low time between steps low_ns,
+ * the first rising edge has to come dir_setup_ns after the start, no step may be lost, and the
+ * second transaction has to run at the exact rate asked for, or at stepper_pulse_max_hz when the
+ * rate is above it.
+ *
+ * Reported per timing, encoding and resolution: the fastest rate, the high time the pulse really
+ * gets (the quantization against high_ns) and the smallest margins seen over the sweep.
+ *
+ * usage: pulse_check [--csv]
+ * exits non zero when a timing is broken anywhere in the sweep
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "rmt_fake.h"
+#include "stepper_motor_encoder.h"
+#include "stepper_move.h"
+
+#define CHECK_MEM_BLOCK_SYMBOLS 48 // SOC_RMT_MEM_WORDS_PER_CHANNEL on ESP32-S3
+#define CHECK_STEPS 200            // per transaction, two of them per move
+#define CHECK_FREQ_MIN_HZ 400      // slowest rate of the firmware, homing's locate rate
+
+typedef struct {
+    const char *name;
+    stepper_pulse_t pulse;
+} check_driver_t;
+
+static const check_driver_t check_drivers[] = {
+    {"none", {0, 0, 0, false}},
+    {"a4988", {1000, 1000, 200, false}},
+    {"drv8825", {1900, 1900, 650, false}},
+    {"tb6600", {2200, 2200, 5000, false}},
+    {"opto", {2500, 1000, 5000, false}}, // optocoupled input, slow to turn on, quick to let go
+};
+static const uint32_t check_resolutions[] = {0, 1000000, 10000000, 80000000}; // 0: picked for the timing
+static const uint32_t check_freqs[] = {10, 100, 400, 3000, 18000, 60000, 100000, 150000, 200000, 250000,
+                                       300000, 400000, 500000, 1000000, 5000000};
+
+static bool check_csv = false;
+
+typedef struct {
+    uint32_t resolution;
+    uint8_t level;
+    uint64_t run;        // ticks at the current level
+    uint64_t t;          // ticks since the start of the move
+    uint64_t first_rise; // 0 until the first step
+    uint64_t steps;
+    uint64_t min_high;
+    uint64_t min_low;    // between steps
+    uint64_t falls[2 * CHECK_STEPS];
+} check_line_t;
+
+typedef struct {
+    uint64_t moves;
+    uint64_t failures;
+    double high_margin_ns; // smallest over the sweep, against the driver's minimum
+    double low_margin_ns;
+    double dir_margin_ns;
+} check_stats_t;
+
+static void check_line_level(check_line_t *line, uint8_t level, uint32_t ticks)
+{
+    if (ticks == 0)
+    {
+        return;
+    }
+    if (level != line->level)
+    {
+        if (line->level)
+        {
+            line->min_high = line->run < line->min_high ? line->run : line->min_high;
+            if (line->steps <= 2 * CHECK_STEPS)
+            {
+                line->falls[line->steps - 1] = line->t;
+            }
+        }
+        else if (line->steps)
+        {
+            line->min_low = line->run < line->min_low ? line->run : line->min_low;
+        }
+        if (level)
+        {
+            line->first_rise = line->steps ? line->first_rise : line->t;
+            line->steps++;
+        }
+        line->level = level;
+        line->run = 0;
+    }
+    line->run += ticks;
+    line->t += ticks;
+}
+
+static void check_sink(void *user_ctx, rmt_symbol_word_t symbol)
+{
+    check_line_t *line = (check_line_t *)user_ctx;
+
+    check_line_level(line, symbol.level0, symbol.duration0);
+    check_line_level(line, symbol.level1, symbol.duration1);
+}
+
+static double check_ns(uint64_t ticks, uint32_t resolution)
+{
+    return ticks * 1e9 / resolution;
+}
+
+static bool check_move(check_stats_t *stats, const check_driver_t *driver, const stepper_pulse_t *pulse,
+                       uint32_t resolution, uint32_t freq_hz)
+{
+    rmt_symbol_word_t mem[CHECK_MEM_BLOCK_SYMBOLS];
+    rmt_fake_channel_t chan;
+    rmt_encoder_handle_t encoder = NULL;
+    stepper_motor_uniform_encoder_config_t config = {
+        .resolution = resolution,
+        .pulse = *pulse,
+        .flags.dither = 1,
+    };
+    stepper_motor_dither_payload_t payloads[2] = {
+        {.freq_hz = freq_hz, .steps = CHECK_STEPS, .first = true},
+        {.freq_hz = freq_hz, .steps = CHECK_STEPS},
+    };
+    static check_line_t line;
+    const char *broken = NULL;
+
+    if (rmt_new_stepper_motor_uniform_encoder(&config, &encoder) != ESP_OK)
+    {
+        fprintf(stderr, "%s: no encoder at %uHz resolution\n", driver->name, resolution);
+        return false;
+    }
+    memset(&line, 0, sizeof(line));
+    line.resolution = resolution;
+    line.min_high = UINT64_MAX;
+    line.min_low = UINT64_MAX;
+    rmt_fake_channel_init(&chan, mem, CHECK_MEM_BLOCK_SYMBOLS);
+    rmt_fake_channel_set_sink(&chan, check_sink, &line);
+    for (int i = 0; i < 2; i++)
+    {
+        rmt_fake_transmit(&chan, encoder, &payloads[i], sizeof(payloads[i]), 0);
+    }
+    // the channel idles low after the last transaction
+    check_line_level(&line, 0, 1);
+    rmt_del_encoder(encoder);
+
+    stepper_pulse_ticks_t ticks;
+    stepper_pulse_ticks(pulse, resolution, &ticks);
+    uint32_t max_hz = stepper_pulse_max_hz(pulse, resolution);
+    // the falling edge ends a period, the second transaction has no lead
+    double period = freq_hz > max_hz ? ticks.period_min : (double)resolution / freq_hz;
+    double measured = (double)(line.falls[2 * CHECK_STEPS - 1] - line.falls[CHECK_STEPS - 1]) / CHECK_STEPS;
+    double high_margin = check_ns(line.min_high, resolution) - pulse->high_ns;
+    double low_margin = check_ns(line.min_low, resolution) - pulse->low_ns;
+    double dir_margin = check_ns(line.first_rise, resolution) - pulse->dir_setup_ns;
+
+    if (line.steps != 2 * CHECK_STEPS)
+    {
+        broken = "steps lost";
+    }
+    else if (high_margin < 0)
+    {
+        broken = "high time below the minimum";
+    }
+    else if (low_margin < 0)
+    {
+        broken = "low time below the minimum";
+    }
+    else if (dir_margin < 0)
+    {
+        broken = "first step inside the DIR setup time";
+    }
+    else if (fabs(measured - period) * CHECK_STEPS > 1.0 + 1e-6)
+    {
+        broken = "rate off";
+    }
+
+    stats->moves++;
+    stats->high_margin_ns = high_margin < stats->high_margin_ns ? high_margin : stats->high_margin_ns;
+    stats->low_margin_ns = low_margin < stats->low_margin_ns ? low_margin : stats->low_margin_ns;
+    stats->dir_margin_ns = dir_margin < stats->dir_margin_ns ? dir_margin : stats->dir_margin_ns;
+    if (broken)
+    {
+        stats->failures++;
+        fprintf(stderr, "%s %s at %uHz resolution, %uHz: %s (%llu steps, high %.1fns, low %.1fns, lead %.1fns, period %.3f for %.3f ticks)\n",
+                driver->name, pulse->fixed ? "fixed" : "50%", resolution, freq_hz, broken, (unsigned long long)line.steps,
+                check_ns(line.min_high, resolution), check_ns(line.min_low, resolution), check_ns(line.first_rise, resolution),
+                measured, period);
+        return false;
+    }
+    return true;
+}
+
+static void check_print_header(void)
+{
+    if (check_csv)
+    {
+        printf("driver,encoding,resolution_hz,max_hz,high_ns,moves,high_margin_ns,low_margin_ns,dir_margin_ns,failures\n");
+    }
+    else
+    {
+        printf("%-8s %-6s %12s %10s %10s %6s %12s %12s %12s %8s\n", "driver", "pulse", "resolution", "max Hz",
+               "high ns", "moves", "high margin", "low margin", "dir margin", "failures");
+    }
+}
+
+static bool check_driver(const check_driver_t *driver, bool fixed)
+{
+    stepper_pulse_t pulse = driver->pulse;
+    bool ok = true;
+
+    pulse.fixed = fixed;
+    for (size_t r = 0; r < sizeof(check_resolutions) / sizeof(check_resolutions[0]); r++)
+    {
+        uint32_t resolution = check_resolutions[r] ? check_resolutions[r] : stepper_pick_pulse_resolution(CHECK_FREQ_MIN_HZ, &pulse);
+        uint32_t max_hz = stepper_pulse_max_hz(&pulse, resolution);
+        check_stats_t stats = {
+            .high_margin_ns = INFINITY,
+            .low_margin_ns = INFINITY,
+            .dir_margin_ns = INFINITY,
+        };
+
+        for (size_t f = 0; f < sizeof(check_freqs) / sizeof(check_freqs[0]); f++)
+        {
+            check_move(&stats, driver, &pulse, resolution, check_freqs[f]);
+        }
+        // both sides of the limit
+        check_move(&stats, driver, &pulse, resolution, max_hz);
+        check_move(&stats, driver, &pulse, resolution, max_hz + 1);
+
+        stepper_pulse_ticks_t ticks;
+        stepper_pulse_ticks(&pulse, resolution, &ticks);
+        double high_ns = ticks.high ? check_ns(ticks.high, resolution) : 0;
+        if (check_csv)
+        {
+            printf("%s,%s,%u,%u,%.1f,%llu,%.1f,%.1f,%.1f,%llu\n", driver->name, fixed ? "fixed" : "half", resolution, max_hz,
+                   high_ns, (unsigned long long)stats.moves, stats.high_margin_ns, stats.low_margin_ns, stats.dir_margin_ns,
+                   (unsigned long long)stats.failures);
+        }
+        else
+        {
+            printf("%-8s %-6s %12u %10u %10.1f %6llu %12.1f %12.1f %12.1f %8llu\n", driver->name, fixed ? "fixed" : "50%",
+                   resolution, max_hz, high_ns, (unsigned long long)stats.moves, stats.high_margin_ns, stats.low_margin_ns,
+                   stats.dir_margin_ns, (unsigned long long)stats.failures);
+        }
+        ok = ok && stats.failures == 0;
+    }
+    return ok;
+}
+
+int main(int argc, char **argv)
+{
+    bool ok = true;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--csv") == 0)
+        {
+            check_csv = true;
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [--csv]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    check_print_header();
+    for (size_t d = 0; d < sizeof(check_drivers) / sizeof(check_drivers[0]); d++)
+    {
+        ok = check_driver(&check_drivers[d], false) && ok;
+        ok = check_driver(&check_drivers[d], true) && ok;
+    }
+    return ok ? 0 : 1;
+}
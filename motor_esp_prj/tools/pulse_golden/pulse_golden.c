@@ -0,0 +1,806 @@
+/*
+ * Golden pulse-train regression harness.
+ *
+ * Scripted scenarios (scenarios/<name>.scn) drive the motion path of the motion executor with fake
+ * peripherals: knob counts wait on their axis, once the previous move is out the axis takes all of
+ * them as one move, samples the speed switch, sets DIR and starts counts * step_basic * speed / 2
+ * steps (an odd half step carried to the axis' next move) at the speed's rate through the axis shaper and the real RMT step generator (dither encoder, ramps when
+ * mapped) on a fake channel, as stepper_motor_jog_start does, the move ends in the done callback. Every STEP and DIR edge is captured per axis, in picoseconds
+ * from the start of the scenario, and compared edge by edge against golden/<name>.trace.
+ *
+ * A scenario line is an optional time then a command, console syntax where there is one:
+ *   @<ms>                       time of this and the following lines, in ms, never going back
+ *   knob <X|Y|Z> <counts>       the knob turned, signed x4 counts, 4 to a detent
+ *   speed <1|10|100>            the speed switch
+ *   set [--fx1 Hz] [--fx10 Hz] [--fx100 Hz] [--step N]
+ *   shape -a <axis> -t <none|zv|zvd|ei> [-f Hz] [-d ratio]
+ *   ramps [--start Hz] [--slope Hz]   map ramp_gen's image, only before the first knob
+ * Everything before the first knob is boot: set values there are the nvs ones the resolution is
+ * picked from, later sets change the speeds only, like on the chip. Task switching and the time
+ * the firmware takes between moves are not modelled, a move starts the moment its axis is free.
+ *
+ * Reported per signal: edges against the golden, the largest and the mean time delta and the
+ * first edge off by more than the tolerance. A different edge count or any delta above the
+ * tolerance fails the scenario.
+ *
+ * usage: pulse_golden [--csv] [--update] [--vcd dir] [--tol-ns N] [scenario ...]
+ *   --update  write the traces as the new goldens instead of comparing
+ *   --vcd     write <dir>/<scenario>.vcd for GTKWave, one wire per STEP and DIR pin
+ * exits non zero when a scenario fails or can't be run
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "rmt_fake.h"
+#include "stepper_motor_encoder.h"
+#include "stepper_move.h"
+#include "stepper_shaper.h"
+#include "stepper_ramp.h"
+#include "stepper_gen.h"
+
+#ifndef PULSE_GOLDEN_DIR
+#define PULSE_GOLDEN_DIR "."
+#endif
+
+#define GOLDEN_AXES 3
+#define GOLDEN_SIGNALS (GOLDEN_AXES * 2) // STEP then DIR of every axis
+#define GOLDEN_MEM_BLOCK_SYMBOLS 48      // SOC_RMT_MEM_WORDS_PER_CHANNEL on ESP32-S3
+#define GOLDEN_QUEUE_LENGTH 32           // knob turns not yet taken
+#define GOLDEN_TOL_NS 100
+#define GOLDEN_LINE_MAX 160
+#define GOLDEN_PATH_MAX 512
+#define GOLDEN_RAMP_IMAGE_SIZE 0x10000
+
+// stepper_app.c defaults
+#define GOLDEN_FREQ_x1 3000
+#define GOLDEN_FREQ_x10 15000
+#define GOLDEN_FREQ_x100 18000
+#define GOLDEN_STEP_BASIC 64
+#define GOLDEN_SPEED 1
+// tools/ramp_gen defaults
+#define GOLDEN_RAMP_SLOPE_HZ 25
+
+static const char *const golden_scenarios[] = {"knob_spin", "speed_flip", "set_shape", "ramps"};
+static const char golden_axis_names[GOLDEN_AXES] = {'X', 'Y', 'Z'};
+
+static bool golden_csv = false;
+
+typedef struct {
+    uint64_t t_ps;
+    uint8_t level;
+} golden_edge_t;
+
+typedef struct {
+    golden_edge_t *edges;
+    size_t num;
+    size_t cap;
+} golden_signal_t;
+
+typedef struct {
+    int32_t counts;
+    uint64_t t_ps; // turned at
+} golden_item_t;
+
+typedef struct {
+    rmt_symbol_word_t mem[GOLDEN_MEM_BLOCK_SYMBOLS];
+    rmt_fake_channel_t chan;
+    rmt_encoder_handle_t encoder;
+    stepper_gen_handle_t gen;
+    stepper_shaper_t shaper;
+    golden_item_t queue[GOLDEN_QUEUE_LENGTH];
+    uint32_t head;
+    uint32_t count;
+    int half;         // half step carried, as stepper_motor_jog_start
+    uint64_t free_ps; // the previous move is out
+    uint64_t t_ps;    // line time while a move is sent
+    uint32_t done;    // done callbacks of the move being sent
+    uint64_t tick_ps;
+    uint8_t step_level;
+    uint8_t dir_level;
+    golden_signal_t *step;
+    golden_signal_t *dir;
+} golden_axis_t;
+
+typedef struct {
+    golden_axis_t axes[GOLDEN_AXES];
+    golden_signal_t signals[GOLDEN_SIGNALS];
+    uint32_t freq_x1, freq_x10, freq_x100;
+    uint32_t step_basic;
+    uint32_t speed;
+    uint32_t resolution;
+    bool booted;
+    bool ramps;
+    uint32_t ramp_start_hz;
+    uint32_t ramp_slope_hz;
+    uint8_t ramp_image[GOLDEN_RAMP_IMAGE_SIZE];
+    uint64_t moves;
+} golden_machine_t;
+
+static golden_machine_t golden_machine;
+
+static void golden_signal_add(golden_signal_t *signal, uint64_t t_ps, uint8_t level)
+{
+    if (signal->num == signal->cap)
+    {
+        signal->cap = signal->cap ? signal->cap * 2 : 1024;
+        signal->edges = realloc(signal->edges, signal->cap * sizeof(golden_edge_t));
+        if (!signal->edges)
+        {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+    }
+    signal->edges[signal->num].t_ps = t_ps;
+    signal->edges[signal->num].level = level;
+    signal->num++;
+}
+
+static void golden_signal_free(golden_signal_t *signal)
+{
+    free(signal->edges);
+    memset(signal, 0, sizeof(*signal));
+}
+
+static void golden_signal_name(int index, char *name, size_t len)
+{
+    snprintf(name, len, "%c_%s", golden_axis_names[index / 2], index % 2 ? "dir" : "step");
+}
+
+static void golden_sink(void *ctx, rmt_symbol_word_t symbol)
+{
+    golden_axis_t *axis = ctx;
+    uint32_t levels[2] = {symbol.level0, symbol.level1};
+    uint32_t durations[2] = {symbol.duration0, symbol.duration1};
+
+    for (int i = 0; i < 2; i++)
+    {
+        if (durations[i] == 0)
+        {
+            continue;
+        }
+        if (levels[i] != axis->step_level)
+        {
+            axis->step_level = levels[i];
+            golden_signal_add(axis->step, axis->t_ps, axis->step_level);
+        }
+        axis->t_ps += durations[i] * axis->tick_ps;
+    }
+}
+
+static int golden_axis_of(const char *name)
+{
+    for (int i = 0; i < GOLDEN_AXES; i++)
+    {
+        if (name[0] == golden_axis_names[i] && name[1] == '\0')
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// everything up to the first move, as stepper_motor_activate
+// the fake channel ends transactions in rmt_transmit, so this fires inside stepper_gen_start
+static bool golden_on_done(stepper_gen_t *gen, void *user_ctx)
+{
+    (void)gen;
+    golden_axis_t *axis = user_ctx;
+    axis->done++;
+    return false;
+}
+
+static bool golden_boot(golden_machine_t *m)
+{
+    uint32_t freq_min = m->freq_x1;
+    freq_min = m->freq_x10 < freq_min ? m->freq_x10 : freq_min;
+    freq_min = m->freq_x100 < freq_min ? m->freq_x100 : freq_min;
+    m->resolution = stepper_pick_resolution(freq_min);
+
+    if (m->ramps)
+    {
+        // the image ramp_gen makes for these speeds
+        uint32_t speeds[3] = {m->freq_x1, m->freq_x10, m->freq_x100};
+        stepper_ramp_profile_t profiles[6];
+        uint32_t num_profiles = 0;
+        uint32_t start_hz = m->ramp_start_hz ? m->ramp_start_hz : freq_min / 2;
+        for (int i = 0; i < 3; i++)
+        {
+            if (speeds[i] <= start_hz)
+            {
+                continue;
+            }
+            uint32_t points = (speeds[i] - start_hz) / m->ramp_slope_hz + 1;
+            points = points < 2 ? 2 : points > STEPPER_RAMP_POINTS_MAX ? STEPPER_RAMP_POINTS_MAX : points;
+            profiles[num_profiles++] = (stepper_ramp_profile_t){m->resolution, start_hz, speeds[i], points};
+            profiles[num_profiles++] = (stepper_ramp_profile_t){m->resolution, speeds[i], start_hz, points};
+        }
+        if (!stepper_ramp_build(m->ramp_image, sizeof(m->ramp_image), profiles, num_profiles))
+        {
+            fprintf(stderr, "cannot build the ramp image\n");
+            return false;
+        }
+    }
+
+    stepper_motor_uniform_encoder_config_t encoder_config = {
+        .resolution = m->resolution,
+        .flags.dither = 1,
+    };
+    for (int i = 0; i < GOLDEN_AXES; i++)
+    {
+        golden_axis_t *axis = &m->axes[i];
+        rmt_fake_channel_init(&axis->chan, axis->mem, GOLDEN_MEM_BLOCK_SYMBOLS);
+        rmt_fake_channel_set_sink(&axis->chan, golden_sink, axis);
+        if (rmt_new_stepper_motor_uniform_encoder(&encoder_config, &axis->encoder) != ESP_OK)
+        {
+            return false;
+        }
+        stepper_rmt_gen_config_t gen_config = {
+            .chan = &axis->chan,
+            .encoder = axis->encoder,
+            .ramps = m->ramps ? m->ramp_image : NULL,
+            .resolution = m->resolution,
+            .on_done = golden_on_done,
+            .user_ctx = axis,
+            .flags.dither = 1,
+        };
+        if (stepper_new_rmt_gen(&gen_config, &axis->gen) != ESP_OK || !stepper_gen_can_start(axis->gen))
+        {
+            return false;
+        }
+        axis->tick_ps = 1000000000000ULL / m->resolution;
+    }
+    m->booted = true;
+    return true;
+}
+
+static void golden_shutdown(golden_machine_t *m)
+{
+    for (int i = 0; i < GOLDEN_AXES; i++)
+    {
+        if (m->axes[i].gen)
+        {
+            stepper_gen_del(m->axes[i].gen);
+        }
+        if (m->axes[i].encoder)
+        {
+            rmt_del_encoder(m->axes[i].encoder);
+        }
+    }
+    for (int i = 0; i < GOLDEN_SIGNALS; i++)
+    {
+        golden_signal_free(&m->signals[i]);
+    }
+}
+
+// the executor taking every knob count turned up to start_ps, the knob counter sums them
+static bool golden_move(golden_machine_t *m, golden_axis_t *axis, uint64_t start_ps)
+{
+    int32_t counts = 0;
+    while (axis->count && axis->queue[axis->head].t_ps <= start_ps)
+    {
+        counts += axis->queue[axis->head].counts;
+        axis->head = (axis->head + 1) % GOLDEN_QUEUE_LENGTH;
+        axis->count--;
+    }
+    int64_t halves = (int64_t)counts * m->step_basic * m->speed + axis->half;
+    int64_t move = halves / 2;
+    if (move == 0)
+    {
+        // turned back to where it was or less than a step, no move
+        axis->half = (int)halves;
+        return true;
+    }
+    axis->half = (int)(halves - move * 2);
+
+    // the speed is sampled when the move starts, not when the knob turned
+    uint32_t freq_hz = m->speed == 1 ? m->freq_x1 : m->speed == 10 ? m->freq_x10 : m->freq_x100;
+    uint8_t dir_level = move < 0; // STEP_MOTOR_SPIN_DIR_CLOCKWISE is 0
+    uint64_t steps = (uint64_t)llabs(move);
+    if (dir_level != axis->dir_level)
+    {
+        axis->dir_level = dir_level;
+        golden_signal_add(axis->dir, start_ps, dir_level);
+    }
+
+    stepper_segment_t segments[STEPPER_SHAPER_SEGMENT_MAX];
+    uint32_t num_segments = stepper_shaper_apply(&axis->shaper, freq_hz, steps, segments);
+    axis->t_ps = start_ps;
+    axis->done = 0;
+    if (stepper_gen_start(axis->gen, segments, num_segments) != ESP_OK || axis->done != 1)
+    {
+        fprintf(stderr, "axis %td: start failed or %u done callbacks\n", axis - m->axes, axis->done);
+        return false;
+    }
+    // the channel goes back to its idle level (eot_level 0) when the transaction ends
+    if (axis->step_level)
+    {
+        axis->step_level = 0;
+        golden_signal_add(axis->step, axis->t_ps, 0);
+    }
+    axis->free_ps = axis->t_ps;
+    m->moves++;
+    return true;
+}
+
+static bool golden_command(golden_machine_t *m, char *line, uint64_t t_ps, const char *where)
+{
+    char *argv[16];
+    int argc = 0;
+
+    for (char *tok = strtok(line, " \t\r\n"); tok && argc < 16; tok = strtok(NULL, " \t\r\n"))
+    {
+        argv[argc++] = tok;
+    }
+    if (argc == 0)
+    {
+        return true;
+    }
+
+    if (strcmp(argv[0], "knob") == 0 && argc == 3 && golden_axis_of(argv[1]) >= 0)
+    {
+        if (!m->booted && !golden_boot(m))
+        {
+            return false;
+        }
+        golden_axis_t *axis = &m->axes[golden_axis_of(argv[1])];
+        int32_t counts = strtol(argv[2], NULL, 0);
+        if (counts == 0 || axis->count == GOLDEN_QUEUE_LENGTH)
+        {
+            fprintf(stderr, "%s: no counts or too many turns waiting\n", where);
+            return false;
+        }
+        axis->queue[(axis->head + axis->count++) % GOLDEN_QUEUE_LENGTH] = (golden_item_t){counts, t_ps};
+        return true;
+    }
+    if (strcmp(argv[0], "speed") == 0 && argc == 2)
+    {
+        m->speed = strtoul(argv[1], NULL, 0);
+        if (m->speed == 1 || m->speed == 10 || m->speed == 100)
+        {
+            return true;
+        }
+    }
+    else if (strcmp(argv[0], "set") == 0 && argc % 2 == 1)
+    {
+        for (int i = 1; i < argc; i += 2)
+        {
+            uint32_t value = strtoul(argv[i + 1], NULL, 0);
+            uint32_t *field = strcmp(argv[i], "--fx1") == 0     ? &m->freq_x1
+                              : strcmp(argv[i], "--fx10") == 0  ? &m->freq_x10
+                              : strcmp(argv[i], "--fx100") == 0 ? &m->freq_x100
+                              : strcmp(argv[i], "--step") == 0  ? &m->step_basic
+                                                                : NULL;
+            if (!field || value == 0)
+            {
+                fprintf(stderr, "%s: unknown option %s or a zero value\n", where, argv[i]);
+                return false;
+            }
+            *field = value;
+        }
+        return true;
+    }
+    else if (strcmp(argv[0], "shape") == 0 && argc % 2 == 1)
+    {
+        int axis = -1;
+        stepper_shaper_type_t type = STEPPER_SHAPER_TYPE_MAX;
+        double freq = 40.0, damping = 0.05; // SHAPE_DEFAULT_FREQ_mHz, SHAPE_DEFAULT_DAMPING_pm
+        for (int i = 1; i < argc; i += 2)
+        {
+            if (strcmp(argv[i], "-a") == 0)
+            {
+                axis = golden_axis_of(argv[i + 1]);
+            }
+            else if (strcmp(argv[i], "-t") == 0)
+            {
+                for (int t = 0; t < STEPPER_SHAPER_TYPE_MAX; t++)
+                {
+                    type = strcmp(argv[i + 1], stepper_shaper_name(t)) == 0 ? (stepper_shaper_type_t)t : type;
+                }
+            }
+            else if (strcmp(argv[i], "-f") == 0)
+            {
+                freq = strtod(argv[i + 1], NULL);
+            }
+            else if (strcmp(argv[i], "-d") == 0)
+            {
+                damping = strtod(argv[i + 1], NULL);
+            }
+        }
+        if (axis >= 0 && type < STEPPER_SHAPER_TYPE_MAX &&
+            stepper_shaper_init(&m->axes[axis].shaper, type, (float)freq, (float)damping))
+        {
+            return true;
+        }
+    }
+    else if (strcmp(argv[0], "ramps") == 0 && argc % 2 == 1 && !m->booted)
+    {
+        m->ramps = true;
+        for (int i = 1; i < argc; i += 2)
+        {
+            if (strcmp(argv[i], "--start") == 0)
+            {
+                m->ramp_start_hz = strtoul(argv[i + 1], NULL, 0);
+            }
+            else if (strcmp(argv[i], "--slope") == 0 && strtoul(argv[i + 1], NULL, 0))
+            {
+                m->ramp_slope_hz = strtoul(argv[i + 1], NULL, 0);
+            }
+            else
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+    fprintf(stderr, "%s: bad command %s\n", where, argv[0]);
+    return false;
+}
+
+// earliest axis with a knob count waiting, UINT64_MAX when all are idle
+static uint64_t golden_next_move(golden_machine_t *m, int *which)
+{
+    uint64_t next = UINT64_MAX;
+
+    for (int i = 0; i < GOLDEN_AXES; i++)
+    {
+        golden_axis_t *axis = &m->axes[i];
+        if (axis->count == 0)
+        {
+            continue;
+        }
+        uint64_t turned = axis->queue[axis->head].t_ps;
+        uint64_t start = turned > axis->free_ps ? turned : axis->free_ps;
+        if (start < next)
+        {
+            next = start;
+            *which = i;
+        }
+    }
+    return next;
+}
+
+static bool golden_run(golden_machine_t *m, const char *path)
+{
+    FILE *file = fopen(path, "r");
+    char line[GOLDEN_LINE_MAX];
+    char where[GOLDEN_PATH_MAX + 16]; // path:line
+    uint64_t t_ps = 0;
+    int line_no = 0;
+    bool ok = true;
+
+    if (!file)
+    {
+        perror(path);
+        return false;
+    }
+    memset(m, 0, sizeof(*m));
+    m->freq_x1 = GOLDEN_FREQ_x1;
+    m->freq_x10 = GOLDEN_FREQ_x10;
+    m->freq_x100 = GOLDEN_FREQ_x100;
+    m->step_basic = GOLDEN_STEP_BASIC;
+    m->speed = GOLDEN_SPEED;
+    m->ramp_slope_hz = GOLDEN_RAMP_SLOPE_HZ;
+    for (int i = 0; i < GOLDEN_AXES; i++)
+    {
+        m->axes[i].step = &m->signals[i * 2];
+        m->axes[i].dir = &m->signals[i * 2 + 1];
+        stepper_shaper_init(&m->axes[i].shaper, STEPPER_SHAPER_NONE, 40.0f, 0.05f);
+    }
+
+    while (ok && fgets(line, sizeof(line), file))
+    {
+        char *cmd = line;
+        int which = 0;
+        line_no++;
+        snprintf(where, sizeof(where), "%s:%d", path, line_no);
+
+        char *comment = strchr(cmd, '#');
+        if (comment)
+        {
+            *comment = '\0';
+        }
+        cmd += strspn(cmd, " \t");
+        if (*cmd == '@')
+        {
+            char *end;
+            double ms = strtod(cmd + 1, &end);
+            uint64_t at = (uint64_t)llround(ms * 1e9);
+            if (end == cmd + 1 || at < t_ps)
+            {
+                fprintf(stderr, "%s: bad time, times only go forward\n", where);
+                ok = false;
+                break;
+            }
+            t_ps = at;
+            cmd = end;
+        }
+        // moves that start before this line, a line at the same time as a start goes first
+        for (uint64_t next = golden_next_move(m, &which); ok && next < t_ps; next = golden_next_move(m, &which))
+        {
+            ok = golden_move(m, &m->axes[which], next);
+        }
+        ok = ok && golden_command(m, cmd, t_ps, where);
+    }
+    fclose(file);
+    if (ok && !m->booted)
+    {
+        fprintf(stderr, "%s: no knob turned, nothing to capture\n", path);
+        ok = false;
+    }
+    if (ok)
+    {
+        int which = 0;
+        for (uint64_t next = golden_next_move(m, &which); ok && next != UINT64_MAX; next = golden_next_move(m, &which))
+        {
+            ok = golden_move(m, &m->axes[which], next);
+        }
+    }
+    return ok;
+}
+
+static bool golden_write_trace(const golden_machine_t *m, const char *name, const char *path)
+{
+    FILE *file = fopen(path, "w");
+    char signal[16];
+
+    if (!file)
+    {
+        perror(path);
+        return false;
+    }
+    fprintf(file, "# pulse_golden %s, resolution %uHz, %llu moves\n", name, m->resolution, (unsigned long long)m->moves);
+    fprintf(file, "# time_ps signal level\n");
+    for (int i = 0; i < GOLDEN_SIGNALS; i++)
+    {
+        golden_signal_name(i, signal, sizeof(signal));
+        for (size_t e = 0; e < m->signals[i].num; e++)
+        {
+            fprintf(file, "%llu %s %u\n", (unsigned long long)m->signals[i].edges[e].t_ps, signal, m->signals[i].edges[e].level);
+        }
+    }
+    fclose(file);
+    return true;
+}
+
+static bool golden_read_trace(const char *path, golden_signal_t *signals)
+{
+    FILE *file = fopen(path, "r");
+    char line[GOLDEN_LINE_MAX];
+    char name[16];
+    char signal[16];
+    unsigned long long t_ps;
+    unsigned level;
+
+    if (!file)
+    {
+        return false;
+    }
+    while (fgets(line, sizeof(line), file))
+    {
+        if (line[0] == '#' || sscanf(line, "%llu %15s %u", &t_ps, name, &level) != 3)
+        {
+            continue;
+        }
+        for (int i = 0; i < GOLDEN_SIGNALS; i++)
+        {
+            golden_signal_name(i, signal, sizeof(signal));
+            if (strcmp(signal, name) == 0)
+            {
+                golden_signal_add(&signals[i], t_ps, level);
+            }
+        }
+    }
+    fclose(file);
+    return true;
+}
+
+static bool golden_write_vcd(const golden_machine_t *m, const char *name, const char *path)
+{
+    FILE *file = fopen(path, "w");
+    size_t next[GOLDEN_SIGNALS] = {0};
+    char signal[16];
+
+    if (!file)
+    {
+        perror(path);
+        return false;
+    }
+    fprintf(file, "$comment pulse_golden %s, resolution %uHz $end\n", name, m->resolution);
+    fprintf(file, "$timescale 1ps $end\n$scope module motor $end\n");
+    for (int i = 0; i < GOLDEN_SIGNALS; i++)
+    {
+        golden_signal_name(i, signal, sizeof(signal));
+        fprintf(file, "$var wire 1 %c %s $end\n", '!' + i, signal);
+    }
+    fprintf(file, "$upscope $end\n$enddefinitions $end\n#0\n$dumpvars\n");
+    for (int i = 0; i < GOLDEN_SIGNALS; i++)
+    {
+        fprintf(file, "0%c\n", '!' + i);
+    }
+    fprintf(file, "$end\n");
+    // merge the signals in time order
+    for (;;)
+    {
+        uint64_t t = UINT64_MAX;
+        for (int i = 0; i < GOLDEN_SIGNALS; i++)
+        {
+            if (next[i] < m->signals[i].num && m->signals[i].edges[next[i]].t_ps < t)
+            {
+                t = m->signals[i].edges[next[i]].t_ps;
+            }
+        }
+        if (t == UINT64_MAX)
+        {
+            break;
+        }
+        fprintf(file, "#%llu\n", (unsigned long long)t);
+        for (int i = 0; i < GOLDEN_SIGNALS; i++)
+        {
+            for (; next[i] < m->signals[i].num && m->signals[i].edges[next[i]].t_ps == t; next[i]++)
+            {
+                fprintf(file, "%u%c\n", m->signals[i].edges[next[i]].level, '!' + i);
+            }
+        }
+    }
+    fclose(file);
+    return true;
+}
+
+// edge by edge against the golden, the timing deltas of every signal
+static bool golden_compare(const golden_machine_t *m, const char *name, const golden_signal_t *golden, double tol_ns)
+{
+    bool pass = true;
+    char signal[16];
+
+    for (int i = 0; i < GOLDEN_SIGNALS; i++)
+    {
+        const golden_signal_t *now = &m->signals[i];
+        const golden_signal_t *ref = &golden[i];
+        size_t common = now->num < ref->num ? now->num : ref->num;
+        double max_ns = 0, sum_ns = 0;
+        long long first_bad = -1;
+
+        for (size_t e = 0; e < common; e++)
+        {
+            double delta_ns = ((double)now->edges[e].t_ps - (double)ref->edges[e].t_ps) / 1000.0;
+            bool bad = fabs(delta_ns) > tol_ns || now->edges[e].level != ref->edges[e].level;
+            sum_ns += delta_ns;
+            max_ns = fabs(delta_ns) > fabs(max_ns) ? delta_ns : max_ns;
+            if (bad && first_bad < 0)
+            {
+                first_bad = e;
+            }
+        }
+        bool ok = first_bad < 0 && now->num == ref->num;
+        pass = pass && ok;
+        if (now->num == 0 && ref->num == 0)
+        {
+            continue;
+        }
+        golden_signal_name(i, signal, sizeof(signal));
+        double mean_ns = common ? sum_ns / common : 0;
+        if (golden_csv)
+        {
+            printf("%s,%s,%zu,%zu,%.3f,%.3f,%lld,%s\n", name, signal, now->num, ref->num, max_ns, mean_ns, first_bad,
+                   ok ? "ok" : "FAIL");
+        }
+        else
+        {
+            printf("  %-7s %8zu %8zu %12.3f %12.3f", signal, now->num, ref->num, max_ns, mean_ns);
+            if (first_bad >= 0)
+            {
+                printf("   edge %lld at %.3fms off by %.3fns", first_bad, now->edges[first_bad].t_ps / 1e9,
+                       ((double)now->edges[first_bad].t_ps - (double)ref->edges[first_bad].t_ps) / 1000.0);
+            }
+            else if (now->num != ref->num)
+            {
+                printf("   %+lld edges", (long long)now->num - (long long)ref->num);
+            }
+            printf("%s\n", ok ? "" : "   FAIL");
+        }
+    }
+    return pass;
+}
+
+int main(int argc, char **argv)
+{
+    const char *scenarios[32];
+    int num_scenarios = 0;
+    const char *vcd_dir = NULL;
+    bool update = false;
+    double tol_ns = GOLDEN_TOL_NS;
+    int rc = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--csv") == 0)
+        {
+            golden_csv = true;
+        }
+        else if (strcmp(argv[i], "--update") == 0)
+        {
+            update = true;
+        }
+        else if (strcmp(argv[i], "--vcd") == 0 && i + 1 < argc)
+        {
+            vcd_dir = argv[++i];
+        }
+        else if (strcmp(argv[i], "--tol-ns") == 0 && i + 1 < argc)
+        {
+            tol_ns = strtod(argv[++i], NULL);
+        }
+        else if (argv[i][0] != '-' && num_scenarios < 32)
+        {
+            scenarios[num_scenarios++] = argv[i];
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [--csv] [--update] [--vcd dir] [--tol-ns N] [scenario ...]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (num_scenarios == 0)
+    {
+        num_scenarios = sizeof(golden_scenarios) / sizeof(golden_scenarios[0]);
+        memcpy(scenarios, golden_scenarios, sizeof(golden_scenarios));
+    }
+
+    if (golden_csv)
+    {
+        printf("scenario,signal,edges,golden_edges,max_delta_ns,mean_delta_ns,first_bad_edge,result\n");
+    }
+    for (int s = 0; s < num_scenarios; s++)
+    {
+        const char *name = scenarios[s];
+        char path[GOLDEN_PATH_MAX];
+        golden_signal_t golden[GOLDEN_SIGNALS] = {0};
+        golden_machine_t *m = &golden_machine;
+
+        snprintf(path, sizeof(path), "%s/scenarios/%s.scn", PULSE_GOLDEN_DIR, name);
+        bool ok = golden_run(m, path);
+        if (ok && vcd_dir)
+        {
+            snprintf(path, sizeof(path), "%s/%s.vcd", vcd_dir, name);
+            ok = golden_write_vcd(m, name, path);
+        }
+        snprintf(path, sizeof(path), "%s/golden/%s.trace", PULSE_GOLDEN_DIR, name);
+        if (!ok)
+        {
+            printf("%s: cannot run\n", name);
+        }
+        else if (update)
+        {
+            ok = golden_write_trace(m, name, path);
+            printf("%s: %llu moves at %uHz resolution, golden written\n", name, (unsigned long long)m->moves, m->resolution);
+        }
+        else if (!golden_read_trace(path, golden))
+        {
+            printf("%s: no golden at %s, make one with --update\n", name, path);
+            ok = false;
+        }
+        else
+        {
+            if (!golden_csv)
+            {
+                printf("%s: %llu moves at %uHz resolution\n", name, (unsigned long long)m->moves, m->resolution);
+                printf("  %-7s %8s %8s %12s %12s\n", "signal", "edges", "golden", "max dt ns", "mean dt ns");
+            }
+            ok = golden_compare(m, name, golden, tol_ns);
+            if (!golden_csv)
+            {
+                printf("  %s\n", ok ? "ok" : "FAIL");
+            }
+        }
+        for (int i = 0; i < GOLDEN_SIGNALS; i++)
+        {
+            golden_signal_free(&golden[i]);
+        }
+        golden_shutdown(m);
+        if (!ok)
+        {
+            rc = 1;
+        }
+    }
+    return rc;
+}
@@ -0,0 +1,200 @@
+/*
+ * Ramp table generator, writes the image flashed into the "ramp" partition.
+ *
+ * Every speed gets an acceleration ramp from the start rate and the deceleration back down, made for
+ * the resolution the firmware runs its channels at (stepper_pick_resolution of the slowest speed, as
+ * in stepper_motor_activate). The symbols come from components/stepper_motor/stepper_ramp.c, the same
+ * smoothstep curve the curve encoder used to compute in RAM at creation. The firmware maps the
+ * partition and copies the ramps at its channel resolutions into a 16KB internal RAM pool, so the
+ * RMT isr never reads flash; ramps past that are left out, this warns when they would be.
+ *
+ * flash it with the app (the project CMakeLists picks up ramp/ramp.bin), or on its own:
+ *   parttool.py write_partition --partition-name ramp --input ramp/ramp.bin
+ *
+ * usage: ramp_gen [-o file] [--start Hz] [--slope Hz] [--resolution Hz] [speed Hz ...]
+ *        ramp_gen --dump file
+ * speeds default to FREQ_DEFAULT_x1/x10/x100, the start rate to half the slowest speed and the
+ * slope (rate gained per ramp step) to 25Hz
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "rmt_fake.h"
+#include "stepper_move.h"
+#include "stepper_ramp.h"
+
+#define GEN_SPEEDS_MAX (STEPPER_RAMP_ENTRIES_MAX / 2)
+#define GEN_PARTITION_SIZE 0x10000 // partitions_table.csv
+#define GEN_RAM_SIZE 0x4000        // STEP_RAMP_RAM_SIZE in stepper_app.c
+#define GEN_SLOPE_HZ 25
+
+static const uint32_t gen_default_speeds[] = {3000, 15000, 18000};
+
+static uint8_t gen_image[GEN_PARTITION_SIZE];
+static uint32_t gen_ram[GEN_RAM_SIZE / sizeof(uint32_t)];
+
+// time and peak acceleration of a ramp, from its symbols
+static void gen_describe(const void *image, const stepper_ramp_entry_t *entry)
+{
+    const uint32_t *words = stepper_ramp_symbols(image, entry);
+    double time_s = 0;
+    double accel_max = 0;
+    double prev_freq = 0;
+
+    for (uint32_t i = 0; i < entry->points; i++)
+    {
+        rmt_symbol_word_t symbol = {.val = words[i]};
+        double period = (double)(symbol.duration0 + symbol.duration1) / entry->resolution;
+        double freq = 1.0 / period;
+        if (i > 0)
+        {
+            double accel = (freq > prev_freq ? freq - prev_freq : prev_freq - freq) / period;
+            accel_max = accel > accel_max ? accel : accel_max;
+        }
+        prev_freq = freq;
+        time_s += period;
+    }
+    printf("  %6uHz -> %6uHz  %4u steps  %7.2fms  peak %8.0f steps/s^2  at %uHz, offset 0x%x\n",
+           entry->start_freq_hz, entry->end_freq_hz, entry->points, time_s * 1e3, accel_max, entry->resolution,
+           entry->offset);
+}
+
+static int gen_dump(const char *path)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file)
+    {
+        perror(path);
+        return 1;
+    }
+    size_t size = fread(gen_image, 1, sizeof(gen_image), file);
+    fclose(file);
+    if (!stepper_ramp_check(gen_image, size))
+    {
+        fprintf(stderr, "%s: not a valid ramp image (version %d)\n", path, STEPPER_RAMP_VERSION);
+        return 1;
+    }
+    const stepper_ramp_header_t *header = (const stepper_ramp_header_t *)gen_image;
+    printf("%s: version %u, %u ramps, %uB\n", path, header->version, header->num_entries, header->size);
+    for (uint32_t i = 0; i < header->num_entries; i++)
+    {
+        gen_describe(gen_image, &stepper_ramp_entries(gen_image)[i]);
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    const char *out = "ramp.bin";
+    uint32_t speeds[GEN_SPEEDS_MAX];
+    uint32_t num_speeds = 0;
+    uint32_t start_hz = 0;
+    uint32_t slope_hz = GEN_SLOPE_HZ;
+    uint32_t resolution = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--dump") == 0 && i + 1 < argc)
+        {
+            return gen_dump(argv[i + 1]);
+        }
+        else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+        {
+            out = argv[++i];
+        }
+        else if (strcmp(argv[i], "--start") == 0 && i + 1 < argc)
+        {
+            start_hz = strtoul(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "--slope") == 0 && i + 1 < argc)
+        {
+            slope_hz = strtoul(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "--resolution") == 0 && i + 1 < argc)
+        {
+            resolution = strtoul(argv[++i], NULL, 0);
+        }
+        else if (argv[i][0] != '-' && num_speeds < GEN_SPEEDS_MAX)
+        {
+            speeds[num_speeds++] = strtoul(argv[i], NULL, 0);
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [-o file] [--start Hz] [--slope Hz] [--resolution Hz] [speed Hz ...]\n"
+                            "       %s --dump file\n",
+                    argv[0], argv[0]);
+            return 2;
+        }
+    }
+    if (num_speeds == 0)
+    {
+        memcpy(speeds, gen_default_speeds, sizeof(gen_default_speeds));
+        num_speeds = sizeof(gen_default_speeds) / sizeof(gen_default_speeds[0]);
+    }
+
+    uint32_t slowest = UINT32_MAX;
+    for (uint32_t i = 0; i < num_speeds; i++)
+    {
+        slowest = speeds[i] < slowest ? speeds[i] : slowest;
+    }
+    if (slowest == 0 || slope_hz == 0)
+    {
+        fprintf(stderr, "speeds and slope must be above 0Hz\n");
+        return 2;
+    }
+    if (resolution == 0)
+    {
+        resolution = stepper_pick_resolution(slowest);
+    }
+    if (start_hz == 0)
+    {
+        start_hz = slowest / 2;
+    }
+
+    // an acceleration from the start rate to every speed, and the deceleration back
+    stepper_ramp_profile_t profiles[STEPPER_RAMP_ENTRIES_MAX];
+    uint32_t num_profiles = 0;
+    for (uint32_t i = 0; i < num_speeds; i++)
+    {
+        if (speeds[i] <= start_hz)
+        {
+            fprintf(stderr, "%uHz is not above the %uHz start rate, no ramp\n", speeds[i], start_hz);
+            continue;
+        }
+        uint32_t points = (speeds[i] - start_hz) / slope_hz + 1;
+        points = points < 2 ? 2 : points > STEPPER_RAMP_POINTS_MAX ? STEPPER_RAMP_POINTS_MAX : points;
+        profiles[num_profiles++] = (stepper_ramp_profile_t){resolution, start_hz, speeds[i], points};
+        profiles[num_profiles++] = (stepper_ramp_profile_t){resolution, speeds[i], start_hz, points};
+    }
+
+    size_t size = stepper_ramp_build(gen_image, sizeof(gen_image), profiles, num_profiles);
+    if (size == 0 || !stepper_ramp_check(gen_image, size))
+    {
+        fprintf(stderr, "cannot build the image: a %uHz half period must fit %d ticks at %uHz, "
+                        "and the ramps the %dB partition\n",
+                start_hz, STEPPER_RAMP_HALF_PERIOD_MAX, resolution, GEN_PARTITION_SIZE);
+        return 1;
+    }
+    FILE *file = fopen(out, "wb");
+    if (!file || fwrite(gen_image, 1, size, file) != size)
+    {
+        perror(out);
+        return 1;
+    }
+    fclose(file);
+
+    printf("%s: %u ramps, %zuB of %dB\n", out, num_profiles, size, GEN_PARTITION_SIZE);
+    for (uint32_t i = 0; i < num_profiles; i++)
+    {
+        gen_describe(gen_image, &stepper_ramp_entries(gen_image)[i]);
+    }
+    // what the firmware keeps in ram of it
+    size_t ram_size = stepper_ramp_copy(gen_ram, sizeof(gen_ram), gen_image, &resolution, 1);
+    uint32_t ram_entries = ram_size ? ((const stepper_ramp_header_t *)gen_ram)->num_entries : 0;
+    if (ram_entries < num_profiles)
+    {
+        fprintf(stderr, "warning: only %u of the %u ramps fit the firmware's %dB ram pool\n", ram_entries, num_profiles,
+                GEN_RAM_SIZE);
+    }
+    return 0;
+}
@@ -0,0 +1,208 @@
+/*
+ * Host simulation of the input shapers on a spring-mass axis.
+ *
+ * A jog move is shaped by components/stepper_motor/stepper_shaper.c exactly as the firmware does,
+ * the carriage follows the segment rates and drags a load through a damped spring. Residual
+ * vibration is the largest load error once the carriage has stopped, settle time is when the load
+ * error last leaves the tolerance band.
+ *
+ * The shaper and the plant can be given different frequencies to see how a mistuned shaper holds up.
+ *
+ * usage: shaper_sim [--csv] [--rate Hz] [--steps N] [--fn Hz] [--zeta z] [--plant-fn Hz] [--plant-zeta z] [--tol steps]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "stepper_shaper.h"
+
+#define SIM_DT_s 1e-5
+#define SIM_TAIL_s 1.0 // simulated time after the carriage stops
+
+typedef struct {
+    uint32_t rate_hz;
+    uint64_t steps;
+    float shaper_fn;
+    float shaper_zeta;
+    double plant_fn;
+    double plant_zeta;
+    double tol;
+} sim_config_t;
+
+typedef struct {
+    uint32_t segments;
+    double move_s;   // carriage motion time
+    double settle_s; // load inside the tolerance band for good
+    double residual; // peak load error after the carriage stopped, in steps
+} sim_result_t;
+
+static bool sim_csv = false;
+
+static void sim_run(const sim_config_t *cfg, const stepper_segment_t *segments, uint32_t num_segments, sim_result_t *r)
+{
+    double wn = 2 * M_PI * cfg->plant_fn;
+    double carriage = 0, load = 0, load_v = 0;
+    double t = 0;
+    double target = (double)cfg->steps;
+
+    r->segments = num_segments;
+    r->move_s = 0;
+    r->settle_s = 0;
+    r->residual = 0;
+
+    // carriage at the rate of each segment, the load chases it
+    for (uint32_t i = 0; i <= num_segments; i++)
+    {
+        double rate = i < num_segments ? segments[i].freq_hz : 0;
+        double span = i < num_segments ? (double)segments[i].steps / segments[i].freq_hz : SIM_TAIL_s;
+        uint64_t n = (uint64_t)(span / SIM_DT_s + 0.5);
+
+        if (i == num_segments)
+        {
+            r->move_s = t;
+            carriage = target;
+        }
+        for (uint64_t k = 0; k < n; k++)
+        {
+            carriage += rate * SIM_DT_s;
+            double acc = wn * wn * (carriage - load) + 2 * cfg->plant_zeta * wn * (rate - load_v);
+            load_v += acc * SIM_DT_s;
+            load += load_v * SIM_DT_s;
+            t += SIM_DT_s;
+
+            double err = fabs(load - target);
+            if (i == num_segments && err > r->residual)
+            {
+                r->residual = err;
+            }
+            if (err > cfg->tol)
+            {
+                r->settle_s = t;
+            }
+        }
+    }
+}
+
+static void sim_print_header(void)
+{
+    if (sim_csv)
+    {
+        printf("shaper,segments,move_ms,settle_ms,residual_steps,residual_pct\n");
+    }
+    else
+    {
+        printf("%-6s %8s %10s %10s %14s %12s\n", "shaper", "segments", "move ms", "settle ms", "residual steps", "residual %");
+    }
+}
+
+static void sim_print(const char *name, const sim_result_t *r, double reference)
+{
+    double pct = reference > 0 ? 100.0 * r->residual / reference : 0;
+
+    if (sim_csv)
+    {
+        printf("%s,%u,%.2f,%.2f,%.3f,%.1f\n", name, r->segments, r->move_s * 1e3, r->settle_s * 1e3, r->residual, pct);
+    }
+    else
+    {
+        printf("%-6s %8u %10.2f %10.2f %14.3f %12.1f\n", name, r->segments, r->move_s * 1e3, r->settle_s * 1e3, r->residual, pct);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    sim_config_t cfg = {
+        .rate_hz = 18000, // FREQ_DEFAULT_x100
+        .steps = 6400,    // 100 detents at the default basic step
+        .shaper_fn = 40.0f,
+        .shaper_zeta = 0.05f,
+        .plant_fn = 0,
+        .plant_zeta = -1,
+        .tol = 1.0,
+    };
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--csv") == 0)
+        {
+            sim_csv = true;
+        }
+        else if (strcmp(argv[i], "--rate") == 0 && i + 1 < argc)
+        {
+            cfg.rate_hz = strtoul(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "--steps") == 0 && i + 1 < argc)
+        {
+            cfg.steps = strtoull(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "--fn") == 0 && i + 1 < argc)
+        {
+            cfg.shaper_fn = strtof(argv[++i], NULL);
+        }
+        else if (strcmp(argv[i], "--zeta") == 0 && i + 1 < argc)
+        {
+            cfg.shaper_zeta = strtof(argv[++i], NULL);
+        }
+        else if (strcmp(argv[i], "--plant-fn") == 0 && i + 1 < argc)
+        {
+            cfg.plant_fn = strtod(argv[++i], NULL);
+        }
+        else if (strcmp(argv[i], "--plant-zeta") == 0 && i + 1 < argc)
+        {
+            cfg.plant_zeta = strtod(argv[++i], NULL);
+        }
+        else if (strcmp(argv[i], "--tol") == 0 && i + 1 < argc)
+        {
+            cfg.tol = strtod(argv[++i], NULL);
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [--csv] [--rate Hz] [--steps N] [--fn Hz] [--zeta z] [--plant-fn Hz] [--plant-zeta z] [--tol steps]\n", argv[0]);
+            return 1;
+        }
+    }
+    // the plant defaults to the mode the shaper is tuned for
+    if (cfg.plant_fn <= 0)
+    {
+        cfg.plant_fn = cfg.shaper_fn;
+    }
+    if (cfg.plant_zeta < 0)
+    {
+        cfg.plant_zeta = cfg.shaper_zeta;
+    }
+    if (cfg.rate_hz == 0 || cfg.steps == 0)
+    {
+        fprintf(stderr, "rate and steps must be non zero\n");
+        return 1;
+    }
+
+    if (!sim_csv)
+    {
+        printf("move %llu steps at %uHz, shaper %.2fHz zeta %.3f, plant %.2fHz zeta %.3f, tolerance %.2f steps\n",
+               (unsigned long long)cfg.steps, cfg.rate_hz, cfg.shaper_fn, cfg.shaper_zeta, cfg.plant_fn, cfg.plant_zeta, cfg.tol);
+    }
+    sim_print_header();
+
+    double reference = 0;
+    for (int type = STEPPER_SHAPER_NONE; type < STEPPER_SHAPER_TYPE_MAX; type++)
+    {
+        stepper_shaper_t shaper;
+        stepper_segment_t segments[STEPPER_SHAPER_SEGMENT_MAX];
+        sim_result_t r;
+
+        if (!stepper_shaper_init(&shaper, type, cfg.shaper_fn, cfg.shaper_zeta))
+        {
+            fprintf(stderr, "%s: shaper out of range, skipped\n", stepper_shaper_name(type));
+            continue;
+        }
+        uint32_t num_segments = stepper_shaper_apply(&shaper, cfg.rate_hz, cfg.steps, segments);
+        sim_run(&cfg, segments, num_segments, &r);
+        if (type == STEPPER_SHAPER_NONE)
+        {
+            reference = r.residual;
+        }
+        sim_print(stepper_shaper_name(type), &r, reference);
+    }
+
+    return 0;
+}
@@ -0,0 +1,123 @@
+/*
+ * Host check of the move splitter.
+ *
+ * components/stepper_motor/stepper_move.c splits a 64-bit step count into RMT transactions of a
+ * looped body, the way stepper_gen.c splits a segment: bodies of STEPPER_UNIFORM_MAX_SYMBOLS
+ * symbols, looped up to STEPPER_MOVE_LOOP_COUNT_MAX times. The counts are the boundaries of that
+ * split, around one body, one full hardware loop and past 32 bits.
+ *
+ * Checked per count:
+ *   sum       the chunks add up to exactly the steps asked for
+ *   chunks    no chunk has zero symbols or passes, more symbols than a body or more passes than
+ *             the hardware loop counter
+ *   count     no more than two transactions beyond the full loops
+ *
+ * usage: split_check [--csv]
+ * exits non zero when a count fails
+ */
+#include <stdio.h>
+#include <string.h>
+#include "stepper_move.h"
+
+#define CHECK_BLOCK_SYMBOLS 32 // STEPPER_UNIFORM_MAX_SYMBOLS, the body stepper_gen.c loops
+#define CHECK_FULL ((uint64_t)CHECK_BLOCK_SYMBOLS * STEPPER_MOVE_LOOP_COUNT_MAX)
+
+static const uint64_t check_counts[] = {
+    0,
+    1,
+    CHECK_BLOCK_SYMBOLS - 1,
+    CHECK_BLOCK_SYMBOLS,
+    CHECK_BLOCK_SYMBOLS + 1,
+    CHECK_FULL - 1,
+    CHECK_FULL,
+    CHECK_FULL + 1,
+    (1ULL << 32) + 1,
+    1ULL << 40,
+};
+
+static bool check_csv = false;
+
+static bool check_count(uint64_t steps)
+{
+    stepper_split_t split;
+    stepper_chunk_t chunk;
+    uint64_t sum = 0;
+    uint64_t chunks = 0;
+    uint64_t chunks_max = steps / CHECK_FULL + 2;
+    uint32_t passes_max = 0;
+    const char *broken = NULL;
+
+    stepper_split_init(&split, steps, CHECK_BLOCK_SYMBOLS, STEPPER_MOVE_LOOP_COUNT_MAX);
+    // bounded, a splitter that hands out empty chunks would never end
+    while (chunks <= chunks_max && stepper_split_next(&split, &chunk))
+    {
+        chunks++;
+        if (chunk.symbols == 0 || chunk.passes == 0)
+        {
+            broken = broken ? broken : "empty chunk";
+        }
+        else if (chunk.symbols > CHECK_BLOCK_SYMBOLS)
+        {
+            broken = broken ? broken : "chunk longer than a body";
+        }
+        else if (chunk.passes > STEPPER_MOVE_LOOP_COUNT_MAX)
+        {
+            broken = broken ? broken : "loop count over the hardware limit";
+        }
+        passes_max = chunk.passes > passes_max ? chunk.passes : passes_max;
+        sum += (uint64_t)chunk.symbols * chunk.passes;
+    }
+
+    if (!broken && chunks > chunks_max)
+    {
+        broken = "too many transactions";
+    }
+    else if (!broken && sum != steps)
+    {
+        broken = "chunks don't add up to the steps";
+    }
+
+    if (check_csv)
+    {
+        printf("%llu,%llu,%llu,%u,%s\n", (unsigned long long)steps, (unsigned long long)sum,
+               (unsigned long long)chunks, passes_max, broken ? broken : "ok");
+    }
+    else
+    {
+        printf("%16llu %16llu %10llu %10u  %s\n", (unsigned long long)steps, (unsigned long long)sum,
+               (unsigned long long)chunks, passes_max, broken ? broken : "ok");
+    }
+    return broken == NULL;
+}
+
+int main(int argc, char **argv)
+{
+    bool ok = true;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--csv") == 0)
+        {
+            check_csv = true;
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [--csv]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    if (check_csv)
+    {
+        printf("steps,sum,transactions,passes_max,result\n");
+    }
+    else
+    {
+        printf("%16s %16s %10s %10s  %s\n", "steps", "sum", "tx", "passes max", "result");
+    }
+    for (size_t i = 0; i < sizeof(check_counts) / sizeof(check_counts[0]); i++)
+    {
+        ok = check_count(check_counts[i]) && ok;
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,181 @@
+/*
+ * Host reader of the telemetry stream.
+ *
+ * Reads a raw capture of the telemetry uart (components/telemetry, "telem -r <Hz>" on the console),
+ * or the serial port itself, and writes one csv row per frame. Frames are found by their sync
+ * bytes and kept only when the crc holds, so a capture may start or break off mid frame; bytes
+ * between good frames are skipped and counted. A jump in seq is a frame the board had no room
+ * for or a frame lost on the line, both are counted as lost.
+ *
+ * Capture on a host, the port set to 2000000 baud raw first:
+ *   stty -F /dev/ttyUSB1 2000000 raw && cat /dev/ttyUSB1 > telem.bin
+ *
+ * usage: telemetry_csv [-o out.csv] [capture|-]
+ * exits non zero when the input cannot be read or holds no frame
+ */
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "telemetry_frame.h"
+
+namespace
+{
+
+const char *const axis_names[TELEMETRY_AXES] = {"x", "y", "z"};
+
+struct reader_stats
+{
+    uint64_t frames = 0;
+    uint64_t lost = 0;    // seq gaps
+    uint64_t skipped = 0; // bytes outside good frames
+    uint64_t bad = 0;     // sync found, frame rejected
+};
+
+void write_header(std::ostream &out)
+{
+    out << "seq,t_us,feed";
+    for (const char *name : axis_names)
+    {
+        out << ',' << name << "_pos," << name << "_freq_hz," << name << "_knob," << name << "_queued," << name
+            << "_pending";
+    }
+    out << '\n';
+}
+
+void write_row(std::ostream &out, const telemetry_frame_t &frame)
+{
+    out << frame.seq << ',' << frame.t_us << ',' << frame.feed;
+    for (const telemetry_axis_t &axis : frame.axis)
+    {
+        out << ',' << axis.pos << ',' << axis.freq_hz << ',' << axis.knob << ',' << unsigned(axis.queued) << ','
+            << unsigned(axis.pending);
+    }
+    out << '\n';
+}
+
+class frame_reader
+{
+public:
+    frame_reader(std::ostream &out, reader_stats &stats) : out_(out), stats_(stats) {}
+
+    void feed(const uint8_t *data, size_t len)
+    {
+        buf_.insert(buf_.end(), data, data + len);
+        size_t at = 0;
+        while (buf_.size() - at >= TELEMETRY_FRAME_SIZE)
+        {
+            telemetry_frame_t frame;
+            if (buf_[at] == (TELEMETRY_SYNC & 0xff) && buf_[at + 1] == (TELEMETRY_SYNC >> 8))
+            {
+                if (telemetry_frame_decode(&buf_[at], &frame))
+                {
+                    take(frame);
+                    at += TELEMETRY_FRAME_SIZE;
+                    continue;
+                }
+                stats_.bad++;
+            }
+            // resync one byte on, a sync pattern inside a frame fails its crc
+            stats_.skipped++;
+            at++;
+        }
+        buf_.erase(buf_.begin(), buf_.begin() + at);
+    }
+
+    // a tail shorter than a frame at the end of the input
+    void finish()
+    {
+        stats_.skipped += buf_.size();
+        buf_.clear();
+    }
+
+private:
+    void take(const telemetry_frame_t &frame)
+    {
+        // seq restarts at 0 with every telem -r, a new stream rather than a gap
+        if (stats_.frames && frame.seq > last_seq_)
+        {
+            stats_.lost += frame.seq - last_seq_ - 1;
+        }
+        last_seq_ = frame.seq;
+        stats_.frames++;
+        write_row(out_, frame);
+    }
+
+    std::ostream &out_;
+    reader_stats &stats_;
+    std::vector<uint8_t> buf_;
+    uint32_t last_seq_ = 0;
+};
+
+int usage(const char *name)
+{
+    std::cerr << "usage: " << name << " [-o out.csv] [capture|-]\n";
+    return 2;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    std::string in_path = "-";
+    std::string out_path;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (std::strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+        {
+            out_path = argv[++i];
+        }
+        else if (argv[i][0] == '-' && argv[i][1] != '\0')
+        {
+            return usage(argv[0]);
+        }
+        else
+        {
+            in_path = argv[i];
+        }
+    }
+
+    std::FILE *in = in_path == "-" ? stdin : std::fopen(in_path.c_str(), "rb");
+    if (!in)
+    {
+        std::perror(in_path.c_str());
+        return 1;
+    }
+    std::ofstream out_file;
+    if (!out_path.empty())
+    {
+        out_file.open(out_path);
+        if (!out_file)
+        {
+            std::perror(out_path.c_str());
+            return 1;
+        }
+    }
+    std::ostream &out = out_path.empty() ? std::cout : out_file;
+
+    reader_stats stats;
+    frame_reader reader(out, stats);
+    write_header(out);
+    uint8_t chunk[4096];
+    size_t len;
+    while ((len = std::fread(chunk, 1, sizeof(chunk), in)) > 0)
+    {
+        reader.feed(chunk, len);
+    }
+    reader.finish();
+    if (in != stdin)
+    {
+        std::fclose(in);
+    }
+
+    std::cerr << stats.frames << " frames, " << stats.lost << " lost, " << stats.bad << " bad, " << stats.skipped
+              << " bytes skipped\n";
+    return stats.frames ? 0 : 1;
+}